@@ -31,6 +31,7 @@
 #include "DbfColContainer.h"
 #include "../Generic/HighlightState.h"
 #include "../GdaConst.h"
+#include "../GdaParallel.h"
 #include "../GeneralWxUtils.h"
 #include "../GenUtils.h"
 #include "../logger.h"
@@ -41,7 +42,7 @@
 
 DbfColContainer::DbfColContainer()
 : size(0), undefined_initialized(false), raw_data(0),
-l_vec(0), d_vec(0), s_vec(0)
+l_vec(0), d_vec(0), s_vec(0), dirty_all(true)
 {
 	info.type = GdaConst::unknown_type;
 }
@@ -65,9 +66,8 @@ bool DbfColContainer::Init(int size_s,
 	info = field_info_s;
 	size = size_s;
 	
-	stale_min_max_val = true;
-	min_val = 0;
-	max_val = 0;
+	stale_summary = true;
+	summary.Reset();
 	
 	// if mark_all_defined is true, then mark all as begin defined.
 	undefined.resize(size_s);
@@ -76,6 +76,7 @@ bool DbfColContainer::Init(int size_s,
 	
 	if (alloc_raw_data) AllocRawData();	
 	if (alloc_vector_data) AllocVecData();
+	MarkAllDirty();
 
 	return true;
 }
@@ -165,31 +166,61 @@ int DbfColContainer::GetDecimals()
 
 void DbfColContainer::GetMinMaxVals(double& min_v, double& max_v)
 {
-	UpdateMinMaxVals();
-	min_v = min_val;
-	max_v = max_val;
+	UpdateSummary();
+	min_v = summary.min;
+	max_v = summary.max;
 }
 
-void DbfColContainer::UpdateMinMaxVals()
+void DbfColContainer::GetSummary(Gda::ColumnSummary& s)
+{
+	UpdateSummary();
+	s = summary;
+}
+
+void DbfColContainer::UpdateSummary()
 {
 	if (GetType() != GdaConst::double_type &&
 		GetType() != GdaConst::long64_type) return;
-	if (stale_min_max_val) {
+	// an edit that removed the current min or max needs a full pass
+	if (stale_summary || !summary.minmax_valid) {
 		std::vector<double> vals;
 		GetVec(vals);
-		min_val = vals[0];
-		max_val = vals[0];
-		for (int i=0; i<size; i++) {
-			if (vals[i] < min_val) {
-				min_val = vals[i];
-			} else if (vals[i] > max_val) {
-				max_val = vals[i];
-			}
-		}
-		stale_min_max_val = false;
+		CheckUndefined();
+		Gda::Summarize(vals, undefined, summary);
+		stale_summary = false;
+	}
+}
+
+void DbfColContainer::GetCellNumeric(int row, double& val, bool& undef)
+{
+	val = 0;
+	undef = true;
+	if (row < 0 || row >= size) return;
+	if (GetType() != GdaConst::double_type &&
+		GetType() != GdaConst::long64_type) return;
+	CheckUndefined();
+	undef = undefined[row];
+	if (IsVecDataAlloc()) {
+		val = (GetType() == GdaConst::double_type ?
+			   d_vec[row] : (double) l_vec[row]);
+	} else if (IsRawDataAlloc()) {
+		if (!DbfFileUtils::ParseDouble(raw_data + row*(info.field_len+1),
+									   info.field_len, &val)) val = 0;
 	}
 }
 
+void DbfColContainer::UpdateSummaryCell(int row, double old_val,
+										bool old_undef)
+{
+	if (stale_summary) return;
+	if (GetType() != GdaConst::double_type &&
+		GetType() != GdaConst::long64_type) return;
+	double new_val;
+	bool new_undef;
+	GetCellNumeric(row, new_val, new_undef);
+	summary.Replace(old_val, old_undef, new_val, new_undef);
+}
+
 // Change Properties will convert data to vector format if length or
 // decimals are changed.
 bool DbfColContainer::ChangeProperties(int new_len, int new_dec)
@@ -272,6 +303,8 @@ bool DbfColContainer::ChangeProperties(int new_len, int new_dec)
 	
 	if (IsRawDataAlloc()) FreeRawData();
 	info.field_len = new_len;
+	MarkAllDirty();
+	stale_summary = true;
 	return true;
 }
 
@@ -280,9 +313,34 @@ bool DbfColContainer::ChangeName(const wxString& new_name)
 {
 	if (!DbfFileUtils::isValidFieldName(new_name)) return false;
 	info.name = new_name;
+	MarkAllDirty();
 	return true;
 }
 
+void DbfColContainer::MarkDirty(int row)
+{
+	if (dirty_all) return;
+	// Once a good fraction of the column has changed it is cheaper to
+	// write the whole column than to patch cells one at a time.
+	if (dirty_rows.size() >= (size_t) (size/8)) {
+		MarkAllDirty();
+	} else {
+		dirty_rows.insert(row);
+	}
+}
+
+void DbfColContainer::MarkAllDirty()
+{
+	dirty_all = true;
+	dirty_rows.clear();
+}
+
+void DbfColContainer::ClearDirty()
+{
+	dirty_all = false;
+	dirty_rows.clear();
+}
+
 bool DbfColContainer::sprintf_period_for_decimal()
 {
 	char buf[10];
@@ -316,6 +374,24 @@ void DbfColContainer::GetVec(std::vector<double>& vec)
 	}
 }
 
+void DbfColContainer::GetVec(const PanelView<double>& vec)
+{
+	if (GetType() != GdaConst::double_type &&
+		GetType() != GdaConst::long64_type) return;
+	if (!IsVecDataAlloc() && IsRawDataAlloc()) CopyRawDataToVector();
+	if (IsVecDataAlloc()) {
+		if (GetType() == GdaConst::double_type) {
+			for (int i=0; i<size; i++) vec[i] = d_vec[i];
+		} else {
+			for (int i=0; i<size; i++) vec[i] = (double) l_vec[i];
+		}
+	} else {
+		std::vector<double> t;
+		GetVec(t);
+		for (int i=0; i<size; i++) vec[i] = t[i];
+	}
+}
+
 // Allow for filling of long64 from double field
 void DbfColContainer::GetVec(std::vector<wxInt64>& vec)
 {
@@ -375,8 +451,8 @@ void DbfColContainer::SetFromVec(const std::vector<double>& vec)
 			d_vec[i] = undefined[i] ? 0 : vec[i];
 		}
 	}
-	stale_min_max_val = true;
-	UpdateMinMaxVals();
+	MarkAllDirty();
+	stale_summary = true;
 }
 
 void DbfColContainer::SetFromVec(const std::vector<wxInt64>& vec)
@@ -395,8 +471,8 @@ void DbfColContainer::SetFromVec(const std::vector<wxInt64>& vec)
 	} else { // must be double_type
 		for (int i=0; i<size; i++) d_vec[i] = (double) vec[i];
 	}
-	stale_min_max_val = true;
-	UpdateMinMaxVals();
+	MarkAllDirty();
+	stale_summary = true;
 }
 
 void DbfColContainer::SetFromVec(const std::vector<wxString>& vec)
@@ -408,7 +484,8 @@ void DbfColContainer::SetFromVec(const std::vector<wxString>& vec)
 	for (int i=0; i<size; i++) undefined[i] = false;
 	undefined_initialized = true;
 	for (int i=0; i<size; i++) s_vec[i] = vec[i];
-	stale_min_max_val = false;
+	MarkAllDirty();
+	stale_summary = true;
 }
 
 void DbfColContainer::SetUndefined(const std::vector<bool>& undef_vec)
@@ -416,6 +493,8 @@ void DbfColContainer::SetUndefined(const std::vector<bool>& undef_vec)
 	if (undefined.size() != size) undefined.resize(size);
 	CheckUndefined();
 	for (int i=0; i<size; i++) undefined[i] = undef_vec[i];
+	MarkAllDirty();
+	stale_summary = true;
 }
 
 void DbfColContainer::GetUndefined(std::vector<bool>& undef_vec)
@@ -439,15 +518,9 @@ void DbfColContainer::CheckUndefined()
 		if (IsRawDataAlloc()) {
 			char* buf=raw_data;
 			for (int i=0; i<size; i++) {
-				// we are not using atof since we it seems to be difficult
-				// to choose a US locale on all systems so as to assume the
-				// DBF-required use of '.' for the decimal character
-				wxString temp(buf);
-				temp.Trim(true);
-				temp.Trim(false);
 				double x;
-				bool r = temp.ToCDouble(&x);
-				undefined[i] = !(r && boost::math::isfinite<double>(x));
+				undefined[i] = !DbfFileUtils::ParseDouble(buf, info.field_len,
+														  &x);
 				buf += inc;
 			}	
 		} else {
@@ -459,7 +532,9 @@ void DbfColContainer::CheckUndefined()
 		if (IsRawDataAlloc()) {
 			char* buf=raw_data;
 			for (int i=0; i<size; i++) {
-				undefined[i] = !GenUtils::validInt(buf);
+				wxInt64 x;
+				undefined[i] = !DbfFileUtils::ParseInt64(buf, info.field_len,
+														 &x);
 				buf += inc;
 			}
 		} else {
@@ -477,20 +552,7 @@ void DbfColContainer::raw_data_to_vec(std::vector<double>& vec)
 	}
 	if (GetType() == GdaConst::unknown_type ||
 		GetType() == GdaConst::placeholder_type) return;
-	CheckUndefined();
-	const int inc = info.field_len+1;
-	char* buf=raw_data;
-	for (int i=0; i<size; i++) {
-		// we are not using atof since we it seems to be difficult
-		// to choose a US locale on all systems so as to assume the
-		// DBF-required use of '.' for the decimal character
-		wxString temp(buf);
-		temp.Trim(true);
-		temp.Trim(false);
-		bool r = temp.ToCDouble(&vec[i]);
-		undefined[i] = !(r && boost::math::isfinite<double>(vec[i]));
-		buf += inc;
-	}
+	raw_data_to_vec(&vec[0]);
 }
 
 void DbfColContainer::raw_data_to_vec(double* vec)
@@ -498,19 +560,16 @@ void DbfColContainer::raw_data_to_vec(double* vec)
 	if (!vec) return;
 	if (GetType() == GdaConst::unknown_type ||
 		GetType() == GdaConst::placeholder_type) return;
-	CheckUndefined();
+	// every value is checked below, so there is no need to
+	// call CheckUndefined first
+	if (undefined.size() != size) undefined.resize(size);
+	undefined_initialized = true;
 	const int inc = info.field_len+1;
 	char* buf=raw_data;
 	for (int i=0; i<size; i++) {
-		// we are not using atof since we it seems to be difficult
-		// to choose a US locale on all systems so as to assume the
-		// DBF-required use of '.' for the decimal character
-		wxString temp(buf);
-		temp.Trim(true);
-		temp.Trim(false);
-		vec[i] = 0;
-		bool r = temp.ToCDouble(&vec[i]);
-		undefined[i] = !(r && boost::math::isfinite<double>(vec[i]));
+		// locale-independent, so always uses the DBF-required '.'
+		undefined[i] = !DbfFileUtils::ParseDouble(buf, info.field_len,
+												  &vec[i]);
 		buf += inc;
 	}
 }
@@ -523,14 +582,7 @@ void DbfColContainer::raw_data_to_vec(std::vector<wxInt64>& vec)
 	}
 	if (GetType() == GdaConst::unknown_type ||
 		GetType() == GdaConst::placeholder_type) return;
-	CheckUndefined();
-	const int inc = info.field_len+1;
-	char* buf=raw_data;
-	for (int i=0; i<size; i++) {
-		undefined[i] = !GenUtils::validInt(buf);
-		GenUtils::strToInt64(buf, &vec[i]);  // will set to 0 if undefined
-		buf += inc;
-	}
+	raw_data_to_vec(&vec[0]);
 }
 
 void DbfColContainer::raw_data_to_vec(wxInt64* vec)
@@ -538,13 +590,14 @@ void DbfColContainer::raw_data_to_vec(wxInt64* vec)
 	if (!vec) return;
 	if (GetType() == GdaConst::unknown_type ||
 		GetType() == GdaConst::placeholder_type) return;
-	CheckUndefined();
+	if (undefined.size() != size) undefined.resize(size);
+	undefined_initialized = true;
 	const int inc = info.field_len+1;
 	char* buf=raw_data;
 	for (int i=0; i<size; i++) {
-		undefined[i] = !GenUtils::validInt(buf);
-		vec[i] = 0;
-		GenUtils::strToInt64(buf, &vec[i]);  // will set to 0 if undefined
+		// will set to 0 if undefined
+		undefined[i] = !DbfFileUtils::ParseInt64(buf, info.field_len,
+												 &vec[i]);
 		buf += inc;
 	}
 }
@@ -581,7 +634,6 @@ void DbfColContainer::raw_data_to_vec(wxString* vec)
 
 void DbfColContainer::d_vec_to_raw_data()
 {
-	char temp[255];
 	if (GetType() == GdaConst::unknown_type ||
 		GetType() == GdaConst::placeholder_type) return;
 	const int inc = info.field_len+1;
@@ -594,23 +646,16 @@ void DbfColContainer::d_vec_to_raw_data()
 		if (undefined[i]) {
 			for (int j=0; j<info.field_len; j++) buf[j] = ' ';
 		} else {
-			sprintf(temp, "%#*.*f", info.field_len,
-					info.decimals, d_vec[i]);
-			for (int j=0; j<info.field_len; j++) buf[j] = temp[j];
+			DbfFileUtils::FormatDouble(d_vec[i], info.field_len,
+									   info.decimals, buf);
 		}
 		buf[info.field_len] = '\0';
 		buf += inc;
 	}
-	if (!sprintf_period_for_decimal()) {
-		for (int i=0, iend=size*inc; i<iend; i++) {
-			if (raw_data[i] == ',') raw_data[i] = '.';
-		}
-	}
 }
 
 void DbfColContainer::l_vec_to_raw_data()
 {
-	char temp[255];
 	if (GetType() == GdaConst::unknown_type ||
 		GetType() == GdaConst::placeholder_type) return;
 	const int inc = info.field_len+1;
@@ -619,8 +664,7 @@ void DbfColContainer::l_vec_to_raw_data()
 		if (undefined[i]) {
 			for (int j=0; j<info.field_len; j++) buf[j] = ' ';
 		} else {
-			sprintf(temp, "%*lld", info.field_len, l_vec[i]);
-			for (int j=0; j<info.field_len; j++) buf[j] = temp[j];
+			DbfFileUtils::FormatInt64(l_vec[i], info.field_len, buf);
 		}
 		buf[info.field_len] = '\0';
 		buf += inc;
@@ -667,6 +711,9 @@ void DbfColContainer::CopyRawDataToVector()
 		default:
 			break;
 	}
+	// the undefined flags were set above, so the raw strings are no longer
+	// needed until the column is written out again
+	FreeRawData();
 }
 
 
@@ -699,3 +746,66 @@ void DbfColContainer::CopyVectorToRawData()
 			break;
 	}
 }
+
+namespace {
+	/** Converts the numeric columns in a range in place.  Each column only
+	 touches its own buffers, so columns can be handled by any thread. */
+	struct DbfColConvertTask {
+		DbfColConvertTask(const std::vector<DbfColContainer*>& cols_s,
+						  bool to_vector_s)
+		: cols(cols_s), to_vector(to_vector_s) {}
+		void operator()(int start, int end, int) {
+			for (int i=start; i<end; i++) {
+				if (to_vector) {
+					cols[i]->CopyRawDataToVector();
+				} else {
+					cols[i]->CopyVectorToRawData();
+				}
+			}
+		}
+		const std::vector<DbfColContainer*>& cols;
+		bool to_vector;
+	};
+	
+	bool IsDbfNumericCol(DbfColContainer* c)
+	{
+		return (c->GetType() == GdaConst::double_type ||
+				c->GetType() == GdaConst::long64_type ||
+				c->GetType() == GdaConst::date_type);
+	}
+}
+
+void DbfColContainer::CopyRawDataToVectors(
+								const std::vector<DbfColContainer*>& cols,
+								bool numeric_only)
+{
+	std::vector<DbfColContainer*> num_cols;
+	for (size_t i=0; i<cols.size(); i++) {
+		if (!cols[i] || !cols[i]->IsRawDataAlloc() ||
+			cols[i]->IsVecDataAlloc()) continue;
+		if (IsDbfNumericCol(cols[i])) {
+			num_cols.push_back(cols[i]);
+		} else if (!numeric_only) {
+			// wxString conversions stay on the calling thread
+			cols[i]->CopyRawDataToVector();
+		}
+	}
+	DbfColConvertTask task(num_cols, true);
+	Gda::ParallelFor(num_cols.size(), task);
+}
+
+void DbfColContainer::CopyVectorsToRawData(
+								const std::vector<DbfColContainer*>& cols)
+{
+	std::vector<DbfColContainer*> num_cols;
+	for (size_t i=0; i<cols.size(); i++) {
+		if (!cols[i] || cols[i]->IsRawDataAlloc()) continue;
+		if (IsDbfNumericCol(cols[i])) {
+			num_cols.push_back(cols[i]);
+		} else {
+			cols[i]->CopyVectorToRawData();
+		}
+	}
+	DbfColConvertTask task(num_cols, false);
+	Gda::ParallelFor(num_cols.size(), task);
+}
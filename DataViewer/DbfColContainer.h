@@ -21,11 +21,14 @@
 #define __GEODA_CENTER_DBF_COL_CONTAINER_H__
 
 #include <map>
+#include <set>
 #include <vector>
 #include <wx/filename.h>
 #include <wx/grid.h>
+#include "SpaceTimePanel.h"
 #include "TableStateObserver.h"
 #include "../GdaConst.h"
+#include "../GdaReduce.h"
 #include "../Generic/HighlightStateObserver.h"
 #include "../ShapeOperations/DbfFile.h"
 
@@ -43,14 +46,15 @@
  an entire column is written, it is only written into to the vector, and
  raw_data is deleted.  When an entire column is read in (for example by
  Scatter Plot), then we must first create the vector if it doesn't already
- exist.
+ exist.  Once the vector is filled raw_data is deleted, so that a decoded
+ column is not held in memory twice.
  
  So, in summary, whenever both raw_data and corresponding vector exist,
  single cell updates are written to both, but entire column updates
  only go to the vector and the raw_data is deleted.  When data is
- written to disk, the raw_data is created once again.  At any given time
- it is therefore possible to have just the raw_data, just the vector, or
- both raw_data and vector.  When providing values to wxGrid, we will
+ written to disk, the raw_data is created once again for the write.  At
+ any given time it is therefore possible to have just the raw_data, just
+ the vector, or both raw_data and vector.  When providing values to wxGrid, we will
  always pull the value from vector first, and then raw_data.  In either
  case, we must check the undefined flag. When writing a column of data,
  we will likely also pass in an optional boolean vector of undefined flags.
@@ -109,12 +113,23 @@ public:
 	int GetDecimals();
 	
 	void GetMinMaxVals(double& min_val, double& max_val);
+	/** Statistics of the defined values of a numeric column.  Computed on
+	 first use, then kept up to date by UpdateSummaryCell for single cell
+	 edits and recomputed after any change to the whole column. */
+	void GetSummary(Gda::ColumnSummary& s);
+	/** Value of a numeric cell as double. */
+	void GetCellNumeric(int row, double& val, bool& undef);
+	/** Call after cell row changed from old_val / old_undef. */
+	void UpdateSummaryCell(int row, double old_val, bool old_undef);
 	
 	// Function to change properties.
 	bool ChangeProperties(int new_len, int new_dec=0);
 	bool ChangeName(const wxString& new_name);
 	
 	void GetVec(std::vector<double>& vec);
+	/** Write the values into a (possibly strided) panel slice of length
+	 size without an intermediate vector. */
+	void GetVec(const PanelView<double>& vec);
 	void GetVec(std::vector<wxInt64>& vec);
 	void GetVec(std::vector<wxString>& vec);
 	
@@ -130,14 +145,36 @@ public:
 	void CopyRawDataToVector();
 	void CopyVectorToRawData();
 	
-	void UpdateMinMaxVals();
-	bool stale_min_max_val;
+	/** Bulk versions of the above for many columns at once.  Numeric
+	 columns are converted in parallel, one column per task; string
+	 columns are converted on the calling thread.  Columns that already
+	 have the target data are skipped.  Like CopyRawDataToVector, the
+	 raw_data of each converted column is freed. */
+	static void CopyRawDataToVectors(const std::vector<DbfColContainer*>& cols,
+									 bool numeric_only);
+	static void CopyVectorsToRawData(const std::vector<DbfColContainer*>& cols);
+	
+	void UpdateSummary();
+	bool stale_summary;
+	
+	/** Dirty tracking for incremental saves.  A column is fully dirty
+	 when it is new, when its properties or name change, or when it is
+	 replaced as a whole.  Otherwise individual cell edits are recorded
+	 by row.  The owning table clears the flags after a successful save. */
+	void MarkDirty(int row);
+	void MarkAllDirty();
+	void ClearDirty();
+	bool IsDirty() { return dirty_all || !dirty_rows.empty(); }
+	bool IsAllDirty() { return dirty_all; }
+	const std::set<int>& GetDirtyRows() { return dirty_rows; }
 	
 private:
 	GdaConst::FieldInfo info;
 	
-	double min_val;
-	double max_val;	
+	bool dirty_all;
+	std::set<int> dirty_rows;
+	
+	Gda::ColumnSummary summary;
 	
 	void raw_data_to_vec(std::vector<double>& vec);
 	void raw_data_to_vec(double* vec);
@@ -18,9 +18,12 @@
  */
 
 #include <limits>
+#include <string.h>
 #include <set>
 #include <boost/foreach.hpp>
 #include <boost/math/special_functions/fpclassify.hpp>
+#include <wx/datetime.h>
+#include <wx/filefn.h>
 #include <wx/grid.h>
 #include <wx/regex.h>
 
@@ -106,21 +109,37 @@ var_order(var_order_ptree)
 	}
 	
 	// Note: first byte of every DBF row is the record deletion flag, so
-	// we always skip this.
+	// we always skip this.  Records are read in large blocks and then
+	// scattered into the columns.
 	int del_flag_len = 1;  // the record deletion flag
+	int rec_len = del_flag_len;
+	for (int col=0; col<cols; col++) rec_len += desc_vec[col].length;
+	const int block_rows = GenUtils::max<int>(1, (1 << 20) / rec_len);
+	std::vector<char> block((size_t) block_rows * rec_len);
 	dbf.file.seekg(dbf.header.header_length, std::ios::beg);
-	for (int row=0; row<rows; row++) {
-		dbf.file.seekg(del_flag_len, std::ios::cur);
+	for (int row=0; row<rows; row+=block_rows) {
+		int n_rows = GenUtils::min<int>(block_rows, rows-row);
+		dbf.file.read(&block[0], (std::streamsize) n_rows * rec_len);
+		int offset = del_flag_len;
 		for (int col=0; col<cols; col++) {
 			int field_len = desc_vec[col].length;
 			DbfColContainer* c_ptr = quick_map[col];
-			//LOG(dbf.file.tellg());
-			dbf.file.read((char*)(c_ptr->raw_data + row*(field_len+1)),
-						  field_len);
-			c_ptr->raw_data[row*(field_len+1)+field_len] = '\0';
-			//LOG_MSG(wxString((char*)(c_ptr->raw_data + row*(field_len+1))));
+			const char* src = &block[0] + offset;
+			char* dst = c_ptr->raw_data + (size_t) row*(field_len+1);
+			for (int r=0; r<n_rows; r++) {
+				memcpy(dst, src, field_len);
+				dst[field_len] = '\0';
+				src += rec_len;
+				dst += field_len+1;
+			}
+			offset += field_len;
 		}
 	}
+	
+	// Everything now matches the file on disk.
+	for (size_t i=0; i<quick_map.size(); ++i) quick_map[i]->ClearDirty();
+	clean_file_name = dbf.fname;
+	
 	time_state->SetTimeIds(var_order.GetTimeIdsRef());
 	is_valid = true;
 	LOG_MSG("Exiting DbfTable::DbfTable");
@@ -395,6 +414,8 @@ void DbfTable::GetColData(int col, GdaFlexValue& data)
 	GetDbfCols(col, cols);
 	size_t tms = cols.size();
 	data.SetSize(rows, tms);
+	// decode all time periods at once, in parallel
+	DbfColContainer::CopyRawDataToVectors(cols, true);
 	std::vector<double> vec;
 	std::valarray<double>& V = data.GetValArrayRef();
 	std::valarray<double> v_tmp(rows);
@@ -421,6 +442,8 @@ void DbfTable::GetColData(int col, d_array_type& dbl_data)
 	GetDbfCols(col, cols);
 	size_t tms = cols.size();
 	dbl_data.resize(boost::extents[tms][rows]);
+	// decode all time periods at once, in parallel
+	DbfColContainer::CopyRawDataToVectors(cols, true);
 	std::vector<double> vec;
 	for (size_t t=0; t<tms; ++t) {
 		if (cols[t]) {
@@ -435,6 +458,25 @@ void DbfTable::GetColData(int col, d_array_type& dbl_data)
 	}
 }
 
+void DbfTable::GetColPanel(int col, SpaceTimePanel& panel,
+						   SpaceTimePanel::Layout layout)
+{
+	if (col < 0 || col >= var_order.GetNumVarGroups()
+		|| !IsColNumeric(col)) return;
+	std::vector<DbfColContainer*> cols;
+	GetDbfCols(col, cols);
+	panel.Resize(cols.size(), rows, layout);
+	// decode all time periods at once, in parallel
+	DbfColContainer::CopyRawDataToVectors(cols, true);
+	for (size_t t=0; t<cols.size(); ++t) {
+		if (!cols[t]) continue; // placeholders stay 0
+		SpaceTimePanel::view v(panel.TimeSlice(t));
+		cols[t]->CheckUndefined();
+		cols[t]->GetVec(v);
+		for (size_t i=0; i<rows; i++) if (cols[t]->undefined[i]) v[i] = 0;
+	}
+}
+
 void DbfTable::GetColData(int col, int time, std::vector<double>& data)
 {
 	if (col < 0 || col >= var_order.GetNumVarGroups()
@@ -528,6 +570,16 @@ void DbfTable::GetMinMaxVals(int col, int time,
 	c->GetMinMaxVals(min_val, max_val);
 }
 
+void DbfTable::GetColSummary(int col, int time, Gda::ColumnSummary& summary)
+{
+	summary.Reset();
+	if (col < 0 || col >= var_order.GetNumVarGroups()) return;
+	if (!IsColNumeric(col)) return;
+	DbfColContainer* c = FindDbfCol(col, time);
+	if (!c) return;
+	c->GetSummary(summary);
+}
+
 void DbfTable::SetColData(int col, int time,
 						  const std::vector<double>& data)
 {
@@ -806,8 +858,10 @@ bool DbfTable::SetCellFromString(int row, int col, int time,
 		buf[field_len] = '\0';
 	}
 	
-	c->stale_min_max_val = true;
-	c->UpdateMinMaxVals();
+	// keep the cached statistics of numeric columns current
+	double old_val;
+	bool old_undef;
+	c->GetCellNumeric(row, old_val, old_undef);
 	
 	// assume defined by default
 	c->undefined[row] = false;
@@ -907,14 +961,8 @@ bool DbfTable::SetCellFromString(int row, int col, int time,
 				if (c->undefined[row]) {
 					for (int j=0; j<field_len; j++) buf[j] = ' ';
 				} else {
-					sprintf(temp, "%#*.*f", field_len,
-							c->GetDecimals(), d_val);
-					for (int j=0; j<field_len; j++) buf[j] = temp[j];
-					if (!DbfColContainer::sprintf_period_for_decimal()) {
-						for (int j=0; j<field_len; j++) {
-							if (buf[j] == ',') buf[j] = '.';
-						}
-					}
+					DbfFileUtils::FormatDouble(d_val, field_len,
+											   c->GetDecimals(), buf);
 				}
 			}
 			break;
@@ -943,6 +991,8 @@ bool DbfTable::SetCellFromString(int row, int col, int time,
 		default:
 			break;
 	}
+	c->MarkDirty(row);
+	c->UpdateSummaryCell(row, old_val, old_undef);
 	table_state->SetColDataChangeEvtTyp(c->GetName(), col);
 	table_state->notifyObservers();
 	SetChangedSinceLastSave(true);
@@ -1209,17 +1259,13 @@ void DbfTable::RenameTimeStep(int time, const wxString& new_name)
 	table_state->notifyObservers();
 }
 
+/** Writes the table to fname.  When fname is the file the table was last
+ loaded from or saved to, and its layout still matches the table, only the
+ dirty fields are patched in place, so the cost of a save is proportional
+ to the size of the change.  Otherwise the whole file is written to a
+ temporary file next to fname which then replaces fname. */
 bool DbfTable::WriteToDbf(const wxString& fname, wxString& err_msg)
 {
-	std::ofstream out_file;	
-	out_file.open(GET_ENCODED_FILENAME(fname),
-				  std::ios::out | std::ios::binary);
-	
-	if (!(out_file.is_open() && out_file.good())) {
-		err_msg += "Problem opening \"" + fname + "\"";
-		return false;
-	}
-	
 	// a mapping from displayed col order to actual col ids in table
 	// Eg, in underlying table, we might have A, B, C, D, E, F,
 	// but because of user wxGrid col reorder operaions might see these
@@ -1228,15 +1274,166 @@ bool DbfTable::WriteToDbf(const wxString& fname, wxString& err_msg)
 	// We must write the DBF in the current displayed column order
 	// However, with since we allow grouped columns, we have to expand
 	// each group and ignore placeholders.
+	std::vector<DbfColContainer*> dbf_cols;
+	GetAllSimpleDbfCols(dbf_cols);
+	
+	// Finish any earlier in-place save of fname that was interrupted before
+	// its layout is compared with the table.
+	if (!DbfFileUtils::ApplyDbfJournal(fname, err_msg)) return false;
+	
+	DbfFileHeader disk_header;
+	bool success;
+	if (CanPatchDbf(fname, dbf_cols, disk_header)) {
+		success = PatchDbf(fname, dbf_cols, disk_header, err_msg);
+	} else {
+		success = RewriteDbf(fname, dbf_cols, err_msg);
+	}
+	if (!success) return false;
+	
+	for (std::map<wxString, DbfColContainer*>::iterator it=var_map.begin();
+		 it != var_map.end(); it++) {
+		it->second->ClearDirty();
+		// raw_data was only recreated for writing
+		if (it->second->IsVecDataAlloc()) it->second->FreeRawData();
+	}
+	clean_file_name = fname;
+	SetChangedSinceLastSave(false);
+	return true;
+}
+
+/** True if fname holds the last saved state of this table and its header
+ and field descriptors match dbf_cols exactly, so that every field can be
+ located by offset.  The header read from disk is returned in header. */
+bool DbfTable::CanPatchDbf(const wxString& fname,
+						   const std::vector<DbfColContainer*>& dbf_cols,
+						   DbfFileHeader& header)
+{
+	if (clean_file_name.IsEmpty() ||
+		!wxFileName(fname).SameAs(wxFileName(clean_file_name)) ||
+		!wxFileExists(fname)) return false;
+	
+	DbfFileReader dbf(fname);
+	if (!dbf.isDbfReadSuccess()) return false;
+	header = dbf.getFileHeader();
+	if ((int) header.num_records != rows ||
+		header.num_fields != (int) dbf_cols.size()) return false;
+	std::vector<DbfFieldDesc> desc_vec = dbf.getFieldDescs();
+	int rec_len = 1;
+	for (size_t i=0; i<dbf_cols.size(); ++i) {
+		DbfColContainer* c = dbf_cols[i];
+		char type;
+		switch (c->GetType()) {
+			case GdaConst::date_type: type = 'D'; break;
+			case GdaConst::long64_type:
+			case GdaConst::double_type: type = 'N'; break;
+			default: type = 'C'; break;
+		}
+		if (desc_vec[i].name != c->GetName() ||
+			desc_vec[i].type != type ||
+			desc_vec[i].length != c->GetFieldLen() ||
+			desc_vec[i].decimals != c->GetDecimals()) return false;
+		rec_len += c->GetFieldLen();
+	}
+	return header.length_each_record == rec_len;
+}
+
+/** Writes only the dirty fields of dbf_cols into fname, which must have
+ passed CanPatchDbf.  The new field contents are first recorded in a
+ journal so that an interrupted save can be completed on the next load. */
+bool DbfTable::PatchDbf(const wxString& fname,
+						const std::vector<DbfColContainer*>& dbf_cols,
+						const DbfFileHeader& header, wxString& err_msg)
+{
+	std::vector<DbfColContainer*> dirty_cols;
+	for (size_t i=0; i<dbf_cols.size(); ++i) {
+		if (dbf_cols[i]->IsDirty()) dirty_cols.push_back(dbf_cols[i]);
+	}
+	if (dirty_cols.empty()) return true;
+	DbfColContainer::CopyVectorsToRawData(dirty_cols);
+	
+	const int rec_len = header.length_each_record;
+	std::vector<DbfFileUtils::DbfPatch> patches;
+	wxInt64 field_offset = header.header_length + 1; // skip deletion flag
+	for (size_t i=0; i<dbf_cols.size(); ++i) {
+		DbfColContainer* c = dbf_cols[i];
+		int f_len = c->GetFieldLen();
+		if (c->IsDirty()) {
+			DbfFileUtils::DbfPatch p;
+			p.len = f_len;
+			p.stride = rec_len;
+			p.src_stride = f_len+1;
+			if (c->IsAllDirty()) {
+				p.offset = field_offset;
+				p.count = rows;
+				p.src = c->raw_data;
+				patches.push_back(p);
+			} else {
+				// runs of consecutive dirty rows become a single patch
+				const std::set<int>& d_rows = c->GetDirtyRows();
+				std::set<int>::const_iterator it = d_rows.begin();
+				while (it != d_rows.end()) {
+					int first = *it;
+					int last = first;
+					for (++it; it != d_rows.end() && *it == last+1; ++it) {
+						last = *it;
+					}
+					p.offset = field_offset + (wxInt64) first * rec_len;
+					p.count = last - first + 1;
+					p.src = c->raw_data + (size_t) first*(f_len+1);
+					patches.push_back(p);
+				}
+			}
+		}
+		field_offset += f_len;
+	}
+	
+	// bytes 1-3 of the header hold the date of the last update
+	wxDateTime today = wxDateTime::Today();
+	char update_date[3];
+	update_date[0] = (char) (today.GetYear() - 1900);
+	update_date[1] = (char) (today.GetMonth() - wxDateTime::Jan + 1);
+	update_date[2] = (char) today.GetDay();
+	DbfFileUtils::DbfPatch date_patch;
+	date_patch.offset = 1;
+	date_patch.len = 3;
+	date_patch.stride = 3;
+	date_patch.count = 1;
+	date_patch.src = update_date;
+	date_patch.src_stride = 3;
+	patches.push_back(date_patch);
+	
+	if (!DbfFileUtils::WriteDbfJournal(fname, header, patches, err_msg)) {
+		return false;
+	}
+	if (!DbfFileUtils::ApplyDbfJournal(fname, err_msg)) return false;
+	orig_header.year = today.GetYear();
+	orig_header.month = today.GetMonth() - wxDateTime::Jan + 1;
+	orig_header.day = today.GetDay();
+	return true;
+}
+
+/** Writes a complete new DBF file.  The file is first written next to
+ fname and only renamed over fname once it is complete, so a failed save
+ never leaves a truncated file behind. */
+bool DbfTable::RewriteDbf(const wxString& fname,
+						  const std::vector<DbfColContainer*>& dbf_cols,
+						  wxString& err_msg)
+{
+	wxString tmp_fname = fname + ".gdatmp";
+	std::ofstream out_file;	
+	out_file.open(GET_ENCODED_FILENAME(tmp_fname),
+				  std::ios::out | std::ios::binary);
+	
+	if (!(out_file.is_open() && out_file.good())) {
+		err_msg += "Problem opening \"" + tmp_fname + "\"";
+		return false;
+	}
 	typedef DbfColContainer* dbf_col_ptr;
-	std::vector<dbf_col_ptr> dbf_cols;
-	GetAllSimpleDbfCols(dbf_cols);	
 	
 	// Ensure that raw_data exists.  If raw_data exists, then each item is
-	// assumed to be ready for writing to disk.
-	BOOST_FOREACH(const dbf_col_ptr& c, dbf_cols) {
-		if (!c->IsRawDataAlloc()) c->CopyVectorToRawData();
-	}
+	// assumed to be ready for writing to disk.  Numeric columns are
+	// encoded in parallel.
+	DbfColContainer::CopyVectorsToRawData(dbf_cols);
 	
 	// update orig_header
 	orig_header.num_records = GetNumberRows();
@@ -1331,19 +1528,49 @@ bool DbfTable::WriteToDbf(const wxString& fname, wxString& err_msg)
 	// mark end of field descriptors with 0x0D
 	out_file.put((char) 0x0D);
 	
-	// Write out each record
-	for (int row=0; row<header.num_records; row++) {
-		out_file.put((char) 0x20); // each record starts with a space character
+	// Write out each record.  Records are gathered into large blocks
+	// before writing.
+	const int rec_len = header.length_each_record;
+	const int block_rows = GenUtils::max<int>(1, (1 << 20) / rec_len);
+	std::vector<char> block((size_t) block_rows * rec_len);
+	for (int row=0; row<(int) header.num_records; row+=block_rows) {
+		int n_rows = GenUtils::min<int>(block_rows, header.num_records-row);
+		for (int r=0; r<n_rows; r++) {
+			// each record starts with a space character
+			block[(size_t) r*rec_len] = (char) 0x20;
+		}
+		int offset = 1;
 		BOOST_FOREACH(const dbf_col_ptr& c, dbf_cols) {
 			int f_len = c->GetFieldLen();
-			out_file.write(c->raw_data + row*(f_len+1), f_len);	
+			const char* src = c->raw_data + (size_t) row*(f_len+1);
+			char* dst = &block[0] + offset;
+			for (int r=0; r<n_rows; r++) {
+				memcpy(dst, src, f_len);
+				src += f_len+1;
+				dst += rec_len;
+			}
+			offset += f_len;
 		}
+		out_file.write(&block[0], (std::streamsize) n_rows * rec_len);
 	}
 	// 0x1A is the EOF marker
 	out_file.put((char) 0x1A);
 	out_file.close();
-	SetChangedSinceLastSave(false);
+	// the new contents must be on disk before the rename makes them visible
+	if (out_file.fail() || !DbfFileUtils::SyncFile(tmp_fname)) {
+		wxRemoveFile(tmp_fname);
+		err_msg += "Problem writing \"" + tmp_fname + "\"";
+		return false;
+	}
 	
+	// A journal left over from an earlier failed patch no longer applies.
+	wxString jnl_fname = DbfFileUtils::GetDbfJournalFileName(fname);
+	if (wxFileExists(jnl_fname)) wxRemoveFile(jnl_fname);
+	if (!wxRenameFile(tmp_fname, fname, true)) {
+		wxRemoveFile(tmp_fname);
+		err_msg += "Problem replacing \"" + fname + "\"";
+		return false;
+	}
 	return true;	
 }
 
@@ -82,6 +82,8 @@ public:
 	virtual void GetColData(int col, int time, std::vector<double>& data);
 	virtual void GetColData(int col, int time, std::vector<wxInt64>& data);
 	virtual void GetColData(int col, int time, std::vector<wxString>& data);
+	virtual void GetColPanel(int col, SpaceTimePanel& panel,
+					 SpaceTimePanel::Layout layout = SpaceTimePanel::time_major);
 	virtual void GetColUndefined(int col, b_array_type& undefined);
 	virtual void GetColUndefined(int col, int time,
 								 std::vector<bool>& undefined);
@@ -89,6 +91,7 @@ public:
 							   std::vector<double>& max_vals);
 	virtual void GetMinMaxVals(int col, int time,
 							   double& min_val, double& max_val);	
+	virtual void GetColSummary(int col, int time, Gda::ColumnSummary& summary);
 
 	virtual void SetColData(int col, int time,
 							const std::vector<double>& data);
@@ -135,7 +138,18 @@ private:
 	DbfColContainer* FindDbfCol(int col, int time=0);
 	void GetDbfCols(int col, std::vector<DbfColContainer*>& cols);
 	void GetAllSimpleDbfCols(std::vector<DbfColContainer*>& cols);
+	bool CanPatchDbf(const wxString& fname,
+					 const std::vector<DbfColContainer*>& dbf_cols,
+					 DbfFileHeader& header);
+	bool PatchDbf(const wxString& fname,
+				  const std::vector<DbfColContainer*>& dbf_cols,
+				  const DbfFileHeader& header, wxString& err_msg);
+	bool RewriteDbf(const wxString& fname,
+					const std::vector<DbfColContainer*>& dbf_cols,
+					wxString& err_msg);
 	wxFileName dbf_file_name;
+	// file whose contents match every column not marked dirty
+	wxString clean_file_name;
 	
 	VarOrderMapper var_order;
 	std::map<wxString, DbfColContainer*> var_map;
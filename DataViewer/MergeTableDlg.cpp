@@ -19,6 +19,7 @@
 
 #include <set>
 #include <map>
+#include <string>
 #include <vector>
 #include <wx/xrc/xmlres.h>
 #include <wx/msgdlg.h>
@@ -37,6 +38,62 @@
 #include "../DialogTools/FieldNameCorrectionDlg.h"
 #include "../logger.h"
 
+namespace {
+	/** Import keys are trimmed before comparison, as merge keys always
+	 have been. */
+	std::string TrimKey(const std::string& s)
+	{
+		size_t b = s.find_first_not_of(" \t\r\n");
+		if (b == std::string::npos) return std::string();
+		size_t e = s.find_last_not_of(" \t\r\n");
+		return s.substr(b, e-b+1);
+	}
+	
+	/** Reads the key and merged fields of the import layer in chunks. */
+	class OGRJoinReader : public Gda::JoinChunkReader {
+	public:
+		OGRJoinReader(OGRLayerProxy* layer_, int key_fid_,
+					  const std::vector<int>& fids_)
+		: layer(layer_), key_fid(key_fid_), fids(fids_) {}
+		virtual ~OGRJoinReader() {}
+		
+		virtual int GetNumRows() { return layer->GetNumRecords(); }
+		
+		virtual void ReadChunk(int start, int n, Gda::JoinKeys& keys,
+							   std::vector<Gda::JoinColumn>& vals)
+		{
+			keys.Resize(n);
+			for (size_t c=0; c<vals.size(); c++) vals[c].Resize(n);
+			Gda::JoinKeyColumn& key = keys.cols[0];
+			for (int i=0; i<n; i++) {
+				OGRFeature* feat = layer->GetFeatureAt(start+i);
+				if (key.is_int) {
+					key.ints[i] = feat->GetFieldAsInteger(key_fid);
+				} else {
+					key.strs[i] = TrimKey(feat->GetFieldAsString(key_fid));
+				}
+				for (size_t c=0; c<vals.size(); c++) {
+					Gda::JoinColumn& col = vals[c];
+					int fid = fids[c];
+					col.undefined[i] = !feat->IsFieldSet(fid);
+					if (col.type == GdaConst::double_type) {
+						col.dbls[i] = feat->GetFieldAsDouble(fid);
+					} else if (col.type == GdaConst::long64_type) {
+						col.ints[i] = feat->GetFieldAsInteger(fid);
+					} else {
+						col.strs[i] = wxString(feat->GetFieldAsString(fid));
+					}
+				}
+			}
+		}
+		
+	private:
+		OGRLayerProxy* layer;
+		int key_fid;
+		std::vector<int> fids;
+	};
+}
+
 BEGIN_EVENT_TABLE( MergeTableDlg, wxDialog )
 	EVT_RADIOBUTTON( XRCID("ID_KEY_VAL_RB"), MergeTableDlg::OnKeyValRB )
 	EVT_RADIOBUTTON( XRCID("ID_REC_ORDER_RB"), MergeTableDlg::OnRecOrderRB )
@@ -89,6 +146,10 @@ void MergeTableDlg::CreateControls()
 								  wxChoice);
 	m_import_key = wxDynamicCast(FindWindow(XRCID("ID_IMPORT_KEY_CHOICE")),
 								 wxChoice);
+	m_join_type = wxDynamicCast(FindWindow(XRCID("ID_JOIN_TYPE_CHOICE")),
+								wxChoice);
+	m_join_agg = wxDynamicCast(FindWindow(XRCID("ID_JOIN_AGG_CHOICE")),
+							   wxChoice);
 	m_exclude_list = wxDynamicCast(FindWindow(XRCID("ID_EXCLUDE_LIST")),
 								   wxListBox);
 	m_include_list = wxDynamicCast(FindWindow(XRCID("ID_INCLUDE_LIST")),
@@ -232,24 +293,6 @@ void MergeTableDlg::OnExclListDClick( wxCommandEvent& ev)
 }
 
 
-void MergeTableDlg::CheckKeys(wxString key_name, vector<wxString>& key_vec,
-                              map<wxString, int>& key_map)
-{
-    for (int i=0, iend=key_vec.size(); i<iend; i++) {
-        key_vec[i].Trim(false);
-        key_vec[i].Trim(true);
-        key_map[key_vec[i]] = i;
-    }
-	
-    if (key_vec.size() != key_map.size()) {
-        wxString msg;
-        msg << "Chosen table merge key field " << key_name;
-        msg << " contains duplicate values. Key fields must contain all ";
-        msg << "unique values.";
-        throw GdaException(msg.mb_str());
-    }
-}
-
 vector<wxString> MergeTableDlg::
 GetSelectedFieldNames(map<wxString,wxString>& merged_fnames_dict)
 {
@@ -282,6 +325,7 @@ GetSelectedFieldNames(map<wxString,wxString>& merged_fnames_dict)
 
 void MergeTableDlg::OnMergeClick( wxCommandEvent& ev )
 {
+    wxString success_msg = "File merged into Table successfully.";
     try {
         wxString error_msg;
         
@@ -298,60 +342,23 @@ void MergeTableDlg::OnMergeClick( wxCommandEvent& ev )
         
         int n_rows = table_int->GetNumberRows();
         int n_merge_field = merged_field_names.size();
+        vector<wxString> field_names(n_merge_field);
+        for (int i=0; i<n_merge_field; i++) {
+            wxString real_field_name = merged_field_names[i];
+            field_names[i] = real_field_name;
+            if (merged_fnames_dict.find(real_field_name) !=
+                merged_fnames_dict.end())
+            {
+                field_names[i] = merged_fnames_dict[real_field_name];
+            }
+        }
        
-        map<int, int> rowid_map;
         // check merge by key/record order
         if (m_key_val_rb->GetValue()==1) {
-            // get and check keys from original table
-            int key1_id = m_current_key->GetSelection();
-            wxString key1_name = m_current_key->GetString(key1_id);
-            int col1_id = table_int->FindColId(key1_name);
-            if (table_int->IsColTimeVariant(col1_id)) {
-                error_msg = "Chosen key field '";
-                error_msg << key1_name << "' is a time variant. Please choose "
-                << "a non-time variant field as key.";
-                throw GdaException(error_msg.mb_str());
-            }
-            vector<wxString> key1_vec;
-            vector<wxInt64>  key1_l_vec;
-            map<wxString,int> key1_map;
-            if ( table_int->GetColType(col1_id, 0) == GdaConst::string_type ) {
-                table_int->GetColData(col1_id, 0, key1_vec);
-            }else if (table_int->GetColType(col1_id,0)==GdaConst::long64_type){
-                table_int->GetColData(col1_id, 0, key1_l_vec);
-            }
-            if (key1_vec.empty()) {
-                for( int i=0; i< key1_l_vec.size(); i++){
-                    wxString tmp;
-                    tmp << key1_l_vec[i];
-                    key1_vec.push_back(tmp);
-                }
-            }
-            CheckKeys(key1_name, key1_vec, key1_map);
-            
-            // get and check keys from import table
-            int key2_id = m_import_key->GetSelection();
-            wxString key2_name = m_import_key->GetString(key2_id);
-            int col2_id = merge_layer_proxy->GetFieldPos(key2_name);
-            int n_merge_rows = merge_layer_proxy->GetNumRecords();
-            vector<wxString> key2_vec;
-            map<wxString,int> key2_map;
-            for (int i=0; i < n_merge_rows; i++) {
-                key2_vec.push_back(merge_layer_proxy->GetValueAt(i, col2_id));
-            }
-            CheckKeys(key2_name, key2_vec, key2_map);
-            
-            // make sure key1 <= key2, and store their mappings
-            map<wxString,int>::iterator key1_it, key2_it;
-            for (key1_it=key1_map.begin(); key1_it!=key1_map.end(); key1_it++) {
-                key2_it = key2_map.find(key1_it->first);
-                if ( key2_it == key2_map.end()){
-                    error_msg = "The set of values in the import key fields ";
-                    error_msg << "do not fully match current table. Please "
-                              << "choose keys with matching sets of values.";
-                    throw GdaException(error_msg.mb_str());
-                }
-                rowid_map[key1_it->second] = key2_it->second;
+            int n_unmatched = MergeByKey(field_names, merged_field_names);
+            if (n_unmatched > 0) {
+                success_msg << " " << n_unmatched << " of " << n_rows
+                << " rows had no matching import key and were left undefined.";
             }
         }
         // merge by order sequence
@@ -363,17 +370,10 @@ void MergeTableDlg::OnMergeClick( wxCommandEvent& ev )
                           << table_int->GetNumberRows() << "records";
                 throw GdaException(error_msg.mb_str());
             }
-        }
-        // append new fields to original table via TableInterface
-        for (int i=0; i<n_merge_field; i++) {
-            wxString real_field_name = merged_field_names[i];
-            wxString field_name  = real_field_name;
-            if (merged_fnames_dict.find(real_field_name) !=
-                merged_fnames_dict.end())
-            {
-                field_name = merged_fnames_dict[real_field_name];
+            // append new fields to original table via TableInterface
+            for (int i=0; i<n_merge_field; i++) {
+                AppendNewField(field_names[i], merged_field_names[i], n_rows);
             }
-            AppendNewField(field_name, real_field_name, n_rows, rowid_map);
         }
 	}
     catch (GdaException& ex) {
@@ -384,8 +384,7 @@ void MergeTableDlg::OnMergeClick( wxCommandEvent& ev )
         return;
     }
     
-	wxMessageDialog dlg(this, "File merged into Table successfully.",
-						"Success", wxOK );
+	wxMessageDialog dlg(this, success_msg, "Success", wxOK );
 	dlg.ShowModal();
 	ev.Skip();
 	EndDialog(wxID_OK);	
@@ -393,8 +392,7 @@ void MergeTableDlg::OnMergeClick( wxCommandEvent& ev )
 
 void MergeTableDlg::AppendNewField(wxString field_name,
                                    wxString real_field_name,
-                                   int n_rows,
-                                   map<int,int>& rowid_map)
+                                   int n_rows)
 {
     int fid = merge_layer_proxy->GetFieldPos(real_field_name);
     GdaConst::FieldType ftype = merge_layer_proxy->GetFieldType(fid);
@@ -402,18 +400,14 @@ void MergeTableDlg::AppendNewField(wxString field_name,
         int add_pos = table_int->InsertCol(ftype, field_name);
         vector<wxString> data(n_rows);
         for (int i=0; i<n_rows; i++) {
-            int import_rid = i;
-            if (!rowid_map.empty()) import_rid = rowid_map[i];
-            data[i]=wxString(merge_layer_proxy->GetValueAt(import_rid,fid));
+            data[i]=wxString(merge_layer_proxy->GetValueAt(i,fid));
         }
         table_int->SetColData(add_pos, 0, data);
     } else if ( ftype == GdaConst::long64_type ) {
         int add_pos = table_int->InsertCol(ftype, field_name);
         vector<wxInt64> data(n_rows);
         for (int i=0; i<n_rows; i++) {
-            int import_rid = i;
-            if (!rowid_map.empty()) import_rid = rowid_map[i];
-            OGRFeature* feat = merge_layer_proxy->GetFeatureAt(import_rid);
+            OGRFeature* feat = merge_layer_proxy->GetFeatureAt(i);
             data[i] = feat->GetFieldAsInteger(fid);
         }
         table_int->SetColData(add_pos, 0, data);
@@ -421,15 +415,130 @@ void MergeTableDlg::AppendNewField(wxString field_name,
         int add_pos=table_int->InsertCol(ftype, field_name);
         vector<double> data(n_rows);
         for (int i=0; i<n_rows; i++) {
-            int import_rid = i;
-            if (!rowid_map.empty()) import_rid = rowid_map[i];
-            OGRFeature* feat = merge_layer_proxy->GetFeatureAt(import_rid);
+            OGRFeature* feat = merge_layer_proxy->GetFeatureAt(i);
             data[i] = feat->GetFieldAsDouble(fid);
         }
         table_int->SetColData(add_pos, 0, data);
     }
 }
 
+/**
+ Join the import table onto the current table by the chosen key fields and
+ append the merged fields.  Returns the number of current rows without a
+ matching import row, which can only be non-zero for a left join.
+ */
+int MergeTableDlg::MergeByKey(const vector<wxString>& field_names,
+                              const vector<wxString>& real_field_names)
+{
+    wxString error_msg;
+    int n_rows = table_int->GetNumberRows();
+    
+    // get and check keys from original table
+    int key1_id = m_current_key->GetSelection();
+    wxString key1_name = m_current_key->GetString(key1_id);
+    int col1_id = table_int->FindColId(key1_name);
+    if (table_int->IsColTimeVariant(col1_id)) {
+        error_msg = "Chosen key field '";
+        error_msg << key1_name << "' is a time variant. Please choose "
+        << "a non-time variant field as key.";
+        throw GdaException(error_msg.mb_str());
+    }
+    int key2_id = m_import_key->GetSelection();
+    wxString key2_name = m_import_key->GetString(key2_id);
+    int col2_id = merge_layer_proxy->GetFieldPos(key2_name);
+    
+    // integer keys are compared as integers, anything else as trimmed text
+    GdaConst::FieldType key1_type = table_int->GetColType(col1_id, 0);
+    bool int_keys = (key1_type == GdaConst::long64_type &&
+                     merge_layer_proxy->GetFieldType(col2_id) ==
+                     GdaConst::long64_type);
+    Gda::JoinKeys key1;
+    key1.cols.resize(1);
+    key1.cols[0].is_int = int_keys;
+    key1.Resize(n_rows);
+    if (key1_type == GdaConst::long64_type) {
+        vector<wxInt64> key1_l_vec;
+        table_int->GetColData(col1_id, 0, key1_l_vec);
+        for (int i=0; i<n_rows; i++) {
+            if (int_keys) {
+                key1.cols[0].ints[i] = key1_l_vec[i];
+            } else {
+                wxString tmp;
+                tmp << key1_l_vec[i];
+                key1.cols[0].strs[i] = std::string(tmp.mb_str());
+            }
+        }
+    } else {
+        vector<wxString> key1_vec;
+        table_int->GetColData(col1_id, 0, key1_vec);
+        for (int i=0; i<n_rows; i++) {
+            key1.cols[0].strs[i] = TrimKey(std::string(key1_vec[i].mb_str()));
+        }
+    }
+    Gda::TableJoin join;
+    if (!join.Build(key1, error_msg)) {
+        wxString msg;
+        msg << "Chosen table merge key field " << key1_name;
+        msg << " contains duplicate values. Key fields must contain all ";
+        msg << "unique values.";
+        throw GdaException(msg.mb_str());
+    }
+    
+    // only string, integer and real fields can be merged
+    vector<int> fids;
+    vector<wxString> join_names;
+    vector<Gda::JoinColumn> vals;
+    for (size_t i=0; i<field_names.size(); i++) {
+        int fid = merge_layer_proxy->GetFieldPos(real_field_names[i]);
+        GdaConst::FieldType ftype = merge_layer_proxy->GetFieldType(fid);
+        if (ftype != GdaConst::string_type &&
+            ftype != GdaConst::long64_type &&
+            ftype != GdaConst::double_type) continue;
+        Gda::JoinColumn col;
+        col.type = ftype;
+        vals.push_back(col);
+        fids.push_back(fid);
+        join_names.push_back(field_names[i]);
+    }
+    
+    Gda::JoinKeys key2;
+    key2.cols.resize(1);
+    key2.cols[0].is_int = int_keys;
+    Gda::JoinType join_type = (m_join_type->GetSelection() == 1 ?
+                               Gda::left_join : Gda::inner_join);
+    // choice items are in the order of Gda::JoinAggregation
+    int agg_sel = m_join_agg->GetSelection();
+    if (agg_sel == wxNOT_FOUND) agg_sel = 0;
+    vector<Gda::JoinAggregation> aggs(vals.size(),
+                                      (Gda::JoinAggregation) agg_sel);
+    OGRJoinReader reader(merge_layer_proxy, col2_id, fids);
+    if (!join.Run(reader, join_type, key2, vals, aggs, error_msg)) {
+        throw GdaException(error_msg.mb_str());
+    }
+    
+    vector<Gda::JoinColumn>& results = join.GetResults();
+    for (size_t i=0; i<results.size(); i++) {
+        AppendJoinedField(join_names[i], results[i]);
+    }
+    vector<int> unmatched;
+    join.GetUnmatchedRows(unmatched);
+    return unmatched.size();
+}
+
+void MergeTableDlg::AppendJoinedField(wxString field_name,
+                                      const Gda::JoinColumn& col)
+{
+    int add_pos = table_int->InsertCol(col.type, field_name);
+    if (col.type == GdaConst::string_type) {
+        table_int->SetColData(add_pos, 0, col.strs);
+    } else if (col.type == GdaConst::long64_type) {
+        table_int->SetColData(add_pos, 0, col.ints);
+    } else {
+        table_int->SetColData(add_pos, 0, col.dbls);
+    }
+    table_int->SetColUndefined(add_pos, 0, col.undefined);
+}
+
 void MergeTableDlg::OnCloseClick( wxCommandEvent& ev )
 {
 	ev.Skip();
@@ -34,6 +34,7 @@
 #include "../ShapeOperations/OGRLayerProxy.h"
 #include "../ShapeOperations/OGRDatasourceProxy.h"
 #include "../DataViewer/TableInterface.h"
+#include "TableJoin.h"
 
 class MergeTableDlg: public wxDialog
 {    
@@ -65,6 +66,8 @@ public:
 	wxRadioButton* m_rec_order_rb;
 	wxChoice* m_current_key;
 	wxChoice* m_import_key;
+	wxChoice* m_join_type;
+	wxChoice* m_join_agg;
 	wxListBox* m_exclude_list;
 	wxListBox* m_include_list;
 	
@@ -85,12 +88,13 @@ private:
 	//std::vector<int> col_id_map;
     
 private:
-    void CheckKeys(wxString key_name, std::vector<wxString>& key_vec,
-                   std::map<wxString, int>& key_map);
     vector<wxString>
     GetSelectedFieldNames(map<wxString,wxString>& merged_fnames_dict);
+    int MergeByKey(const std::vector<wxString>& field_names,
+                   const std::vector<wxString>& real_field_names);
     void AppendNewField(wxString field_name, wxString real_field_name,
-                        int n_rows, std::map<int,int>& rowid_map);
+                        int n_rows);
+    void AppendJoinedField(wxString field_name, const Gda::JoinColumn& col);
 	DECLARE_EVENT_TABLE()
 };
 
@@ -41,6 +41,21 @@
 
 using namespace std;
 
+namespace {
+	/** Numeric cell value as double, for the cached column summaries. */
+	double GetNumericCell(OGRColumn* ogr_col, int row)
+	{
+		if (ogr_col->GetType() == GdaConst::double_type) {
+			double val = 0;
+			ogr_col->GetCellValue(row, val);
+			return val;
+		}
+		wxInt64 val = 0;
+		ogr_col->GetCellValue(row, val);
+		return (double) val;
+	}
+}
+
 OGRTable::OGRTable(OGRLayerProxy* _ogr_layer, GdaConst::DataSourceType ds_type,
                    TableState* table_state, TimeState* time_state,
                    const VarOrderPtree& var_order_ptree)
@@ -255,6 +270,7 @@ bool OGRTable::Save(wxString& err_msg)
                 operations_queue.push(op);
                 completed_stack.pop();
             }
+            col_summaries.clear();
             err_msg << "GeoDa can't save changes to datasource. Please try to "
                     << "export to other type of datasources.";
             return false;
@@ -633,35 +649,14 @@ void OGRTable::GetMinMaxVals(int col, vector<double>& min_vals,
 {
 	if (col < 0 || col >= GetNumberCols()) return;
 	if (!IsColNumeric(col)) return;
-	min_vals.clear();
-	max_vals.clear();
-	double tmp_min_val, tmp_max_val, tmp;
-	
-	VarGroup vg = var_order.FindVarGroup(col);
-	if (vg.IsEmpty()) return;
-	int times = vg.GetNumTms();
-    
-    vector<wxString> vars;
-	vg.GetVarNames(vars);
-
-	for (size_t t=0; t<times; ++t) {
-		int col_idx = vars[t].IsEmpty() ? -1 : FindOGRColId(vars[t]);
-		if (col_idx != -1) {
-            vector<double> data(rows, 0);
-            columns[col_idx]->FillData(data);
-            tmp_min_val = data[0];
-            tmp_max_val = data[0];
-            
-			for (size_t i=0; i<rows; ++i) {
-				tmp = data[i];
-                if (i > 0) {
-                    if ( tmp_min_val > tmp ) tmp_min_val = tmp;
-                    if ( tmp_max_val < tmp ) tmp_max_val = tmp;
-                }
-			}
-            min_vals.push_back(tmp_min_val);
-            max_vals.push_back(tmp_max_val);
-		}
+	int times = GetColTimeSteps(col);
+	min_vals.resize(times);
+	max_vals.resize(times);
+	for (int t=0; t<times; ++t) {
+		Gda::ColumnSummary s;
+		GetColSummary(col, t, s);
+		min_vals[t] = s.min;
+		max_vals[t] = s.max;
 	}
 }
 
@@ -673,12 +668,41 @@ void OGRTable::GetMinMaxVals(int col, int time,
 	if (col < 0 || col >= var_order.GetNumVarGroups()) return;
 	if (!IsColNumeric(col)) return;
 	if (time < 0 || time > GetColTimeSteps(col)) return;
+	
+	Gda::ColumnSummary s;
+	GetColSummary(col, time, s);
+	min_val = s.min;
+	max_val = s.max;
+}
 
-	std::vector<double> t_min;
-	std::vector<double> t_max;
-	GetMinMaxVals(col, t_min, t_max);
-	min_val = t_min[time];
-	max_val = t_max[time];
+/**
+ * Summaries are computed once per OGR column and then updated by
+ * SetCellFromString; any other change to a column drops its entry.
+ */
+void OGRTable::GetColSummary(int col, int time, Gda::ColumnSummary& summary)
+{
+	summary.Reset();
+	if (col < 0 || col >= var_order.GetNumVarGroups()) return;
+	if (!IsColNumeric(col)) return;
+	OGRColumn* ogr_col = FindOGRColumn(col, time);
+	if (ogr_col == NULL) return;
+	map<OGRColumn*, Gda::ColumnSummary>::iterator it =
+		col_summaries.find(ogr_col);
+	if (it != col_summaries.end() && it->second.minmax_valid) {
+		summary = it->second;
+		return;
+	}
+	// OGR doesn't keep track of undefined values, see GetColUndefined
+	vector<double> data(rows, 0);
+	if (ogr_col->GetType() == GdaConst::double_type) {
+		ogr_col->FillData(data);
+	} else {
+		vector<wxInt64> l_data(rows, 0);
+		ogr_col->FillData(l_data);
+		for (int i=0; i<rows; ++i) data[i] = (double) l_data[i];
+	}
+	Gda::Summarize(data, summary);
+	col_summaries[ogr_col] = summary;
 }
 
 void OGRTable::SetColData(int col, int time, const std::vector<double>& data)
@@ -691,6 +715,7 @@ void OGRTable::SetColData(int col, int time, const std::vector<double>& data)
     OGRColumn* ogr_col = columns[ogr_col_id];
     operations_queue.push(new OGRTableOpUpdateColumn(ogr_col, data));
     ogr_col->UpdateData(data);
+    col_summaries.erase(ogr_col);
 	table_state->SetColDataChangeEvtTyp(ogr_col->GetName(), col);
 	table_state->notifyObservers();
 	SetChangedSinceLastSave(true);
@@ -706,6 +731,7 @@ void OGRTable::SetColData(int col, int time, const std::vector<wxInt64>& data)
     OGRColumn* ogr_col = columns[ogr_col_id];
     operations_queue.push(new OGRTableOpUpdateColumn(ogr_col, data));
     ogr_col->UpdateData(data);
+    col_summaries.erase(ogr_col);
 	table_state->SetColDataChangeEvtTyp(ogr_col->GetName(), col);
 	table_state->notifyObservers();
 	SetChangedSinceLastSave(true);
@@ -721,6 +747,7 @@ void OGRTable::SetColData(int col, int time,
     OGRColumn* ogr_col = columns[ogr_col_id];
     operations_queue.push(new OGRTableOpUpdateColumn(ogr_col, data));
     ogr_col->UpdateData(data);
+    col_summaries.erase(ogr_col);
 	table_state->SetColDataChangeEvtTyp(ogr_col->GetName(), col);
 	table_state->notifyObservers();
 	SetChangedSinceLastSave(true);
@@ -752,6 +779,7 @@ bool OGRTable::ColChangeProperties(int col, int time,
     operations_queue.push(new OGRTableOpUpdateField(ogr_col, new_len, new_dec));
     ogr_col->SetLength(new_len);
     ogr_col->SetDecimals(new_dec);
+    col_summaries.erase(ogr_col);
     
     table_state->SetColPropertiesChangeEvtTyp(GetColName(col), col);
 	table_state->notifyObservers();
@@ -875,7 +903,17 @@ bool OGRTable::SetCellFromString(int row, int col, int time,
 		}
 	}
     operations_queue.push(new OGRTableOpUpdateCell(columns[t_col], row, value));
+	map<OGRColumn*, Gda::ColumnSummary>::iterator sum_it =
+		col_summaries.find(columns[t_col]);
+	double old_val = 0;
+	if (sum_it != col_summaries.end()) {
+		old_val = GetNumericCell(columns[t_col], row);
+	}
 	columns[t_col]->SetValueAt(row, value);
+	if (sum_it != col_summaries.end()) {
+		double new_val = GetNumericCell(columns[t_col], row);
+		sum_it->second.Replace(old_val, false, new_val, false);
+	}
 	SetChangedSinceLastSave(true);
     table_state->SetColDataChangeEvtTyp(GetColName(col), col);
 	table_state->notifyObservers();
@@ -977,6 +1015,7 @@ bool OGRTable::DeleteCol(int pos)
                 if (columns[i]->GetName().CmpNoCase(s) == 0) {
                     operations_queue.push(
                         new OGRTableOpDeleteColumn(columns[i]));
+                    col_summaries.erase(columns[i]);
                     columns.erase(columns.begin()+i);
                     break;
                 }
@@ -52,6 +52,8 @@ private:
     // queues of table operations
     queue<OGRTableOperation*> operations_queue;
     stack<OGRTableOperation*> completed_stack;
+    // cached statistics of numeric columns, see GetColSummary()
+    map<OGRColumn*, Gda::ColumnSummary> col_summaries;
 	
 private:
 	void AddTimeIDs(int n);
@@ -121,6 +123,7 @@ public:
 							   std::vector<double>& max_vals);
 	virtual void GetMinMaxVals(int col, int time,
 							   double& min_val, double& max_val);
+	virtual void GetColSummary(int col, int time, Gda::ColumnSummary& summary);
 	virtual void SetColData(int col, int time,
 							const std::vector<double>& data);
 	virtual void SetColData(int col, int time,
@@ -0,0 +1,173 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include "TableInterface.h"
+#include "TableState.h"
+#include "SortedColCache.h"
+
+SortedColCache::SortedColCache(TableInterface* _table_int,
+							   TableState* _table_state)
+: table_int(_table_int), table_state(_table_state)
+{
+	table_state->registerObserver(this);
+}
+
+SortedColCache::~SortedColCache()
+{
+	Clear();
+	table_state->removeObserver(this);
+}
+
+const Gda::dbl_int_pair_vec_type& SortedColCache::GetSorted(int col, int tm)
+{
+	return GetEntry(col, tm).sorted;
+}
+
+const std::vector<bool>& SortedColCache::GetUndefined(int col, int tm)
+{
+	return GetEntry(col, tm).undefined;
+}
+
+void SortedColCache::GetMinMax(int col, int tm,
+							   double& min_val, double& max_val)
+{
+	Entry& e = GetEntry(col, tm);
+	min_val = e.min_val;
+	max_val = e.max_val;
+}
+
+double SortedColCache::GetPercentile(int col, int tm, double x)
+{
+	Entry& e = GetEntry(col, tm);
+	if (e.sorted.empty()) return 0;
+	return Gda::percentile(x, e.sorted);
+}
+
+const std::vector<int>& SortedColCache::GetUniqueRuns(int col, int tm)
+{
+	Entry& e = GetEntry(col, tm);
+	if (e.runs.empty()) {
+		int n = e.sorted.size();
+		for (int i=0; i<n; i++) {
+			if (i == 0 || e.sorted[i].first != e.sorted[i-1].first) {
+				e.runs.push_back(i);
+			}
+		}
+		e.runs.push_back(n);
+	}
+	return e.runs;
+}
+
+void SortedColCache::GetRowsInRange(int col, int tm,
+									double min_val, double max_val,
+									std::vector<int>& rows)
+{
+	rows.clear();
+	if (min_val > max_val) return;
+	const Entry& e = GetEntry(col, tm);
+	Gda::dbl_int_pair_type lo(min_val, 0);
+	Gda::dbl_int_pair_type hi(max_val, 0);
+	Gda::dbl_int_pair_vec_type::const_iterator first, last;
+	first = std::lower_bound(e.sorted.begin(), e.sorted.end(), lo,
+							 Gda::dbl_int_pair_cmp_less);
+	last = std::upper_bound(first, e.sorted.end(), hi,
+							Gda::dbl_int_pair_cmp_less);
+	for (; first != last; ++first) {
+		if (!e.undefined[first->second]) rows.push_back(first->second);
+	}
+}
+
+void SortedColCache::Clear()
+{
+	for (entry_map_type::iterator it=entries.begin(); it!=entries.end(); ++it) {
+		delete it->second;
+	}
+	entries.clear();
+}
+
+SortedColCache::Entry& SortedColCache::GetEntry(int col, int tm)
+{
+	if (!table_int->IsColTimeVariant(col)) tm = 0;
+	key_type key(table_int->GetColName(col), tm);
+	entry_map_type::iterator it = entries.find(key);
+	if (it != entries.end()) return *it->second;
+	
+	Entry* e = new Entry;
+	entries[key] = e;
+	int num_obs = table_int->GetNumberRows();
+	std::vector<double> data(num_obs, 0);
+	e->undefined.resize(num_obs, true);
+	if (table_int->IsColNumeric(col)) {
+		table_int->GetColData(col, tm, data);
+		table_int->GetColUndefined(col, tm, e->undefined);
+	}
+	e->sorted.resize(num_obs);
+	for (int i=0; i<num_obs; i++) {
+		e->sorted[i].first = data[i];
+		e->sorted[i].second = i;
+	}
+	std::sort(e->sorted.begin(), e->sorted.end(), Gda::dbl_int_pair_cmp_less);
+	
+	// undefined values sort as zero, so skip over them at either end
+	e->min_val = 0;
+	e->max_val = 0;
+	for (int i=0; i<num_obs; i++) {
+		if (!e->undefined[e->sorted[i].second]) {
+			e->min_val = e->sorted[i].first;
+			break;
+		}
+	}
+	for (int i=num_obs-1; i>=0; i--) {
+		if (!e->undefined[e->sorted[i].second]) {
+			e->max_val = e->sorted[i].first;
+			break;
+		}
+	}
+	return *e;
+}
+
+void SortedColCache::RemoveGroup(const wxString& name)
+{
+	entry_map_type::iterator it = entries.lower_bound(key_type(name, 0));
+	while (it != entries.end() && it->first.first == name) {
+		delete it->second;
+		entries.erase(it++);
+	}
+}
+
+void SortedColCache::update(TableState* o)
+{
+	TableState::EventType ev = o->GetEventType();
+	if (ev == TableState::col_data_change) {
+		// the event names the simple column that changed and the position
+		// of its group
+		int pos = o->GetModifiedColPos();
+		if (pos >= 0 && pos < table_int->GetNumberCols()) {
+			RemoveGroup(table_int->GetColName(pos));
+		}
+		RemoveGroup(o->GetModifiedColName());
+	} else if (ev == TableState::col_disp_decimals_change ||
+			   ev == TableState::col_order_change ||
+			   ev == TableState::empty) {
+		// sort order is unaffected
+	} else {
+		Clear();
+	}
+}
@@ -0,0 +1,95 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_SORTED_COL_CACHE_H__
+#define __GEODA_CENTER_SORTED_COL_CACHE_H__
+
+#include <map>
+#include <utility>
+#include <vector>
+#include <wx/string.h>
+#include "../GenUtils.h"
+#include "TableStateObserver.h"
+
+class TableInterface;
+class TableState;
+
+/**
+ SortedColCache keeps the sorted order of numeric table columns so that
+ every view of the same variable and time period shares one sort instead
+ of repeating it.  Entries are keyed by group name and time and are built
+ on first request.  Entries for a variable are dropped when TableState
+ reports a change to its data, and the whole cache is dropped on any
+ change of columns, properties or time ids.
+ 
+ Sorted values are exactly what sorting the output of
+ TableInterface::GetColData(col, tm, std::vector<double>&) with
+ Gda::dbl_int_pair_cmp_less would give, so undefined values appear as
+ zero.  Min/max, percentiles and range queries only consider defined
+ values.
+ */
+class SortedColCache : public TableStateObserver {
+public:
+	SortedColCache(TableInterface* table_int, TableState* table_state);
+	virtual ~SortedColCache();
+	
+	/** Values of col at time tm in ascending order, each paired with its
+	 row.  The reference stays valid until the next table change. */
+	const Gda::dbl_int_pair_vec_type& GetSorted(int col, int tm);
+	/** Undefined flags of col at time tm, by row. */
+	const std::vector<bool>& GetUndefined(int col, int tm);
+	/** Smallest and largest defined values, or zero if there are none. */
+	void GetMinMax(int col, int tm, double& min_val, double& max_val);
+	/** Same as Gda::percentile(x, GetSorted(col, tm)). */
+	double GetPercentile(int col, int tm, double x);
+	/** Positions in GetSorted(col, tm) where each run of equal values
+	 starts, followed by the number of observations. */
+	const std::vector<int>& GetUniqueRuns(int col, int tm);
+	/** Rows with a defined value v, min_val <= v <= max_val, in order of
+	 increasing value.  Found by binary search. */
+	void GetRowsInRange(int col, int tm, double min_val, double max_val,
+						std::vector<int>& rows);
+	void Clear();
+	
+	/** Implementation of TableStateObserver interface */
+	virtual void update(TableState* o);
+	virtual bool AllowTimelineChanges() { return true; }
+	virtual bool AllowGroupModify(const wxString& grp_nm) { return true; }
+	virtual bool AllowObservationAddDelete() { return true; }
+	
+private:
+	struct Entry {
+		Gda::dbl_int_pair_vec_type sorted;
+		std::vector<bool> undefined;
+		double min_val;
+		double max_val;
+		std::vector<int> runs; // empty until first requested
+	};
+	typedef std::pair<wxString, int> key_type;
+	typedef std::map<key_type, Entry*> entry_map_type;
+	
+	Entry& GetEntry(int col, int tm);
+	void RemoveGroup(const wxString& name);
+	
+	entry_map_type entries;
+	TableInterface* table_int;
+	TableState* table_state;
+};
+
+#endif
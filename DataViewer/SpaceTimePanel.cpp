@@ -0,0 +1,66 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SpaceTimePanel.h"
+
+SpaceTimePanel::SpaceTimePanel()
+: num_times(0), num_obs(0), layout(time_major)
+{
+}
+
+SpaceTimePanel::SpaceTimePanel(int num_times_s, int num_obs_s,
+							   Layout layout_s)
+: num_times(0), num_obs(0), layout(time_major)
+{
+	Resize(num_times_s, num_obs_s, layout_s);
+}
+
+void SpaceTimePanel::Resize(int num_times_s, int num_obs_s, Layout layout_s)
+{
+	num_times = num_times_s > 0 ? num_times_s : 0;
+	num_obs = num_obs_s > 0 ? num_obs_s : 0;
+	layout = layout_s;
+	block.assign((size_t) num_times * num_obs, 0);
+}
+
+void SpaceTimePanel::SetLayout(Layout layout_s)
+{
+	if (layout_s == layout) return;
+	if (num_times <= 1 || num_obs <= 1) {
+		layout = layout_s;
+		return;
+	}
+	// out-of-place transpose in cache-sized tiles
+	const int tile = 32;
+	int rows = layout == time_major ? num_times : num_obs;
+	int cols = layout == time_major ? num_obs : num_times;
+	std::vector<double> t_block(block.size());
+	for (int r0=0; r0<rows; r0+=tile) {
+		int r1 = r0+tile < rows ? r0+tile : rows;
+		for (int c0=0; c0<cols; c0+=tile) {
+			int c1 = c0+tile < cols ? c0+tile : cols;
+			for (int r=r0; r<r1; r++) {
+				const double* src = &block[(size_t) r*cols];
+				for (int c=c0; c<c1; c++) t_block[(size_t) c*rows + r] = src[c];
+			}
+		}
+	}
+	block.swap(t_block);
+	layout = layout_s;
+}
@@ -0,0 +1,144 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_SPACE_TIME_PANEL_H__
+#define __GEODA_CENTER_SPACE_TIME_PANEL_H__
+
+#include <cstddef>
+#include <vector>
+
+/** A non-owning, strided view of one slice of a SpaceTimePanel: either the
+ values of all observations at one time period, or the time series of one
+ observation.  Element i lives at base[i*stride], so a view is contiguous
+ (and GetPtr() may be handed to code expecting a double*) only when
+ IsContiguous() is true.  Views are invalidated by SpaceTimePanel::Resize
+ and SpaceTimePanel::SetLayout. */
+template <class T>
+class PanelView
+{
+public:
+	PanelView() : base(0), len(0), stride(1) {}
+	PanelView(T* base_s, int len_s, int stride_s)
+	: base(base_s), len(len_s), stride(stride_s) {}
+	
+	T& operator[](int i) const { return base[(std::ptrdiff_t) i * stride]; }
+	int size() const { return len; }
+	int GetStride() const { return stride; }
+	bool IsContiguous() const { return stride == 1 || len <= 1; }
+	T* GetPtr() const { return base; }
+	
+	/** Gather the view into out[0..size()). */
+	void CopyTo(double* out) const {
+		if (stride == 1) {
+			for (int i=0; i<len; i++) out[i] = base[i];
+		} else {
+			const T* p = base;
+			for (int i=0; i<len; i++, p+=stride) out[i] = *p;
+		}
+	}
+	void CopyTo(std::vector<double>& out) const {
+		out.resize(len);
+		if (len > 0) CopyTo(&out[0]);
+	}
+	
+private:
+	T* base;
+	int len;
+	int stride;
+};
+
+/**
+ SpaceTimePanel holds every time period of one numeric variable group as a
+ single contiguous [time][obs] block of doubles.  The block is stored either
+ time-major (all observations of period 0, then period 1, ...), where each
+ time slice is contiguous, or obs-major (the full time series of
+ observation 0, then observation 1, ...), where each observation's series
+ is contiguous.  Both kinds of slice are handed out as PanelView objects
+ pointing into the block, so no data is copied.
+
+ panel[t][i] and panel.size() follow boost::multi_array<double, 2>, which
+ panels replace in the analyses that read whole variable groups.
+ */
+class SpaceTimePanel
+{
+public:
+	enum Layout { time_major, obs_major };
+	typedef PanelView<double> view;
+	typedef PanelView<const double> const_view;
+	
+	SpaceTimePanel();
+	SpaceTimePanel(int num_times, int num_obs, Layout layout = time_major);
+	
+	/** Resize to num_times x num_obs and set every value to 0. */
+	void Resize(int num_times, int num_obs, Layout layout = time_major);
+	/** Rearrange the block in place into the requested layout. */
+	void SetLayout(Layout layout);
+	Layout GetLayout() const { return layout; }
+	
+	int GetNumTimes() const { return num_times; }
+	int GetNumObs() const { return num_obs; }
+	/** Number of time periods, as for boost::multi_array::size() */
+	size_t size() const { return num_times; }
+	bool empty() const { return block.empty(); }
+	
+	view TimeSlice(int t) {
+		return view(Base() + TimeOffset(t), num_obs, ObsStride());
+	}
+	const_view TimeSlice(int t) const {
+		return const_view(Base() + TimeOffset(t), num_obs, ObsStride());
+	}
+	view ObsSeries(int obs) {
+		return view(Base() + ObsOffset(obs), num_times, TimeStride());
+	}
+	const_view ObsSeries(int obs) const {
+		return const_view(Base() + ObsOffset(obs), num_times, TimeStride());
+	}
+	view operator[](int t) { return TimeSlice(t); }
+	const_view operator[](int t) const { return TimeSlice(t); }
+	
+	double& at(int t, int obs) {
+		return block[TimeOffset(t) + ObsOffset(obs)];
+	}
+	double at(int t, int obs) const {
+		return block[TimeOffset(t) + ObsOffset(obs)];
+	}
+	
+	/** The whole block in the current layout. */
+	double* GetData() { return Base(); }
+	const double* GetData() const { return Base(); }
+	
+private:
+	double* Base() { return block.empty() ? 0 : &block[0]; }
+	const double* Base() const { return block.empty() ? 0 : &block[0]; }
+	std::ptrdiff_t TimeOffset(int t) const {
+		return (std::ptrdiff_t) t * TimeStride();
+	}
+	std::ptrdiff_t ObsOffset(int obs) const {
+		return (std::ptrdiff_t) obs * ObsStride();
+	}
+	int TimeStride() const { return layout == time_major ? num_obs : 1; }
+	int ObsStride() const { return layout == time_major ? 1 : num_times; }
+	
+	std::vector<double> block;
+	int num_times;
+	int num_obs;
+	Layout layout;
+};
+
+#endif
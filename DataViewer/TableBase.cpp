@@ -22,6 +22,7 @@
 #include "../Generic/HighlightState.h"
 #include "../GenUtils.h"
 #include "../GeneralWxUtils.h"
+#include "SortedColCache.h"
 #include "TableState.h"
 #include "TimeState.h"
 #include "TableInterface.h"
@@ -283,22 +284,17 @@ void TableBase::SortByCol(int col, bool ascending)
 			break;
 		case GdaConst::double_type:
 		{
-			std::vector<double> temp;
-			table_int->GetColData(col, tm, temp);
-			std::vector< index_pair<double> > sort_col(rows);
-			for (int i=0; i<rows; i++) {
-				sort_col[i].index = i;
-				sort_col[i].val = temp[i];
-			}
+			// reuse the sort shared with the views of this column
+			const Gda::dbl_int_pair_vec_type& sorted =
+				project->GetSortedColCache()->GetSorted(col, tm);
 			if (ascending) {
-				sort(sort_col.begin(), sort_col.end(),
-					 index_pair<double>::less_than);
+				for (int i=0, iend=rows; i<iend; i++) {
+					row_order[i] = sorted[i].second;
+				}
 			} else {
-				sort(sort_col.begin(), sort_col.end(),
-					 index_pair<double>::greater_than);
-			}
-			for (int i=0, iend=rows; i<iend; i++) {
-				row_order[i] = sort_col[i].index;
+				for (int i=0, iend=rows; i<iend; i++) {
+					row_order[i] = sorted[rows-1-i].second;
+				}
 			}
 		}
 			break;
@@ -57,6 +57,59 @@ int TableInterface::GetTimeInt(const wxString& tm_str)
 	return 0;
 }
 
+void TableInterface::GetColSummary(int col, int time,
+								   Gda::ColumnSummary& summary)
+{
+	summary.Reset();
+	if (!IsColNumeric(col)) return;
+	std::vector<double> data;
+	std::vector<bool> undefined;
+	GetColData(col, time, data);
+	GetColUndefined(col, time, undefined);
+	if (!Gda::Summarize(data, undefined, summary)) {
+		// the table does not track undefined cells
+		Gda::Summarize(data, summary);
+	}
+}
+
+void TableInterface::GetColSampleStats(int col, int time,
+									   SampleStatistics& stats)
+{
+	stats = SampleStatistics();
+	Gda::ColumnSummary s;
+	GetColSummary(col, time, s);
+	if (s.n_undef > 0) {
+		Gda::ColumnSummary zeros;
+		zeros.n = s.n_undef;
+		s.n_undef = 0;
+		s.Merge(zeros);
+	}
+	stats.CalculateFromSummary(s);
+}
+
+void TableInterface::GetColPanel(int col, SpaceTimePanel& panel,
+								 SpaceTimePanel::Layout layout)
+{
+	if (!IsColNumeric(col)) return;
+	int tms = GetColTimeSteps(col);
+	int rows = GetNumberRows();
+	panel.Resize(tms, rows, layout);
+	std::vector<double> data;
+	std::vector<bool> undefined;
+	for (int t=0; t<tms; t++) {
+		// placeholder time periods leave data untouched, so reset it
+		data.assign(rows, 0);
+		undefined.clear();
+		GetColData(col, t, data);
+		GetColUndefined(col, t, undefined);
+		SpaceTimePanel::view v(panel.TimeSlice(t));
+		bool has_undef = ((int) undefined.size() == rows);
+		for (int i=0; i<rows; i++) {
+			v[i] = (has_undef && undefined[i]) ? 0 : data[i];
+		}
+	}
+}
+
 bool TableInterface::ChangedSinceLastSave()
 {
 	return changed_since_last_save;
@@ -25,12 +25,15 @@
 #include <utility>
 #include <vector>
 #include <boost/multi_array.hpp>
+#include "SpaceTimePanel.h"
 #include "TableState.h"
 #include "TimeState.h"
 #include "../GdaConst.h"
+#include "../GdaReduce.h"
 #include "../VarCalc/GdaFlexValue.h"
 
 class TimeState;
+struct SampleStatistics;
 typedef boost::multi_array<double, 2> d_array_type;
 typedef boost::multi_array<wxInt64, 2> l_array_type;
 typedef boost::multi_array<wxString, 2> s_array_type;
@@ -127,6 +130,11 @@ public:
 	virtual void GetColData(int col, int time, std::vector<double>& data) = 0;
 	virtual void GetColData(int col, int time, std::vector<wxInt64>& data) = 0;
 	virtual void GetColData(int col, int time, std::vector<wxString>& data) = 0;
+	/** Read every time period of numeric variable group col into one
+	 contiguous panel.  Undefined values and placeholder time periods are
+	 read as 0, as for GetColData(int, d_array_type&). */
+	virtual void GetColPanel(int col, SpaceTimePanel& panel,
+					 SpaceTimePanel::Layout layout = SpaceTimePanel::time_major);
 	virtual void GetColUndefined(int col, b_array_type& undefined) = 0;
 	virtual void GetColUndefined(int col, int time,
 								 std::vector<bool>& undefined) = 0;
@@ -134,6 +142,14 @@ public:
 							   std::vector<double>& max_vals) = 0;
 	virtual void GetMinMaxVals(int col, int time,
 							   double& min_val, double& max_val) = 0;
+	/** Count, min, max, mean and variance of the defined values of a
+	 numeric column at time.  The default computes it from GetColData;
+	 tables override it to cache the result per column and time. */
+	virtual void GetColSummary(int col, int time, Gda::ColumnSummary& summary);
+	/** Sample statistics of GetColData(col, time), taken from the cached
+	 summary rather than a pass over the data.  As in GetColData, undefined
+	 cells count as 0. */
+	void GetColSampleStats(int col, int time, SampleStatistics& stats);
 	
 	virtual void SetColData(int col, int time,
 							const std::vector<double>& data) = 0;
@@ -0,0 +1,371 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../GdaParallel.h"
+#include "../GenUtils.h"
+#include "TableJoin.h"
+
+namespace {
+	uint64_t HashString(const std::string& s)
+	{
+		// 64-bit FNV-1a
+		uint64_t h = 14695981039346656037ULL;
+		for (size_t i=0, sz=s.size(); i<sz; i++) {
+			h ^= (unsigned char) s[i];
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+	
+	struct JoinHashTask {
+		JoinHashTask(Gda::JoinKeys& keys_s) : keys(keys_s) {}
+		void operator()(int start, int end, int thread_id) {
+			for (int i=start; i<end; i++) {
+				uint64_t h = 0;
+				for (size_t c=0; c<keys.cols.size(); c++) {
+					const Gda::JoinKeyColumn& col = keys.cols[c];
+					uint64_t k = col.is_int ?
+						Gda::ThomasWangHashUInt64((uint64_t) col.ints[i]) :
+						HashString(col.strs[i]);
+					h ^= k + 0x9e3779b97f4a7c15ULL + (h<<6) + (h>>2);
+				}
+				keys.hashes[i] = h;
+			}
+		}
+		Gda::JoinKeys& keys;
+	};
+	
+	struct JoinProbeTask {
+		JoinProbeTask(const Gda::TableJoin& join_s,
+					  const Gda::JoinKeys& keys_s, std::vector<int>& match_s)
+		: join(join_s), keys(keys_s), match(match_s) {}
+		void operator()(int start, int end, int thread_id) {
+			for (int i=start; i<end; i++) match[i] = join.Find(keys, i);
+		}
+		const Gda::TableJoin& join;
+		const Gda::JoinKeys& keys;
+		std::vector<int>& match;
+	};
+	
+	const int hash_min_chunk = 16384;
+}
+
+void Gda::JoinKeys::Resize(int n)
+{
+	num_rows = n;
+	for (size_t c=0; c<cols.size(); c++) {
+		if (cols[c].is_int) {
+			cols[c].ints.resize(n);
+		} else {
+			cols[c].strs.resize(n);
+		}
+	}
+}
+
+void Gda::JoinKeys::ComputeHashes()
+{
+	hashes.resize(num_rows);
+	JoinHashTask task(*this);
+	Gda::ParallelFor(num_rows, task, -1, hash_min_chunk);
+}
+
+bool Gda::JoinKeys::Equal(int row, const JoinKeys& o, int o_row) const
+{
+	for (size_t c=0; c<cols.size(); c++) {
+		if (cols[c].is_int) {
+			if (cols[c].ints[row] != o.cols[c].ints[o_row]) return false;
+		} else {
+			if (cols[c].strs[row] != o.cols[c].strs[o_row]) return false;
+		}
+	}
+	return true;
+}
+
+void Gda::JoinColumn::Resize(int n)
+{
+	if (type == GdaConst::double_type) {
+		dbls.resize(n);
+	} else if (type == GdaConst::long64_type) {
+		ints.resize(n);
+	} else {
+		strs.resize(n);
+	}
+	undefined.resize(n);
+}
+
+namespace Gda {
+	/** Builds the open addressing table of each hash partition.  A
+	 partition is only touched by the thread that builds it. */
+	struct JoinBuildTask {
+		JoinBuildTask(TableJoin& join_s,
+					  const std::vector<std::vector<int> >& part_rows_s)
+		: join(join_s), part_rows(part_rows_s),
+		dup_a(part_rows_s.size(), -1), dup_b(part_rows_s.size(), -1) {}
+		void operator()(int start, int end, int thread_id) {
+			const JoinKeys& base = join.base;
+			for (int p=start; p<end; p++) {
+				const std::vector<int>& rows = part_rows[p];
+				size_t cap = 16;
+				while (cap < 2*rows.size()) cap <<= 1;
+				std::vector<int>& slots = join.slots[p];
+				slots.assign(cap, -1);
+				const uint64_t mask = cap-1;
+				for (size_t k=0; k<rows.size(); k++) {
+					int r = rows[k];
+					uint64_t pos = base.hashes[r] & mask;
+					while (slots[pos] != -1) {
+						int s = slots[pos];
+						if (base.hashes[s] == base.hashes[r] &&
+							base.Equal(s, base, r)) {
+							if (dup_a[p] == -1) {
+								dup_a[p] = s;
+								dup_b[p] = r;
+							}
+							break;
+						}
+						pos = (pos+1) & mask;
+					}
+					if (slots[pos] == -1) slots[pos] = r;
+				}
+			}
+		}
+		TableJoin& join;
+		const std::vector<std::vector<int> >& part_rows;
+		std::vector<int> dup_a;
+		std::vector<int> dup_b;
+	};
+	
+	/** Folds one chunk into the aggregates of a range of value columns.
+	 Columns are independent, so each is owned by one thread. */
+	struct JoinAggTask {
+		JoinAggTask(TableJoin& join_s, const std::vector<JoinColumn>& vals_s,
+					const std::vector<int>& match_s,
+					const std::vector<JoinAggregation>& aggs_s)
+		: join(join_s), vals(vals_s), match(match_s), aggs(aggs_s) {}
+		void operator()(int start, int end, int thread_id) {
+			for (int c=start; c<end; c++) {
+				join.Aggregate(c, vals[c], match, aggs[c]);
+			}
+		}
+		TableJoin& join;
+		const std::vector<JoinColumn>& vals;
+		const std::vector<int>& match;
+		const std::vector<JoinAggregation>& aggs;
+	};
+}
+
+Gda::TableJoin::TableJoin() : part_bits(0)
+{
+}
+
+bool Gda::TableJoin::Build(const JoinKeys& base_keys, wxString& err_msg)
+{
+	base = base_keys;
+	base.ComputeHashes();
+	int n = base.num_rows;
+	// partition by the top bits of the hash so that partitions can be
+	// built concurrently; small tables use a single partition
+	part_bits = n >= 65536 ? 6 : 0;
+	int num_parts = 1 << part_bits;
+	std::vector<std::vector<int> > part_rows(num_parts);
+	if (part_bits == 0) {
+		part_rows[0].resize(n);
+		for (int i=0; i<n; i++) part_rows[0][i] = i;
+	} else {
+		std::vector<int> cnt(num_parts, 0);
+		for (int i=0; i<n; i++) cnt[base.hashes[i] >> (64-part_bits)]++;
+		for (int p=0; p<num_parts; p++) part_rows[p].reserve(cnt[p]);
+		for (int i=0; i<n; i++) {
+			part_rows[base.hashes[i] >> (64-part_bits)].push_back(i);
+		}
+	}
+	slots.clear();
+	slots.resize(num_parts);
+	JoinBuildTask task(*this, part_rows);
+	Gda::ParallelFor(num_parts, task);
+	
+	int dup_a = -1, dup_b = -1;
+	for (int p=0; p<num_parts; p++) {
+		if (task.dup_a[p] == -1) continue;
+		if (dup_a == -1 || task.dup_a[p] < dup_a) {
+			dup_a = task.dup_a[p];
+			dup_b = task.dup_b[p];
+		}
+	}
+	if (dup_a != -1) {
+		err_msg = wxString::Format("rows %d and %d have the same key value",
+								   dup_a+1, dup_b+1);
+		return false;
+	}
+	return true;
+}
+
+int Gda::TableJoin::Find(const JoinKeys& probe, int row) const
+{
+	uint64_t h = probe.hashes[row];
+	int p = part_bits == 0 ? 0 : (int) (h >> (64-part_bits));
+	const std::vector<int>& table = slots[p];
+	if (table.empty()) return -1;
+	const uint64_t mask = table.size()-1;
+	uint64_t pos = h & mask;
+	while (table[pos] != -1) {
+		int b = table[pos];
+		if (base.hashes[b] == h && base.Equal(b, probe, row)) return b;
+		pos = (pos+1) & mask;
+	}
+	return -1;
+}
+
+GdaConst::FieldType Gda::TableJoin::ResultType(GdaConst::FieldType t,
+											   JoinAggregation agg)
+{
+	if (agg == join_count) return GdaConst::long64_type;
+	if (t == GdaConst::string_type) return t;
+	if (agg == join_mean) return GdaConst::double_type;
+	return t;
+}
+
+bool Gda::TableJoin::Run(JoinChunkReader& reader, JoinType join_type,
+						 const JoinKeys& import_keys,
+						 const std::vector<JoinColumn>& import_vals,
+						 const std::vector<JoinAggregation>& aggs,
+						 wxString& err_msg, int chunk_size)
+{
+	int n_base = base.num_rows;
+	int n_vals = import_vals.size();
+	bool unique = false;
+	for (int c=0; c<n_vals; c++) if (aggs[c] == join_unique) unique = true;
+	
+	match_count.assign(n_base, 0);
+	results.resize(n_vals);
+	agg_n.resize(n_vals);
+	agg_sum.resize(n_vals);
+	for (int c=0; c<n_vals; c++) {
+		JoinColumn& out = results[c];
+		out = JoinColumn();
+		out.type = ResultType(import_vals[c].type, aggs[c]);
+		out.Resize(n_base);
+		bool is_count = (aggs[c] == join_count);
+		for (int b=0; b<n_base; b++) out.undefined[b] = !is_count;
+		agg_n[c].assign(n_base, 0);
+		agg_sum[c].clear();
+		if (aggs[c] == join_mean) agg_sum[c].assign(n_base, 0);
+	}
+	
+	JoinKeys keys = import_keys;
+	std::vector<JoinColumn> vals = import_vals;
+	std::vector<int> match;
+	if (chunk_size < 1) chunk_size = 65536;
+	int n_import = reader.GetNumRows();
+	for (int start=0; start<n_import; start+=chunk_size) {
+		int n = chunk_size < n_import-start ? chunk_size : n_import-start;
+		reader.ReadChunk(start, n, keys, vals);
+		keys.ComputeHashes();
+		match.resize(n);
+		JoinProbeTask probe(*this, keys, match);
+		Gda::ParallelFor(n, probe, -1, hash_min_chunk);
+		
+		for (int r=0; r<n; r++) {
+			int b = match[r];
+			if (b < 0) continue;
+			if (++match_count[b] > 1 && unique) {
+				err_msg = "The import key field contains duplicate values ";
+				err_msg << "that match row " << b+1 << " of the current ";
+				err_msg << "table. Choose how to aggregate duplicate keys, ";
+				err_msg << "or choose a key field with unique values.";
+				return false;
+			}
+		}
+		if (join_type == anti_join) continue;
+		JoinAggTask agg_task(*this, vals, match, aggs);
+		Gda::ParallelFor(n_vals, agg_task);
+	}
+	
+	for (int c=0; c<n_vals; c++) {
+		if (aggs[c] != join_mean || results[c].type != GdaConst::double_type) {
+			continue;
+		}
+		for (int b=0; b<n_base; b++) {
+			if (agg_n[c][b] > 0) {
+				results[c].dbls[b] = agg_sum[c][b] / (double) agg_n[c][b];
+			}
+		}
+		agg_sum[c].clear();
+	}
+	
+	if (join_type == inner_join) {
+		for (int b=0; b<n_base; b++) {
+			if (match_count[b] > 0) continue;
+			err_msg = "The set of values in the import key fields ";
+			err_msg << "do not fully match current table. Please "
+					<< "choose keys with matching sets of values.";
+			return false;
+		}
+	}
+	return true;
+}
+
+void Gda::TableJoin::Aggregate(int col, const JoinColumn& vals,
+							   const std::vector<int>& match,
+							   JoinAggregation agg)
+{
+	JoinColumn& out = results[col];
+	std::vector<int>& cnt = agg_n[col];
+	bool is_str = (vals.type == GdaConst::string_type);
+	bool is_int = (vals.type == GdaConst::long64_type);
+	for (size_t r=0, sz=match.size(); r<sz; r++) {
+		int b = match[r];
+		if (b < 0 || vals.undefined[r]) continue;
+		bool first = (cnt[b]++ == 0);
+		out.undefined[b] = false;
+		if (agg == join_count) {
+			out.ints[b]++;
+		} else if (agg == join_mean && !is_str) {
+			agg_sum[col][b] += is_int ? (double) vals.ints[r] : vals.dbls[r];
+		} else if (is_str || agg == join_unique || agg == join_first ||
+				   first) {
+			if (!first) continue;
+			if (is_str) {
+				out.strs[b] = vals.strs[r];
+			} else if (is_int) {
+				out.ints[b] = vals.ints[r];
+			} else {
+				out.dbls[b] = vals.dbls[r];
+			}
+		} else if (is_int) {
+			wxInt64 v = vals.ints[r];
+			if (agg == join_sum) out.ints[b] += v;
+			else if (agg == join_min && v < out.ints[b]) out.ints[b] = v;
+			else if (agg == join_max && v > out.ints[b]) out.ints[b] = v;
+		} else {
+			double v = vals.dbls[r];
+			if (agg == join_sum) out.dbls[b] += v;
+			else if (agg == join_min && v < out.dbls[b]) out.dbls[b] = v;
+			else if (agg == join_max && v > out.dbls[b]) out.dbls[b] = v;
+		}
+	}
+}
+
+void Gda::TableJoin::GetUnmatchedRows(std::vector<int>& rows)
+{
+	rows.clear();
+	for (size_t b=0; b<match_count.size(); b++) {
+		if (match_count[b] == 0) rows.push_back(b);
+	}
+}
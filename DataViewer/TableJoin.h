@@ -0,0 +1,154 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_TABLE_JOIN_H__
+#define __GEODA_CENTER_TABLE_JOIN_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <wx/string.h>
+#include "../GdaConst.h"
+
+/**
+ Hash join of an import table onto the rows of the current table, used by
+ MergeTableDlg.  Keys are compared in their native types: each key column
+ holds either 64-bit integers or strings, and a key may span several
+ columns.  The current table is indexed once in an open addressing hash
+ table, split by hash into partitions that are built in parallel.  The
+ import table is then read in chunks through JoinChunkReader, so only one
+ chunk of import keys and values is held at a time, and each chunk is
+ probed in parallel and folded into per-row aggregates.
+ 
+ Several import rows may match one row of the current table.  Each value
+ column then uses one of the JoinAggregation rules, or join_unique to
+ reject such duplicates as merging did before.
+ */
+namespace Gda {
+	enum JoinType {
+		left_join,  // unmatched rows get undefined values
+		inner_join, // every row of the current table must match
+		anti_join   // only find the rows that have no match
+	};
+	
+	enum JoinAggregation {
+		join_unique, // at most one import row may match
+		join_first, join_sum, join_mean, join_count, join_min, join_max
+	};
+	
+	struct JoinKeyColumn {
+		JoinKeyColumn() : is_int(true) {}
+		bool is_int;
+		std::vector<wxInt64> ints;
+		std::vector<std::string> strs;
+	};
+	
+	/** Key columns for the rows on one side of a join. */
+	struct JoinKeys {
+		JoinKeys() : num_rows(0) {}
+		/** Set the number of rows, keeping the column types. */
+		void Resize(int n);
+		/** Fill hashes from the key columns, in parallel for large n. */
+		void ComputeHashes();
+		bool Equal(int row, const JoinKeys& o, int o_row) const;
+		
+		int num_rows;
+		std::vector<JoinKeyColumn> cols;
+		std::vector<uint64_t> hashes;
+	};
+	
+	/** Values of one column for a range of rows.  type is one of
+	 GdaConst::double_type, long64_type or string_type, and only the
+	 matching vector is used. */
+	struct JoinColumn {
+		JoinColumn() : type(GdaConst::double_type) {}
+		void Resize(int n);
+		GdaConst::FieldType type;
+		std::vector<double> dbls;
+		std::vector<wxInt64> ints;
+		std::vector<wxString> strs;
+		std::vector<bool> undefined;
+	};
+	
+	/** Source of import rows for TableJoin::Run. */
+	class JoinChunkReader {
+	public:
+		virtual ~JoinChunkReader() {}
+		virtual int GetNumRows() = 0;
+		/** Read rows [start, start+n) of the import table.  keys and vals
+		 already have their column types set; the reader resizes them to
+		 n rows and fills them in.  Key hashes are computed by the caller. */
+		virtual void ReadChunk(int start, int n, JoinKeys& keys,
+							   std::vector<JoinColumn>& vals) = 0;
+	};
+	
+	class TableJoin {
+	public:
+		TableJoin();
+		
+		/** Index the keys of the current table.  Returns false with a
+		 message in err_msg if two rows have the same key. */
+		bool Build(const JoinKeys& base_keys, wxString& err_msg);
+		
+		/** Join every row of reader onto the indexed rows.  import_keys
+		 and import_vals describe the column types the reader fills in, one
+		 aggregation per value column.  Returns false with a message in
+		 err_msg if the join type or an aggregation is violated. */
+		bool Run(JoinChunkReader& reader, JoinType join_type,
+				 const JoinKeys& import_keys,
+				 const std::vector<JoinColumn>& import_vals,
+				 const std::vector<JoinAggregation>& aggs,
+				 wxString& err_msg, int chunk_size = 65536);
+		
+		/** Joined values for each row of the current table, one per
+		 import value column.  count gives long64 values, mean gives
+		 doubles, and sum, min and max of strings keep the first value. */
+		std::vector<JoinColumn>& GetResults() { return results; }
+		/** Number of import rows matched by each row of the current table. */
+		const std::vector<int>& GetMatchCounts() { return match_count; }
+		/** Rows of the current table with no matching import row. */
+		void GetUnmatchedRows(std::vector<int>& rows);
+		
+		/** Index of the row of the current table with the same key as row
+		 of probe, or -1.  probe hashes must be computed. */
+		int Find(const JoinKeys& probe, int row) const;
+		
+	private:
+		static GdaConst::FieldType ResultType(GdaConst::FieldType t,
+											  JoinAggregation agg);
+		void Aggregate(int col, const JoinColumn& vals,
+					   const std::vector<int>& match, JoinAggregation agg);
+		
+		JoinKeys base;
+		int part_bits;
+		/** One open addressing table per hash partition; each slot holds a
+		 row of base or -1. */
+		std::vector<std::vector<int> > slots;
+		
+		std::vector<JoinColumn> results;
+		std::vector<int> match_count;
+		std::vector<std::vector<int> > agg_n; // defined values per column
+		std::vector<std::vector<double> > agg_sum; // for mean
+		
+		friend struct JoinBuildTask;
+		friend struct JoinAggTask;
+	};
+}
+
+#endif
@@ -100,3 +100,12 @@ void TimeState::notifyObservers()
 		(*it)->update(this);
 	}
 }
+
+void TimeState::notifyObserversOfNextTime(int next_time)
+{
+	if (next_time < 0 || next_time >= GetTimeSteps()) return;
+	for (std::list<TimeStateObserver*>::iterator it=observers.begin();
+		 it != observers.end(); ++it) {
+		(*it)->PrepareTime(next_time);
+	}
+}
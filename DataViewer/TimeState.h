@@ -39,6 +39,7 @@ public:
 	void registerObserver(TimeStateObserver* o);
 	void removeObserver(TimeStateObserver* o);
 	void notifyObservers();
+	void notifyObserversOfNextTime(int next_time);
 	
 	int GetCurrTime();
 	wxString GetCurrTimeString();
@@ -25,6 +25,10 @@ class TimeState;  // forward declaration
 class TimeStateObserver {
 public:
 	virtual void update(TimeState* o) = 0;
+	/** Hint that time period next_time is about to become current, for
+	 example during an animation.  Observers can use this to render ahead
+	 of time.  Default does nothing. */
+	virtual void PrepareTime(int next_time) {}
 };
 
 #endif
@@ -295,6 +295,7 @@ void CatClassifHistCanvas::PopulateCanvas()
 	LOG_MSG("Entering CatClassifHistCanvas::PopulateCanvas");
 	BOOST_FOREACH( GdaShape* shp, background_shps ) { delete shp; }
 	background_shps.clear();
+	scale_trans_batch.Cancel();
 	BOOST_FOREACH( GdaShape* shp, selectable_shps ) { delete shp; }
 	selectable_shps.clear();
 	BOOST_FOREACH( GdaShape* shp, foreground_shps ) { delete shp; }
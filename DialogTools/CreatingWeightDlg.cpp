@@ -23,6 +23,7 @@
 #include <string>
 #include <wx/filedlg.h>
 #include <wx/msgdlg.h>
+#include <wx/progdlg.h>
 #include <wx/sizer.h>
 #include <wx/valtext.h>
 #include <wx/xrc/xmlres.h>
@@ -33,11 +34,14 @@
 #include "../ShapeOperations/shp2cnt.h"
 #include "../ShapeOperations/ShapeFile.h"
 #include "../ShapeOperations/VoronoiUtils.h"
+#include "../ShapeOperations/CsrWeight.h"
+#include "../ShapeOperations/GeomMeasures.h"
 #include "../Project.h"
 #include "../GeneralWxUtils.h"
 #include "../DataViewer/TableInterface.h"
 #include "../DataViewer/TableState.h"
 #include "../ShapeOperations/WeightsManager.h"
+#include "../ShapeOperations/WeightsBuildJob.h"
 #include "../GeoDa.h"
 #include "../TemplateCanvas.h"
 #include "../GenUtils.h"
@@ -76,6 +80,8 @@ BEGIN_EVENT_TABLE( CreatingWeightDlg, wxDialog )
     EVT_BUTTON( XRCID("wxID_CLOSE"), CreatingWeightDlg::OnCloseClick )
     EVT_CHECKBOX( XRCID("IDC_PRECISION_CBX"),
                  CreatingWeightDlg::OnPrecisionThresholdCheck)
+    EVT_CHECKBOX( XRCID("IDC_BORDER_WEIGHTS_CBX"),
+                 CreatingWeightDlg::OnBorderWeightsCheck)
 END_EVENT_TABLE()
 
 
@@ -109,6 +115,7 @@ bool CreatingWeightDlg::Create( wxWindow* parent, wxWindowID id,
     m_include_lower = 0;
     m_txt_precision_threshold = 0;
     m_cbx_precision_threshold = 0;
+    m_cbx_border_weights = 0;
     m_distance_metric = 0;
     m_X = 0;
     m_Y = 0;
@@ -149,6 +156,7 @@ void CreatingWeightDlg::CreateControls()
     m_threshold = XRCCTRL(*this, "IDC_THRESHOLD_EDIT", wxTextCtrl);
     m_txt_precision_threshold = XRCCTRL(*this, "IDC_PRECISION_THRESHOLD_EDIT",
                                     wxTextCtrl);
+    m_cbx_border_weights = XRCCTRL(*this, "IDC_BORDER_WEIGHTS_CBX", wxCheckBox);
     m_sliderdistance = XRCCTRL(*this, "IDC_THRESHOLD_SLIDER", wxSlider);
     m_radio2 = XRCCTRL(*this, "IDC_RADIO_QUEEN", wxRadioButton);
     m_radio1 = XRCCTRL(*this, "IDC_RADIO_ROOK", wxRadioButton);
@@ -257,7 +265,6 @@ void CreatingWeightDlg::OnCreateClick( wxCommandEvent& event )
 	int m_alpha = 1;
 
 	GalElement *gal = 0;
-    GalElement *Hgal = 0;
 	GwtElement *gwt = 0;
 	bool done = false;
 	
@@ -276,9 +283,10 @@ void CreatingWeightDlg::OnCreateClick( wxCommandEvent& event )
 				t_val /= 1.609344; // convert km to mi
 			}
 			if (t_val > 0) {
-				gwt = shp2gwt(m_num_obs, m_XCOO, m_YCOO,
-							  t_val * m_thres_delta_factor,
-							  1, m_method);
+				WeightsSpec spec(WeightsSpec::threshold_type);
+				spec.threshold = t_val * m_thres_delta_factor;
+				spec.method = m_method;
+				if (!BuildWeights(spec, gal, gwt)) return;
 				if (gwt == 0) {
 					wxString m;
 					m << "No weights file was created due to all observations ";
@@ -302,7 +310,10 @@ void CreatingWeightDlg::OnCreateClick( wxCommandEvent& event )
 		case 4: // k nn
 		{
 			if (m_kNN > 0 && m_kNN < m_num_obs) {
-				gwt = DynKNN(m_XCOO, m_YCOO, m_kNN+1, m_method);
+				WeightsSpec spec(WeightsSpec::knn_type);
+				spec.k = m_kNN;
+				spec.method = m_method;
+				if (!BuildWeights(spec, gal, gwt)) return;
 				if (gwt==0) return;
 				
 				Shp2GalProgress(0, gwt,
@@ -323,27 +334,36 @@ void CreatingWeightDlg::OnCreateClick( wxCommandEvent& event )
 		case 6: // queen
 		{
 			bool is_rook = (m_radio == 5);
+			if (IsBorderWeights()) {
+				WeightsSpec spec(WeightsSpec::border_type);
+				if (!BuildWeights(spec, gal, gwt)) return;
+				if (!gwt) {
+					wxString msg("No polygons were found to share a border. "
+								 "Borders are only shared where neighboring "
+								 "polygons have common vertices.");
+					wxMessageDialog dlg(NULL, msg,
+										"Empty Border Weights",
+										wxOK | wxICON_WARNING);
+					dlg.ShowModal();
+					break;
+				}
+				Shp2GalProgress(0, gwt,
+								project->GetProjectTitle(), outputfile,
+								id, id_vec);
+				if (gwt) delete [] gwt; gwt = 0;
+				done = true;
+				break;
+			}
+			WeightsSpec spec(is_rook ? WeightsSpec::rook_type :
+							 WeightsSpec::queen_type);
+			spec.order = m_ooC;
+			spec.include_lower = m_check1;
 			if (project->main_data.header.shape_type == Shapefile::POINT) {
 				if (project->IsPointDuplicates()) {
 					project->DisplayPointDupsWarning();
 				}
 				
-				std::vector<std::set<int> > nbr_map;
-				if (is_rook) {
-					project->GetVoronoiRookNeighborMap(nbr_map);
-				} else {
-					project->GetVoronoiQueenNeighborMap(nbr_map);
-				}
-				gal = Gda::VoronoiUtils::NeighborMapToGal(nbr_map);
-				if (!gal) {
-					wxString msg("There was a problem generating voronoi "
-								 "contiguity neighbors.  Please report this.");
-					wxMessageDialog dlg(NULL, msg,
-										"Voronoi Contiguity Error",
-										wxOK | wxICON_ERROR);
-					dlg.ShowModal();
-					break;
-				}
+				if (!BuildWeights(spec, gal, gwt)) return;
 			} else {
                 double precision_threshold = 0.0;
                 if ( m_cbx_precision_threshold->IsChecked()) {
@@ -357,10 +377,32 @@ void CreatingWeightDlg::OnCreateClick( wxCommandEvent& event )
                         precision_threshold = 0.0;
                     }
                 }
-				gal = shp2gal(project->main_data, (is_rook ? 1 : 0), true,
-                              precision_threshold);
+				spec.precision_threshold = precision_threshold;
+				if (!BuildWeights(spec, gal, gwt)) return;
 			}
 			
+			if (!gal && spec.order > 1 && !spec.include_lower) {
+				// the first order neighbors may well exist
+				wxString msg = wxString::Format("No neighbors of order %d "
+												"were found.  Try a lower "
+												"order, or include the lower "
+												"orders.", spec.order);
+				wxMessageDialog dlg(NULL, msg,
+									"Empty Contiguity Weights Created",
+									wxOK | wxICON_WARNING);
+				dlg.ShowModal();
+				break;
+			}
+			if (!gal &&
+				project->main_data.header.shape_type == Shapefile::POINT) {
+				wxString msg("There was a problem generating voronoi "
+							 "contiguity neighbors.  Please report this.");
+				wxMessageDialog dlg(NULL, msg,
+									"Voronoi Contiguity Error",
+									wxOK | wxICON_ERROR);
+				dlg.ShowModal();
+				break;
+			}
 			if (!gal) {
                 // could be an empty weights file, and should prompt user
                 // to setup Precision Threshold
@@ -393,17 +435,9 @@ void CreatingWeightDlg::OnCreateClick( wxCommandEvent& event )
                 m_txt_precision_threshold->SetValue(tmpTxt);
                 break;
             }
-			if (m_ooC > 1) {
-				Hgal = HOContiguity(m_ooC, m_num_obs, gal, m_check1);
-				Shp2GalProgress(Hgal, 0,
-								project->GetProjectTitle(), outputfile,
-								id, id_vec);
-			} else {
- 		        Shp2GalProgress(gal, 0,
-								project->GetProjectTitle(), outputfile,
-								id, id_vec);
-			}
-			if (Hgal) delete [] Hgal; Hgal = 0;
+			Shp2GalProgress(gal, 0,
+							project->GetProjectTitle(), outputfile,
+							id, id_vec);
 			if (gal) delete [] gal; gal = 0;
 			done = true;
 		}
@@ -442,6 +476,12 @@ void CreatingWeightDlg::OnPrecisionThresholdCheck( wxCommandEvent& event )
     }
 }
 
+void CreatingWeightDlg::OnBorderWeightsCheck( wxCommandEvent& event )
+{
+	// border weights are first order only and use exact vertex matches
+	SetRadioBtnAndAssocWidgets(m_radio);
+}
+
 void CreatingWeightDlg::OnCRadioRookSelected( wxCommandEvent& event )
 {
 	SetRadioBtnAndAssocWidgets(5);
@@ -507,6 +547,7 @@ void CreatingWeightDlg::SetRadioBtnAndAssocWidgets(int radio)
 	m_contiguity->Enable(false);
 	m_spincont->Enable(false);
     m_cbx_precision_threshold->Enable(false);
+	m_cbx_border_weights->Enable(false);
 	m_include_lower->Enable(false);
 	EnableThresholdControls(false);
 	FindWindow(XRCID("IDC_STATIC_KNN"))->Enable(false);
@@ -525,10 +566,15 @@ void CreatingWeightDlg::SetRadioBtnAndAssocWidgets(int radio)
 		case 6: // queen
 		case 5: { // rook
 			FindWindow(XRCID("IDC_STATIC_OOC1"))->Enable(true);
-			m_contiguity->Enable(true);
-			m_spincont->Enable(true);
-            m_cbx_precision_threshold->Enable(true);
-			m_include_lower->Enable(true);
+			m_cbx_border_weights->Enable(m_radio == 5 &&
+				project->main_data.header.shape_type == Shapefile::POLYGON);
+			bool b = !IsBorderWeights();
+			m_contiguity->Enable(b);
+			m_spincont->Enable(b);
+            m_cbx_precision_threshold->Enable(b);
+            m_txt_precision_threshold->Enable(b &&
+				m_cbx_precision_threshold->IsChecked());
+			m_include_lower->Enable(b);
 		}
 			break;
 		case 3: { // threshold distance
@@ -878,9 +924,17 @@ bool CreatingWeightDlg::IsSaveAsGwt()
 	// 4 - k-nn - GWT
 	// 5 - rook - GAL
 	// 6 - queen - GAL
+	// rook weighted by shared border length is also saved as GWT
+	if (IsBorderWeights()) return true;
 	return 	!(m_radio == 5 || m_radio == 6);	
 }
 
+bool CreatingWeightDlg::IsBorderWeights()
+{
+	return (m_radio == 5 && m_cbx_border_weights->IsEnabled() &&
+			m_cbx_border_weights->GetValue());
+}
+
 void CreatingWeightDlg::OnXSelected(wxCommandEvent& event )
 {
 	LOG_MSG("Entering CreatingWeightDlg::OnXSelected");
@@ -970,6 +1024,82 @@ void CreatingWeightDlg::OnIdVariableSelected( wxCommandEvent& event )
 	UpdateCreateButtonState();	
 }
 
+/** Builds spec with a WeightsBuildJob while a progress dialog is shown.
+ * Returns false if the user cancelled the build or it could not be started.
+ */
+bool CreatingWeightDlg::BuildWeights(const WeightsSpec& spec,
+									 GalElement*& gal, GwtElement*& gwt)
+{
+	gal = 0;
+	gwt = 0;
+	WeightsBuildJob job;
+	bool is_points = project->main_data.header.shape_type == Shapefile::POINT;
+	bool is_queen = spec.type == WeightsSpec::queen_type;
+	Gda::GeomMeasures* gm = 0;
+	bool had_borders = true;
+	if (spec.type == WeightsSpec::knn_type ||
+		spec.type == WeightsSpec::threshold_type) {
+		job.SetCoordinates(m_XCOO, m_YCOO);
+	} else if (spec.type == WeightsSpec::border_type) {
+		// the job computes missing borders into the project's measures
+		gm = project->GetGeomMeasuresForBorders();
+		had_borders = gm->HasSharedBorders();
+		job.SetPolygons(&project->main_data);
+		job.SetGeomMeasures(gm);
+	} else if (is_points && project->HasVoronoiNeighbors(is_queen)) {
+		CsrWeight w;
+		if (is_queen) {
+			project->GetVoronoiQueenNeighbors(w);
+			job.SetContiguity(&w, 0);
+		} else {
+			project->GetVoronoiRookNeighbors(w);
+			job.SetContiguity(0, &w);
+		}
+	} else if (is_points) {
+		// the job builds the Voronoi diagram, the project keeps the result
+		std::vector<double> x;
+		std::vector<double> y;
+		project->GetCenters(x, y);
+		job.SetPoints(x, y);
+	} else {
+		job.SetPolygons(&project->main_data);
+	}
+	std::vector<WeightsSpec> specs(1, spec);
+	if (!job.Start(specs)) return false;
+	
+	FindWindow(XRCID("wxID_OK"))->Enable(false);
+	FindWindow(XRCID("wxID_CLOSE"))->Enable(false);
+	const int prog_n_max = 1000;
+	wxProgressDialog prog_dlg("Weights File Creation",
+							  "Creating weights...", prog_n_max, this,
+							  wxPD_CAN_ABORT | wxPD_AUTO_HIDE | wxPD_APP_MODAL);
+	bool cont = true;
+	while (cont && !job.IsDone()) {
+		long n_max = job.GetProgressMax();
+		int val = 0;
+		if (n_max > 0) {
+			val = (int) ((prog_n_max-1) * (double) job.GetProgress() / n_max);
+		}
+		cont = prog_dlg.Update(val);
+		if (cont) wxMilliSleep(50);
+	}
+	if (cont) {
+		job.Wait();
+		gal = job.TakeGal(0);
+		gwt = job.TakeGwt(0);
+		if (is_points && (is_queen || spec.type == WeightsSpec::rook_type)) {
+			project->SetVoronoiNeighbors(job.GetContiguity(true),
+										 job.GetContiguity(false));
+		}
+		if (gm && !had_borders) project->SaveSharedBorders();
+	} else {
+		job.Cancel();
+	}
+	FindWindow(XRCID("wxID_OK"))->Enable(true);
+	FindWindow(XRCID("wxID_CLOSE"))->Enable(true);
+	return cont;
+}
+
 /** layer_name: layer name
  * ofn: output file name
  * idd: id column name
@@ -993,6 +1123,8 @@ bool CreatingWeightDlg::Shp2GalProgress(GalElement *gal, GwtElement *gwt,
 		flag = WriteGwt(gwt, layer_name, ofn, idd, id_vec, 1, geodaL );
 	else if (m_radio == 4) // kNN
 		flag = WriteGwt(gwt, layer_name, ofn, idd, id_vec, -2, geodaL);
+	else if (IsBorderWeights()) // shared border length
+		flag = WriteGwt(gwt, layer_name, ofn, idd, id_vec, 1, geodaL);
 	else flag = false;
 
 	if (!flag) {
@@ -37,6 +37,7 @@ class GwtElement;
 class Project;
 class TableInterface;
 class TableState;
+struct WeightsSpec;
 
 /** NOTE: CreatingWeightDlg is still modal even though it is a
  TableStateObserver. The plan is to make it non-modal in the future.*/
@@ -79,6 +80,7 @@ public:
     void OnCreateClick( wxCommandEvent& event );
     void OnCloseClick( wxCommandEvent& event );
     void OnPrecisionThresholdCheck( wxCommandEvent& event );
+    void OnBorderWeightsCheck( wxCommandEvent& event );
 
 	/** Implementation of TableStateObserver interface */
 	virtual void update(TableState* o);
@@ -103,6 +105,7 @@ private:
     wxTextCtrl* m_threshold;
     wxCheckBox* m_cbx_precision_threshold;
     wxTextCtrl* m_txt_precision_threshold;
+    wxCheckBox* m_cbx_border_weights;
     wxSlider* m_sliderdistance;
     wxRadioButton* m_radio4;
     wxCheckBox* m_radio9;
@@ -148,6 +151,12 @@ private:
 	void InitDlg();
 	bool CheckID(const wxString& id);
 	bool IsSaveAsGwt(); // determine if save type will be GWT or GAL.
+	// true if rook weights are to be weighted by shared border length
+	bool IsBorderWeights();
+	// builds spec on background threads behind a cancellable progress
+	// dialog.  Returns false if cancelled.
+	bool BuildWeights(const WeightsSpec& spec, GalElement*& gal,
+					  GwtElement*& gwt);
     bool Shp2GalProgress(GalElement *gal, GwtElement *gwt,
 						 const wxString& ifn, const wxString& ofn,
 						 const wxString& idd,
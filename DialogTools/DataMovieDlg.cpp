@@ -18,6 +18,7 @@
  */
 
 #include <wx/sizer.h>
+#include <wx/stopwatch.h>
 #include <wx/xrc/xmlres.h>
 #include "../FramesManager.h"
 #include "../DataViewer/TableInterface.h"
@@ -122,6 +123,8 @@ all_init(false)
 								wxStaticText);
 	cur_val_txt = wxDynamicCast(FindWindow(XRCID("ID_CUR_VAL_TXT")),
 								wxStaticText);
+	frame_time_txt = wxDynamicCast(FindWindow(XRCID("ID_FRAME_TIME_TXT")),
+								   wxStaticText);
 	loop_cb = wxDynamicCast(FindWindow(XRCID("ID_LOOP")), wxCheckBox);
 	reverse_cb = wxDynamicCast(FindWindow(XRCID("ID_REVERSE")), wxCheckBox);
 	cumulative_cb = wxDynamicCast(FindWindow(XRCID("ID_CUMULATIVE")),
@@ -259,13 +262,14 @@ void DataMovieDlg::OnPlayPauseButton(wxCommandEvent& ev)
 			new_slider_val = GetSliderPosNum()-1;
 			if (new_slider_val < 0) new_slider_val = num_obs;
 		}
+		wxStopWatch sw;
 		ChangePosNum(new_slider_val);
 		
 		playing = true;
 		play_button->SetLabel("||");
 		Refresh();
 		if (!timer) timer = new DataMovieTimer(this);
-		timer->Start(delay_ms);
+		ScheduleNextFrame(sw.Time());
 	}
 }
 
@@ -291,7 +295,7 @@ void DataMovieDlg::ChangeSpeed(int delay_ms)
 {
 	if (!all_init) return;
 	if (timer && timer->IsRunning()) {
-		timer->Start(delay_ms);
+		timer->Start(delay_ms, wxTIMER_ONE_SHOT);
 	}
 }
 
@@ -498,9 +502,30 @@ void DataMovieDlg::UpdateDelayFromSlider()
 	ChangeSpeed(delay_ms);	
 }
 
+/** The timer runs in one-shot mode and is restarted after each frame with
+ the requested delay less the time already spent on the frame, so that the
+ playback rate does not drift when views are slow to redraw. */
+void DataMovieDlg::ScheduleNextFrame(long elapsed_ms)
+{
+	SetFrameTimeTxt(elapsed_ms);
+	if (!playing || !timer) return;
+	long wait_ms = delay_ms - elapsed_ms;
+	if (wait_ms < 1) wait_ms = 1;
+	timer->Start((int) wait_ms, wxTIMER_ONE_SHOT);
+}
+
+void DataMovieDlg::SetFrameTimeTxt(long elapsed_ms)
+{
+	if (!frame_time_txt) return;
+	wxString s;
+	s << elapsed_ms << " ms/frame";
+	frame_time_txt->SetLabelText(s);
+}
+
 void DataMovieDlg::TimerCall()
 {
 	if (!playing) return;
+	wxStopWatch sw;
 	wxCommandEvent ev;
 	int new_time_step;
 	if (forward) {
@@ -525,6 +550,7 @@ void DataMovieDlg::TimerCall()
 		}
 	}
 	ChangePosNum(new_time_step);
+	ScheduleNextFrame(sw.Time());
 }
 
 /** FramesManager calls update when time changes, but this dialog does
@@ -89,6 +89,8 @@ public:
 	
 	void UpdateDelayFromSlider();
 	void TimerCall();
+	void ScheduleNextFrame(long elapsed_ms);
+	void SetFrameTimeTxt(long elapsed_ms);
 	
 	/** Implementation of FramesManagerObserver interface */
 	virtual void update(FramesManager* o);
@@ -123,6 +125,7 @@ private:
 	wxStaticText* max_txt;
 	wxStaticText* cur_obs_txt;
 	wxStaticText* cur_val_txt;
+	wxStaticText* frame_time_txt;
 	wxCheckBox* loop_cb;
 	wxCheckBox* reverse_cb;
 	wxCheckBox* cumulative_cb;
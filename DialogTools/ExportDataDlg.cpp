@@ -439,11 +439,11 @@ ExportDataDlg::CreateOGRLayer(wxString& ds_name, TableInterface* table,
         for(size_t i=0; i<geometries.size(); i++) selected_rows.push_back(i);
     }
 
-	// convert to OGR geometries
-	vector<OGRGeometry*> ogr_geometries;
+	// geometries are converted to OGR geometries batch by batch while
+	// exporting, only the layer geometry type is needed here
 	OGRwkbGeometryType geom_type = 
-		OGRDataAdapter::GetInstance().MakeOGRGeometries(
-			geometries, shape_type, ogr_geometries, selected_rows);
+		OGRDataAdapter::GetInstance().GetOGRGeometryType(
+			geometries, shape_type, selected_rows);
 
 	// take care of empty layer name
     if (layer_name.empty()) {
@@ -455,8 +455,8 @@ ExportDataDlg::CreateOGRLayer(wxString& ds_name, TableInterface* table,
     
     OGRLayerProxy* new_layer = OGRDataAdapter::GetInstance().ExportDataSource(
                 ds_format.ToStdString(), ds_name.ToStdString(),
-                layer_name.ToStdString(), geom_type,
-                ogr_geometries, table, selected_rows, spatial_ref, is_update);
+                layer_name.ToStdString(), geom_type, geometries, shape_type,
+                table, selected_rows, spatial_ref, is_update);
     if (new_layer == NULL)
         return false;
     wxProgressDialog prog_dlg("Save data source progress dialog",
@@ -469,7 +469,11 @@ ExportDataDlg::CreateOGRLayer(wxString& ds_name, TableInterface* table,
         if ( new_layer->stop_exporting == true )
             return false;
         // update progress bar
-        cont = prog_dlg.Update(new_layer->export_progress);
+        wxString prog_msg = "Saving data...";
+        if (new_layer->export_rate > 0)
+            prog_msg << wxString::Format(" (%.0f records/s)",
+                                         new_layer->export_rate);
+        cont = prog_dlg.Update(new_layer->export_progress, prog_msg);
         if (!cont ) {
             new_layer->stop_exporting = true;
             OGRDataAdapter::GetInstance().CancelExport(new_layer);
@@ -487,11 +491,6 @@ ExportDataDlg::CreateOGRLayer(wxString& ds_name, TableInterface* table,
 	if (!is_geometry_only)
 		for (size_t i=0; i < geometries.size(); i++) 
 			delete geometries[i];
-
-	//NOTE: export_ds will take ownership of ogr_geometries 
-	//for (size_t i=0; i<ogr_geometries.size(); i++) {
-	//	OGRGeometryFactory::destroyGeometry( ogr_geometries[i]);
-	//}
     return true;
 }
 
@@ -22,7 +22,10 @@
 #include <wx/image.h>
 #include <wx/xrc/xmlres.h>
 #include <wx/dcbuffer.h>
+#include <wx/stopwatch.h>
+#include <time.h>
 
+#include "../Explore/GlobalMoranEngine.h"
 #include "../ShapeOperations/GalWeight.h"
 #include "../ShapeOperations/shp.h"
 #include "../ShapeOperations/shp2cnt.h"
@@ -33,6 +36,20 @@
 #include "../logger.h"
 #include "RandomizationDlg.h"
 
+RandomizationTimer::RandomizationTimer(RandomizationDlg* dlg)
+: randomization_dlg(dlg)
+{
+}
+
+RandomizationTimer::~RandomizationTimer()
+{
+}
+
+void RandomizationTimer::Notify()
+{
+	if (randomization_dlg) randomization_dlg->TimerCall();
+}
+
 IMPLEMENT_CLASS( RandomizationDlg, wxDialog )
 
 BEGIN_EVENT_TABLE( RandomizationDlg, wxDialog )
@@ -51,7 +68,8 @@ RandomizationDlg::RandomizationDlg( const std::vector<double>& raw_data1_s,
 								   long style )
 : start(-1), stop(1), raw_data1(raw_data1_s), raw_data2(raw_data2_s), W(W_s),
 num_obs(raw_data1_s.size()), Permutations(NumPermutations),
-MoranI(NumPermutations, 0), is_bivariate(true)
+MoranI(NumPermutations, 0), is_bivariate(true), is_rate(false),
+engine(0), timer(0), batch_size(100)
 {
 	LOG_MSG("In RandomizationDlg::RandomizationDlg");
 	
@@ -74,7 +92,33 @@ RandomizationDlg::RandomizationDlg( const std::vector<double>& raw_data1_s,
 								   long style )
 : start(-1), stop(1), raw_data1(raw_data1_s), W(W_s),
 num_obs(raw_data1_s.size()), Permutations(NumPermutations),
-MoranI(NumPermutations, 0), is_bivariate(false)
+MoranI(NumPermutations, 0), is_bivariate(false), is_rate(false),
+engine(0), timer(0), batch_size(100)
+{
+	LOG_MSG("In RandomizationDlg::RandomizationDlg");
+	
+	SetParent(parent);
+    CreateControls();
+    Centre();
+	
+	SetBackgroundStyle(wxBG_STYLE_CUSTOM);
+	
+	CalcMoran();
+	Init();
+}
+
+RandomizationDlg::RandomizationDlg( const GalElement* W_s,
+								   const std::vector<double>& events_s,
+								   const std::vector<double>& base_s,
+								   int NumPermutations,
+								   wxWindow* parent, wxWindowID id,
+								   const wxString& caption, 
+								   const wxPoint& pos, const wxSize& size,
+								   long style )
+: start(-1), stop(1), raw_data1(events_s), raw_data2(base_s), W(W_s),
+num_obs(events_s.size()), Permutations(NumPermutations),
+MoranI(NumPermutations, 0), is_bivariate(false), is_rate(true),
+engine(0), timer(0), batch_size(100)
 {
 	LOG_MSG("In RandomizationDlg::RandomizationDlg");
 	
@@ -90,24 +134,20 @@ MoranI(NumPermutations, 0), is_bivariate(false)
 
 void RandomizationDlg::CalcMoran()
 {
-	Moran = 0;
-	if (is_bivariate) {
-		for (int i=0; i<num_obs; i++) {
-			Moran += W[i].SpatialLag(raw_data2) * raw_data1[i];
-		}
+	CsrWeight w(W, num_obs);
+	engine = new GlobalMoranEngine(w);
+	if (is_rate) {
+		engine->SetRates(raw_data1, raw_data2);
+	} else if (is_bivariate) {
+		engine->SetData(raw_data1, raw_data2);
 	} else {
-		for (int i=0; i<num_obs; i++) {
-			Moran += W[i].SpatialLag(raw_data1) * raw_data1[i];
-		}
+		engine->SetData(raw_data1);
 	}
-	Moran /= (double) num_obs - 1.0;
+	Moran = engine->GetMoranI();
 }
 
 void RandomizationDlg::Init()
 {
-	perm = new int[num_obs];
-	theRands = new long[num_obs];
-	
 	if (Permutations <= 10) bins = 10;
 	else if (Permutations <= 100) bins = 20;
 	else if (Permutations <= 1000) bins = (Permutations+1)/4;
@@ -128,8 +168,11 @@ void RandomizationDlg::Init()
 
 RandomizationDlg::~RandomizationDlg()
 {
-	if (perm) delete [] perm;
-	if (theRands) delete [] theRands;
+	if (timer) {
+		timer->Stop();
+		delete timer;
+	}
+	if (engine) delete engine;
 }
 
 void RandomizationDlg::CreateControls()
@@ -147,10 +190,8 @@ void RandomizationDlg::OnOkClick( wxCommandEvent& event )
 {
 	wxRect rcClient = GetClientRect();
 	CheckSize(rcClient.GetWidth(), rcClient.GetHeight());
-    //RunPermutations();
 	RunRandomTrials();
 	Refresh();
-	FindWindow(XRCID("ID_CLOSE"))->SetLabel("Done");
 }
  
 void RandomizationDlg::DrawRectangle(wxDC* dc, int left, int top, int right,
@@ -170,8 +211,12 @@ void RandomizationDlg::DrawRectangle(wxDC* dc, int left, int top, int right,
 }
 
 // NOTE: must carefully look at thresholdBin!
+/** Permutations are run in batches from a timer so that the histogram
+ fills in while the dialog stays responsive.  Each batch runs on all
+ cores. */
 void RandomizationDlg::RunRandomTrials()
 {
+	if (timer) timer->Stop();
 	totFrequency = 0;
 	for (int i=0; i<bins; i++) freq[i]=0;
 	// thresholdBin bin already has one permutation
@@ -179,26 +224,34 @@ void RandomizationDlg::RunRandomTrials()
 	// leftmost and the righmost are the same so far
 	minBin = thresholdBin; 
 	maxBin = thresholdBin;
+	MMean = 0;
+	MSdev = 0;
+	pseudo_p_val = 1;
+	count_greater = true;
+	expected_val = engine->GetExpectedI();
+	
+	engine->SetSeed((uint64_t) time(0));
+	batch_size = 100;
+	if (!timer) timer = new RandomizationTimer(this);
+	timer->Start(10);
+}
 
-	for (int i=0; i<Permutations; i++) {
-		//create a random permutation
-		rng.Perm(num_obs, perm, theRands);
-		double newMoran = 0;
-		if (is_bivariate) {
-			for (int i=0; i<num_obs; i++) {
-				newMoran += (W[i].SpatialLag(raw_data2, perm)
-							 * raw_data1[perm[i]]);
-			}
-		} else {
-			for (int i=0; i<num_obs; i++) {
-				newMoran += (W[i].SpatialLag(raw_data1, perm)
-							 * raw_data1[perm[i]]);
-			}
-		}
-		newMoran /= (double) num_obs - 1.0;
+void RandomizationDlg::TimerCall()
+{
+	if (totFrequency >= Permutations) {
+		timer->Stop();
+		return;
+	}
+	int count = Permutations - totFrequency;
+	if (count > batch_size) count = batch_size;
+	
+	wxStopWatch sw;
+	engine->Permute(totFrequency, count, &MoranI[totFrequency]);
+	long ms = sw.Time();
+	
+	for (int i=totFrequency, iend=totFrequency+count; i<iend; i++) {
 		// find its place in the distribution
-		MoranI[ totFrequency++ ] = newMoran;
-		int newBin = (int)floor( (newMoran - start)/range );
+		int newBin = (int)floor( (MoranI[i] - start)/range );
 		if (newBin < 0) newBin = 0;
 		else if (newBin >= bins) newBin = bins-1;
 		
@@ -206,7 +259,20 @@ void RandomizationDlg::RunRandomTrials()
 		if (newBin < minBin) minBin = newBin;
 		if (newBin > maxBin) maxBin = newBin;
 	}
+	totFrequency += count;
 	UpdateStatistics();
+	
+	// aim for roughly 50 ms of work per batch
+	if (ms < 25) {
+		batch_size *= 2;
+	} else if (ms > 100 && batch_size > 1) {
+		batch_size /= 2;
+	}
+	if (totFrequency >= Permutations) {
+		timer->Stop();
+		FindWindow(XRCID("ID_CLOSE"))->SetLabel("Done");
+	}
+	Refresh();
 }
 
 /** For a pseudo p-val based on permutations, we use a one-sided test,
@@ -243,7 +309,7 @@ void RandomizationDlg::UpdateStatistics()
 	}
 	
 	pseudo_p_val = (((double) signFrequency)+1.0)/(((double) totFrequency)+1.0);
-	expected_val = (double) -1/(num_obs - 1);
+	expected_val = engine->GetExpectedI();
 }
 
 void RandomizationDlg::Draw(wxDC* dc)
@@ -251,6 +317,8 @@ void RandomizationDlg::Draw(wxDC* dc)
 	int fMax = freq[0];
 	for (int i=1; i<bins; i++) if (fMax < freq[i]) fMax = freq[i];
 
+	// scale a copy since the counts keep growing while permutations run
+	std::vector<int> freq(this->freq);
 	for (int i=0; i < bins; i++) {
 		double df = double (freq[i]* Height) / double (fMax);
 		freq[i] = int(df);
@@ -311,11 +379,24 @@ void RandomizationDlg::Draw(wxDC* dc)
 							Moran, expected_val, MMean, MSdev, zval);
 	dc->DrawText(text, Left, Top + Height + Bottom/2);
  
-	text = wxString::Format("permutations: %d  ", Permutations);
+	if (totFrequency < Permutations) {
+		text = wxString::Format("permutations: %d of %d  ", totFrequency,
+								Permutations);
+	} else {
+		text = wxString::Format("permutations: %d  ", Permutations);
+	}
 	dc->DrawText(text, Left+5, 20);
 
 	text = wxString::Format("pseudo p-value: %-7.6f", pseudo_p_val);
 	dc->DrawText(text, Left+5, 35);
+	
+	if (engine->IsAnalyticValid()) {
+		text = wxString::Format("analytical z-value  normality: %-7.4f"
+								"  randomization: %-7.4f",
+								engine->GetZNormality(),
+								engine->GetZRandomization());
+		dc->DrawText(text, Left+5, 50);
+	}
 }
 
 
@@ -21,9 +21,23 @@
 #define __GEODA_CENTER_RANDOMIZATION_DLG_H__
 
 #include <vector>
-#include "../ShapeOperations/Randik.h"
+#include <wx/timer.h>
+#include "../ShapeOperations/CsrWeight.h"
 
 class GalElement;
+class GlobalMoranEngine;
+class RandomizationDlg;
+
+class RandomizationTimer: public wxTimer
+{
+public:
+	RandomizationTimer(RandomizationDlg* dlg);
+	virtual ~RandomizationTimer();
+	virtual void Notify();
+	
+private:
+	RandomizationDlg* randomization_dlg;
+};
 
 class RandomizationDlg: public wxDialog
 {    
@@ -46,6 +60,16 @@ public:
 					 const wxPoint& pos = wxDefaultPosition,
 					 const wxSize& my_size = wxDefaultSize,
 					 long style = wxCAPTION|wxSYSTEM_MENU);
+	/** Moran's I of the Empirical Bayes standardized rates of events over
+	 base. */
+	RandomizationDlg( const GalElement* W,
+					 const std::vector<double>& events,
+					 const std::vector<double>& base, int NumPermutations,
+					 wxWindow* parent, wxWindowID id = wxID_ANY,
+					 const wxString& caption = "Randomization",
+					 const wxPoint& pos = wxDefaultPosition,
+					 const wxSize& my_size = wxDefaultSize,
+					 long style = wxCAPTION|wxSYSTEM_MENU);
 	virtual ~RandomizationDlg();
     void CreateControls();
 	void Init();
@@ -60,9 +84,10 @@ public:
 	void DrawRectangle(wxDC* dc, int left, int top, int right, int bottom,
 					   const wxColour color);
 	
-    void SinglePermute();
-	void RunPermutations();
 	void RunRandomTrials();
+	/** Run the next batch of permutations and refresh the histogram.
+	 Called by RandomizationTimer until all permutations are done. */
+	void TimerCall();
 	void UpdateStatistics();
 	
     int	Width, Height, Left, Right, Top, Bottom;
@@ -78,9 +103,10 @@ public:
 	std::vector<int> freq;
 	
 	bool is_bivariate;
+	bool is_rate;
 	const GalElement* W;
-	std::vector<double> raw_data1;
-	std::vector<double> raw_data2;
+	std::vector<double> raw_data1; // events when is_rate
+	std::vector<double> raw_data2; // base when is_rate
 	double Moran;
 	double  MMean;
 	double  MSdev;
@@ -89,14 +115,15 @@ public:
 	double  expected_val;
 	bool count_greater;
 	
-	int* perm;
-	long* theRands;
+	GlobalMoranEngine* engine;
+	RandomizationTimer* timer;
+	int batch_size; // permutations per timer call, adapted to run time
 	
-    Randik  rng;
 	bool    experiment_run_once;
 
 private:
-	RandomizationDlg() : start(-1), stop(1), Moran(0), Permutations(0) {}
+	RandomizationDlg() : start(-1), stop(1), Moran(0), Permutations(0),
+		engine(0), timer(0) {}
 };
 
 #endif
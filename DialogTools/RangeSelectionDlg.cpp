@@ -31,6 +31,7 @@
 #include "../Project.h"
 #include "../FramesManager.h"
 #include "../DataViewer/DataViewerAddColDlg.h"
+#include "../DataViewer/SortedColCache.h"
 #include "../DataViewer/TableInterface.h"
 #include "../DataViewer/TableState.h"
 #include "../logger.h"
@@ -207,30 +208,17 @@ void RangeSelectionDlg::OnSelRangeClick( wxCommandEvent& event )
 	m_min_text->GetValue().ToDouble(&min_dval);
 	double max_dval = 1;
 	m_max_text->GetValue().ToDouble(&max_dval);
-	std::vector<bool> undefined;
-	table_int->GetColUndefined(mcol, f_tm, undefined);
+	// The rows in range are found by binary search in the sorted column
+	// shared with the views.  Undefined values are never selected.
+	SortedColCache* sort_cache = project->GetSortedColCache();
+	std::vector<int> in_range;
 	if (table_int->GetColType(mcol) == GdaConst::long64_type) {
 		wxInt64 min_ival = ceil(min_dval);
 		wxInt64 max_ival = floor(max_dval);
-		std::vector<wxInt64> vec;
-		table_int->GetColData(mcol, f_tm, vec);
-		for (int i=0, iend=table_int->GetNumberRows(); i<iend; i++) {
-			if (!undefined[i] && min_ival <= vec[i] && vec[i] <= max_ival) {
-				if (!h[i]) nh[nh_cnt++]=i;
-			} else {
-				if (h[i]) nuh[nuh_cnt++]=i;
-			}
-		}
+		sort_cache->GetRowsInRange(mcol, f_tm, (double) min_ival,
+								   (double) max_ival, in_range);
 	} else if (table_int->GetColType(mcol) == GdaConst::double_type) {
-		std::vector<double> vec;
-		table_int->GetColData(mcol, f_tm, vec);
-		for (int i=0, iend=table_int->GetNumberRows(); i<iend; i++) {
-			if (!undefined[i] && min_dval <= vec[i] && vec[i] <= max_dval) {
-				if (!h[i]) nh[nh_cnt++]=i;
-			} else {
-				if (h[i]) nuh[nuh_cnt++]=i;
-			}
-		}
+		sort_cache->GetRowsInRange(mcol, f_tm, min_dval, max_dval, in_range);
 	} else {
 		wxString msg("Selected field is not a numeric type.  Please report "
 					 "this bug.");
@@ -238,6 +226,23 @@ void RangeSelectionDlg::OnSelRangeClick( wxCommandEvent& event )
 		dlg.ShowModal();
 		return;
 	}
+	// Only the rows in range are visited.  If some highlighted rows lie
+	// outside the range, the old selection is cleared first so that they
+	// need not be searched for.
+	int in_range_h = 0;
+	for (size_t i=0; i<in_range.size(); i++) {
+		if (h[in_range[i]]) {
+			in_range_h++;
+		} else {
+			nh[nh_cnt++] = in_range[i];
+		}
+	}
+	if (in_range_h < hs.GetTotalHighlighted()) {
+		hs.SetEventType(HighlightState::unhighlight_all);
+		hs.notifyObservers();
+		nh_cnt = 0;
+		for (size_t i=0; i<in_range.size(); i++) nh[nh_cnt++] = in_range[i];
+	}
 	if (nh_cnt > 0 || nuh_cnt > 0) {
 		hs.SetEventType(HighlightState::delta);
 		hs.SetTotalNewlyHighlighted(nh_cnt);
@@ -18,6 +18,7 @@
  */
 
 #include <wx/sizer.h>
+#include <wx/stopwatch.h>
 #include <wx/xrc/xmlres.h>
 #include "../FramesManager.h"
 #include "../DataViewer/TimeState.h"
@@ -90,6 +91,8 @@ loop(true), forward(true)
 		delay_ms = min_delay_ms + ((max_delay_ms-min_delay_ms)*sval)/100;	
 	}
 	cur_txt = wxDynamicCast(FindWindow(XRCID("ID_CUR_TXT")), wxStaticText);
+	frame_time_txt = wxDynamicCast(FindWindow(XRCID("ID_FRAME_TIME_TXT")),
+								   wxStaticText);
 	loop_cb = wxDynamicCast(FindWindow(XRCID("ID_LOOP")), wxCheckBox);
 	reverse_cb = wxDynamicCast(FindWindow(XRCID("ID_REVERSE")), wxCheckBox);
 	
@@ -193,13 +196,15 @@ void TimeChooserDlg::OnPlayPauseButton(wxCommandEvent& ev)
 			new_slider_val = GetSliderTimeStep()-1;
 			if (new_slider_val < 0) new_slider_val = GetTotalTimeSteps()-1;
 		}
+		wxStopWatch sw;
 		ChangeTime(new_slider_val);
 		
 		playing = true;
 		play_button->SetLabel("||");
 		Refresh();
+		time_state->notifyObserversOfNextTime(GetNextTimeStep(new_slider_val));
 		if (!timer) timer = new TimeChooserTimer(this);
-		timer->Start(delay_ms);
+		ScheduleNextFrame(sw.Time());
 	}
 }
 
@@ -260,7 +265,7 @@ void TimeChooserDlg::ChangeSpeed(int delay_ms)
 {
 	if (!all_init) return;
 	if (timer && timer->IsRunning()) {
-		timer->Start(delay_ms);
+		timer->Start(delay_ms, wxTIMER_ONE_SHOT);
 	}
 }
 
@@ -309,9 +314,47 @@ void TimeChooserDlg::UpdateDelayFromSlider()
 	ChangeSpeed(delay_ms);	
 }
 
+/** Return the time step that follows time during playback, or -1 if
+ playback stops after time. */
+int TimeChooserDlg::GetNextTimeStep(int time)
+{
+	int steps = GetTotalTimeSteps();
+	if (steps <= 1) return -1;
+	int next;
+	if (forward) {
+		next = time+1;
+		if (next >= steps) next = loop ? 0 : -1;
+	} else {
+		next = time-1;
+		if (next < 0) next = loop ? steps-1 : -1;
+	}
+	return next;
+}
+
+/** The timer runs in one-shot mode and is restarted after each frame with
+ the requested delay less the time already spent on the frame, so that the
+ playback rate does not drift when drawing is slow. */
+void TimeChooserDlg::ScheduleNextFrame(long elapsed_ms)
+{
+	SetFrameTimeTxt(elapsed_ms);
+	if (!playing || !timer) return;
+	long wait_ms = delay_ms - elapsed_ms;
+	if (wait_ms < 1) wait_ms = 1;
+	timer->Start((int) wait_ms, wxTIMER_ONE_SHOT);
+}
+
+void TimeChooserDlg::SetFrameTimeTxt(long elapsed_ms)
+{
+	if (!all_init || !frame_time_txt) return;
+	wxString s;
+	s << elapsed_ms << " ms/frame";
+	frame_time_txt->SetLabelText(s);
+}
+
 void TimeChooserDlg::TimerCall()
 {
 	if (!playing) return;
+	wxStopWatch sw;
 	wxCommandEvent ev;
 	int new_time_step;
 	if (forward) {
@@ -336,6 +379,9 @@ void TimeChooserDlg::TimerCall()
 		}
 	}
 	ChangeTime(new_time_step);
+	// draw the next period now, while waiting out the rest of this frame
+	time_state->notifyObserversOfNextTime(GetNextTimeStep(new_time_step));
+	ScheduleNextFrame(sw.Time());
 }
 
 void TimeChooserDlg::update(FramesManager* o)
@@ -77,7 +77,10 @@ public:
 	void SetCurTxt(wxInt64 val);
 	
 	void UpdateDelayFromSlider();
+	int GetNextTimeStep(int time);
 	void TimerCall();
+	void ScheduleNextFrame(long elapsed_ms);
+	void SetFrameTimeTxt(long elapsed_ms);
 	
 	/** Implementation of FramesManagerObserver interface */
 	virtual void update(FramesManager* o);
@@ -104,6 +107,7 @@ protected:
 	static const int max_delay_ms = 3000;
 	wxButton* play_button;
 	wxStaticText* cur_txt;
+	wxStaticText* frame_time_txt;
 	wxCheckBox* loop_cb;
 	wxCheckBox* reverse_cb;
 	bool all_init;
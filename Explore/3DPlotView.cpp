@@ -67,17 +67,13 @@ c3d_plot_frame(t_frame)
 	var_min.resize(var_info.size());
 	var_max.resize(var_info.size());
 	
-	std::vector<double> temp_vec(num_obs);
 	for (int v=0; v<num_vars; v++) {
-		table_int->GetColData(col_ids[v], data[v]);
-		table_int->GetColData(col_ids[v], scaled_d[v]);
-		int data_times = data[v].shape()[0];
+		table_int->GetColPanel(col_ids[v], data[v]);
+		scaled_d[v] = data[v];
+		int data_times = data[v].GetNumTimes();
 		data_stats[v].resize(data_times);
 		for (int t=0; t<data_times; t++) {
-			for (int i=0; i<num_obs; i++) {
-				temp_vec[i] = data[v][t][i];
-			}
-			data_stats[v][t].CalculateFromSample(temp_vec);
+			table_int->GetColSampleStats(col_ids[v], t, data_stats[v][t]);
 		}
 	}
 	
@@ -22,6 +22,7 @@
 
 #include <wx/glcanvas.h>
 #include "../FramesManagerObserver.h"
+#include "../DataViewer/SpaceTimePanel.h"
 #include "../Generic/HighlightStateObserver.h"
 #include "../GenUtils.h"
 #include "../TemplateCanvas.h"
@@ -115,8 +116,8 @@ public:
 	int num_time_vals;
 	int ref_var_index;
 	std::vector<GeoDaVarInfo> var_info;
-	std::vector<d_array_type> data;
-	std::vector<d_array_type> scaled_d;
+	std::vector<SpaceTimePanel> data;
+	std::vector<SpaceTimePanel> scaled_d;
 	std::vector< std::vector<SampleStatistics> > data_stats;
 	std::vector<double> var_min; // min over time
 	std::vector<double> var_max; // max over time
@@ -30,6 +30,7 @@
 #include <wx/msgdlg.h>
 #include <wx/xrc/xmlres.h>
 #include "../DialogTools/NumCategoriesDlg.h"
+#include "../DataViewer/SortedColCache.h"
 #include "../DataViewer/TableInterface.h"
 #include "../DataViewer/TimeState.h"
 #include "../GdaConst.h"
@@ -86,16 +87,11 @@ hinge_15(true)
 	hinge_stats.resize(data0_times);
 	data_stats.resize(data0_times);
 	data_sorted.resize(data0_times);
+	SortedColCache* sort_cache = project->GetSortedColCache();
 	for (int t=0; t<data0_times; t++) {
-		data_sorted[t].resize(num_obs);
-		for (int i=0; i<num_obs; i++) {
-			data_sorted[t][i].first = data[0][t][i];
-			data_sorted[t][i].second = i;
-		}
-		std::sort(data_sorted[t].begin(), data_sorted[t].end(),
-				  Gda::dbl_int_pair_cmp_less);
+		data_sorted[t] = sort_cache->GetSorted(col_ids[0], t);
 		hinge_stats[t].CalculateHingeStats(data_sorted[t]);
-		data_stats[t].CalculateFromSample(data_sorted[t]);
+		table_int->GetColSampleStats(col_ids[0], t, data_stats[t]);
 	}
 
 	template_frame->ClearAllGroupDependencies();
@@ -458,6 +454,7 @@ void BoxNewPlotCanvas::PopulateCanvas()
 	LOG_MSG("Entering BoxNewPlotCanvas::PopulateCanvas");
 	BOOST_FOREACH( GdaShape* shp, background_shps ) { delete shp; }
 	background_shps.clear();
+	scale_trans_batch.Cancel();
 	BOOST_FOREACH( GdaShape* shp, selectable_shps ) { delete shp; }
 	selectable_shps.clear();
 	BOOST_FOREACH( GdaShape* shp, foreground_shps ) { delete shp; }
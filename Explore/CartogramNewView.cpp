@@ -141,8 +141,14 @@ improve_table(6), realtime_updates(false), all_init(false)
 	std::vector<double> orig_data(num_obs);
 	project->GetCenters(orig_x, orig_y);
 	
-	cart_nbr_info = new CartNbrInfo(project->GetVoronoiRookNeighborGal(),
-									num_obs);
+	if (project->main_data.header.shape_type == Shapefile::POLYGON) {
+		cart_nbr_info = new CartNbrInfo(project->GetGeomMeasuresWithBorders(),
+										project->GetVoronoiRookNeighborGal(),
+										num_obs);
+	} else {
+		cart_nbr_info = new CartNbrInfo(project->GetVoronoiRookNeighborGal(),
+										num_obs);
+	}
 	int num_cart_times = (table_int->IsColTimeVariant(col_ids[RAD_VAR]) ?
 						  project->GetTableInt()->GetTimeSteps() : 1);
 	carts.resize(num_cart_times);
@@ -619,6 +625,7 @@ void CartogramNewCanvas::PopulateCanvas()
 	// Note: only need to delete selectable shapes if the cartogram
 	// relative positions change.  Otherwise, just reuse.
 	if (full_map_redraw_needed) {
+		scale_trans_batch.Cancel();
 		BOOST_FOREACH( GdaShape* shp, selectable_shps ) { delete shp; }
 		selectable_shps.clear();
 	}
@@ -897,9 +904,13 @@ void CartogramNewCanvas::ImproveAll(double max_seconds, int max_iters)
 				// thread terminates, it removes itself from the list.
 				std::list<wxThread*> worker_list;
 				int thread_id = 0;
+				// each cartogram is itself multi-threaded, so share the
+				// cores between the cartograms in this batch
+				int cart_workers = GenUtils::max<int>(1, num_cpus/num_in_batch);
 				for (int t=crt_min_tm; t<crt_min_tm+num_in_batch; t++) {
 					LOG_MSG(wxString::Format("    creating thread for cart %d",
 											 t)); 
+					carts[t]->set_num_workers(cart_workers);
 					DorlingCartWorkerThread* thread =
 						new DorlingCartWorkerThread(iters, carts[t],
 													&worker_list_mutex,
@@ -934,6 +945,7 @@ void CartogramNewCanvas::ImproveAll(double max_seconds, int max_iters)
 				LOG_MSG("All worker threads exited");
 			
 			} else {
+				carts[crt_min_tm]->set_num_workers(num_cpus);
 				carts[crt_min_tm]->improve(iters);
 				num_improvement_iters[crt_min_tm] += iters;
 			}
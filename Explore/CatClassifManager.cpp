@@ -19,14 +19,16 @@
 
 #include <boost/foreach.hpp>
 #include "../logger.h"
+#include "../DataViewer/SortedColCache.h"
 #include "../DataViewer/TableInterface.h"
 #include "../DataViewer/TableState.h"
 #include "CatClassifManager.h"
 
 CatClassifManager::CatClassifManager(TableInterface* _table_int,
 									 TableState* _table_state,
+									 SortedColCache* _sort_cache,
 									 CustomClassifPtree* cc_ptree)
-: table_state(_table_state), table_int(_table_int)
+: table_state(_table_state), table_int(_table_int), sort_cache(_sort_cache)
 {
 	BOOST_FOREACH(const CatClassifDef& cc, cc_ptree->GetCatClassifList()) {
 		CreateNewClassifState(cc);
@@ -130,15 +132,9 @@ void CatClassifManager::update(TableState* o)
 				bool found = table_int->DbColNmToColAndTm(cc.assoc_db_fld_name,
 														  col, tm);
 				if (!found) continue;
-				std::vector<double> v;
-				table_int->GetColData(col, tm, v);
-				int num_obs = table_int->GetNumberRows();
-				Gda::dbl_int_pair_vec_type data(num_obs);
-				for (int ii=0; ii<num_obs; ++ii) {
-					data[ii].first = v[ii];
-					data[ii].second = ii;
-				}
-				std::sort(data.begin(), data.end(), Gda::dbl_int_pair_cmp_less);
+				// the cache has already dropped the stale sort for this column
+				const Gda::dbl_int_pair_vec_type& data =
+					sort_cache->GetSorted(col, tm);
 				CatClassifDef _cc = cc;
 				CatClassification::SetBreakPoints(_cc.breaks, _cc.names, data,
 												  _cc.cat_classif_type,
@@ -28,13 +28,15 @@
 #include "CatClassification.h"
 #include "CatClassifState.h"
 
+class SortedColCache;
 class TableState;
 class TableInterface;
 
 class CatClassifManager : public TableStateObserver {
 public:
 	CatClassifManager(TableInterface* table_int,
-					  TableState* table_state, CustomClassifPtree* cc_ptree);
+					  TableState* table_state, SortedColCache* sort_cache,
+					  CustomClassifPtree* cc_ptree);
 	virtual ~CatClassifManager();
 	void GetTitles(std::vector<wxString>& titles);
 	CatClassifState* FindClassifState(const wxString& title);
@@ -55,6 +57,7 @@ private:
 	std::list<CatClassifState*> classif_states;
 	TableInterface* table_int;
 	TableState* table_state;
+	SortedColCache* sort_cache;
 };
 
 #endif
@@ -28,6 +28,8 @@
 #include "../DialogTools/NumCategoriesDlg.h"
 #include "../logger.h"
 #include "../GdaConst.h"
+#include "../GdaParallel.h"
+#include "../GdaTrace.h"
 #include "CatClassification.h"
 
 struct UniqueValElem {
@@ -54,15 +56,11 @@ void create_unique_val_mapping(std::vector<UniqueValElem>& uv_mapping,
 }
 
 /** Assume that b.size() <= N-1 */
-void pick_rand_breaks(std::vector<int>& b, int N)
+void pick_rand_breaks(std::vector<int>& b, int N,
+					  boost::uniform_01<boost::mt19937>& X)
 {
 	int num_breaks = b.size();
 	if (num_breaks > N-1) return;
-	// Mersenne Twister random number generator, randomly seeded
-	// with current time in seconds since Jan 1 1970.
-	static boost::mt19937 rng(std::time(0));
-	static boost::uniform_01<boost::mt19937> X(rng);
-	
 	std::set<int> s;
 	while (s.size() != num_breaks) s.insert(1 + (N-1)*X());
 	int cnt=0;
@@ -72,6 +70,15 @@ void pick_rand_breaks(std::vector<int>& b, int N)
 	std::sort(b.begin(), b.end());
 }
 
+void pick_rand_breaks(std::vector<int>& b, int N)
+{
+	// Mersenne Twister random number generator, randomly seeded
+	// with current time in seconds since Jan 1 1970.
+	static boost::mt19937 rng(std::time(0));
+	static boost::uniform_01<boost::mt19937> X(rng);
+	pick_rand_breaks(b, N, X);
+}
+
 // translate unique value breaks into normal breaks given unique value mapping
 void unique_to_normal_breaks(const std::vector<int>& u_val_breaks,
 							 const std::vector<UniqueValElem>& u_val_mapping,
@@ -275,84 +282,31 @@ void CatClassification::SetBreakPoints(std::vector<double>& breaks,
 	}
 }
 
-/** Update Categories based on num_cats and number time periods
- var is assumed to be sorted.
- num_cats is only used by themes where the user enters the number of
- categories.
- Note: LISA and Getis-Ord map themes are not supported by this function.
- */
-void CatClassification::PopulateCatClassifData(const CatClassifDef& cat_def,
+namespace CatClassification {
+namespace {
+/** Fill in the categories of canvas time steps [t_start, t_end) once
+ PopulateCatClassifData has created them.  For the themes accepted by
+ IsClassifiedByTm, a time step only touches its own categories, so
+ disjoint ranges may be classified concurrently. */
+void ClassifyCanvasTms(const CatClassifDef& cat_def, int num_cats,
 				const std::vector<Gda::dbl_int_pair_vec_type>& var,
 				CatClassifData& cat_data, std::vector<bool>& cats_valid,
-				std::vector<wxString>& cats_error_message)
+				std::vector<wxString>& cats_error_message,
+				int t_start, int t_end)
 {
-	int num_cats = cat_def.num_cats;
 	CatClassifType theme = cat_def.cat_classif_type;
 	int num_time_vals = var.size();
 	int num_obs = var[0].size();
-	if (theme == CatClassification::no_theme) {
-		// 1 = #cats
-		cat_data.CreateCategoriesAllCanvasTms(1, num_time_vals, num_obs);
-		for (int t=0; t<num_time_vals; t++) {
-			cat_data.SetCategoryColor(t, 0,
-									  GdaConst::map_default_fill_colour);
-		}
-	} else if (theme == CatClassification::quantile) {
-		// user supplied number of categories
-		cat_data.CreateCategoriesAllCanvasTms(num_cats, num_time_vals, num_obs);
-		cat_data.SetCategoryBrushesAllCanvasTms(
-				CatClassification::sequential_color_scheme, num_cats, false);
-	} else if (theme == CatClassification::unique_values) {
-		// number of categories based on number of unique values in data
-		cat_data.CreateEmptyCategories(num_time_vals, num_obs);
-	} else if (theme == CatClassification::natural_breaks) {
-		// user supplied number of categories
-		cat_data.CreateEmptyCategories(num_time_vals, num_obs);
-		// if there are fewer unique values than number of categories,
-		// we will automatically reduce the number of categories to the
-		// number of unique values.
-	} else if (theme == CatClassification::equal_intervals) {
-		// user supplied number of categories
-		cat_data.CreateEmptyCategories(num_time_vals, num_obs);
-		// if there is only one value, then we automatically reduce
-		// the number of categories down to one.
-	} else if (theme == CatClassification::percentile ||
-			   theme == CatClassification::hinge_15 ||
-			   theme == CatClassification::hinge_30 ||
-			   theme == CatClassification::stddev ||
-			   theme == CatClassification::excess_risk_theme) {
-		num_cats = 6;
-		cat_data.CreateCategoriesAllCanvasTms(num_cats, num_time_vals, num_obs);
-		cat_data.SetCategoryBrushesAllCanvasTms(
-				CatClassification::diverging_color_scheme, num_cats, false);
-	} else if (theme == CatClassification::custom) {
-		cat_data.CreateCategoriesAllCanvasTms(num_cats, num_time_vals, num_obs);
-		cat_data.SetCategoryBrushesAllCanvasTms(cat_def.colors);
-	}
-	
-	if (theme == CatClassification::no_theme) {
-		for (int t=0; t<num_time_vals; t++) {
-			cat_data.SetCategoryLabel(t, 0, "");
-			cat_data.SetCategoryCount(t, 0, num_obs);
-			for (int i=0; i<num_obs; i++) cat_data.AppendIdToCategory(t, 0, i);
-			cat_data.SetCategoryMinMax(t, 0, var[t][0].first,
-									   var[t][var[t].size()-1].first);
-		}
-		return;
-	}
 	
 	if (num_cats > num_obs) {
-		for (int t=0; t<num_time_vals; t++) {
+		for (int t=t_start; t<t_end; t++) {
 			cats_valid[t] = false;
 			cats_error_message[t] << "Error: Chosen theme requires more ";
 			cats_error_message[t] << "cateogries than observations.";
 		}
 	} else if (theme == hinge_15 || theme == hinge_30) {
 		std::vector<HingeStats> hinge_stats(num_time_vals);
-		cat_data.SetCategoryBrushesAllCanvasTms(
-				CatClassification::diverging_color_scheme, num_cats, false);
-		cat_data.ResetAllCategoryMinMax();
-		for (int t=0; t<num_time_vals; t++) {
+		for (int t=t_start; t<t_end; t++) {
 			if (!cats_valid[t]) continue;
 			
 			hinge_stats[t].CalculateHingeStats(var[t]);
@@ -399,7 +353,7 @@ void CatClassification::PopulateCatClassifData(const CatClassifDef& cat_def,
 		}
 	} else if (theme == custom) {
 		if (num_cats == 1) {
-			for (int t=0; t<num_time_vals; t++) {
+			for (int t=t_start; t<t_end; t++) {
 				if (!cats_valid[t]) continue;
 				for (int i=0, iend=var[t].size(); i<iend; i++) {
 					cat_data.AppendIdToCategory(t, 0, var[t][i].second);
@@ -418,7 +372,7 @@ void CatClassification::PopulateCatClassifData(const CatClassifDef& cat_def,
 			int num_breaks = breaks.size();
 			int num_breaks_lower = (num_breaks+1)/2;
 			
-			for (int t=0; t<num_time_vals; t++) {
+			for (int t=t_start; t<t_end; t++) {
 				if (!cats_valid[t]) continue;
 				// Set default cat_min / cat_max values for when
 				// category size is 0
@@ -521,7 +475,7 @@ void CatClassification::PopulateCatClassifData(const CatClassifDef& cat_def,
 		}
 	} else if (theme == quantile) {
 		if (num_cats == 1) {
-			for (int t=0; t<num_time_vals; t++) {
+			for (int t=t_start; t<t_end; t++) {
 				if (!cats_valid[t]) continue;
 				for (int i=0, iend=var[t].size(); i<iend; i++) {
 					cat_data.AppendIdToCategory(t, 0, var[t][i].second);
@@ -542,7 +496,7 @@ void CatClassification::PopulateCatClassifData(const CatClassifDef& cat_def,
 			int num_breaks = breaks.size();
 			int num_breaks_lower = (num_breaks+1)/2;
 			
-			for (int t=0; t<num_time_vals; t++) {
+			for (int t=t_start; t<t_end; t++) {
 				if (!cats_valid[t]) continue;
 				for (int i=0; i<num_breaks; i++) {
 					breaks[i] = Gda::percentile(((i+1.0)*100.0)/
@@ -620,8 +574,7 @@ void CatClassification::PopulateCatClassifData(const CatClassifDef& cat_def,
 			}
 		}
 	} else if (theme == percentile) {
-		cat_data.ResetAllCategoryMinMax();
-		for (int t=0; t<num_time_vals; t++) {
+		for (int t=t_start; t<t_end; t++) {
 			if (!cats_valid[t]) continue;
 			
 			double p_1 = Gda::percentile(1, var[t]);
@@ -667,8 +620,7 @@ void CatClassification::PopulateCatClassifData(const CatClassifDef& cat_def,
 	} else if (theme == stddev) {
 		std::vector<double> v(num_obs);
 		SampleStatistics stats;
-		cat_data.ResetAllCategoryMinMax();
-		for (int t=0; t<num_time_vals; t++) {
+		for (int t=t_start; t<t_end; t++) {
 			if (!cats_valid[t]) continue;
 			
 			for (int i=0; i<num_obs; i++) v[i] = var[t][i].first;
@@ -730,7 +682,7 @@ void CatClassification::PopulateCatClassifData(const CatClassifDef& cat_def,
 		// at most 10 unique values.
 		
 		std::vector< std::vector<double> > u_vals_map(num_time_vals);
-		for (int t=0; t<num_time_vals; t++) {
+		for (int t=t_start; t<t_end; t++) {
 			if (!cats_valid[t]) continue;
 			u_vals_map[t].push_back(var[t][0].first);
 			for (int i=0; i<num_obs; i++) {
@@ -742,7 +694,7 @@ void CatClassification::PopulateCatClassifData(const CatClassifDef& cat_def,
 			}
 		}
 		
-		for (int t=0; t<num_time_vals; t++) {
+		for (int t=t_start; t<t_end; t++) {
 			if (!cats_valid[t]) continue;
 			if (u_vals_map[t].size() > max_num_categories) {
 				// automatically use Natural Breaks when number of
@@ -760,7 +712,7 @@ void CatClassification::PopulateCatClassifData(const CatClassifDef& cat_def,
 		}
 		
 		cat_data.ResetAllCategoryMinMax();
-		for (int t=0; t<num_time_vals; t++) {
+		for (int t=t_start; t<t_end; t++) {
 			if (!cats_valid[t]) continue;
 			int t_num_cats = u_vals_map[t].size();
 			int cur_cat = 0;
@@ -781,7 +733,7 @@ void CatClassification::PopulateCatClassifData(const CatClassifDef& cat_def,
 	} else if (theme == natural_breaks) {
 		SetNaturalBreaksCats(num_cats, var, cat_data, cats_valid);
 	} else if (theme == equal_intervals) {
-		for (int t=0; t<num_time_vals; t++) {
+		for (int t=t_start; t<t_end; t++) {
 			if (!cats_valid[t]) continue;
 			double min_val = var[t][0].first;
 			double max_val = var[t][0].first;
@@ -846,8 +798,7 @@ void CatClassification::PopulateCatClassifData(const CatClassifDef& cat_def,
 			}
 		}
 	} else if (theme == excess_risk_theme) {
-		cat_data.ResetAllCategoryMinMax();
-		for (int t=0; t<num_time_vals; t++) {
+		for (int t=t_start; t<t_end; t++) {
 			if (!cats_valid[t]) continue;
 			
 			double val;
@@ -886,13 +837,130 @@ void CatClassification::PopulateCatClassifData(const CatClassifDef& cat_def,
 			}
 		}
 	} else {
-		for (int t=0; t<num_time_vals; t++) {
+		for (int t=t_start; t<t_end; t++) {
 			cats_valid[t] = false;
 			cats_error_message[t] = "Theme Not Implemented";
 		}
 	}
 }
 
+bool IsClassifiedByTm(CatClassifType theme)
+{
+	return (theme == hinge_15 || theme == hinge_30 || theme == custom ||
+			theme == quantile || theme == percentile || theme == stddev ||
+			theme == excess_risk_theme);
+}
+
+struct ClassifyTask {
+	ClassifyTask(const CatClassifDef& cat_def_s, int num_cats_s,
+				 const std::vector<Gda::dbl_int_pair_vec_type>& var_s,
+				 CatClassifData& cat_data_s, std::vector<bool>& cats_valid_s,
+				 std::vector<wxString>& cats_error_message_s)
+	: cat_def(cat_def_s), num_cats(num_cats_s), var(var_s),
+	cat_data(cat_data_s), cats_valid(cats_valid_s),
+	cats_error_message(cats_error_message_s) {}
+	void operator()(int start, int end, int thread_id) {
+		ClassifyCanvasTms(cat_def, num_cats, var, cat_data, cats_valid,
+						  cats_error_message, start, end);
+	}
+	const CatClassifDef& cat_def;
+	int num_cats;
+	const std::vector<Gda::dbl_int_pair_vec_type>& var;
+	CatClassifData& cat_data;
+	std::vector<bool>& cats_valid;
+	std::vector<wxString>& cats_error_message;
+};
+}
+}
+
+
+/** Update Categories based on num_cats and number time periods
+ var is assumed to be sorted.
+ num_cats is only used by themes where the user enters the number of
+ categories.
+ Note: LISA and Getis-Ord map themes are not supported by this function.
+ */
+void CatClassification::PopulateCatClassifData(const CatClassifDef& cat_def,
+				const std::vector<Gda::dbl_int_pair_vec_type>& var,
+				CatClassifData& cat_data, std::vector<bool>& cats_valid,
+				std::vector<wxString>& cats_error_message)
+{
+	GDA_TRACE_SCOPE("classify", "CatClassification::PopulateCatClassifData");
+	int num_cats = cat_def.num_cats;
+	CatClassifType theme = cat_def.cat_classif_type;
+	int num_time_vals = var.size();
+	int num_obs = var[0].size();
+	if (theme == CatClassification::no_theme) {
+		// 1 = #cats
+		cat_data.CreateCategoriesAllCanvasTms(1, num_time_vals, num_obs);
+		for (int t=0; t<num_time_vals; t++) {
+			cat_data.SetCategoryColor(t, 0,
+									  GdaConst::map_default_fill_colour);
+		}
+	} else if (theme == CatClassification::quantile) {
+		// user supplied number of categories
+		cat_data.CreateCategoriesAllCanvasTms(num_cats, num_time_vals, num_obs);
+		cat_data.SetCategoryBrushesAllCanvasTms(
+				CatClassification::sequential_color_scheme, num_cats, false);
+	} else if (theme == CatClassification::unique_values) {
+		// number of categories based on number of unique values in data
+		cat_data.CreateEmptyCategories(num_time_vals, num_obs);
+	} else if (theme == CatClassification::natural_breaks) {
+		// user supplied number of categories
+		cat_data.CreateEmptyCategories(num_time_vals, num_obs);
+		// if there are fewer unique values than number of categories,
+		// we will automatically reduce the number of categories to the
+		// number of unique values.
+	} else if (theme == CatClassification::equal_intervals) {
+		// user supplied number of categories
+		cat_data.CreateEmptyCategories(num_time_vals, num_obs);
+		// if there is only one value, then we automatically reduce
+		// the number of categories down to one.
+	} else if (theme == CatClassification::percentile ||
+			   theme == CatClassification::hinge_15 ||
+			   theme == CatClassification::hinge_30 ||
+			   theme == CatClassification::stddev ||
+			   theme == CatClassification::excess_risk_theme) {
+		num_cats = 6;
+		cat_data.CreateCategoriesAllCanvasTms(num_cats, num_time_vals, num_obs);
+		cat_data.SetCategoryBrushesAllCanvasTms(
+				CatClassification::diverging_color_scheme, num_cats, false);
+	} else if (theme == CatClassification::custom) {
+		cat_data.CreateCategoriesAllCanvasTms(num_cats, num_time_vals, num_obs);
+		cat_data.SetCategoryBrushesAllCanvasTms(cat_def.colors);
+	}
+	
+	if (theme == CatClassification::no_theme) {
+		for (int t=0; t<num_time_vals; t++) {
+			cat_data.SetCategoryLabel(t, 0, "");
+			cat_data.SetCategoryCount(t, 0, num_obs);
+			for (int i=0; i<num_obs; i++) cat_data.AppendIdToCategory(t, 0, i);
+			cat_data.SetCategoryMinMax(t, 0, var[t][0].first,
+									   var[t][var[t].size()-1].first);
+		}
+		return;
+	}
+	
+	if (num_cats <= num_obs && IsClassifiedByTm(theme)) {
+		// brushes and min/max resets are shared setup, everything after
+		// that is independent per canvas time step.  Note that cats_valid
+		// is only read here, as vector<bool> elements share words.
+		if (theme == hinge_15 || theme == hinge_30) {
+			cat_data.SetCategoryBrushesAllCanvasTms(
+				CatClassification::diverging_color_scheme, num_cats, false);
+		}
+		if (theme != custom && theme != quantile) {
+			cat_data.ResetAllCategoryMinMax();
+		}
+		ClassifyTask task(cat_def, num_cats, var, cat_data, cats_valid,
+						  cats_error_message);
+		Gda::ParallelFor(num_time_vals, task);
+	} else {
+		ClassifyCanvasTms(cat_def, num_cats, var, cat_data, cats_valid,
+						  cats_error_message, 0, num_time_vals);
+	}
+}
+
 /**
  Modify CatClassifDef so that it is consistent with data in the TableInterface.
  Some things that might require changes to CatClassifDef data:
@@ -1126,11 +1194,75 @@ void CatClassification::FindNaturalBreaks(int num_cats,
 	}
 }
 	
+namespace {
+/** Random search for the natural breaks of every canvas time step.  Each
+ time step draws from its own generator, so time steps are searched
+ concurrently and best_breaks[t] only depends on seed and t. */
+struct NaturalBreaksTask {
+	NaturalBreaksTask(int num_cats_s,
+					  const std::vector<Gda::dbl_int_pair_vec_type>& var_s,
+					  const std::vector<bool>& cats_valid_s, uint64_t seed_s,
+					  std::vector<std::vector<int> >& best_breaks_s)
+	: num_cats(num_cats_s), var(var_s), cats_valid(cats_valid_s),
+	seed(seed_s), best_breaks(best_breaks_s) {}
+	void operator()(int start, int end, int thread_id) {
+		int num_time_vals = var.size();
+		int num_obs = var[0].size();
+		std::vector<double> v(num_obs);
+		for (int t=start; t<end; t++) {
+			if (!cats_valid[t]) continue;
+			for (int i=0; i<num_obs; i++) v[i] = var[t][i].first;
+			std::vector<UniqueValElem> uv_mapping;
+			create_unique_val_mapping(uv_mapping, v);
+			int num_unique_vals = uv_mapping.size();
+			int t_cats = GenUtils::min<int>(num_unique_vals, num_cats);
+			
+			double mean = 0;
+			for (int i=0; i<num_obs; i++) mean += v[i];
+			mean /= (double) num_obs;
+			double gssd = 0;
+			for (int i=0; i<num_obs; i++) gssd += (v[i]-mean)*(v[i]-mean);
+			
+			std::vector<int> rand_b(t_cats-1);
+			std::vector<int> uv_rand_b(t_cats-1);
+			best_breaks[t].resize(t_cats-1);
+			double max_gvf_found = 0;
+			// for 5000 permutations, 2200 obs, and 4 time periods, slow
+			// enough make sure permutations is such that this total is not
+			// exceeded.
+			double c = 5000*2200*4;
+			int perms = c / ((double) num_time_vals * (double) num_obs);
+			if (perms < 10) perms = 10;
+			if (perms > 10000) perms = 10000;
+			
+			boost::mt19937 rng(Gda::ThomasWangHashUInt64(seed + t));
+			boost::uniform_01<boost::mt19937> X(rng);
+			for (int i=0; i<perms; i++) {
+				pick_rand_breaks(uv_rand_b, num_unique_vals, X);
+				// translate uv_rand_b into normal breaks
+				unique_to_normal_breaks(uv_rand_b, uv_mapping, rand_b);
+				double new_gvf = calc_gvf(rand_b, v, gssd);
+				if (new_gvf > max_gvf_found) {
+					max_gvf_found = new_gvf;
+					best_breaks[t] = rand_b;
+				}
+			}
+		}
+	}
+	int num_cats;
+	const std::vector<Gda::dbl_int_pair_vec_type>& var;
+	const std::vector<bool>& cats_valid;
+	uint64_t seed;
+	std::vector<std::vector<int> >& best_breaks;
+};
+}
+
 void CatClassification::SetNaturalBreaksCats(int num_cats,
 					const std::vector<Gda::dbl_int_pair_vec_type>& var,
 					CatClassifData& cat_data, std::vector<bool>& cats_valid,
 					CatClassification::ColorScheme coltype)
 {
+	GDA_TRACE_SCOPE("classify", "CatClassification::SetNaturalBreaksCats");
 	int num_time_vals = var.size();
 	int num_obs = var[0].size();
 	// user supplied number of categories
@@ -1139,53 +1271,19 @@ void CatClassification::SetNaturalBreaksCats(int num_cats,
 	// we will automatically reduce the number of categories to the
 	// number of unique values.
 	
-	std::vector<double> v(num_obs);
+	std::vector<std::vector<int> > best_breaks(num_time_vals);
+	NaturalBreaksTask task(num_cats, var, cats_valid, std::time(0),
+						   best_breaks);
+	Gda::ParallelFor(num_time_vals, task);
+	
 	for (int t=0; t<num_time_vals; t++) {
-		for (int i=0; i<num_obs; i++) v[i] = var[t][i].first;
 		if (!cats_valid[t]) continue;
-		std::vector<UniqueValElem> uv_mapping;
-		create_unique_val_mapping(uv_mapping, v);
-		int num_unique_vals = uv_mapping.size();
-		int t_cats = GenUtils::min<int>(num_unique_vals, num_cats);
-		
-		double mean = 0;
-		for (int i=0; i<num_obs; i++) mean += v[i];
-		mean /= (double) num_obs;
-		double gssd = 0;
-		for (int i=0; i<num_obs; i++) gssd += (v[i]-mean)*(v[i]-mean);			
-		
-		std::vector<int> rand_b(t_cats-1);
-		std::vector<int> best_breaks(t_cats-1);
-		std::vector<int> uv_rand_b(t_cats-1);
-		double max_gvf_found = 0;
-		int max_gvf_ind = 0;
-		// for 5000 permutations, 2200 obs, and 4 time periods, slow enough
-		// make sure permutations is such that this total is not exceeded.
-		double c = 5000*2200*4;
-		int perms = c / ((double) num_time_vals * (double) num_obs);
-		if (perms < 10) perms = 10;
-		if (perms > 10000) perms = 10000;
-		
-		for (int i=0; i<perms; i++) {
-			pick_rand_breaks(uv_rand_b, num_unique_vals);
-			// translate uv_rand_b into normal breaks
-			unique_to_normal_breaks(uv_rand_b, uv_mapping, rand_b);
-			double new_gvf = calc_gvf(rand_b, v, gssd);
-			if (new_gvf > max_gvf_found) {
-				max_gvf_found = new_gvf;
-				max_gvf_ind = i;
-				best_breaks = rand_b;
-			}
-		}
-		LOG(perms);
-		LOG(max_gvf_ind);
-		LOG(max_gvf_found);
-		
+		int t_cats = best_breaks[t].size()+1;
 		cat_data.SetCategoryBrushesAtCanvasTm(coltype, t_cats, false, t);
 		
-		for (int i=0, nb=best_breaks.size(); i<=nb; i++) {
-			int ss = (i == 0) ? 0 : best_breaks[i-1];
-			int tt = (i == nb) ? v.size() : best_breaks[i];
+		for (int i=0, nb=best_breaks[t].size(); i<=nb; i++) {
+			int ss = (i == 0) ? 0 : best_breaks[t][i-1];
+			int tt = (i == nb) ? num_obs : best_breaks[t][i];
 			for (int j=ss; j<tt; j++) {
 				cat_data.AppendIdToCategory(t, i, var[t][j].second);
 			}
@@ -27,6 +27,7 @@
 #include <wx/msgdlg.h>
 #include <wx/splitter.h>
 #include <wx/xrc/xmlres.h>
+#include "../DataViewer/SortedColCache.h"
 #include "../DataViewer/TableInterface.h"
 #include "../DialogTools/HistIntervalDlg.h"
 #include "../GdaConst.h"
@@ -70,20 +71,15 @@ show_axes(true), scale_x_over_time(true), scale_y_over_time(true)
 {
 	LOG_MSG("Entering ConditionalHistogramCanvas::ConditionalHistogramCanvas");
 	
-	int hist_var_tms = data[HIST_VAR].shape()[0];
+	int hist_var_tms = data[HIST_VAR].GetNumTimes();
 	data_stats.resize(hist_var_tms);
 	data_sorted.resize(hist_var_tms);
 	data_min_over_time = data[HIST_VAR][0][0];
 	data_max_over_time = data[HIST_VAR][0][0];
+	SortedColCache* sort_cache = project->GetSortedColCache();
 	for (int t=0; t<hist_var_tms; t++) {
-		data_sorted[t].resize(num_obs);
-		for (int i=0; i<num_obs; i++) {
-			data_sorted[t][i].first = data[HIST_VAR][t][i];
-			data_sorted[t][i].second = i;
-		}
-		std::sort(data_sorted[t].begin(), data_sorted[t].end(),
-				  Gda::dbl_int_pair_cmp_less);
-		data_stats[t].CalculateFromSample(data_sorted[t]);
+		data_sorted[t] = sort_cache->GetSorted(col_ids[HIST_VAR], t);
+		table_int->GetColSampleStats(col_ids[HIST_VAR], t, data_stats[t]);
 		if (data_stats[t].min < data_min_over_time) {
 			data_min_over_time = data_stats[t].min;
 		}
@@ -419,6 +415,7 @@ void ConditionalHistogramCanvas::ResizeSelectableShps(int virtual_scrn_w,
 void ConditionalHistogramCanvas::PopulateCanvas()
 {
 	LOG_MSG("Entering ConditionalHistogramCanvas::PopulateCanvas");
+	scale_trans_batch.Cancel();
 	BOOST_FOREACH( GdaShape* shp, selectable_shps ) { delete shp; }
 	selectable_shps.clear();
 
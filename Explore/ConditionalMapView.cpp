@@ -1096,6 +1096,7 @@ void ConditionalMapCanvas::ResizeSelectableShps(int virtual_scrn_w,
 		ms->applyScaleTrans(last_scale_trans);
 	}
 	
+	scale_trans_gen++;
 	layer0_valid = false;
 	Refresh();
 	
@@ -1169,6 +1170,7 @@ void ConditionalMapCanvas::PopulateCanvas()
 	// Note: only need to delete selectable shapes if the cartogram
 	// relative positions change.  Otherwise, just reuse.
 	if (full_map_redraw_needed) {
+		scale_trans_batch.Cancel();
 		BOOST_FOREACH( GdaShape* shp, selectable_shps ) { delete shp; }
 		selectable_shps.clear();
 	}
@@ -28,6 +28,7 @@
 #include <wx/splitter.h>
 #include <wx/xrc/xmlres.h>
 #include "../DialogTools/CatClassifDlg.h"
+#include "../DataViewer/SortedColCache.h"
 #include "../DataViewer/TableInterface.h"
 #include "../DataViewer/TimeState.h"
 #include "../GdaConst.h"
@@ -80,34 +81,23 @@ cc_state_vert(0), cc_state_horiz(0), all_init(false)
 	
 	template_frame->ClearAllGroupDependencies();
 	for (size_t i=0; i<var_info.size(); i++) {
-		table_int->GetColData(col_ids[i], data[i]);
+		table_int->GetColPanel(col_ids[i], data[i]);
 		template_frame->AddGroupDependancy(var_info[i].name);
 	}
 	horiz_num_time_vals = data[HOR_VAR].size();
 	horiz_var_sorted.resize(horiz_num_time_vals);
 	horiz_cats_valid.resize(horiz_num_time_vals);
 	horiz_cats_error_message.resize(horiz_num_time_vals);
+	SortedColCache* sort_cache = project->GetSortedColCache();
 	for (int t=0; t<horiz_num_time_vals; t++) {
-		horiz_var_sorted[t].resize(num_obs);
-		for (int i=0; i<num_obs; i++) {
-			horiz_var_sorted[t][i].first = data[HOR_VAR][t][i];
-			horiz_var_sorted[t][i].second = i;
-		}
-		std::sort(horiz_var_sorted[t].begin(), horiz_var_sorted[t].end(),
-				  Gda::dbl_int_pair_cmp_less);
+		horiz_var_sorted[t] = sort_cache->GetSorted(col_ids[HOR_VAR], t);
 	}
 	vert_num_time_vals = data[VERT_VAR].size();
 	vert_var_sorted.resize(vert_num_time_vals);
 	vert_cats_valid.resize(vert_num_time_vals);
 	vert_cats_error_message.resize(vert_num_time_vals);
 	for (int t=0; t<vert_num_time_vals; t++) {
-		vert_var_sorted[t].resize(num_obs);
-		for (int i=0; i<num_obs; i++) {
-			vert_var_sorted[t][i].first = data[VERT_VAR][t][i];
-			vert_var_sorted[t][i].second = i;
-		}
-		std::sort(vert_var_sorted[t].begin(), vert_var_sorted[t].end(),
-				  Gda::dbl_int_pair_cmp_less);
+		vert_var_sorted[t] = sort_cache->GetSorted(col_ids[VERT_VAR], t);
 	}
 	VarInfoAttributeChange();
 
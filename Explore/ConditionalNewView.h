@@ -24,6 +24,7 @@
 #include <wx/thread.h>
 #include "CatClassification.h"
 #include "CatClassifStateObserver.h"
+#include "../DataViewer/SpaceTimePanel.h"
 #include "../TemplateCanvas.h"
 #include "../TemplateFrame.h"
 #include "../GenUtils.h"
@@ -103,7 +104,7 @@ protected:
 	int horiz_num_time_vals;
 	int ref_var_index;
 	std::vector<GeoDaVarInfo> var_info;
-	std::vector<d_array_type> data;
+	std::vector<SpaceTimePanel> data; // data[variable][time][obs]
 	
 	bool is_any_time_variant;
 	bool is_any_sync_with_global_time;
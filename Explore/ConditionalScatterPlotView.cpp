@@ -434,6 +434,7 @@ void ConditionalScatterPlotCanvas::ResizeSelectableShps(int virtual_scrn_w,
 		ms->applyScaleTrans(last_scale_trans);
 	}
 	
+	scale_trans_gen++;
 	layer0_valid = false;
 	Refresh();
 	
@@ -446,6 +447,7 @@ void ConditionalScatterPlotCanvas::ResizeSelectableShps(int virtual_scrn_w,
 void ConditionalScatterPlotCanvas::PopulateCanvas()
 {
 	LOG_MSG("Entering ConditionalScatterPlotCanvas::PopulateCanvas");
+	scale_trans_batch.Cancel();
 	BOOST_FOREACH( GdaShape* shp, selectable_shps ) { delete shp; }
 	selectable_shps.clear();
 	selectable_shps.resize(num_obs);
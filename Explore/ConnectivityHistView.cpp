@@ -309,6 +309,7 @@ void ConnectivityHistCanvas::PopulateCanvas()
 	LOG_MSG("Entering ConnectivityHistCanvas::PopulateCanvas");
 	BOOST_FOREACH( GdaShape* shp, background_shps ) { delete shp; }
 	background_shps.clear();
+	scale_trans_batch.Cancel();
 	BOOST_FOREACH( GdaShape* shp, selectable_shps ) { delete shp; }
 	selectable_shps.clear();
 	BOOST_FOREACH( GdaShape* shp, foreground_shps ) { delete shp; }
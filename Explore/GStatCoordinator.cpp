@@ -18,13 +18,13 @@
  */
 
 #include <time.h>
-#include <boost/math/distributions/normal.hpp> // for normal_distribution
 #include <algorithm>
 #include <functional>
 #include <map>
 #include <wx/filename.h>
 #include <wx/stopwatch.h>
 #include "../DataViewer/TableInterface.h"
+#include "../GdaTrace.h"
 #include "../GenUtils.h"
 #include "../ShapeOperations/Randik.h"
 #include "../logger.h"
@@ -78,49 +78,6 @@
  */
 
 
-GStatWorkerThread::GStatWorkerThread(int obs_start_s, int obs_end_s,
-									 uint64_t	seed_start_s,
-									 GStatCoordinator* gstat_coord_s,
-									 wxMutex* worker_list_mutex_s,
-									 wxCondition* worker_list_empty_cond_s,
-									 std::list<wxThread*> *worker_list_s,
-									 int thread_id_s)
-: wxThread(),
-obs_start(obs_start_s), obs_end(obs_end_s), seed_start(seed_start_s),
-gstat_coord(gstat_coord_s),
-worker_list_mutex(worker_list_mutex_s),
-worker_list_empty_cond(worker_list_empty_cond_s),
-worker_list(worker_list_s),
-thread_id(thread_id_s)
-{
-}
-
-GStatWorkerThread::~GStatWorkerThread()
-{
-}
-
-wxThread::ExitCode GStatWorkerThread::Entry()
-{
-	LOG_MSG(wxString::Format("GStatWorkerThread %d started", thread_id));
-	
-	// call work for assigned range of observations
-	gstat_coord->CalcPseudoP_range(obs_start, obs_end, seed_start);
-	
-	wxMutexLocker lock(*worker_list_mutex);
-	// remove ourself from the list
-	worker_list->remove(this);
-	// if empty, signal on empty condition since only main thread
-	// should be waiting on this condition
-	LOG_MSG(wxString::Format("GStatWorkerThread %d finished", thread_id));
-	if (worker_list->empty()) {
-		LOG_MSG("worker_list is empty, so signaling main thread");
-		worker_list_empty_cond->Signal();
-	}
-	
-	return NULL;
-}
-
-
 GStatCoordinator::GStatCoordinator(const GalWeight* gal_weights_s,
 								   TableInterface* table_int,
 								   const std::vector<GeoDaVarInfo>& var_info_s,
@@ -136,8 +93,9 @@ data(var_info_s.size()),
 last_seed_used(0), reuse_last_seed(false)
 {
 	SetSignificanceFilter(1);
+	W_csr.InitFromGal(W, num_obs);
 	for (int i=0; i<var_info.size(); i++) {
-		table_int->GetColData(col_ids[i], data[i]);
+		table_int->GetColPanel(col_ids[i], data[i]);
 	}
 	InitFromVarInfo();
 	
@@ -147,6 +105,30 @@ last_seed_used(0), reuse_last_seed(false)
 	}
 }
 
+GStatCoordinator::GStatCoordinator(const GalWeight* gal_weights_s,
+								   int num_obs_s,
+								   const std::vector<GeoDaVarInfo>& var_info_s,
+								   const std::vector<SpaceTimePanel>& data_s,
+								   bool row_standardize_weights)
+: W(gal_weights_s->gal),
+weight_name(wxFileName(gal_weights_s->wflnm).GetName()),
+row_standardize(row_standardize_weights),
+num_obs(num_obs_s),
+permutations(99),
+var_info(var_info_s),
+data(data_s),
+last_seed_used(0), reuse_last_seed(false)
+{
+	SetSignificanceFilter(1);
+	W_csr.InitFromGal(W, num_obs);
+	InitFromVarInfo();
+	
+	maps.resize(8);
+	for (int i=0, iend=maps.size(); i<iend; i++) {
+		maps[i] = (GetisOrdMapNewFrame*) 0;
+	}
+}
+
 GStatCoordinator::~GStatCoordinator()
 {
 	LOG_MSG("In GStatCoordinator::~GStatCoordinator");
@@ -194,7 +176,6 @@ void GStatCoordinator::DeallocateVectors()
 	}
 	pseudo_p_star_vecs.clear();
 	
-	for (int i=0; i<x_vecs.size(); i++) if (x_vecs[i]) delete [] x_vecs[i];
 	x_vecs.clear();
 }
 
@@ -238,7 +219,6 @@ void GStatCoordinator::AllocateVectors()
 		p_star_vecs[i] = new double[num_obs];
 		pseudo_p_vecs[i] = new double[num_obs];
 		pseudo_p_star_vecs[i] = new double[num_obs];
-		x_vecs[i] = new double[num_obs];
 		
 		map_valid[i] = true;
 		map_error_message[i] = wxEmptyString;
@@ -267,28 +247,7 @@ void GStatCoordinator::InitFromVarInfo()
 	
 	for (int t=var_info[0].time_min; t<=var_info[0].time_max; t++) {
 		int d_t = t - var_info[0].time_min;
-		for (int i=0; i<num_obs; i++) x_vecs[d_t][i] = data[0][t][i];
-	}
-	
-	for (int t=0; t<num_time_vals; t++) {
-		x = x_vecs[t];
-		for (int i=0; i<num_obs; i++) {
-			if ( W[i].Size() > 0 ) {
-				n[t]++;
-				x_star[t] += x[i];
-				x_sstar[t] += x[i] * x[i];
-			}
-		}
-		ExG[t] = 1.0/(n[t]-1); // same for all i when W is row-standardized
-		ExGstar[t] = 1.0/n[t]; // same for all i when W is row-standardized
-		mean_x[t] = x_star[t] / n[t]; // x hat (overall)
-		var_x[t] = x_sstar[t]/n[t] - mean_x[t]*mean_x[t]; // s^2 overall
-		
-		// when W is row-standardized, VarGstar same for all i
-		// same as s^2 / (n^2 mean_x ^2)
-		VarGstar[t] = var_x[t] / (n[t]*n[t] * mean_x[t]*mean_x[t]);
-		// when W is row-standardized, sdGstar same for all i
-		sdGstar[t] = sqrt(VarGstar[t]);		
+		x_vecs[d_t] = data[0][t].GetPtr();
 	}
 	
 	CalcGs();
@@ -351,349 +310,75 @@ void GStatCoordinator::FillClusterCats(int canvas_time,
 }
 
 
-/** Initialize Gi and Gi_star.  We handle either binary or row-standardized
- binary weights.  Weights with self-neighbors are handled correctly. */
-void GStatCoordinator::CalcGs()
+/** Point the GStatEngine slices at the per-time-period arrays. */
+void GStatCoordinator::FillSlices(std::vector<GStatSlice>& slices)
 {
-	using boost::math::normal; // typedef provides default type is double.
-	// Construct a standard normal distribution std_norm_dist
-	normal std_norm_dist; // default mean = zero, and s.d. = unity
-	
+	slices.resize(num_time_vals);
 	for (int t=0; t<num_time_vals; t++) {
-		G = G_vecs[t];
-		G_defined = G_defined_vecs[t];
-		G_star = G_star_vecs[t];
-		z = z_vecs[t];
-		p = p_vecs[t];
-		z_star = z_star_vecs[t];
-		p_star = p_star_vecs[t];
-		pseudo_p = pseudo_p_vecs[t];
-		pseudo_p_star = pseudo_p_star_vecs[t];
-		x = x_vecs[t];
-		
-		has_undefined[t] = false;
-		has_isolates[t] = false;
-
-		double n_expr = sqrt((n[t]-1)*(n[t]-1)*(n[t]-2));
-		for (long i=0; i<num_obs; i++) {
-			if ( W[i].size > 0 ) {
-				double lag = 0;
-				bool self_neighbor = false;
-				for (int j=0; j<W[i].size; j++) {
-					if (W[i].data[j] != i) {
-						lag += x[W[i].data[j]];
-					} else {
-						self_neighbor = true;
-					}
-				}
-				double Wi = self_neighbor ? W[i].size-1 : W[i].size;
-				if (row_standardize) {
-					lag /= W[i].size;
-					Wi /= W[i].size;
-				}
-				double xd_i = x_star[t] - x[i];
-				if (xd_i != 0) {
-					G[i] = lag / xd_i;
-				} else {
-					G_defined[i] = false;
-				}
-				double x_hat_i = xd_i * ExG[t]; // (x_star - x[i])/(n-1)
+		GStatSlice& s = slices[t];
+		s.x = x_vecs[t];
+		s.G = G_vecs[t];
+		s.G_defined = G_defined_vecs[t];
+		s.G_star = G_star_vecs[t];
+		s.z = z_vecs[t];
+		s.p = p_vecs[t];
+		s.z_star = z_star_vecs[t];
+		s.p_star = p_star_vecs[t];
+		s.pseudo_p = pseudo_p_vecs[t];
+		s.pseudo_p_star = pseudo_p_star_vecs[t];
+	}
+}
 
-				double ExGi = Wi/(n[t]-1);
-				// location-specific variance
-				double ss_i = ((x_sstar[t] - x[i]*x[i])/(n[t]-1)
-							   - x_hat_i*x_hat_i);
-				double sdG_i = sqrt(Wi*(n[t]-1-Wi)*ss_i)/(n_expr * x_hat_i);
-				
-				// compute z and one-sided p-val from standard-normal table
-				if (G_defined[i]) {
-					z[i] = (G[i] - ExGi)/sdG_i;
-					if (z[i] >= 0) {
-						p[i] = 1.0-cdf(std_norm_dist, z[i]);
-					} else {
-						p[i] = cdf(std_norm_dist, z[i]);
-					}
-				} else {
-					has_undefined[t] = true;
-				}
-			} else {
-				has_isolates[t] = true;
-			}
-		}
-	
-		if (x_star[t] == 0) {
-			for (long i=0; i<num_obs; i++) G_defined[i] = false;
-			has_undefined[t] = true;
-			break;
-		}
-	
-		if (row_standardize) {
-			for (long i=0; i<num_obs; i++) {
-				double lag = 0;
-				bool self_neighbor = false;
-				for (int j=0; j<W[i].size; j++) {
-					if (W[i].data[j] == i) self_neighbor = true;
-					lag += x[W[i].data[j]];
-				}
-				G_star[i] = self_neighbor ? lag/(W[i].size * x_star[t]) :
-					(lag+x[i])/((W[i].size+1) * x_star[t]);
-				z_star[i] = (G_star[i] - ExGstar[t])/sdGstar[t];
-			}
-		} else { // binary weights
-			double n_expr_mean_x = n[t] * sqrt(n[t]-1) * mean_x[t];
-			for (long i=0; i<num_obs; i++) {
-				double lag = 0;
-				bool self_neighbor = false;
-				for (int j=0; j<W[i].size; j++) {
-					if (W[i].data[j] == i) self_neighbor = true;
-					lag += x[W[i].data[j]];
-				}
-				if (!self_neighbor) lag += x[i];
-				G_star[i] = lag / x_star[t];
-				double Wi = self_neighbor ? W[i].size : W[i].size+1;
-				// location-specific mean
-				double ExGi_star = Wi/n[t];
-				// location-specific variance
-				double sdG_i_star = sqrt(Wi*(n[t]-Wi)*var_x[t])/n_expr_mean_x;
-				z_star[i] = (G_star[i] - ExGi_star)/sdG_i_star;
-			}
-		}
+/** Initialize Gi and Gi_star for all time periods in a single pass over
+ the weights.  We handle either binary or row-standardized binary weights.
+ Weights with self-neighbors are handled correctly. */
+void GStatCoordinator::CalcGs()
+{
+	std::vector<GStatSlice> slices;
+	FillSlices(slices);
+	GStatEngine engine(W_csr, row_standardize);
+	engine.CalcGs(slices);
 	
-		for (long i=0; i<num_obs; i++) {
-			// compute z and one-sided p-val from standard-normal table
-			if (z_star[i] >= 0) {
-				p_star[i] = 1.0-cdf(std_norm_dist, z_star[i]);
-			} else {
-				p_star[i] = cdf(std_norm_dist, z_star[i]);
-			}
-		}
+	for (int t=0; t<num_time_vals; t++) {
+		n[t] = slices[t].n;
+		x_star[t] = slices[t].x_star;
+		x_sstar[t] = slices[t].x_sstar;
+		ExG[t] = slices[t].ExG;
+		ExGstar[t] = slices[t].ExGstar;
+		mean_x[t] = slices[t].mean_x;
+		var_x[t] = slices[t].var_x;
+		VarGstar[t] = slices[t].VarGstar;
+		sdGstar[t] = slices[t].sdGstar;
+		has_undefined[t] = slices[t].has_undefined;
+		has_isolates[t] = slices[t].has_isolates;
 	}
 }
 
+/** All time periods share one permutation stream: GStatEngine draws the
+ random neighbors once per observation and permutation and evaluates
+ every time period against them.  Self-neighbors are disallowed in the
+ permutation test. */
 void GStatCoordinator::CalcPseudoP()
 {
 	LOG_MSG("Entering GStatCoordinator::CalcPseudoP");
-	wxStopWatch sw;
-	int nCPUs = wxThread::GetCPUCount();
+	GDA_TRACE_SCOPE("permute", "GStatCoordinator::CalcPseudoP");
 	
-	// To ensure thread safety, only work on one time slice of data
-	// at a time.  For each time period t:
-	// 1. copy data for time period t into data1 and data2 arrays
-	// 2. Perform multi-threaded computation
-	// 3. copy results into results array
-	
-	if (nCPUs <= 1) {
-		LOG_MSG(wxString::Format("%d threading cores detected "
-								 "so running single threaded", nCPUs));
-	} else {
-		LOG_MSG(wxString::Format("%d threading cores detected, "
-								 "running multi-threaded.", nCPUs));
-	}
+	if (!reuse_last_seed) last_seed_used = time(0);
+	std::vector<GStatSlice> slices;
+	FillSlices(slices);
+	GStatEngine engine(W_csr, row_standardize);
+	engine.CalcPseudoP(slices, permutations, last_seed_used);
 	
-	for (int t=0; t<num_time_vals; t++) {
-		LOG_MSG(wxString::Format("Calculating GStat significances for time "
-								 "period %d", t));
-
-		G = G_vecs[t];
-		G_defined = G_defined_vecs[t];
-		G_star = G_star_vecs[t];
-		z = z_vecs[t];
-		p = p_vecs[t];
-		z_star = z_star_vecs[t];
-		p_star = p_star_vecs[t];
-		pseudo_p = pseudo_p_vecs[t];
-		pseudo_p_star = pseudo_p_star_vecs[t];
-		x = x_vecs[t];
-		x_star_t = x_star[t];
-		
-		if (nCPUs <= 1) {
-			if (!reuse_last_seed) last_seed_used = time(0);
-			CalcPseudoP_range(0, num_obs-1, last_seed_used);
-		} else {
-			CalcPseudoP_threaded();
-		}
-	}
+	GDA_TRACE_COUNT("permute", "GStat permutations",
+					(int64_t) permutations * num_obs * num_time_vals);
 	{
 		wxString m;
-		m << "GStat on " << num_obs << " obs with " << permutations;
-		m << " perms over " << num_time_vals << " time periods took ";
-		m << sw.Time() << " ms. Last seed used: " << last_seed_used;
+		m << "GStat last seed used: " << last_seed_used;
 		LOG_MSG(m);
 	}
 	LOG_MSG("Exiting GStatCoordinator::CalcPseudoP");
 }
 
-void GStatCoordinator::CalcPseudoP_threaded()
-{
-	LOG_MSG("Entering GStatCoordinator::CalcPseudoP_threaded");
-	int nCPUs = wxThread::GetCPUCount();
-	
-	// mutext protects access to the worker_list
-    wxMutex worker_list_mutex;
-	// signals that worker_list is empty
-	wxCondition worker_list_empty_cond(worker_list_mutex);
-	worker_list_mutex.Lock(); // mutex should be initially locked
-	
-    // List of all the threads currently alive.  As soon as the thread
-	// terminates, it removes itself from the list.
-	std::list<wxThread*> worker_list;
-	
-	// divide up work according to number of observations
-	// and number of CPUs
-	int work_chunk = num_obs / nCPUs;
-	int obs_start = 0;
-	int obs_end = obs_start + work_chunk;
-	
-	bool is_thread_error = false;
-	int quotient = num_obs / nCPUs;
-	int remainder = num_obs % nCPUs;
-	int tot_threads = (quotient > 0) ? nCPUs : remainder;
-	
-	if (!reuse_last_seed) last_seed_used = time(0);
-	for (int i=0; i<tot_threads && !is_thread_error; i++) {
-		int a=0;
-		int b=0;
-		if (i < remainder) {
-			a = i*(quotient+1);
-			b = a+quotient;
-		} else {
-			a = remainder*(quotient+1) + (i-remainder)*quotient;
-			b = a+quotient-1;
-		}
-		uint64_t seed_start = last_seed_used+a;
-		uint64_t seed_end = seed_start + ((uint64_t) (b-a));
-		int thread_id = i+1;
-		wxString msg;
-		msg << "thread " << thread_id << ": " << a << "->" << b;
-		msg << ", seed: " << seed_start << "->" << seed_end;
-		LOG_MSG(msg);
-		
-		GStatWorkerThread* thread =
-			new GStatWorkerThread(a, b, seed_start, this,
-								  &worker_list_mutex,
-								  &worker_list_empty_cond,
-								  &worker_list, thread_id);
-		if ( thread->Create() != wxTHREAD_NO_ERROR ) {
-			LOG_MSG("Error: Can't create thread!");
-			delete thread;
-			is_thread_error = true;
-		} else {
-			worker_list.push_front(thread);
-		}
-	}
-	if (is_thread_error) {
-		LOG_MSG("Error: Could not spawn a worker thread, falling back "
-				"to single-threaded pseudo-p calculation.");
-		// fall back to single thread calculation mode
-		CalcPseudoP_range(0, num_obs-1, last_seed_used);
-	} else {
-		LOG_MSG("Starting all worker threads");
-		std::list<wxThread*>::iterator it;
-		for (it = worker_list.begin(); it != worker_list.end(); it++) {
-			(*it)->Run();
-		}
-		
-		while (!worker_list.empty()) {
-			// wait until thread_list might be empty
-			worker_list_empty_cond.Wait();
-			// We have been woken up. If this was not a false
-			// alarm (spurious signal), the loop will exit.
-			LOG_MSG("work_list_empty_cond signaled");
-		}
-		LOG_MSG("All worker threads exited");
-	}
-	
-	LOG_MSG("Exiting GStatCoordinator::CalcPseudoP_threaded");
-}
-
-/** In the code that computes Gi and Gi*, we specifically checked for 
- self-neighbors and handled the situation appropriately.  For the
- permutation code, we will disallow self-neighbors. */
-void GStatCoordinator::CalcPseudoP_range(int obs_start, int obs_end,
-										 uint64_t seed_start)
-{
-	GeoDaSet workPermutation(num_obs);
-	//Randik rng;
-	//const int DBGI = 4;
-	//std::map<int,int> freq;
-	//for (int j=0; j<num_obs; j++) freq[j] = 0;
-	int max_rand = num_obs-1;
-	for (long i=obs_start; i<=obs_end; i++) {
-		const int numNeighsI = W[i].Size();
-		const double numNeighsD = W[i].Size();
-		if ( numNeighsI > 0 && G_defined[i]) { //only compute for non-isolates
-			double xd_i = x_star_t - x[i]; // know != 0 since G_defined[i] true
-			
-			int countGLarger = 0;
-			int countGStarLarger = 0;
-			double permutedG = 0;
-			double permutedGStar = 0;
-			for (int perm=0; perm<permutations; perm++) {
-				int rand = 0;
-				while (rand < numNeighsI) {
-					// computing 'perfect' permutation of given size
-					//int newRandom = (int) (rng.fValue() * max_rand);
-					int newRandom = (int) (Gda::ThomasWangHashDouble(seed_start++)
-										   * max_rand);
-					//int newRandom = X(rng);
-					if (newRandom != i && !workPermutation.Belongs(newRandom))
-					{
-						//if (i == DBGI) freq[newRandom]++;
-						//if (i == DBGI && perm < 20) m << newRandom << " ";
-						workPermutation.Push(newRandom);
-						rand++;
-					}
-				}
-				
-				double lag_i=0;
-				// use permutation to compute the lags
-				for (int j=0; j<numNeighsI; j++) {
-					lag_i += x[workPermutation.Pop()];
-				}
-				
-				if (row_standardize) {
-					permutedG = lag_i / (numNeighsD * xd_i);
-					permutedGStar = (lag_i+x[i]) / ((numNeighsD+1)*x_star_t);	
-				} else { // binary weights
-					// Wi = numNeighsD // assume no self-neighbors
-					permutedG = lag_i / xd_i;
-					permutedGStar = (lag_i+x[i]) / x_star_t;
-				}
-				//LOG(G[i]);
-				//LOG(permutedG);
-				//LOG(G_star[i]);
-				//LOG(permutedGStar);
-				
-				//if (i == DBGI && perm < 20) {
-				//	m << "Gi*: " << permutedGStar;
-				//	LOG_MSG(m);
-				//}
-				
-				if (permutedG >= G[i]) countGLarger++;
-				if (permutedGStar >= G_star[i]) countGStarLarger++;
-			}
-			//if (i == DBGI) {
-			//	for (int j=0; j<num_obs; j++) LOG(freq[j]);
-			//	LOG(G_star[i]);
-			//	LOG(countGStarLarger);
-			//	LOG(permutations);
-			//}
-			// pick the smallest
-			if (permutations-countGLarger < countGLarger) { 
-				countGLarger=permutations-countGLarger;
-			}
-			pseudo_p[i] = (countGLarger + 1.0)/(permutations+1.0);
-			//if (i == DBGI) LOG(pseudo_p[i]);
-			
-			if (permutations-countGStarLarger < countGStarLarger) { 
-				countGStarLarger=permutations-countGStarLarger;
-			}
-			pseudo_p_star[i] = (countGStarLarger + 1.0)/(permutations+1.0);
-			//if (i == DBGI) LOG(pseudo_p_star[i]);
-		}
-	}
-}
-
 void GStatCoordinator::SetSignificanceFilter(int filter_id)
 {
 	// 0: >0.05 1: 0.05, 2: 0.01, 3: 0.001, 4: 0.0001
@@ -31,41 +31,18 @@
 #ifndef __GEODA_CENTER_G_STAT_COORDINATOR_H__
 #define __GEODA_CENTER_G_STAT_COORDINATOR_H__
 
-#include <list>
 #include <vector>
 #include <boost/multi_array.hpp>
 #include <wx/string.h>
-#include <wx/thread.h>
+#include "../DataViewer/SpaceTimePanel.h"
 #include "../GenUtils.h"
+#include "../ShapeOperations/CsrWeight.h"
 #include "../ShapeOperations/GalWeight.h"
+#include "GStatEngine.h"
 
 class GetisOrdMapNewFrame; // instead of GStatCoordinatorObserver
-class GStatCoordinator;
 typedef boost::multi_array<double, 2> d_array_type;
 
-class GStatWorkerThread : public wxThread
-{
-public:
-	GStatWorkerThread(int obs_start, int obs_end, uint64_t seed_start,
-					 GStatCoordinator* gstat_coord,
-					 wxMutex* worker_list_mutex,
-					 wxCondition* worker_list_empty_cond,
-					 std::list<wxThread*> *worker_list,
-					 int thread_id);
-	virtual ~GStatWorkerThread();
-	virtual void* Entry();  // thread execution starts here
-
-	int obs_start;
-	int obs_end;
-	uint64_t seed_start;
-	int thread_id;
-	
-	GStatCoordinator* gstat_coord;
-	wxMutex* worker_list_mutex;
-	wxCondition* worker_list_empty_cond;
-	std::list<wxThread*> *worker_list;
-};
-
 class GStatCoordinator
 {
 public:
@@ -74,6 +51,12 @@ public:
 					 const std::vector<GeoDaVarInfo>& var_info,
 					 const std::vector<int>& col_ids,
 					 bool row_standardize_weights);
+	/** Constructs from data already in memory rather than from a Table.
+	 data[i] is the space-time panel for var_info[i]. */
+	GStatCoordinator(const GalWeight* gal_weights, int num_obs,
+					 const std::vector<GeoDaVarInfo>& var_info,
+					 const std::vector<SpaceTimePanel>& data,
+					 bool row_standardize_weights);
 	virtual ~GStatCoordinator();
 	
 	bool IsOk() { return true; }
@@ -92,8 +75,7 @@ public:
 	
 	std::vector<double> n; // # non-neighborless observations
 	
-	double x_star_t; // temporary x_star for use in worker threads
-	std::vector<double> x_star; // sum of all x_i // threaded
+	std::vector<double> x_star; // sum of all x_i
 	std::vector<double> x_sstar; // sum of all (x_i)^2
 		
 	std::vector<double> ExG; // same for all i since we row-standardize W
@@ -106,24 +88,6 @@ public:
 	// since W is row-standardized, sdGstar same for all i
 	std::vector<double> sdGstar;
 	
-protected:
-	// The following ten are just temporary pointers into the corresponding
-	// space-time data arrays below
-	double* G; //threaded
-	bool* G_defined; // check for divide-by-zero //threaded
-	double* G_star; //threaded
-	// z-val corresponding to each G_i
-	double* z;
-	// p-val from z_i using standard normal table
-	double* p;
-	// z-val corresponding to each G_star_i
-	double* z_star;
-	// p-val from z_i^star using standard normal table
-	double* p_star;
-	double* pseudo_p; //threaded
-	double* pseudo_p_star; //threaded
-	double* x; //threaded
-	
 public:
 	std::vector<double*> G_vecs; //threaded
 	std::vector<bool*> G_defined_vecs; // check for divide-by-zero //threaded
@@ -138,16 +102,18 @@ public:
 	std::vector<double*> p_star_vecs;
 	std::vector<double*> pseudo_p_vecs; //threaded
 	std::vector<double*> pseudo_p_star_vecs; //threaded
-	std::vector<double*> x_vecs; //threaded
+	// x_vecs[t] points into data[0], x is never modified
+	std::vector<const double*> x_vecs; //threaded
 
 	const GalElement* W;
+	CsrWeight W_csr; // flat copy of W shared by the GStatEngine workers
 	wxString weight_name;
 
 	int num_obs; // total # obs including neighborless obs
 	int num_time_vals; // number of valid time periods based on var_info
 	
 	// This variable should be empty for GStatMapNewCanvas
-	std::vector<d_array_type> data; // data[variable][time][obs]
+	std::vector<SpaceTimePanel> data; // data[variable][time][obs]
 	
 	// All GetisOrdMapNewCanvas objects synchronize themselves
 	// from the following 6 variables.
@@ -168,7 +134,6 @@ public:
 	std::vector<GetisOrdMapNewFrame*> maps;	
 	
 	void CalcPseudoP();
-	void CalcPseudoP_range(int obs_start, int obs_end, uint64_t seed_start);
 	
 	void InitFromVarInfo();
 	void VarInfoAttributeChange();
@@ -179,8 +144,8 @@ protected:
 	void DeallocateVectors();
 	void AllocateVectors();
 	
-	void CalcPseudoP_threaded();
 	void CalcGs();
+	void FillSlices(std::vector<GStatSlice>& slices);
 	std::vector<bool> has_undefined;
 	std::vector<bool> has_isolates;
 	bool row_standardize;
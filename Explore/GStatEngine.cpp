@@ -0,0 +1,320 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <boost/math/distributions/normal.hpp> // for normal_distribution
+#include "../GdaParallel.h"
+#include "../GenUtils.h"
+#include "../ShapeOperations/CsrWeight.h"
+#include "GStatEngine.h"
+
+namespace {
+	struct GStatGsTask {
+		GStatGsTask(GStatEngine* e_s) : e(e_s) {}
+		void operator()(int start, int end, int) { e->CalcGs_range(start, end); }
+		GStatEngine* e;
+	};
+	
+	struct GStatPermTask {
+		GStatPermTask(GStatEngine* e_s) : e(e_s) {}
+		void operator()(int start, int end, int) {
+			e->CalcPseudoP_range(start, end); }
+		GStatEngine* e;
+	};
+	
+	/** one-sided p-val from standard-normal table.  z is NaN when the
+	 variance is zero, e.g. for an observation whose only neighbor is
+	 itself. */
+	inline double OneSidedP(const boost::math::normal& std_norm_dist,
+							double z)
+	{
+		if (Gda::IsNaN(z)) return 1.0;
+		if (z >= 0) return 1.0-cdf(std_norm_dist, z);
+		return cdf(std_norm_dist, z);
+	}
+}
+
+GStatSlice::GStatSlice()
+: x(0), G(0), G_defined(0), G_star(0), z(0), p(0), z_star(0), p_star(0),
+pseudo_p(0), pseudo_p_star(0), n(0), x_star(0), x_sstar(0), ExG(0),
+ExGstar(0), mean_x(0), var_x(0), VarGstar(0), sdGstar(0),
+has_undefined(false), has_isolates(false)
+{
+}
+
+GStatEngine::GStatEngine(const CsrWeight& w_s, bool row_standardize_s)
+: w(w_s), row_standardize(row_standardize_s), num_obs(w_s.GetNumObs()),
+num_slices(0), slices(0), permutations(99), seed(0)
+{
+}
+
+GStatEngine::~GStatEngine()
+{
+}
+
+/** Interleave the slices into x_block so that the values of all slices
+ for one observation are contiguous. */
+void GStatEngine::LoadSlices(std::vector<GStatSlice>& slices_s)
+{
+	num_slices = slices_s.size();
+	slices = num_slices > 0 ? &slices_s[0] : 0;
+	x_block.resize((size_t) num_obs * num_slices);
+	for (int k=0; k<num_slices; k++) {
+		const double* x = slices[k].x;
+		double* xb = &x_block[0] + k;
+		for (int i=0; i<num_obs; i++) xb[(size_t) i*num_slices] = x[i];
+	}
+}
+
+void GStatEngine::CalcSummaries()
+{
+	const int K = num_slices;
+	std::vector<double> x_star(K, 0);
+	std::vector<double> x_sstar(K, 0);
+	double n = 0;
+	for (int i=0; i<num_obs; i++) {
+		if (w.IsIsolate(i)) continue;
+		n++;
+		const double* xi = &x_block[(size_t) i*K];
+		for (int k=0; k<K; k++) {
+			x_star[k] += xi[k];
+			x_sstar[k] += xi[k] * xi[k];
+		}
+	}
+	bool has_isolates = n < num_obs;
+	for (int k=0; k<K; k++) {
+		GStatSlice& s = slices[k];
+		s.n = n;
+		s.x_star = x_star[k];
+		s.x_sstar = x_sstar[k];
+		s.ExG = 1.0/(n-1); // same for all i when W is row-standardized
+		s.ExGstar = 1.0/n; // same for all i when W is row-standardized
+		s.mean_x = s.x_star / n; // x hat (overall)
+		s.var_x = s.x_sstar/n - s.mean_x*s.mean_x; // s^2 overall
+		// when W is row-standardized, VarGstar same for all i
+		// same as s^2 / (n^2 mean_x ^2)
+		s.VarGstar = s.var_x / (n*n * s.mean_x*s.mean_x);
+		s.sdGstar = sqrt(s.VarGstar);
+		s.has_isolates = has_isolates;
+		s.has_undefined = false;
+	}
+}
+
+void GStatEngine::CalcGs(std::vector<GStatSlice>& slices_s)
+{
+	if (num_obs <= 0 || slices_s.empty()) return;
+	LoadSlices(slices_s);
+	CalcSummaries();
+	
+	GStatGsTask task(this);
+	Gda::ParallelFor(num_obs, task, -1, 256);
+	
+	for (int k=0; k<num_slices; k++) {
+		const bool* G_defined = slices[k].G_defined;
+		for (int i=0; i<num_obs && !slices[k].has_undefined; i++) {
+			if (!w.IsIsolate(i) && !G_defined[i]) {
+				slices[k].has_undefined = true;
+			}
+		}
+	}
+}
+
+/** Initialize Gi and Gi_star for observations in [obs_start, obs_end).
+ We handle either binary or row-standardized binary weights.  Weights
+ with self-neighbors are handled correctly. */
+void GStatEngine::CalcGs_range(int obs_start, int obs_end)
+{
+	using boost::math::normal; // typedef provides default type is double.
+	normal std_norm_dist; // default mean = zero, and s.d. = unity
+	
+	const int K = num_slices;
+	std::vector<double> lag(K);
+	
+	for (int i=obs_start; i<obs_end; i++) {
+		const int sz = w.Size(i);
+		const int* nbrs = w.Nbrs(i);
+		const double* xi = &x_block[(size_t) i*K];
+		
+		// one pass over the neighbors accumulates the lag of every slice
+		std::fill(lag.begin(), lag.end(), 0.0);
+		bool self_neighbor = false;
+		for (int j=0; j<sz; j++) {
+			if (nbrs[j] == i) {
+				self_neighbor = true;
+				continue;
+			}
+			const double* xj = &x_block[(size_t) nbrs[j]*K];
+			for (int k=0; k<K; k++) lag[k] += xj[k];
+		}
+		double Wi = self_neighbor ? sz-1 : sz;
+		double Wi_star = self_neighbor ? sz : sz+1;
+		
+		for (int k=0; k<K; k++) {
+			GStatSlice& s = slices[k];
+			const double n = s.n;
+			if (s.x_star == 0) {
+				s.G[i] = 0;
+				s.G_defined[i] = false;
+				s.z[i] = 0;
+				s.p[i] = 1;
+				s.G_star[i] = 0;
+				s.z_star[i] = 0;
+				s.p_star[i] = 1;
+				continue;
+			}
+			
+			s.G[i] = 0;
+			s.G_defined[i] = true;
+			s.z[i] = 0;
+			s.p[i] = 1;
+			if (sz > 0) {
+				double lag_i = lag[k];
+				double W_i = Wi;
+				if (row_standardize) {
+					lag_i /= sz;
+					W_i /= sz;
+				}
+				double xd_i = s.x_star - xi[k];
+				if (xd_i != 0) {
+					s.G[i] = lag_i / xd_i;
+					double x_hat_i = xd_i * s.ExG; // (x_star - x[i])/(n-1)
+					double ExGi = W_i/(n-1);
+					// location-specific variance
+					double ss_i = ((s.x_sstar - xi[k]*xi[k])/(n-1)
+								   - x_hat_i*x_hat_i);
+					double n_expr = sqrt((n-1)*(n-1)*(n-2));
+					double sdG_i = sqrt(W_i*(n-1-W_i)*ss_i)/(n_expr * x_hat_i);
+					s.z[i] = (s.G[i] - ExGi)/sdG_i;
+					s.p[i] = OneSidedP(std_norm_dist, s.z[i]);
+				} else {
+					s.G_defined[i] = false;
+				}
+			}
+			
+			double lag_star = lag[k] + xi[k];
+			if (row_standardize) {
+				s.G_star[i] = lag_star / (Wi_star * s.x_star);
+				s.z_star[i] = (s.G_star[i] - s.ExGstar)/s.sdGstar;
+			} else { // binary weights
+				s.G_star[i] = lag_star / s.x_star;
+				// location-specific mean
+				double ExGi_star = Wi_star/n;
+				// location-specific variance
+				double sdG_i_star = (sqrt(Wi_star*(n-Wi_star)*s.var_x) /
+									 (n * sqrt(n-1) * s.mean_x));
+				s.z_star[i] = (s.G_star[i] - ExGi_star)/sdG_i_star;
+			}
+			s.p_star[i] = OneSidedP(std_norm_dist, s.z_star[i]);
+		}
+	}
+}
+
+void GStatEngine::CalcPseudoP(std::vector<GStatSlice>& slices_s,
+							  int permutations_s, uint64_t seed_s)
+{
+	if (num_obs <= 1 || slices_s.empty()) return;
+	LoadSlices(slices_s);
+	permutations = permutations_s;
+	seed = seed_s;
+	
+	GStatPermTask task(this);
+	Gda::ParallelFor(num_obs, task);
+}
+
+/** The neighbors drawn for one observation and one permutation are shared
+ by all slices, so only the lag accumulation and the comparisons are
+ repeated per slice. */
+void GStatEngine::CalcPseudoP_range(int obs_start, int obs_end)
+{
+	const int K = num_slices;
+	GeoDaSet workPermutation(num_obs);
+	std::vector<double> lag(K);
+	std::vector<int> countGLarger(K);
+	std::vector<int> countGStarLarger(K);
+	
+	for (int i=obs_start; i<obs_end; i++) {
+		const int numNeighsI = std::min(w.Size(i), num_obs-1);
+		const double numNeighsD = numNeighsI;
+		if (numNeighsI <= 0) continue; //only compute for non-isolates
+		bool any_defined = false;
+		for (int k=0; k<K && !any_defined; k++) {
+			if (slices[k].G_defined[i]) any_defined = true;
+		}
+		if (!any_defined) continue;
+		
+		const double* xi = &x_block[(size_t) i*K];
+		std::fill(countGLarger.begin(), countGLarger.end(), 0);
+		std::fill(countGStarLarger.begin(), countGStarLarger.end(), 0);
+		// counter-based random stream for observation i
+		uint64_t key = Gda::ThomasWangHashUInt64(seed + i);
+		
+		for (int perm=0; perm<permutations; perm++) {
+			int rand = 0;
+			while (rand < numNeighsI) {
+				// computing 'perfect' permutation of given size
+				int newRandom = (int) (Gda::ThomasWangHashDouble(key++)
+									   * num_obs);
+				if (newRandom >= num_obs) newRandom = num_obs-1;
+				if (newRandom != i && !workPermutation.Belongs(newRandom)) {
+					workPermutation.Push(newRandom);
+					rand++;
+				}
+			}
+			
+			std::fill(lag.begin(), lag.end(), 0.0);
+			// use permutation to compute the lags
+			for (int j=0; j<numNeighsI; j++) {
+				const double* xj = &x_block[(size_t) workPermutation.Pop()*K];
+				for (int k=0; k<K; k++) lag[k] += xj[k];
+			}
+			
+			for (int k=0; k<K; k++) {
+				const GStatSlice& s = slices[k];
+				if (!s.G_defined[i]) continue;
+				double xd_i = s.x_star - xi[k]; // != 0 since G_defined[i]
+				double permutedG, permutedGStar;
+				if (row_standardize) {
+					permutedG = lag[k] / (numNeighsD * xd_i);
+					permutedGStar = ((lag[k]+xi[k]) /
+									 ((numNeighsD+1)*s.x_star));
+				} else { // binary weights
+					// Wi = numNeighsD // assume no self-neighbors
+					permutedG = lag[k] / xd_i;
+					permutedGStar = (lag[k]+xi[k]) / s.x_star;
+				}
+				if (permutedG >= s.G[i]) countGLarger[k]++;
+				if (permutedGStar >= s.G_star[i]) countGStarLarger[k]++;
+			}
+		}
+		
+		for (int k=0; k<K; k++) {
+			GStatSlice& s = slices[k];
+			if (!s.G_defined[i]) continue;
+			// pick the smallest
+			int cG = countGLarger[k];
+			if (permutations-cG < cG) cG = permutations-cG;
+			s.pseudo_p[i] = (cG + 1.0)/(permutations+1.0);
+			
+			int cGs = countGStarLarger[k];
+			if (permutations-cGs < cGs) cGs = permutations-cGs;
+			s.pseudo_p_star[i] = (cGs + 1.0)/(permutations+1.0);
+		}
+	}
+}
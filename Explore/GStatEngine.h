@@ -0,0 +1,105 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_G_STAT_ENGINE_H__
+#define __GEODA_CENTER_G_STAT_ENGINE_H__
+
+#include <stdint.h>
+#include <vector>
+
+class CsrWeight;
+
+/**
+ Input and output arrays for one (variable, time period) combination.
+ All pointers refer to caller-owned arrays of length num_obs.  The
+ summary values below the arrays are filled in by GStatEngine::CalcGs.
+ */
+struct GStatSlice {
+	GStatSlice();
+	
+	const double* x;
+	double* G;
+	bool* G_defined; // false where G is undefined (divide-by-zero)
+	double* G_star;
+	double* z; // z-val corresponding to each G_i
+	double* p; // p-val from z_i using standard normal table
+	double* z_star; // z-val corresponding to each G_star_i
+	double* p_star; // p-val from z_i^star using standard normal table
+	double* pseudo_p; // only needed for CalcPseudoP
+	double* pseudo_p_star; // only needed for CalcPseudoP
+	
+	double n; // # non-neighborless observations
+	double x_star; // sum of all x_i
+	double x_sstar; // sum of all (x_i)^2
+	double ExG; // same for all i when W is row-standardized
+	double ExGstar; // same for all i when W is row-standardized
+	double mean_x; // x hat (overall)
+	double var_x; // s^2 overall
+	double VarGstar; // same for all i when W is row-standardized
+	double sdGstar;
+	bool has_undefined;
+	bool has_isolates;
+};
+
+/**
+ Batched Getis-Ord G and G* computation.  Any number of variables and
+ time periods are handled together: the slices are interleaved into a
+ single observation-major block so that one sweep over the CSR neighbor
+ lists accumulates the spatial lags of every slice at once, and the
+ permutation test draws one set of random neighbors per observation and
+ permutation that is then shared by all slices.  Work is divided by
+ observation over all available cores.  Random neighbors for observation i
+ are drawn from a counter-based stream seeded by (seed, i), so results do
+ not depend on the number of worker threads.
+ 
+ Self-neighbors are handled for the analytical G and G* values, but are
+ disallowed in the permutation test, as in GStatCoordinator.
+ */
+class GStatEngine {
+public:
+	GStatEngine(const CsrWeight& w, bool row_standardize);
+	virtual ~GStatEngine();
+	
+	/** Compute G, G*, z-values and normal p-values for every slice. */
+	void CalcGs(std::vector<GStatSlice>& slices);
+	/** Compute permutation pseudo p-values for G and G* for every slice.
+	 CalcGs must have been called on the same slices first. */
+	void CalcPseudoP(std::vector<GStatSlice>& slices, int permutations,
+					 uint64_t seed);
+	
+	// called by the worker threads
+	void CalcGs_range(int obs_start, int obs_end);
+	void CalcPseudoP_range(int obs_start, int obs_end);
+	
+protected:
+	void LoadSlices(std::vector<GStatSlice>& slices);
+	void CalcSummaries();
+	
+	const CsrWeight& w;
+	bool row_standardize;
+	int num_obs;
+	int num_slices;
+	GStatSlice* slices;
+	// x_block[i*num_slices + k] is x for observation i in slice k
+	std::vector<double> x_block;
+	int permutations;
+	uint64_t seed;
+};
+
+#endif
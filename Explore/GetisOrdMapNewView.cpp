@@ -179,10 +179,7 @@ void GetisOrdMapNewCanvas::TimeChange()
 			var_info[i].time = ref_time + var_info[i].ref_time_offset;
 		}
 	}
-	cat_data.SetCurrentCanvasTmStep(ref_time - ref_time_min);
-	invalidateBms();
-	PopulateCanvas();
-	Refresh();
+	ChangeCanvasTmStep(ref_time - ref_time_min);
 	LOG_MSG("Exiting GetisOrdMapNewCanvas::TimeChange");
 }
 
@@ -0,0 +1,346 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include "../GdaParallel.h"
+#include "../GenUtils.h"
+#include "../ShapeOperations/RateSmoothing.h"
+#include "GlobalMoranEngine.h"
+
+namespace {
+	struct MoranPermTask {
+		MoranPermTask(GlobalMoranEngine* e_s, int first_s, double* results_s)
+		: e(e_s), first(first_s), results(results_s) {}
+		void operator()(int start, int end, int) {
+			e->Permute_range(first, start, end, results); }
+		GlobalMoranEngine* e;
+		int first;
+		double* results;
+	};
+}
+
+GlobalMoranEngine::GlobalMoranEngine(const CsrWeight& w_s)
+: stat_type(univariate), num_obs(w_s.GetNumObs()), S0(0), S1(0), S2(0),
+Sx(0), Sy(0), Sxx(0), Syy(0), Sx3(0), Sx4(0), C(0), Rx(0), Cy(0),
+perm_denom(0), seed(0)
+{
+	SetWeights(w_s);
+}
+
+GlobalMoranEngine::~GlobalMoranEngine()
+{
+}
+
+void GlobalMoranEngine::SetWeights(const CsrWeight& w_s)
+{
+	w = w_s;
+	num_obs = w.GetNumObs();
+	CalcWeightSums();
+	if ((int) x.size() == num_obs) CalcCrossSums();
+}
+
+/** Row-standardize the weights and compute S0, S1 and S2 along with the
+ transpose that the rolling update needs. */
+void GlobalMoranEngine::CalcWeightSums()
+{
+	const int n = num_obs;
+	wv.resize(w.GetNumNonZero());
+	row_sum.assign(n, 0);
+	col_sum.assign(n, 0);
+	self_w.assign(n, 0);
+	for (int i=0; i<n; i++) {
+		int sz = w.Size(i);
+		if (sz == 0) continue;
+		const double* v = w.Weights(i);
+		double tot = 0;
+		if (v) {
+			for (int j=0; j<sz; j++) tot += v[j];
+		} else {
+			tot = sz;
+		}
+		const int* nbrs = w.Nbrs(i);
+		double* wvi = &wv[w.row_start[i]];
+		for (int j=0; j<sz; j++) {
+			wvi[j] = tot != 0 ? (v ? v[j] : 1.0) / tot : 0;
+			row_sum[i] += wvi[j];
+			col_sum[nbrs[j]] += wvi[j];
+			if (nbrs[j] == i) self_w[i] += wvi[j];
+		}
+	}
+	
+	// transpose
+	wt.Clear();
+	wt.num_obs = n;
+	wt.row_start.assign(n+1, 0);
+	for (long k=0, kend=w.nbrs.size(); k<kend; k++) {
+		wt.row_start[w.nbrs[k]+1]++;
+	}
+	for (int i=0; i<n; i++) wt.row_start[i+1] += wt.row_start[i];
+	wt.nbrs.resize(w.nbrs.size());
+	wt.weights.resize(w.nbrs.size());
+	std::vector<long> pos(wt.row_start.begin(), wt.row_start.end()-1);
+	for (int i=0; i<n; i++) {
+		const int* nbrs = w.Nbrs(i);
+		for (int j=0, sz=w.Size(i); j<sz; j++) {
+			long k = pos[nbrs[j]]++;
+			wt.nbrs[k] = i;
+			wt.weights[k] = wv[w.row_start[i]+j];
+		}
+	}
+	
+	// S1 = 1/2 sum_ij (w_ij + w_ji)^2 = sum_ij w_ij^2 + sum_ij w_ij w_ji
+	S0 = 0;
+	S1 = 0;
+	S2 = 0;
+	std::vector<double> scatter(n, 0);
+	for (int i=0; i<n; i++) {
+		S0 += row_sum[i];
+		S2 += (row_sum[i] + col_sum[i]) * (row_sum[i] + col_sum[i]);
+		const int* nbrs = w.Nbrs(i);
+		const double* wvi = wv.empty() ? 0 : &wv[w.row_start[i]];
+		int sz = w.Size(i);
+		for (int j=0; j<sz; j++) {
+			S1 += wvi[j] * wvi[j];
+			scatter[nbrs[j]] += wvi[j];
+		}
+		const int* in_nbrs = wt.Nbrs(i);
+		const double* in_w = wt.Weights(i);
+		for (int j=0, jend=wt.Size(i); j<jend; j++) {
+			S1 += in_w[j] * scatter[in_nbrs[j]];
+		}
+		for (int j=0; j<sz; j++) scatter[nbrs[j]] = 0;
+	}
+}
+
+void GlobalMoranEngine::SetData(const std::vector<double>& x_s)
+{
+	stat_type = univariate;
+	x = x_s;
+	y = x_s;
+	CalcDataSums();
+	CalcCrossSums();
+}
+
+void GlobalMoranEngine::SetData(const std::vector<double>& x_s,
+								const std::vector<double>& y_s)
+{
+	stat_type = bivariate;
+	x = x_s;
+	y = y_s;
+	CalcDataSums();
+	CalcCrossSums();
+}
+
+bool GlobalMoranEngine::SetRates(const std::vector<double>& events,
+								 const std::vector<double>& base)
+{
+	std::vector<double> rates(num_obs, 0);
+	std::vector<bool> undefined(num_obs, false);
+	bool ok = GdaAlgs::RateStandardizeEB(num_obs, &base[0], &events[0],
+										 &rates[0], undefined);
+	SetData(rates);
+	stat_type = eb_rate;
+	return ok;
+}
+
+void GlobalMoranEngine::CalcDataSums()
+{
+	Sx = Sy = Sxx = Syy = Sx3 = Sx4 = 0;
+	for (int i=0; i<num_obs; i++) {
+		double x2 = x[i]*x[i];
+		Sx += x[i];
+		Sxx += x2;
+		Sx3 += x2*x[i];
+		Sx4 += x2*x2;
+		Sy += y[i];
+		Syy += y[i]*y[i];
+	}
+}
+
+void GlobalMoranEngine::CalcCrossSums()
+{
+	C = Rx = Cy = 0;
+	for (int i=0; i<num_obs; i++) {
+		const int* nbrs = w.Nbrs(i);
+		const double* wvi = wv.empty() ? 0 : &wv[w.row_start[i]];
+		double lag = 0;
+		for (int j=0, sz=w.Size(i); j<sz; j++) lag += wvi[j] * y[nbrs[j]];
+		C += x[i] * lag;
+		Rx += x[i] * row_sum[i];
+		Cy += y[i] * col_sum[i];
+	}
+}
+
+void GlobalMoranEngine::UpdateObservation(int i, double x_i)
+{
+	UpdateObservation(i, x_i, stat_type == bivariate ? y[i] : x_i);
+}
+
+/** C' = C + dx * sum_j w_ij y_j + dy * sum_j w_ji x_j + dx * dy * w_ii */
+void GlobalMoranEngine::UpdateObservation(int i, double x_i, double y_i)
+{
+	if (i < 0 || i >= num_obs) return;
+	double d_x = x_i - x[i];
+	double d_y = y_i - y[i];
+	
+	double out_lag = 0;
+	const int* nbrs = w.Nbrs(i);
+	const double* wvi = wv.empty() ? 0 : &wv[w.row_start[i]];
+	for (int j=0, sz=w.Size(i); j<sz; j++) out_lag += wvi[j] * y[nbrs[j]];
+	double in_lag = 0;
+	const int* in_nbrs = wt.Nbrs(i);
+	const double* in_w = wt.Weights(i);
+	for (int j=0, sz=wt.Size(i); j<sz; j++) in_lag += in_w[j] * x[in_nbrs[j]];
+	C += d_x * out_lag + d_y * in_lag + d_x * d_y * self_w[i];
+	Rx += d_x * row_sum[i];
+	Cy += d_y * col_sum[i];
+	
+	double x2_old = x[i]*x[i];
+	double x2_new = x_i*x_i;
+	Sx += d_x;
+	Sxx += x2_new - x2_old;
+	Sx3 += x2_new*x_i - x2_old*x[i];
+	Sx4 += x2_new*x2_new - x2_old*x2_old;
+	Sy += d_y;
+	Syy += y_i*y_i - y[i]*y[i];
+	x[i] = x_i;
+	y[i] = y_i;
+}
+
+double GlobalMoranEngine::GetMoranI() const
+{
+	const double n = num_obs;
+	if (n <= 1) return 0;
+	double mx = Sx / n;
+	double my = Sy / n;
+	double A = C - my*Rx - mx*Cy + mx*my*S0;
+	double Bx = Sxx - n*mx*mx;
+	double By = Syy - n*my*my;
+	if (Bx <= 0 || By <= 0) return 0;
+	return A / sqrt(Bx*By);
+}
+
+double GlobalMoranEngine::GetExpectedI() const
+{
+	const double n = num_obs;
+	if (n <= 1) return 0;
+	return (S0/n) * (-1.0/(n-1.0));
+}
+
+bool GlobalMoranEngine::IsAnalyticValid() const
+{
+	return stat_type != bivariate && num_obs > 3 && S0 > 0;
+}
+
+/** Var[I] = (n^2 S1 - n S2 + 3 S0^2) / (S0^2 (n^2-1)) - E[I]^2 for the
+ usual Moran's I.  Our I is scaled by S0/n, which differs from one only
+ when there are neighborless observations. */
+double GlobalMoranEngine::GetVarNormality() const
+{
+	if (!IsAnalyticValid()) return 0;
+	const double n = num_obs;
+	double EI = -1.0/(n-1.0);
+	double v = ((n*n*S1 - n*S2 + 3*S0*S0) / (S0*S0*(n*n-1.0))) - EI*EI;
+	return (S0/n)*(S0/n) * v;
+}
+
+double GlobalMoranEngine::GetVarRandomization() const
+{
+	if (!IsAnalyticValid()) return 0;
+	const double n = num_obs;
+	double m = Sx / n;
+	double m2 = Sxx - n*m*m; // sum of squared deviations
+	if (m2 <= 0) return 0;
+	// sum of fourth powers of deviations
+	double m4 = Sx4 - 4*m*Sx3 + 6*m*m*Sxx - 3*n*m*m*m*m;
+	double b2 = n * m4 / (m2*m2);
+	double EI = -1.0/(n-1.0);
+	double num = (n*((n*n-3*n+3)*S1 - n*S2 + 3*S0*S0)
+				  - b2*((n*n-n)*S1 - 2*n*S2 + 6*S0*S0));
+	double v = num / ((n-1)*(n-2)*(n-3)*S0*S0) - EI*EI;
+	return (S0/n)*(S0/n) * v;
+}
+
+double GlobalMoranEngine::GetZNormality() const
+{
+	double v = GetVarNormality();
+	return v > 0 ? (GetMoranI() - GetExpectedI())/sqrt(v) : 0;
+}
+
+double GlobalMoranEngine::GetZRandomization() const
+{
+	double v = GetVarRandomization();
+	return v > 0 ? (GetMoranI() - GetExpectedI())/sqrt(v) : 0;
+}
+
+void GlobalMoranEngine::Permute(int first, int count, double* results)
+{
+	if (count <= 0 || num_obs <= 1) return;
+	const double n = num_obs;
+	double mx = Sx / n;
+	double my = Sy / n;
+	dx.resize(num_obs);
+	dy.resize(num_obs);
+	for (int i=0; i<num_obs; i++) {
+		dx[i] = x[i] - mx;
+		dy[i] = y[i] - my;
+	}
+	double Bx = Sxx - n*mx*mx;
+	double By = Syy - n*my*my;
+	perm_denom = (Bx > 0 && By > 0) ? sqrt(Bx*By) : 0;
+	
+	MoranPermTask task(this, first, results);
+	Gda::ParallelFor(count, task);
+}
+
+/** Permutation p is stored in results[p-first]. */
+void GlobalMoranEngine::Permute_range(int first, int start, int end,
+									  double* results)
+{
+	std::vector<int> perm(num_obs);
+	std::vector<double> dy_p(num_obs);
+	for (int k=start; k<end; k++) {
+		if (perm_denom == 0) {
+			results[k] = 0;
+			continue;
+		}
+		// Fisher-Yates shuffle from the stream for permutation first+k
+		uint64_t key = Gda::ThomasWangHashUInt64(seed + first + k);
+		for (int i=0; i<num_obs; i++) perm[i] = i;
+		for (int i=num_obs-1; i>0; i--) {
+			int j = (int) (Gda::ThomasWangHashDouble(key++) * (i+1));
+			if (j > i) j = i;
+			int tmp = perm[i];
+			perm[i] = perm[j];
+			perm[j] = tmp;
+		}
+		for (int i=0; i<num_obs; i++) dy_p[i] = dy[perm[i]];
+		double A = 0;
+		for (int i=0; i<num_obs; i++) {
+			int sz = w.Size(i);
+			if (sz == 0) continue;
+			const int* nbrs = w.Nbrs(i);
+			const double* wvi = &wv[w.row_start[i]];
+			double lag = 0;
+			for (int j=0; j<sz; j++) lag += wvi[j] * dy_p[nbrs[j]];
+			A += dx[perm[i]] * lag;
+		}
+		results[k] = A / perm_denom;
+	}
+}
@@ -0,0 +1,117 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_GLOBAL_MORAN_ENGINE_H__
+#define __GEODA_CENTER_GLOBAL_MORAN_ENGINE_H__
+
+#include <stdint.h>
+#include <vector>
+#include "../ShapeOperations/CsrWeight.h"
+
+/**
+ Global Moran's I for univariate, bivariate and EB-standardized rate
+ variables with row-standardized weights, as shown in the Moran scatter
+ plot: I = sum_i z1_i * lag(z2)_i / (n-1) where z1 and z2 are standardized.
+ 
+ The statistic is kept as a handful of running sums (sum w_ij x_i y_j,
+ sums and sums of squares of x and y, ...).  Weight-only quantities
+ (S0, S1, S2, row and column sums) are cached separately from data-only
+ quantities, so replacing the weights or the variable only recomputes the
+ half that changed, and UpdateObservation changes a single value in
+ O(number of neighbors).
+ 
+ Analytical moments follow Cliff and Ord (1981) under the normality and
+ randomization assumptions.  They are only available for the univariate
+ and EB rate statistics.
+ 
+ Permutations are independent: permutation p shuffles the locations with
+ a Fisher-Yates shuffle driven by a counter-based ThomasWang stream keyed
+ by (seed, p).  Any range of permutations can therefore be computed in
+ any order, on any number of threads, with identical results.
+ */
+class GlobalMoranEngine {
+public:
+	enum StatType { univariate, bivariate, eb_rate };
+	
+	GlobalMoranEngine(const CsrWeight& w);
+	virtual ~GlobalMoranEngine();
+	
+	/** Replace the weights. Data sums are kept. */
+	void SetWeights(const CsrWeight& w);
+	void SetData(const std::vector<double>& x);
+	void SetData(const std::vector<double>& x, const std::vector<double>& y);
+	/** EB-standardized rate of events / base.  Returns false if no rate
+	 is defined. */
+	bool SetRates(const std::vector<double>& events,
+				  const std::vector<double>& base);
+	/** Change x_i (and y_i for the univariate statistic) in place. */
+	void UpdateObservation(int i, double x_i);
+	void UpdateObservation(int i, double x_i, double y_i);
+	
+	StatType GetStatType() const { return stat_type; }
+	int GetNumObs() const { return num_obs; }
+	double GetMoranI() const;
+	/** E[I] = -1/(n-1), scaled for isolates */
+	double GetExpectedI() const;
+	bool IsAnalyticValid() const;
+	double GetVarNormality() const;
+	double GetVarRandomization() const;
+	double GetZNormality() const;
+	double GetZRandomization() const;
+	
+	void SetSeed(uint64_t s) { seed = s; }
+	uint64_t GetSeed() const { return seed; }
+	/** Compute Moran's I for permutations [first, first+count) into
+	 results[0] ... results[count-1] using all available cores. */
+	void Permute(int first, int count, double* results);
+	// called by worker threads
+	void Permute_range(int first, int start, int end, double* results);
+	
+protected:
+	void CalcWeightSums();
+	void CalcDataSums();
+	void CalcCrossSums();
+	
+	StatType stat_type;
+	int num_obs;
+	CsrWeight w;
+	std::vector<double> wv; // row-standardized weights, parallel to w.nbrs
+	std::vector<double> row_sum;
+	std::vector<double> col_sum;
+	std::vector<double> self_w; // w_ii
+	// transpose of w for the rolling update: wt.weights holds w_ji
+	CsrWeight wt;
+	double S0;
+	double S1;
+	double S2;
+	
+	std::vector<double> x;
+	std::vector<double> y; // same as x unless bivariate
+	double Sx, Sy, Sxx, Syy, Sx3, Sx4;
+	// sum_ij w_ij x_i y_j, sum_i x_i row_sum_i, sum_j y_j col_sum_j
+	double C, Rx, Cy;
+	
+	// deviations from the mean used by the permutation workers
+	std::vector<double> dx;
+	std::vector<double> dy;
+	double perm_denom;
+	uint64_t seed;
+};
+
+#endif
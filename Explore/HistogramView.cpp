@@ -29,6 +29,7 @@
 #include <wx/dcmemory.h>
 #include <wx/msgdlg.h>
 #include <wx/xrc/xmlres.h>
+#include "../DataViewer/SortedColCache.h"
 #include "../DataViewer/TableInterface.h"
 #include "../DataViewer/TimeState.h"
 #include "../DialogTools/HistIntervalDlg.h"
@@ -71,6 +72,7 @@ scale_x_over_time(true), scale_y_over_time(true)
 	LOG_MSG("Entering HistogramCanvas::HistogramCanvas");
 	template_frame = t_frame;	
 	TableInterface* table_int = project->GetTableInt();
+	SortedColCache* sort_cache = project->GetSortedColCache();
 	
 	std::vector<d_array_type> data(v_info.size());
 	
@@ -82,14 +84,8 @@ scale_x_over_time(true), scale_y_over_time(true)
 	data_min_over_time = data[0][0][0];
 	data_max_over_time = data[0][0][0];
 	for (int t=0; t<data0_times; t++) {
-		data_sorted[t].resize(num_obs);
-		for (int i=0; i<num_obs; i++) {
-			data_sorted[t][i].first = data[0][t][i];
-			data_sorted[t][i].second = i;
-		}
-		std::sort(data_sorted[t].begin(), data_sorted[t].end(),
-				  Gda::dbl_int_pair_cmp_less);
-		data_stats[t].CalculateFromSample(data_sorted[t]);
+		data_sorted[t] = sort_cache->GetSorted(col_ids[0], t);
+		table_int->GetColSampleStats(col_ids[0], t, data_stats[t]);
 		hinge_stats[t].CalculateHingeStats(data_sorted[t]);
 		if (data_stats[t].min < data_min_over_time) {
 			data_min_over_time = data_stats[t].min;
@@ -360,6 +356,7 @@ void HistogramCanvas::PopulateCanvas()
 	LOG_MSG("Entering HistogramCanvas::PopulateCanvas");
 	BOOST_FOREACH( GdaShape* shp, background_shps ) { delete shp; }
 	background_shps.clear();
+	scale_trans_batch.Cancel();
 	BOOST_FOREACH( GdaShape* shp, selectable_shps ) { delete shp; }
 	selectable_shps.clear();
 	BOOST_FOREACH( GdaShape* shp, foreground_shps ) { delete shp; }
@@ -21,8 +21,8 @@
 #include <wx/filename.h>
 #include <wx/stopwatch.h>
 #include "../DataViewer/TableInterface.h"
-#include "../ShapeOperations/RateSmoothing.h"
 #include "../ShapeOperations/Randik.h"
+#include "../GdaTrace.h"
 #include "../logger.h"
 #include "LisaCoordinatorObserver.h"
 #include "LisaCoordinator.h"
@@ -114,11 +114,32 @@ last_seed_used(0), reuse_last_seed(false)
 {
 	SetSignificanceFilter(1);
 	for (int i=0; i<var_info.size(); i++) {
-		table_int->GetColData(col_ids[i], data[i]);
+		table_int->GetColPanel(col_ids[i], data[i]);
 	}
 	InitFromVarInfo();
 }
 
+LisaCoordinator::LisaCoordinator(const GalWeight* gal_weights_s,
+								 int num_obs_s,
+								 const std::vector<GeoDaVarInfo>& var_info_s,
+								 const std::vector<SpaceTimePanel>& data_s,
+								 LisaType lisa_type_s,
+								 bool calc_significances_s)
+: W(gal_weights_s->gal),
+weight_name(wxFileName(gal_weights_s->wflnm).GetName()),
+num_obs(num_obs_s),
+permutations(99),
+lisa_type(lisa_type_s),
+calc_significances(calc_significances_s),
+isBivariate(lisa_type_s == bivariate),
+var_info(var_info_s),
+data(data_s),
+last_seed_used(0), reuse_last_seed(false)
+{
+	SetSignificanceFilter(1);
+	InitFromVarInfo();
+}
+
 
 LisaCoordinator::~LisaCoordinator()
 {
@@ -148,14 +169,10 @@ void LisaCoordinator::DeallocateVectors()
 		if (cluster_vecs[i]) delete [] cluster_vecs[i];
 	}
 	cluster_vecs.clear();
-	for (int i=0; i<data1_vecs.size(); i++) {
-		if (data1_vecs[i]) delete [] data1_vecs[i];
-	}
 	data1_vecs.clear();
-	for (int i=0; i<data2_vecs.size(); i++) {
-		if (data2_vecs[i]) delete [] data2_vecs[i];
-	}
 	data2_vecs.clear();
+	data1_panel.Resize(0, 0);
+	data2_panel.Resize(0, 0);
 }
 
 /** allocate based on var_info and num_time_vals **/
@@ -172,6 +189,7 @@ void LisaCoordinator::AllocateVectors()
 	map_error_message.resize(tms);
 	has_isolates.resize(tms);
 	has_undefined.resize(tms);
+	data1_panel.Resize(tms, num_obs);
 	for (int i=0; i<tms; i++) {
 		lags_vecs[i] = new double[num_obs];
 		local_moran_vecs[i] = new double[num_obs];
@@ -180,15 +198,16 @@ void LisaCoordinator::AllocateVectors()
 			sig_cat_vecs[i] = new int[num_obs];
 		}
 		cluster_vecs[i] = new int[num_obs];
-		data1_vecs[i] = new double[num_obs];
+		data1_vecs[i] = data1_panel[i].GetPtr();
 		map_valid[i] = true;
 		map_error_message[i] = wxEmptyString;
 	}
 	
 	if (lisa_type == bivariate) {
 		data2_vecs.resize((var_info[1].time_max - var_info[1].time_min) + 1);
+		data2_panel.Resize(data2_vecs.size(), num_obs);
 		for (int i=0; i<data2_vecs.size(); i++) {
-			data2_vecs[i] = new double[num_obs];
+			data2_vecs[i] = data2_panel[i].GetPtr();
 		}
 	}
 }
@@ -225,52 +244,43 @@ void LisaCoordinator::InitFromVarInfo()
 	if (lisa_type == univariate || lisa_type == bivariate) {
 		for (int t=var_info[0].time_min; t<=var_info[0].time_max; t++) {
 			int d1_t = t - var_info[0].time_min;
-			for (int i=0; i<num_obs; i++) data1_vecs[d1_t][i] = data[0][t][i];
+			data[0][t].CopyTo(data1_vecs[d1_t]);
 		}
 		if (lisa_type == bivariate) {
 			for (int t=var_info[1].time_min; t<=var_info[1].time_max; t++) {
 				int d2_t = t - var_info[1].time_min;
-				for (int i=0; i<num_obs; i++) {
-					data2_vecs[d2_t][i] = data[1][t][i];
-				}
+				data[1][t].CopyTo(data2_vecs[d2_t]);
 			}
 		}
 	} else { // lisa_type == eb_rate_standardized
-		std::vector<bool> undef_res(num_obs, false);
-		double* smoothed_results = new double[num_obs];
-		double* E = new double[num_obs]; // E corresponds to var_info[0]
-		double* P = new double[num_obs]; // P corresponds to var_info[1]
 		// we will only fill data1 for eb_rate_standardized and
-		// further lisa calcs will treat as univariate
+		// further lisa calcs will treat as univariate.  All time periods
+		// are smoothed in one pass.
+		std::vector<const double*> E(num_time_vals); // var_info[0]
+		std::vector<const double*> P(num_time_vals); // var_info[1]
 		for (int t=0; t<num_time_vals; t++) {
 			int v0_t = var_info[0].time_min;
 			if (var_info[0].is_time_variant &&
 				var_info[0].sync_with_global_time) {
 				v0_t += t;
 			}
-			for (int i=0; i<num_obs; i++) E[i] = data[0][v0_t][i];
+			E[t] = data[0][v0_t].GetPtr();
 			int v1_t = var_info[1].time_min;
 			if (var_info[1].is_time_variant &&
 				var_info[1].sync_with_global_time) {
 				v1_t += t;
 			}
-			for (int i=0; i<num_obs; i++) P[i] = data[1][v1_t][i];
-			bool success = GdaAlgs::RateStandardizeEB(num_obs, P, E,
-														smoothed_results,
-														undef_res);
-			if (!success) {
+			P[t] = data[1][v1_t].GetPtr();
+		}
+		rate_smoother.Smooth(GdaAlgs::eb_rate_standardized, num_obs, 0, P, E,
+							 data1_vecs);
+		for (int t=0; t<num_time_vals; t++) {
+			if (!rate_smoother.IsValid(t)) {
 				map_valid[t] = false;
 				map_error_message[t] << "Emprical Bayes Rate ";
 				map_error_message[t] << "Standardization failed.";
-			} else {
-				for (int i=0; i<num_obs; i++) {
-					data1_vecs[t][i] = smoothed_results[i];
-				}
 			}
 		}
-		if (smoothed_results) delete [] smoothed_results;
-		if (E) delete [] E;
-		if (P) delete [] P;
 	}
 	
 	StandardizeData();
@@ -319,6 +329,7 @@ void LisaCoordinator::StandardizeData()
 /** assumes StandardizeData already called on data1 and data2 */
 void LisaCoordinator::CalcLisa()
 {
+	GDA_TRACE_SCOPE("classify", "LisaCoordinator::CalcLisa");
 	for (int t=0; t<num_time_vals; t++) {
 		data1 = data1_vecs[t];
 		if (isBivariate) {
@@ -361,7 +372,7 @@ void LisaCoordinator::CalcPseudoP()
 {
 	LOG_MSG("Entering LisaCoordinator::CalcPseudoP");
 	if (!calc_significances) return;
-	wxStopWatch sw;
+	GDA_TRACE_SCOPE("permute", "LisaCoordinator::CalcPseudoP");
 	int nCPUs = wxThread::GetCPUCount();
 	
 	// To ensure thread safety, only work on one time slice of data
@@ -401,11 +412,11 @@ void LisaCoordinator::CalcPseudoP()
 			CalcPseudoP_threaded();
 		}
 	}
+	GDA_TRACE_COUNT("permute", "LISA permutations",
+					(int64_t) permutations * num_obs * num_time_vals);
 	{
 		wxString m;
-		m << "LISA on " << num_obs << " obs with " << permutations;
-		m << " perms over " << num_time_vals << " time periods took ";
-		m << sw.Time() << " ms. Last seed used: " << last_seed_used;
+		m << "LISA last seed used: " << last_seed_used;
 		LOG_MSG(m);
 	}
 	LOG_MSG("Exiting LisaCoordinator::CalcPseudoP");
@@ -497,6 +508,7 @@ void LisaCoordinator::CalcPseudoP_threaded()
 void LisaCoordinator::CalcPseudoP_range(int obs_start, int obs_end,
 										uint64_t seed_start)
 {
+	GDA_TRACE_SCOPE("permute", "LisaCoordinator::CalcPseudoP_range");
 	GeoDaSet workPermutation(num_obs);
 	//Randik rng;
 	int max_rand = num_obs-1;
@@ -25,8 +25,10 @@
 #include <boost/multi_array.hpp>
 #include <wx/string.h>
 #include <wx/thread.h>
+#include "../DataViewer/SpaceTimePanel.h"
 #include "../GenUtils.h"
 #include "../ShapeOperations/GalWeight.h"
+#include "../ShapeOperations/RateSmoothing.h"
 
 class LisaCoordinatorObserver;
 class LisaCoordinator;
@@ -65,6 +67,12 @@ public:
 					const std::vector<GeoDaVarInfo>& var_info,
 					const std::vector<int>& col_ids,
 					LisaType lisa_type, bool calc_significances = true);
+	/** Constructs from data already in memory rather than from a Table.
+	 data[i] is the space-time panel for var_info[i]. */
+	LisaCoordinator(const GalWeight* gal_weights, int num_obs,
+					const std::vector<GeoDaVarInfo>& var_info,
+					const std::vector<SpaceTimePanel>& data,
+					LisaType lisa_type, bool calc_significances = true);
 	virtual ~LisaCoordinator();
 	
 	bool IsOk() { return true; }
@@ -106,8 +114,11 @@ public:
 	std::vector<double*> sig_local_moran_vecs;
 	std::vector<int*> sig_cat_vecs;
 	std::vector<int*> cluster_vecs;
+	// data1_vecs[t] and data2_vecs[t] point into the working panels below
 	std::vector<double*> data1_vecs;
 	std::vector<double*> data2_vecs;
+	SpaceTimePanel data1_panel;
+	SpaceTimePanel data2_panel;
 	
 	const GalElement* W;
 	wxString weight_name;
@@ -118,7 +129,7 @@ public:
 	int num_time_vals; // number of valid time periods based on var_info
 	
 	// These two variables should be empty for LisaMapNewCanvas
-	std::vector<d_array_type> data; // data[variable][time][obs]
+	std::vector<SpaceTimePanel> data; // data[variable][time][obs]
 	
 	// All LisaMapNewCanvas objects synchronize themselves
 	// from the following 6 variables.
@@ -153,6 +164,8 @@ protected:
 	void StandardizeData();
 	std::vector<bool> has_undefined;
 	std::vector<bool> has_isolates;
+	// kept so that its scratch buffers are reused for every update
+	GdaAlgs::RateSmootherBatch rate_smoother;
 	bool row_standardize;
 	bool calc_significances; // if false, then p-vals will never be needed
 	uint64_t last_seed_used;
@@ -423,6 +423,18 @@ void LisaScatterPlotCanvas::ShowRandomizationDialog(int permutation)
 		RandomizationDlg dlg(raw_data1, raw_data2, lisa_coord->W, permutation,
 							 0);
 		dlg.ShowModal();
+	} else if (is_rate) {
+		// the engine smooths the rates itself, from events and base
+		std::vector<double> events(num_obs);
+		std::vector<double> base(num_obs);
+		const double* E = lisa_coord->data[0][var_info_orig[0].time].GetPtr();
+		const double* P = lisa_coord->data[1][var_info_orig[1].time].GetPtr();
+		for (int i=0; i<num_obs; i++) {
+			events[i] = E[i];
+			base[i] = P[i];
+		}
+		RandomizationDlg dlg(lisa_coord->W, events, base, permutation, 0);
+		dlg.ShowModal();
 	} else {
 		RandomizationDlg dlg(raw_data1, lisa_coord->W, permutation, 0);
 		dlg.ShowModal();
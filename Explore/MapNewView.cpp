@@ -28,6 +28,7 @@
 #include <wx/xrc/xmlres.h>
 #include "CatClassifState.h"
 #include "CatClassifManager.h"
+#include "../DataViewer/SortedColCache.h"
 #include "../DataViewer/TableInterface.h"
 #include "../DataViewer/TimeState.h"
 #include "../DialogTools/CatClassifDlg.h"
@@ -42,7 +43,7 @@
 #include "../GeoDa.h"
 #include "../Project.h"
 #include "../ShapeOperations/GalWeight.h"
-#include "../ShapeOperations/RateSmoothing.h"
+#include "../ShapeOperations/CsrWeight.h"
 #include "../ShapeOperations/ShapeUtils.h"
 #include "../ShapeOperations/VoronoiUtils.h"
 #include "../ShapeOperations/WeightsManager.h"
@@ -405,15 +406,11 @@ void MapNewCanvas::NewCustomCatClassif()
 		var_info[0] = dlg.var_info[0];
 		table_int->GetColData(dlg.col_ids[0], data[0]);
 		VarInfoAttributeChange();
+		SortedColCache* sort_cache = project->GetSortedColCache();
 		cat_var_sorted.resize(num_time_vals);
 		for (int t=0; t<num_time_vals; t++) {
-			cat_var_sorted[t].resize(num_obs);
-			for (int i=0; i<num_obs; i++) {
-				cat_var_sorted[t][i].first = data[0][t+var_info[0].time_min][i];
-				cat_var_sorted[t][i].second = i;
-			}
-			std::sort(cat_var_sorted[t].begin(), cat_var_sorted[t].end(),
-					  Gda::dbl_int_pair_cmp_less);
+			cat_var_sorted[t] = sort_cache->GetSorted(dlg.col_ids[0],
+											t+var_info[0].time_min);
 		}
 	}
 	
@@ -623,6 +620,7 @@ void MapNewCanvas::PopulateCanvas()
 	// Note: only need to delete selectable shapes if the map needs
 	// to be resized.  Otherwise, just reuse.
 	if (full_map_redraw_needed) {
+		scale_trans_batch.Cancel();
 		BOOST_FOREACH( GdaShape* shp, selectable_shps ) { delete shp; }
 		selectable_shps.clear();
 	}
@@ -709,13 +707,56 @@ void MapNewCanvas::TimeChange()
 			var_info[i].time = ref_time + var_info[i].ref_time_offset;
 		}
 	}
-	cat_data.SetCurrentCanvasTmStep(ref_time - ref_time_min);
-	invalidateBms();
-	PopulateCanvas();
-	Refresh();
+	ChangeCanvasTmStep(ref_time - ref_time_min);
 	LOG_MSG("Exiting MapNewCanvas::TimeChange");
 }
 
+/** Return the canvas time step shown for global time period time, or -1
+ if the map does not follow the global time. */
+int MapNewCanvas::GetCanvasTmForTime(int time)
+{
+	if (!is_any_sync_with_global_time || ref_var_index == -1) return -1;
+	int ref_time_min = var_info[ref_var_index].time_min;
+	int ref_time_max = var_info[ref_var_index].time_max;
+	if (time > ref_time_max) time = ref_time_max;
+	if (time < ref_time_min) time = ref_time_min;
+	return time - ref_time_min;
+}
+
+/** Show canvas time step canvas_ts.  When the map is valid at both the old
+ and the new time step only the category colors differ, so the selectable
+ shapes are kept and the layer0 frame is swapped in from the frame cache
+ if it was rendered ahead of time. */
+void MapNewCanvas::ChangeCanvasTmStep(int canvas_ts)
+{
+	int prev_ts = cat_data.GetCurrentCanvasTmStep();
+	cat_data.SetCurrentCanvasTmStep(canvas_ts);
+	EnableFrameCache(num_time_vals > 1);
+	if (!full_map_redraw_needed &&
+		prev_ts >= 0 && prev_ts < (int) map_valid.size() &&
+		canvas_ts >= 0 && canvas_ts < (int) map_valid.size() &&
+		map_valid[prev_ts] && map_valid[canvas_ts]) {
+		SwitchFrame(canvas_ts);
+	} else {
+		invalidateBms();
+		PopulateCanvas();
+	}
+	Refresh();
+}
+
+void MapNewCanvas::PrerenderTime(int time)
+{
+	int canvas_ts = GetCanvasTmForTime(time);
+	int curr_ts = cat_data.GetCurrentCanvasTmStep();
+	if (canvas_ts < 0 || canvas_ts == curr_ts || full_map_redraw_needed) {
+		return;
+	}
+	if (canvas_ts >= (int) map_valid.size() ||
+		curr_ts < 0 || curr_ts >= (int) map_valid.size() ||
+		!map_valid[curr_ts] || !map_valid[canvas_ts]) return;
+	PrerenderFrame(canvas_ts);
+}
+
 void MapNewCanvas::VarInfoAttributeChange()
 {
 	Gda::UpdateVarInfoSecondaryAttribs(var_info);
@@ -776,94 +817,87 @@ void MapNewCanvas::CreateAndUpdateCategories()
 	// We assume data has been initialized to correct data
 	// for all time periods.
 	
-	double* P = 0;
-	double* E = 0;
-	double* smoothed_results = 0;
-	std::vector<bool> undef_res(smoothing_type == no_smoothing ? 0 : num_obs);
-	if (smoothing_type != no_smoothing) {
-		P = new double[num_obs];
-		E = new double[num_obs];
-		smoothed_results = new double[num_obs];
-	}
-	
 	cat_var_sorted.resize(num_time_vals);
-	for (int t=0; t<num_time_vals; t++) {
-		cat_var_sorted[t].resize(num_obs);
-		
-		if (smoothing_type != no_smoothing) {
+	for (int t=0; t<num_time_vals; t++) cat_var_sorted[t].resize(num_obs);
+	
+	if (smoothing_type != no_smoothing) {
+		// Gather the base and event columns for every valid time period and
+		// smooth them all in a single batch.
+		std::vector<const double*> P;
+		std::vector<const double*> E;
+		std::vector<double*> smoothed_results;
+		std::vector<int> batch_tms;
+		std::vector<double> results_buf((size_t) num_obs * num_time_vals);
+		for (int t=0; t<num_time_vals; t++) {
+			int e_t = var_info[0].time;
 			if (var_info[0].sync_with_global_time) {
-				for (int i=0; i<num_obs; i++) {
-					E[i] = data[0][t+var_info[0].time_min][i];
-				}
-			} else {
-				for (int i=0; i<num_obs; i++) {
-					E[i] = data[0][var_info[0].time][i];
-				}
+				e_t = t + var_info[0].time_min;
 			}
-			
+			int p_t = var_info[1].time;
 			if (var_info[1].sync_with_global_time) {
-				for (int i=0; i<num_obs; i++) {
-					P[i] = data[1][t+var_info[1].time_min][i];
-				}
-			} else {
-				for (int i=0; i<num_obs; i++) {
-					P[i] = data[1][var_info[1].time][i];
-				}
+				p_t = t + var_info[1].time_min;
 			}
-			
 			for (int i=0; i<num_obs; i++) {
-				if (P[i] <= 0) {
+				if (data[1][p_t][i] <= 0) {
 					map_valid[t] = false;
 					map_error_message[t] = "Error: Base values contain"
 						" non-positive numbers which will result in"
 						" undefined values.";
-					continue;
+					break;
 				}
 			}
-			
 			if (!map_valid[t]) continue;
-			
-			if (smoothing_type == raw_rate) {
-				GdaAlgs::RateSmoother_RawRate(num_obs, P, E,
-												smoothed_results,
-												undef_res);
-			} else if (smoothing_type == excess_risk) {
-				// Note: Excess Risk is a transformation, not a smoothing
-				GdaAlgs::RateSmoother_ExcessRisk(num_obs, P, E,
-												   smoothed_results,
-												   undef_res);
-			} else if (smoothing_type == empirical_bayes) {
-				GdaAlgs::RateSmoother_EBS(num_obs, P, E,
-											smoothed_results, undef_res);
-			} else if (smoothing_type == spatial_rate) {
-				GdaAlgs::RateSmoother_SRS(num_obs, gal_weight->gal, P, E,
-											smoothed_results, undef_res);
-			} else if (smoothing_type == spatial_empirical_bayes) {
-				GdaAlgs::RateSmoother_SEBS(num_obs, gal_weight->gal, P, E,
-											 smoothed_results, undef_res);
-			}
+			E.push_back(&data[0][e_t][0]);
+			P.push_back(&data[1][p_t][0]);
+			smoothed_results.push_back(&results_buf[(size_t) t*num_obs]);
+			batch_tms.push_back(t);
+		}
 		
+		GdaAlgs::RateSmoothingType rs_type = GdaAlgs::raw_rate;
+		if (smoothing_type == excess_risk) {
+			// Note: Excess Risk is a transformation, not a smoothing
+			rs_type = GdaAlgs::excess_risk;
+		} else if (smoothing_type == empirical_bayes) {
+			rs_type = GdaAlgs::empirical_bayes;
+		} else if (smoothing_type == spatial_rate) {
+			rs_type = GdaAlgs::spatial_rate;
+		} else if (smoothing_type == spatial_empirical_bayes) {
+			rs_type = GdaAlgs::spatial_empirical_bayes;
+		}
+		CsrWeight w_csr;
+		if (rs_type == GdaAlgs::spatial_rate ||
+			rs_type == GdaAlgs::spatial_empirical_bayes) {
+			w_csr.InitFromGal(gal_weight->gal, num_obs);
+		}
+		if (!batch_tms.empty()) {
+			rate_smoother.Smooth(rs_type, num_obs, &w_csr, P, E,
+								 smoothed_results);
+		}
+		
+		for (size_t k=0; k<batch_tms.size(); k++) {
+			int t = batch_tms[k];
 			for (int i=0; i<num_obs; i++) {
-				cat_var_sorted[t][i].first = smoothed_results[i];
+				cat_var_sorted[t][i].first = smoothed_results[k][i];
 				cat_var_sorted[t][i].second = i;
 			}
-		} else {
+			std::sort(cat_var_sorted[t].begin(), cat_var_sorted[t].end(),
+					  Gda::dbl_int_pair_cmp_less);
+		}
+	} else {
+		// Unsmoothed values come straight from the table, so reuse the
+		// sort shared with other views of the same variable.
+		SortedColCache* sort_cache = project->GetSortedColCache();
+		int col = table_int->FindColId(var_info[0].name);
+		for (int t=0; t<num_time_vals; t++) {
+			int tm = t+var_info[0].time_min;
+			if (col != wxNOT_FOUND) {
+				cat_var_sorted[t] = sort_cache->GetSorted(col, tm);
+				continue;
+			}
 			for (int i=0; i<num_obs; i++) {
-				cat_var_sorted[t][i].first =data[0][t+var_info[0].time_min][i];
+				cat_var_sorted[t][i].first = data[0][tm][i];
 				cat_var_sorted[t][i].second = i;
 			}
-		}
-	}
-	
-	if (smoothing_type != no_smoothing) {
-		if (P) delete [] P;
-		if (E) delete [] E;
-		if (smoothed_results) delete [] smoothed_results;
-	}
-
-	// Sort each vector in ascending order
-	for (int t=0; t<num_time_vals; t++) {
-		if (map_valid[t]) { // only sort data with valid smoothing
 			std::sort(cat_var_sorted[t].begin(), cat_var_sorted[t].end(),
 					  Gda::dbl_int_pair_cmp_less);
 		}
@@ -28,6 +28,7 @@
 #include "../TemplateFrame.h"
 #include "../GenUtils.h"
 #include "../Generic/GdaShape.h"
+#include "../ShapeOperations/RateSmoothing.h"
 
 class CatClassifState;
 class MapNewFrame;
@@ -74,9 +75,12 @@ public:
 	virtual void OnSaveCategories();
 	virtual void SetCheckMarks(wxMenu* menu);
 	virtual void TimeChange();
+	virtual void PrerenderTime(int time);
 	
 protected:
 	virtual void PopulateCanvas();
+	int GetCanvasTmForTime(int time);
+	void ChangeCanvasTmStep(int canvas_ts);
 	virtual void VarInfoAttributeChange();
 	virtual void CreateAndUpdateCategories();
 
@@ -115,6 +119,8 @@ protected:
 	bool is_any_sync_with_global_time;
 	std::vector<bool> map_valid;
 	std::vector<wxString> map_error_message;
+	// kept so that its scratch buffers are reused for every update
+	GdaAlgs::RateSmootherBatch rate_smoother;
 	
 	bool full_map_redraw_needed;
 	
@@ -0,0 +1,144 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include "../GdaParallel.h"
+#include "PCPDensity.h"
+
+/** Counts the segments of one gap per index of the ParallelFor range.
+ Every gap has its own cells, so threads never write the same count. */
+struct PCPCountTask {
+	enum Mode { count_all, count_highlighted, update_highlighted };
+	PCPCountTask(PCPDensity& d_, Mode mode_)
+	: d(d_), mode(mode_), id_to_cat(0), hs(0), ids(0), n(0), sign(1) {}
+	void operator()(int start, int end, int thread_id) {
+		int nb = d.num_bins;
+		int na = d.num_axes;
+		int cells = nb*nb;
+		int gaps = na-1;
+		for (int g=start; g<end; g++) {
+			if (mode == count_all) {
+				int* all = &d.all_counts[g*cells];
+				for (int i=0; i<d.num_obs; i++) {
+					const unsigned char* b = &d.bins[i*na + g];
+					int c = b[0]*nb + b[1];
+					int cat = (*id_to_cat)[i];
+					d.cat_counts[(cat*gaps + g)*cells + c]++;
+					all[c]++;
+				}
+			} else if (mode == count_highlighted) {
+				int* hl = &d.hl_counts[g*cells];
+				for (int i=0; i<d.num_obs; i++) {
+					if (!(*hs)[i]) continue;
+					const unsigned char* b = &d.bins[i*na + g];
+					hl[b[0]*nb + b[1]]++;
+				}
+			} else {
+				int* hl = &d.hl_counts[g*cells];
+				for (int k=0; k<n; k++) {
+					const unsigned char* b = &d.bins[ids[k]*na + g];
+					hl[b[0]*nb + b[1]] += sign;
+				}
+			}
+		}
+	}
+	PCPDensity& d;
+	Mode mode;
+	const std::vector<int>* id_to_cat;
+	const std::vector<bool>* hs;
+	const int* ids;
+	int n;
+	int sign;
+};
+
+PCPDensity::PCPDensity()
+: num_obs(0), num_axes(0), num_bins(0), num_cats(0)
+{
+}
+
+void PCPDensity::Init(int num_obs_, int num_axes_, int num_bins_)
+{
+	num_obs = num_obs_;
+	num_axes = num_axes_;
+	num_bins = std::min(std::max(num_bins_, 1), 256);
+	num_cats = 0;
+	bins.assign(num_obs*num_axes, 0);
+	cat_counts.clear();
+	all_counts.assign(GetNumGaps()*num_bins*num_bins, 0);
+	hl_counts.assign(GetNumGaps()*num_bins*num_bins, 0);
+}
+
+void PCPDensity::CountAll(const std::vector<int>& id_to_cat, int num_cats_)
+{
+	num_cats = num_cats_;
+	cat_counts.assign(num_cats*GetNumGaps()*num_bins*num_bins, 0);
+	std::fill(all_counts.begin(), all_counts.end(), 0);
+	PCPCountTask task(*this, PCPCountTask::count_all);
+	task.id_to_cat = &id_to_cat;
+	Gda::ParallelFor(GetNumGaps(), task);
+}
+
+void PCPDensity::CountHighlighted(const std::vector<bool>& hs)
+{
+	std::fill(hl_counts.begin(), hl_counts.end(), 0);
+	PCPCountTask task(*this, PCPCountTask::count_highlighted);
+	task.hs = &hs;
+	Gda::ParallelFor(GetNumGaps(), task);
+}
+
+void PCPDensity::UpdateHighlighted(const int* ids, int n, int sign)
+{
+	if (n <= 0) return;
+	PCPCountTask task(*this, PCPCountTask::update_highlighted);
+	task.ids = ids;
+	task.n = n;
+	task.sign = sign;
+	// small deltas from brushing are not worth starting threads for
+	Gda::ParallelFor(GetNumGaps(), task, n < 4096 ? 1 : -1);
+}
+
+void PCPDensity::InvertHighlighted()
+{
+	for (size_t c=0, cend=hl_counts.size(); c<cend; c++) {
+		hl_counts[c] = all_counts[c] - hl_counts[c];
+	}
+}
+
+void PCPDensity::ClearHighlighted()
+{
+	std::fill(hl_counts.begin(), hl_counts.end(), 0);
+}
+
+int PCPDensity::GetMaxCount()
+{
+	int max_count = 0;
+	for (size_t c=0, cend=cat_counts.size(); c<cend; c++) {
+		if (cat_counts[c] > max_count) max_count = cat_counts[c];
+	}
+	return max_count;
+}
+
+int PCPDensity::GetMaxHighlightCount()
+{
+	int max_count = 0;
+	for (size_t c=0, cend=hl_counts.size(); c<cend; c++) {
+		if (hl_counts[c] > max_count) max_count = hl_counts[c];
+	}
+	return max_count;
+}
@@ -0,0 +1,85 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_PCP_DENSITY_H__
+#define __GEODA_CENTER_PCP_DENSITY_H__
+
+#include <vector>
+
+/**
+ Segment counts for the line density mode of the parallel coordinate plot.
+ Each axis is divided into num_bins equal bins and every observation is
+ assigned one bin per axis.  The segment an observation draws between
+ axes v and v+1 is then counted in cell (bin on v, bin on v+1) of gap v,
+ so that the plot can be drawn as at most num_bins^2 weighted segments per
+ gap rather than one polyline per observation.
+ 
+ Counts are kept per category for the unhighlighted layer, and once more
+ for the highlighted observations.  Counting runs in parallel over gaps,
+ and the highlighted counts can be updated from a selection delta.
+ */
+class PCPDensity {
+public:
+	PCPDensity();
+	
+	/** Set the dimensions and clear all counts.  num_bins is at most 256.
+	 Bins default to 0 until set with SetBin. */
+	void Init(int num_obs, int num_axes, int num_bins);
+	void SetBin(int obs, int axis, int bin) {
+		bins[obs*num_axes + axis] = (unsigned char) bin; }
+	
+	/** Count every observation under its category in id_to_cat. */
+	void CountAll(const std::vector<int>& id_to_cat, int num_cats);
+	/** Recount the highlighted observations from scratch. */
+	void CountHighlighted(const std::vector<bool>& hs);
+	/** Add (sign 1) or remove (sign -1) the n observations of ids from the
+	 highlighted counts. */
+	void UpdateHighlighted(const int* ids, int n, int sign);
+	/** Highlighted counts become their complement, as after
+	 HighlightState::invert.  Needs CountAll first. */
+	void InvertHighlighted();
+	void ClearHighlighted();
+	
+	int GetNumGaps() { return num_axes > 1 ? num_axes-1 : 0; }
+	int GetNumBins() { return num_bins; }
+	int GetNumCats() { return num_cats; }
+	int GetCount(int cat, int gap, int a, int b) {
+		return cat_counts[((cat*GetNumGaps() + gap)*num_bins + a)*num_bins + b];
+	}
+	int GetHighlightCount(int gap, int a, int b) {
+		return hl_counts[(gap*num_bins + a)*num_bins + b];
+	}
+	/** Largest cell count over all categories and gaps. */
+	int GetMaxCount();
+	int GetMaxHighlightCount();
+	
+private:
+	int num_obs;
+	int num_axes;
+	int num_bins;
+	int num_cats;
+	std::vector<unsigned char> bins; // obs-major, one bin per axis
+	std::vector<int> cat_counts; // [cat][gap][a][b]
+	std::vector<int> all_counts; // [gap][a][b] over all categories
+	std::vector<int> hl_counts; // [gap][a][b] of highlighted obs
+	
+	friend struct PCPCountTask;
+};
+
+#endif
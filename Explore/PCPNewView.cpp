@@ -62,6 +62,7 @@ num_time_vals(1), num_vars(v_info.size()),
 data(v_info.size()),
 highlight_state(project_s->GetHighlightState()), custom_classif_state(0),
 display_stats(false), show_axes(true), standardized(false),
+line_density(false), hl_density_valid(false),
 pcp_selectstate(pcp_start), show_pcp_control(false),
 overall_abs_max_std_exists(false), theme_var(0),
 num_categories(6), all_init(false)
@@ -79,7 +80,6 @@ num_categories(6), all_init(false)
 	//hinge_stats.resize(v_info.size());
 	data_stats.resize(v_info.size());
 	
-	std::vector<double> temp_vec(num_obs);
 	for (int v=0; v<num_vars; v++) {
 		table_int->GetColData(col_ids[v], data[v]);
 		int data_times = data[v].shape()[0];
@@ -88,16 +88,15 @@ num_categories(6), all_init(false)
 		//data_sorted[v].resize(data_times);
 		for (int t=0; t<data_times; t++) {
 			//data_sorted[v][t].resize(num_obs);
-			for (int i=0; i<num_obs; i++) {
-				temp_vec[i] = data[v][t][i];
-				//data_sorted[v][t][i].first = data[v][t][i];
-				//data_sorted[v][t][i].second = i;
-			}
+			//for (int i=0; i<num_obs; i++) {
+			//	data_sorted[v][t][i].first = data[v][t][i];
+			//	data_sorted[v][t][i].second = i;
+			//}
 			//std::sort(data_sorted[v][t].begin(),
 			//		  data_sorted[v][t].end(),
 			//		  Gda::dbl_int_pair_cmp_less);
 			//hinge_stats[v][t].CalculateHingeStats(data_sorted[v][t]);
-			data_stats[v][t].CalculateFromSample(temp_vec);
+			table_int->GetColSampleStats(col_ids[v], t, data_stats[v][t]);
 			double min = data_stats[v][t].min;
 			double max = data_stats[v][t].max;
 			if (min != max) {
@@ -243,6 +242,8 @@ void PCPNewCanvas::SetCheckMarks(wxMenu* menu)
 								  IsDisplayStats());
 	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_SHOW_AXES"),
 								  IsShowAxes());
+	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_PCP_LINE_DENSITY"),
+								  IsLineDensity());
 	
 	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_VIEW_ORIGINAL_DATA"),
 								  !standardized);
@@ -397,6 +398,31 @@ void PCPNewCanvas::SetCheckMarks(wxMenu* menu)
 void PCPNewCanvas::update(HighlightState* o)
 {
 	LOG_MSG("Entering PCPNewCanvas::update");
+	
+	if (line_density && hl_density_valid) {
+		// update the highlighted segment counts from the selection delta
+		HighlightState::EventType type = highlight_state->GetEventType();
+		if (type == HighlightState::delta) {
+			int nuh_cnt = highlight_state->GetTotalNewlyUnhighlighted();
+			int nh_cnt = highlight_state->GetTotalNewlyHighlighted();
+			if (nuh_cnt > 0) {
+				density.UpdateHighlighted(
+							&highlight_state->GetNewlyUnhighlighted()[0],
+							nuh_cnt, -1);
+			}
+			if (nh_cnt > 0) {
+				density.UpdateHighlighted(
+							&highlight_state->GetNewlyHighlighted()[0],
+							nh_cnt, 1);
+			}
+		} else if (type == HighlightState::invert) {
+			density.InvertHighlighted();
+		} else if (type == HighlightState::unhighlight_all) {
+			density.ClearHighlighted();
+		} else {
+			hl_density_valid = false;
+		}
+	}
 
 	// we want to force a full redraw of all selected objects
 	layer1_valid = false;
@@ -572,6 +598,7 @@ void PCPNewCanvas::PopulateCanvas()
 	LOG_MSG("Entering PCPNewCanvas::PopulateCanvas");
 	BOOST_FOREACH( GdaShape* shp, background_shps ) { delete shp; }
 	background_shps.clear();
+	scale_trans_batch.Cancel();
 	BOOST_FOREACH( GdaShape* shp, selectable_shps ) { delete shp; }
 	selectable_shps.clear();
 	BOOST_FOREACH( GdaShape* shp, foreground_shps ) { delete shp; }
@@ -624,6 +651,9 @@ void PCPNewCanvas::PopulateCanvas()
 	double std_fact = 1;
 	if (overall_abs_max_std_exists) std_fact = 100.0/(2.0*overall_abs_max_std);
 	double nvf = 100.0/((double) (num_vars-1));
+	const int num_bins = 100;
+	density.Init(num_obs, num_vars, num_bins);
+	hl_density_valid = false;
 	for (int i=0; i<num_obs; i++) {
 		for (int v=0; v<num_vars; v++) {
 			int vv = var_order[v];
@@ -644,6 +674,8 @@ void PCPNewCanvas::PopulateCanvas()
 				pts[v].x *= std_fact;
 			}
 			pts[v].y = 100.0-(nvf*((double) v));
+			int bin = (int) (pts[v].x*num_bins/100.0);
+			density.SetBin(i, v, std::max(0, std::min(bin, num_bins-1)));
 		}
 		selectable_shps[i] = new GdaPolyLine(num_vars, pts);
 	}
@@ -944,6 +976,101 @@ void PCPNewCanvas::StandardizeData(bool standardize)
 //   LeftDCLick(), etc.
 // LeftUp(): returns true at the moment the button changed to up.
 
+void PCPNewCanvas::ShowLineDensity(bool show_density)
+{
+	line_density = show_density;
+	hl_density_valid = false;
+	invalidateBms();
+	Refresh();
+}
+
+void PCPNewCanvas::DrawSelectableShapes(wxMemoryDC &dc)
+{
+	if (!line_density) {
+		TemplateCanvas::DrawSelectableShapes(dc);
+		return;
+	}
+	// categories may have changed since the last layer0 draw
+	int cc_ts = cat_data.GetCurrentCanvasTmStep();
+	density.CountAll(cat_data.categories[cc_ts].id_to_cat,
+					 cat_data.GetNumCategories(cc_ts));
+	DrawLineDensity(dc, false);
+}
+
+void PCPNewCanvas::DrawHighlightedShapes(wxMemoryDC &dc)
+{
+	if (!line_density) {
+		TemplateCanvas::DrawHighlightedShapes(dc);
+		return;
+	}
+	if (!hl_density_valid) {
+		density.CountHighlighted(highlight_state->GetHighlight());
+		hl_density_valid = true;
+	}
+	DrawLineDensity(dc, true);
+}
+
+/** Draw one segment per non-empty cell of every gap between adjacent axes.
+ Counts are shaded from the background color to the category color (or
+ the highlight color) on a log scale, and the densest cells are drawn
+ with a wider pen. */
+void PCPNewCanvas::DrawLineDensity(wxDC& dc, bool highlighted)
+{
+	const int num_levels = 4;
+	int num_gaps = density.GetNumGaps();
+	int num_bins = density.GetNumBins();
+	int num_cats = highlighted ? 1 : density.GetNumCats();
+	int max_count = (highlighted ? density.GetMaxHighlightCount() :
+					 density.GetMaxCount());
+	if (max_count == 0 || num_gaps == 0) return;
+	double log_max = log((double) max_count + 1.0);
+	int cc_ts = cat_data.GetCurrentCanvasTmStep();
+	
+	// the axis end points of every bin, in screen coordinates
+	double nvf = 100.0/((double) (num_vars-1));
+	std::vector<wxPoint> bin_pts(num_vars*num_bins);
+	for (int v=0; v<num_vars; v++) {
+		for (int a=0; a<num_bins; a++) {
+			wxRealPoint p((a+0.5)*100.0/num_bins, 100.0-(nvf*((double) v)));
+			last_scale_trans.transform(p, &bin_pts[v*num_bins+a]);
+		}
+	}
+	
+	std::vector<wxPen> pens(num_levels);
+	for (int cat=0; cat<num_cats; cat++) {
+		wxColour c(highlighted ? highlight_color :
+				   cat_data.GetCategoryColor(cc_ts, cat));
+		for (int l=0; l<num_levels; l++) {
+			double f = 0.25 + 0.75*((double) l)/((double) (num_levels-1));
+			wxColour lc(canvas_background_color.Red() +
+						f*(c.Red()-canvas_background_color.Red()),
+						canvas_background_color.Green() +
+						f*(c.Green()-canvas_background_color.Green()),
+						canvas_background_color.Blue() +
+						f*(c.Blue()-canvas_background_color.Blue()));
+			pens[l] = wxPen(lc, l == num_levels-1 ? 2 : 1);
+		}
+		int cur_level = -1;
+		for (int g=0; g<num_gaps; g++) {
+			for (int a=0; a<num_bins; a++) {
+				for (int b=0; b<num_bins; b++) {
+					int n = (highlighted ? density.GetHighlightCount(g, a, b) :
+							 density.GetCount(cat, g, a, b));
+					if (n <= 0) continue;
+					int l = (int) (log((double) n + 1.0)/log_max * num_levels);
+					if (l >= num_levels) l = num_levels-1;
+					if (l != cur_level) {
+						dc.SetPen(pens[l]);
+						cur_level = l;
+					}
+					dc.DrawLine(bin_pts[g*num_bins+a],
+								bin_pts[(g+1)*num_bins+b]);
+				}
+			}
+		}
+	}
+}
+
 void PCPNewCanvas::OnMouseEvent(wxMouseEvent& event)
 {
 	// Capture the mouse when left mouse button is down.
@@ -1368,6 +1495,14 @@ void PCPNewFrame::OnDisplayStatistics(wxCommandEvent& event)
 	UpdateOptionMenuItems();
 }
 
+void PCPNewFrame::OnLineDensity(wxCommandEvent& event)
+{
+	LOG_MSG("In PCPNewFrame::OnLineDensity");
+	PCPNewCanvas* t = (PCPNewCanvas*) template_canvas;
+	t->ShowLineDensity(!t->IsLineDensity());
+	UpdateOptionMenuItems();
+}
+
 void PCPNewFrame::OnViewOriginalData(wxCommandEvent& event)
 {
 	LOG_MSG("In PCPNewFrame::OnViewOriginalData");
@@ -24,6 +24,7 @@
 #include <wx/menu.h>
 #include "CatClassification.h"
 #include "CatClassifStateObserver.h"
+#include "PCPDensity.h"
 #include "../TemplateCanvas.h"
 #include "../TemplateLegend.h"
 #include "../TemplateFrame.h"
@@ -76,9 +77,16 @@ public:
 	void DisplayStatistics(bool display_stats);
 	void ShowAxes(bool show_axes);
 	void StandardizeData(bool standardize);
+	void ShowLineDensity(bool show_density);
 	
 	bool IsDisplayStats() { return display_stats; }
 	bool IsShowAxes() { return show_axes; }
+	bool IsLineDensity() { return line_density; }
+	
+	/** Override of TemplateCanvas methods to draw segment counts between
+	 adjacent axes in place of individual lines when IsLineDensity(). */
+	virtual void DrawSelectableShapes(wxMemoryDC &dc);
+	virtual void DrawHighlightedShapes(wxMemoryDC &dc);
 
 	/** Used by PCP for detecting and updating PCP-specific controls */
 	enum PCPSelectState { pcp_start, pcp_leftdown_on_circ,
@@ -125,6 +133,11 @@ protected:
 	bool display_stats;
 	bool standardized;
 	
+	void DrawLineDensity(wxDC& dc, bool highlighted);
+	bool line_density;
+	PCPDensity density;
+	bool hl_density_valid; // highlighted counts match highlight_state
+	
 	int theme_var; // current theme variable
 	std::vector<GdaShapeText*> control_labels;
 	int control_label_sel; // selected variable text label
@@ -169,6 +182,7 @@ public:
 	virtual void OnCustomCatClassifA(const wxString& cc_title);
 	void OnShowAxes(wxCommandEvent& event);
     void OnDisplayStatistics(wxCommandEvent& event);
+	void OnLineDensity(wxCommandEvent& event);
 	void OnViewOriginalData(wxCommandEvent& event);
     void OnViewStandardizedData(wxCommandEvent& event);
 
@@ -140,9 +140,14 @@ obs_id_to_z_val_order(boost::extents[0][0]), all_init(false)
 	template_frame = t_frame;
 	
 	TableInterface* table_int = project->GetTableInt();
+	data_stats.resize(var_info.size());
 	for (size_t i=0; i<var_info.size(); i++) {
 		template_frame->AddGroupDependancy(var_info[i].name);
 		table_int->GetColData(col_ids[i], data[i]);
+		data_stats[i].resize(data[i].shape()[0]);
+		for (size_t t=0; t<data_stats[i].size(); t++) {
+			table_int->GetColSampleStats(col_ids[i], t, data_stats[i][t]);
+		}
 	}
 	
 	if (!is_bubble_plot) {
@@ -711,6 +716,7 @@ void ScatterNewPlotCanvas::PopulateCanvas()
 	LOG_MSG("Entering ScatterNewPlotCanvas::PopulateCanvas");
 	BOOST_FOREACH( GdaShape* shp, background_shps ) { delete shp; }
 	background_shps.clear();
+	scale_trans_batch.Cancel();
 	BOOST_FOREACH( GdaShape* shp, selectable_shps ) { delete shp; }
 	selectable_shps.clear();
 	BOOST_FOREACH( GdaShape* shp, foreground_shps ) { delete shp; }
@@ -759,9 +765,9 @@ void ScatterNewPlotCanvas::PopulateCanvas()
 	double y_max = var_info[1].max_over_time;
 	double y_min = var_info[1].min_over_time;	
 	
-	statsX = SampleStatistics(X);
-	statsY = SampleStatistics(Y);
-	if (is_bubble_plot) statsZ = SampleStatistics(Z);
+	statsX = data_stats[0][var_info[0].time];
+	statsY = data_stats[1][var_info[1].time];
+	if (is_bubble_plot) statsZ = data_stats[2][var_info[2].time];
 	if (standardized) {
 		for (int i=0, iend=X.size(); i<iend; i++) {
 			X[i] = (X[i]-statsX.mean)/statsX.sd_with_bessel;
@@ -143,6 +143,8 @@ protected:
 	int ref_var_index;
 	std::vector<GeoDaVarInfo> var_info;
 	std::vector<d_array_type> data;
+	// statistics of data[v][t] from the table's cached column summaries
+	std::vector<std::vector<SampleStatistics> > data_stats;
 	d_array_type x_data;
 	d_array_type y_data;
 	d_array_type z_data;
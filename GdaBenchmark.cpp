@@ -0,0 +1,1031 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <wx/bitmap.h>
+#include <wx/dcmemory.h>
+#include <wx/filefn.h>
+#include <wx/filename.h>
+#include "DataViewer/SpaceTimePanel.h"
+#include "Explore/CatClassification.h"
+#include "Explore/GStatCoordinator.h"
+#include "Explore/LisaCoordinator.h"
+#include "Generic/GdaShape.h"
+#include "Generic/PointRaster.h"
+#include "Generic/ScaleTransBatch.h"
+#include "Regression/DiagnosticReport.h"
+#include "ShapeOperations/CsrWeight.h"
+#include "ShapeOperations/CsvFileUtils.h"
+#include "ShapeOperations/DbfFile.h"
+#include "ShapeOperations/GdaCache.h"
+#include "ShapeOperations/GalWeight.h"
+#include "ShapeOperations/GwtWeight.h"
+#include "ShapeOperations/OGRLayerProxy.h"
+#include "ShapeOperations/VoronoiUtils.h"
+#include "ShapeOperations/WeightsBuildJob.h"
+#include "ShapeOperations/shp2cnt.h"
+#include "ShapeOperations/shp2gwt.h"
+#include "GdaConst.h"
+#include "GdaParallel.h"
+#include "GenUtils.h"
+#include "logger.h"
+#include "TemplateCanvas.h"
+#include "version.h"
+#include "GdaBenchmark.h"
+
+bool classicalRegression(const GalElement *g, int num_obs, double * Y,
+						 int dim, double ** X, 
+						 int expl, DiagnosticReport *dr, bool InclConstant,
+						 bool m_moranz, wxGauge* gauge,
+						 bool do_white_test);
+
+bool spatialLagRegression(const GalElement *g, int num_obs, double * Y,
+						  int dim, double ** X, int deps, DiagnosticReport *dr,
+						  bool InclConstant, wxGauge* p_bar = 0);
+
+namespace {
+	using namespace Gda::Benchmark;
+	
+	const double pi = 3.14159265358979323846;
+	const int knn_k = 4;
+	const int num_breaks_cats = 5;
+	
+	/** Uniform and normal deviates from consecutive hash keys. */
+	struct HashRng {
+		HashRng(uint64_t seed) : key(seed), has_spare(false), spare(0) {}
+		double Uniform() { return Gda::ThomasWangHashDouble(key++); }
+		/** Box-Muller, keeping the second deviate for the next call. */
+		double Normal() {
+			if (has_spare) { has_spare = false; return spare; }
+			double u = Uniform();
+			double v = Uniform();
+			if (u < 1e-300) u = 1e-300;
+			double r = sqrt(-2.0*log(u));
+			spare = r*sin(2*pi*v);
+			has_spare = true;
+			return r*cos(2*pi*v);
+		}
+		uint64_t key;
+		bool has_spare;
+		double spare;
+	};
+	
+	boost::posix_time::ptime Now()
+	{
+		return boost::posix_time::microsec_clock::universal_time();
+	}
+	
+	double MsSince(const boost::posix_time::ptime& start)
+	{
+		return (Now() - start).total_microseconds() / 1000.0;
+	}
+	
+	void AddTiming(const char* engine, const Layer& layer,
+				   const std::vector<double>& ms,
+				   std::vector<Timing>& timings)
+	{
+		if (ms.empty()) return;
+		Timing t;
+		t.engine = engine;
+		t.generator = GeneratorName(layer.generator);
+		t.num_obs = layer.num_obs;
+		t.runs = ms.size();
+		t.min_ms = *std::min_element(ms.begin(), ms.end());
+		double sum = 0;
+		for (size_t i=0; i<ms.size(); i++) sum += ms[i];
+		t.mean_ms = sum / ms.size();
+		timings.push_back(t);
+		std::cout << std::setw(28) << std::left << t.engine
+			<< std::setw(20) << t.generator << std::setw(10) << std::right
+			<< t.num_obs << std::fixed << std::setprecision(3)
+			<< std::setw(14) << t.min_ms << " ms" << std::endl;
+	}
+	
+	void InitMain(Shapefile::Main& main, Shapefile::ShapeType type, int n)
+	{
+		main.records.clear();
+		main.records.resize(n);
+		main.header = Shapefile::Header();
+		main.header.file_code = 9994;
+		main.header.version = 1000;
+		main.header.shape_type = type;
+	}
+	
+	/** Set the header bounding box from the points in x and y, which for
+	 polygon layers is widened to the polygon boxes. */
+	void SetMainBox(Layer& layer)
+	{
+		Shapefile::Header& h = layer.main.header;
+		if (layer.num_obs == 0) return;
+		h.bbox_x_min = h.bbox_x_max = layer.x[0];
+		h.bbox_y_min = h.bbox_y_max = layer.y[0];
+		for (int i=0; i<layer.num_obs; i++) {
+			if (layer.IsPolygons()) {
+				Shapefile::PolygonContents* pc = (Shapefile::PolygonContents*)
+					layer.main.records[i].contents_p;
+				if (pc->box[0] < h.bbox_x_min) h.bbox_x_min = pc->box[0];
+				if (pc->box[1] < h.bbox_y_min) h.bbox_y_min = pc->box[1];
+				if (pc->box[2] > h.bbox_x_max) h.bbox_x_max = pc->box[2];
+				if (pc->box[3] > h.bbox_y_max) h.bbox_y_max = pc->box[3];
+			} else {
+				if (layer.x[i] < h.bbox_x_min) h.bbox_x_min = layer.x[i];
+				if (layer.y[i] < h.bbox_y_min) h.bbox_y_min = layer.y[i];
+				if (layer.x[i] > h.bbox_x_max) h.bbox_x_max = layer.x[i];
+				if (layer.y[i] > h.bbox_y_max) h.bbox_y_max = layer.y[i];
+			}
+		}
+	}
+	
+	/** Make record i a single ring polygon.  ring must be closed and
+	 clockwise. */
+	void SetPolygon(Shapefile::Main& main, int i,
+					const std::vector<Shapefile::Point>& ring)
+	{
+		Shapefile::PolygonContents* pc = new Shapefile::PolygonContents;
+		pc->num_parts = 1;
+		pc->parts.resize(1, 0);
+		pc->num_points = ring.size();
+		pc->points = ring;
+		pc->box[0] = pc->box[2] = ring[0].x;
+		pc->box[1] = pc->box[3] = ring[0].y;
+		for (size_t k=1; k<ring.size(); k++) {
+			if (ring[k].x < pc->box[0]) pc->box[0] = ring[k].x;
+			if (ring[k].y < pc->box[1]) pc->box[1] = ring[k].y;
+			if (ring[k].x > pc->box[2]) pc->box[2] = ring[k].x;
+			if (ring[k].y > pc->box[3]) pc->box[3] = ring[k].y;
+		}
+		main.records[i].header.record_number = i+1;
+		main.records[i].header.content_length = 22 + 2 + 8*pc->num_points;
+		main.records[i].contents_p = pc;
+	}
+	
+	void SetPoint(Shapefile::Main& main, int i, double x, double y)
+	{
+		Shapefile::PointContents* pc = new Shapefile::PointContents;
+		pc->x = x;
+		pc->y = y;
+		main.records[i].header.record_number = i+1;
+		main.records[i].header.content_length = 10;
+		main.records[i].contents_p = pc;
+	}
+	
+	/** y and x1 share the trend sin(x/L) + cos(y/L) with L one eighth of
+	 the layer extent, so both are positively autocorrelated. */
+	void SetAttributes(Layer& layer, double extent, HashRng& rng)
+	{
+		int n = layer.num_obs;
+		double L = extent / 8.0;
+		layer.y_var.resize(n);
+		layer.x1_var.resize(n);
+		layer.x2_var.resize(n);
+		for (int i=0; i<n; i++) {
+			double f = sin(layer.x[i]/L) + cos(layer.y[i]/L);
+			layer.x1_var[i] = f + 0.5*rng.Normal();
+			layer.x2_var[i] = rng.Normal();
+			layer.y_var[i] = (10.0 + 2.0*layer.x1_var[i] - layer.x2_var[i] +
+							  f + rng.Normal());
+		}
+	}
+	
+	void GenerateGrid(int n, Layer& layer)
+	{
+		InitMain(layer.main, Shapefile::POLYGON, n);
+		int cols = (int) ceil(sqrt((double) n));
+		std::vector<Shapefile::Point> ring(5);
+		for (int i=0; i<n; i++) {
+			double c = i % cols;
+			double r = i / cols;
+			ring[0] = Shapefile::Point(c, r);
+			ring[1] = Shapefile::Point(c, r+1);
+			ring[2] = Shapefile::Point(c+1, r+1);
+			ring[3] = Shapefile::Point(c+1, r);
+			ring[4] = ring[0];
+			SetPolygon(layer.main, i, ring);
+			layer.x[i] = c + 0.5;
+			layer.y[i] = r + 0.5;
+		}
+	}
+	
+	/** Hexagons with corners (0,+-2) and (+-2,+-1) about their center are
+	 an affine image of regular hexagons.  Centers are 4 apart within a row
+	 and rows are 3 apart, with odd rows shifted by 2. */
+	void GenerateHexLattice(int n, Layer& layer)
+	{
+		InitMain(layer.main, Shapefile::POLYGON, n);
+		int cols = (int) ceil(sqrt((double) n));
+		std::vector<Shapefile::Point> ring(7);
+		for (int i=0; i<n; i++) {
+			int r = i / cols;
+			double cx = 4.0*(i % cols) + 2.0*(r % 2);
+			double cy = 3.0*r;
+			ring[0] = Shapefile::Point(cx, cy+2);
+			ring[1] = Shapefile::Point(cx+2, cy+1);
+			ring[2] = Shapefile::Point(cx+2, cy-1);
+			ring[3] = Shapefile::Point(cx, cy-2);
+			ring[4] = Shapefile::Point(cx-2, cy-1);
+			ring[5] = Shapefile::Point(cx-2, cy+1);
+			ring[6] = ring[0];
+			SetPolygon(layer.main, i, ring);
+			layer.x[i] = cx;
+			layer.y[i] = cy;
+		}
+	}
+	
+	/** A Thomas cluster process: one cluster per 1000 points with normal
+	 scatter about uniform centers, plus 10% uniform background points. */
+	void GenerateClusteredPoints(int n, double extent, HashRng& rng,
+								 Layer& layer)
+	{
+		InitMain(layer.main, Shapefile::POINT, n);
+		int num_clusters = GenUtils::max<int>(1, n/1000);
+		std::vector<double> cx(num_clusters);
+		std::vector<double> cy(num_clusters);
+		for (int c=0; c<num_clusters; c++) {
+			cx[c] = extent * rng.Uniform();
+			cy[c] = extent * rng.Uniform();
+		}
+		double sd = extent / (4.0 * sqrt((double) num_clusters));
+		for (int i=0; i<n; i++) {
+			if (rng.Uniform() < 0.1) {
+				layer.x[i] = extent * rng.Uniform();
+				layer.y[i] = extent * rng.Uniform();
+			} else {
+				int c = (int) (num_clusters * rng.Uniform());
+				if (c >= num_clusters) c = num_clusters-1;
+				layer.x[i] = cx[c] + sd * rng.Normal();
+				layer.y[i] = cy[c] + sd * rng.Normal();
+			}
+			SetPoint(layer.main, i, layer.x[i], layer.y[i]);
+		}
+	}
+	
+	/** Thiessen polygons of uniform random points.  Neighboring cells are
+	 built from the same Voronoi vertices, so shared edges match exactly. */
+	bool GenerateIrregularPolygons(int n, double extent, HashRng& rng,
+								   Layer& layer)
+	{
+		for (int i=0; i<n; i++) {
+			layer.x[i] = extent * rng.Uniform();
+			layer.y[i] = extent * rng.Uniform();
+		}
+		std::vector<GdaShape*> polys;
+		double xmin, ymin, xmax, ymax;
+		if (!Gda::VoronoiUtils::MakePolygons(layer.x, layer.y, polys,
+											 xmin, ymin, xmax, ymax)) {
+			return false;
+		}
+		InitMain(layer.main, Shapefile::POLYGON, n);
+		std::vector<Shapefile::Point> ring;
+		for (int i=0; i<n; i++) {
+			GdaPolygon* p = (GdaPolygon*) polys[i];
+			ring.resize(p->n);
+			for (int k=0; k<p->n; k++) {
+				ring[k] = Shapefile::Point(p->points_o[k].x, p->points_o[k].y);
+			}
+			SetPolygon(layer.main, i, ring);
+			delete p;
+		}
+		return true;
+	}
+	
+	void PutLE16(std::vector<char>& b, int pos, int v)
+	{
+		b[pos] = (char) (v & 0xff);
+		b[pos+1] = (char) ((v >> 8) & 0xff);
+	}
+	
+	void PutLE32(std::vector<char>& b, int pos, wxUint32 v)
+	{
+		for (int k=0; k<4; k++) b[pos+k] = (char) ((v >> (8*k)) & 0xff);
+	}
+	
+	const char* field_names[] = { "POLY_ID", "CENT_X", "CENT_Y", "Y", "X1",
+		"X2" };
+	const int num_fields = 6;
+	
+	void RowValues(const Layer& layer, int i, double* vals)
+	{
+		vals[0] = i+1;
+		vals[1] = layer.x[i];
+		vals[2] = layer.y[i];
+		vals[3] = layer.y_var[i];
+		vals[4] = layer.x1_var[i];
+		vals[5] = layer.x2_var[i];
+	}
+	
+	/** A dBase III file with an integer POLY_ID and five numeric fields
+	 of width 20 with 8 decimals. */
+	bool WriteDbf(const wxString& fname, const Layer& layer)
+	{
+		std::ofstream out;
+		out.open(GET_ENCODED_FILENAME(fname), std::ios::out | std::ios::binary);
+		if (!(out.is_open() && out.good())) return false;
+		const int id_len = 10;
+		const int val_len = 20;
+		const int val_dec = 8;
+		const int rec_len = 1 + id_len + (num_fields-1)*val_len;
+		const int hdr_len = 32 + 32*num_fields + 1;
+		std::vector<char> hdr(hdr_len, 0);
+		hdr[0] = 0x03;
+		hdr[1] = (char) (Gda::version_year - 1900);
+		hdr[2] = (char) Gda::version_month;
+		hdr[3] = (char) Gda::version_day;
+		PutLE32(hdr, 4, layer.num_obs);
+		PutLE16(hdr, 8, hdr_len);
+		PutLE16(hdr, 10, rec_len);
+		for (int f=0; f<num_fields; f++) {
+			int pos = 32 + 32*f;
+			strncpy(&hdr[pos], field_names[f], 10);
+			hdr[pos+11] = 'N';
+			hdr[pos+16] = (char) (f == 0 ? id_len : val_len);
+			hdr[pos+17] = (char) (f == 0 ? 0 : val_dec);
+		}
+		hdr[hdr_len-1] = 0x0D;
+		out.write(&hdr[0], hdr_len);
+		
+		std::vector<char> rec(rec_len);
+		double vals[num_fields];
+		for (int i=0; i<layer.num_obs; i++) {
+			RowValues(layer, i, vals);
+			rec[0] = ' ';
+			DbfFileUtils::FormatInt64(i+1, id_len, &rec[1]);
+			for (int f=1; f<num_fields; f++) {
+				DbfFileUtils::FormatDouble(vals[f], val_len, val_dec,
+										   &rec[1 + id_len + (f-1)*val_len]);
+			}
+			out.write(&rec[0], rec_len);
+		}
+		out.put(0x1A);
+		return out.good();
+	}
+	
+	bool WriteCsv(const wxString& fname, const Layer& layer)
+	{
+		std::ofstream out;
+		out.open(GET_ENCODED_FILENAME(fname), std::ios::out);
+		if (!(out.is_open() && out.good())) return false;
+		for (int f=0; f<num_fields; f++) {
+			out << (f > 0 ? "," : "") << field_names[f];
+		}
+		out << "\n" << std::setprecision(12);
+		double vals[num_fields];
+		for (int i=0; i<layer.num_obs; i++) {
+			RowValues(layer, i, vals);
+			out << i+1;
+			for (int f=1; f<num_fields; f++) out << "," << vals[f];
+			out << "\n";
+		}
+		return out.good();
+	}
+	
+	/** The points, or polygon centers, of layer with the fields of
+	 WriteDbf as layer "bench" of a new SQLite file. */
+	bool WriteSqlite(const std::string& fname, const Layer& layer)
+	{
+		OGRSFDriver* drv =
+			OGRSFDriverRegistrar::GetRegistrar()->GetDriverByName("SQLite");
+		if (drv == NULL) return false;
+		OGRDataSource* ds = drv->CreateDataSource(fname.c_str(), NULL);
+		if (ds == NULL) return false;
+		OGRLayer* lyr = ds->CreateLayer("bench", NULL, wkbPoint, NULL);
+		bool ok = lyr != NULL;
+		for (int f=0; ok && f<num_fields; f++) {
+			OGRFieldDefn fd(field_names[f], f == 0 ? OFTInteger : OFTReal);
+			ok = lyr->CreateField(&fd) == OGRERR_NONE;
+		}
+		if (ok) lyr->StartTransaction();
+		double vals[num_fields];
+		for (int i=0; ok && i<layer.num_obs; i++) {
+			RowValues(layer, i, vals);
+			OGRFeature* f = OGRFeature::CreateFeature(lyr->GetLayerDefn());
+			f->SetField(0, i+1);
+			for (int k=1; k<num_fields; k++) f->SetField(k, vals[k]);
+			OGRPoint pt(layer.x[i], layer.y[i]);
+			f->SetGeometry(&pt);
+			ok = lyr->CreateFeature(f) == OGRERR_NONE;
+			OGRFeature::DestroyFeature(f);
+		}
+		if (ok) lyr->CommitTransaction();
+		OGRDataSource::DestroyDataSource(ds);
+		return ok;
+	}
+	
+	/** True if the features of a and b have the same fields and points,
+	 in the same order. */
+	bool SameFeatures(OGRLayer* a, OGRLayer* b)
+	{
+		a->ResetReading();
+		b->ResetReading();
+		bool same = true;
+		while (same) {
+			OGRFeature* fa = a->GetNextFeature();
+			OGRFeature* fb = b->GetNextFeature();
+			same = (fa == NULL) == (fb == NULL);
+			if (same && fa) {
+				for (int k=0; k<num_fields && same; k++) {
+					same = fa->GetFieldAsDouble(k) == fb->GetFieldAsDouble(k);
+				}
+				OGRPoint* pa = (OGRPoint*) fa->GetGeometryRef();
+				OGRPoint* pb = (OGRPoint*) fb->GetGeometryRef();
+				same = same && pa && pb && pa->getX() == pb->getX() &&
+					pa->getY() == pb->getY();
+			}
+			bool done = fa == NULL;
+			if (fa) OGRFeature::DestroyFeature(fa);
+			if (fb) OGRFeature::DestroyFeature(fb);
+			if (done) break;
+		}
+		return same;
+	}
+	
+	/** GdaCache round trip with a local SQLite file standing in for a
+	 database: the cache misses until CacheLayer copied the layer, then
+	 hits with the values of the source, and misses again after one point
+	 moved until UpdateLayer refreshed the copy. */
+	bool RunCache(const wxString& dir, const Layer& layer, int reps,
+				  std::vector<Timing>& timings, std::string& err_msg)
+	{
+		using namespace boost::posix_time;
+		wxString src_fname = LayerFileName(dir, layer, "sqlite");
+		wxString cache_fname = wxFileName(dir, "bench_cache",
+										  "sqlite").GetFullPath();
+		if (wxFileExists(src_fname)) wxRemoveFile(src_fname);
+		if (wxFileExists(cache_fname)) wxRemoveFile(cache_fname);
+		std::string ds_name(src_fname.mb_str());
+		if (!WriteSqlite(ds_name, layer)) {
+			err_msg = "Could not write " + ds_name;
+			return false;
+		}
+		OGRDataSource* src_ds = OGRSFDriverRegistrar::Open(ds_name.c_str(),
+														   TRUE);
+		OGRLayer* src_layer = src_ds ? src_ds->GetLayerByName("bench") : 0;
+		if (src_layer == NULL) {
+			if (src_ds) OGRDataSource::DestroyDataSource(src_ds);
+			err_msg = "Could not open " + ds_name;
+			return false;
+		}
+		OGRLayerProxy* src_proxy =
+			new OGRLayerProxy("bench", src_layer, GdaConst::ds_sqlite);
+		GdaCache* cache = new GdaCache(cache_fname);
+		std::vector<double> ms;
+		
+		for (int r=0; r<reps && err_msg.empty(); r++) {
+			ptime start = Now();
+			if (cache->GetLayerProxy(ds_name, src_proxy)) {
+				err_msg = "GdaCache: hit before the layer was cached";
+			}
+			ms.push_back(MsSince(start));
+		}
+		AddTiming("GdaCache::GetLayerProxy miss", layer, ms, timings);
+		ms.clear();
+		if (err_msg.empty()) {
+			ptime start = Now();
+			if (!cache->CacheLayer(ds_name, src_proxy)) {
+				err_msg = "GdaCache: could not cache the layer";
+			}
+			ms.push_back(MsSince(start));
+		}
+		AddTiming("GdaCache::CacheLayer", layer, ms, timings);
+		ms.clear();
+		OGRLayerProxy* cached = 0;
+		for (int r=0; r<reps && err_msg.empty(); r++) {
+			ptime start = Now();
+			cached = cache->GetLayerProxy(ds_name, src_proxy);
+			ms.push_back(MsSince(start));
+			if (cached == NULL) err_msg = "GdaCache: miss after CacheLayer";
+		}
+		AddTiming("GdaCache::GetLayerProxy hit", layer, ms, timings);
+		if (err_msg.empty() && !SameFeatures(src_layer, cached->layer)) {
+			err_msg = "GdaCache: cached copy differs from the source";
+		}
+		
+		// move the last point out of the extent
+		if (err_msg.empty()) {
+			src_layer->ResetReading();
+			OGRFeature* f = 0;
+			OGRFeature* last = 0;
+			while ((f = src_layer->GetNextFeature()) != NULL) {
+				if (last) OGRFeature::DestroyFeature(last);
+				last = f;
+			}
+			if (last) {
+				OGREnvelope env;
+				src_layer->GetExtent(&env, TRUE);
+				OGRPoint pt(env.MaxX + 1, env.MaxY + 1);
+				last->SetGeometry(&pt);
+				src_layer->SetFeature(last);
+				OGRFeature::DestroyFeature(last);
+			}
+			if (cache->GetLayerProxy(ds_name, src_proxy)) {
+				err_msg = "GdaCache: hit after the source changed";
+			} else if (!cache->IsLayerUpdated(ds_name, src_proxy)) {
+				err_msg = "GdaCache: change of the source not detected";
+			}
+		}
+		ms.clear();
+		if (err_msg.empty()) {
+			ptime start = Now();
+			cache->UpdateLayer(ds_name, src_proxy);
+			ms.push_back(MsSince(start));
+			cached = cache->GetLayerProxy(ds_name, src_proxy);
+			if (cached == NULL || !SameFeatures(src_layer, cached->layer)) {
+				err_msg = "GdaCache: cached copy not updated";
+			}
+		}
+		AddTiming("GdaCache::UpdateLayer", layer, ms, timings);
+		
+		delete cache;
+		delete src_proxy;
+		OGRDataSource::DestroyDataSource(src_ds);
+		wxRemoveFile(src_fname);
+		wxRemoveFile(cache_fname);
+		return err_msg.empty();
+	}
+	
+	/** Draw shps the way TemplateCanvas::DrawSelectableShapes_gen_dc draws
+	 layer0 with a single category. */
+	void DrawLayer0(wxDC& dc, const std::vector<GdaShape*>& shps,
+					bool polygons, int w, int h, PointRaster& raster)
+	{
+		dc.SetPen(*wxWHITE_PEN);
+		dc.SetBrush(*wxWHITE_BRUSH);
+		dc.DrawRectangle(0, 0, w, h);
+		wxColour fill(GdaConst::map_default_fill_colour);
+		std::vector<int> ids(shps.size());
+		for (int i=0, iend=shps.size(); i<iend; i++) ids[i] = i;
+		if (!polygons) {
+			raster.Bin(shps, w, h, GdaConst::my_point_click_radius+1);
+			dc.SetBrush(*wxTRANSPARENT_BRUSH);
+			dc.SetPen(fill);
+			TemplateCanvas::DrawPointMarks(dc, shps, ids, raster);
+			return;
+		}
+		dc.SetPen(GdaConst::map_default_outline_colour);
+		dc.SetBrush(fill);
+		TemplateCanvas::DrawPolygons(dc, shps, ids);
+	}
+	
+	wxString LayerFileName(const wxString& dir, const Layer& layer,
+						   const wxString& ext)
+	{
+		wxString name;
+		name << "bench_" << GeneratorName(layer.generator) << "_";
+		name << layer.num_obs;
+		return wxFileName(dir, name, ext).GetFullPath();
+	}
+	
+	void JsonString(std::ostream& out, const std::string& s)
+	{
+		out << '"';
+		for (size_t i=0; i<s.size(); i++) {
+			char c = s[i];
+			if (c == '"' || c == '\\') {
+				out << '\\' << c;
+			} else if ((unsigned char) c < 0x20) {
+				out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+					<< (int) c << std::dec << std::setfill(' ');
+			} else {
+				out << c;
+			}
+		}
+		out << '"';
+	}
+}
+
+const char* Gda::Benchmark::GeneratorName(Generator g)
+{
+	if (g == grid) return "grid";
+	if (g == hex_lattice) return "hex_lattice";
+	if (g == clustered_points) return "clustered_points";
+	return "irregular_polygons";
+}
+
+bool Gda::Benchmark::Generate(Generator g, int n, uint64_t seed,
+							  Layer& layer)
+{
+	if (n < 3) return false;
+	layer.generator = g;
+	layer.num_obs = n;
+	layer.x.resize(n);
+	layer.y.resize(n);
+	// a different stream per generator so that layers of different types
+	// do not share their random numbers
+	HashRng rng(Gda::ThomasWangHashUInt64(seed + g));
+	// mean spacing of about 10 between random points
+	double extent = 10.0 * sqrt((double) n);
+	if (g == grid) {
+		GenerateGrid(n, layer);
+		extent = ceil(sqrt((double) n));
+	} else if (g == hex_lattice) {
+		GenerateHexLattice(n, layer);
+		extent = 4.0 * ceil(sqrt((double) n));
+	} else if (g == clustered_points) {
+		GenerateClusteredPoints(n, extent, rng, layer);
+	} else {
+		if (!GenerateIrregularPolygons(n, extent, rng, layer)) return false;
+	}
+	SetMainBox(layer);
+	SetAttributes(layer, extent, rng);
+	return true;
+}
+
+bool Gda::Benchmark::RunLayer(const Options& opt, Layer& layer,
+							  std::vector<Timing>& timings,
+							  std::string& err_msg)
+{
+	using namespace boost::posix_time;
+	const int n = layer.num_obs;
+	const int reps = GenUtils::max<int>(1, opt.repeats);
+	std::vector<double> ms;
+	
+	wxString dir(opt.work_dir);
+	if (dir.IsEmpty()) {
+		dir = wxFileName(wxFileName::GetTempDir(), "geoda_benchmark").GetFullPath();
+	}
+	if (!wxDirExists(dir)) wxFileName::Mkdir(dir, 0777, wxPATH_MKDIR_FULL);
+	wxString gal_fname = LayerFileName(dir, layer, "gal");
+	wxString gwt_fname = LayerFileName(dir, layer, "gwt");
+	wxString dbf_fname = LayerFileName(dir, layer, "dbf");
+	wxString csv_fname = LayerFileName(dir, layer, "csv");
+	std::vector<wxInt64> ids(n);
+	for (int i=0; i<n; i++) ids[i] = i+1;
+	
+	// Contiguity.  Point layers use the contiguity of their Thiessen
+	// polygons, as the Weights File Creation dialog does.
+	GalElement* gal = 0;
+	ms.clear();
+	for (int r=0; r<reps; r++) {
+		if (gal) delete [] gal;
+		gal = 0;
+		ptime start = Now();
+		if (layer.IsPolygons()) {
+			gal = shp2gal(layer.main, 1, false);
+		} else {
+			CsrWeight w;
+			if (Gda::VoronoiUtils::PointsToContiguity(layer.x, layer.y,
+													  false, w)) {
+				gal = w.ToGal();
+			}
+		}
+		ms.push_back(MsSince(start));
+	}
+	if (!gal) {
+		err_msg = "Could not build contiguity weights.";
+		return false;
+	}
+	AddTiming(layer.IsPolygons() ? "MakeContiguity rook" :
+			  "PointsToContiguity rook", layer, ms, timings);
+	ms.clear();
+	for (int r=0; r<reps; r++) {
+		ptime start = Now();
+		GalElement* queen = 0;
+		if (layer.IsPolygons()) {
+			queen = shp2gal(layer.main, 0, false);
+		} else {
+			CsrWeight w;
+			if (Gda::VoronoiUtils::PointsToContiguity(layer.x, layer.y,
+													  true, w)) {
+				queen = w.ToGal();
+			}
+		}
+		ms.push_back(MsSince(start));
+		if (queen) delete [] queen;
+	}
+	AddTiming(layer.IsPolygons() ? "MakeContiguity queen" :
+			  "PointsToContiguity queen", layer, ms, timings);
+	
+	GalWeight gal_w;
+	gal_w.gal = gal; // now owned by gal_w
+	gal_w.num_obs = n;
+	gal_w.wflnm = gal_fname;
+	
+	GwtElement* gwt = 0;
+	ms.clear();
+	for (int r=0; r<reps; r++) {
+		if (gwt) delete [] gwt;
+		ptime start = Now();
+		gwt = DynKNN(layer.x, layer.y, knn_k+1, 1);
+		ms.push_back(MsSince(start));
+	}
+	AddTiming("DynKNN", layer, ms, timings);
+	
+	// kNN in the space of the three attributes and the coordinates, built
+	// by a WeightsBuildJob as in an application
+	{
+		std::vector<std::vector<double> > cols(3);
+		cols[0] = layer.y_var;
+		cols[1] = layer.x1_var;
+		cols[2] = layer.x2_var;
+		WeightsSpec spec(WeightsSpec::attr_knn_type);
+		spec.k = knn_k;
+		spec.with_coords = true;
+		std::vector<WeightsSpec> specs(1, spec);
+		ms.clear();
+		for (int r=0; r<reps; r++) {
+			WeightsBuildJob job;
+			job.SetCoordinates(layer.x, layer.y);
+			job.SetAttributes(cols);
+			ptime start = Now();
+			if (job.Start(specs)) job.Wait();
+			ms.push_back(MsSince(start));
+			GwtElement* g = job.TakeGwt(0);
+			if (!g) {
+				if (gwt) delete [] gwt;
+				err_msg = "Could not build attribute kNN weights.";
+				return false;
+			}
+			delete [] g;
+		}
+		AddTiming("WeightsBuildJob attribute kNN", layer, ms, timings);
+	}
+	
+	bool saved = (SaveGal(gal, "bench", gal_fname, "POLY_ID", ids) &&
+				  WriteGwt(gwt, "bench", gwt_fname, "POLY_ID", ids, 1, false));
+	if (gwt) delete [] gwt;
+	if (!saved) {
+		err_msg = "Could not write weights files to " + std::string(dir.mb_str());
+		return false;
+	}
+	ms.clear();
+	for (int r=0; r<reps; r++) {
+		ptime start = Now();
+		GalElement* g = WeightUtils::ReadGal(gal_fname, 0);
+		ms.push_back(MsSince(start));
+		if (g) delete [] g;
+	}
+	AddTiming("ReadGal", layer, ms, timings);
+	ms.clear();
+	for (int r=0; r<reps; r++) {
+		ptime start = Now();
+		GwtElement* g = WeightUtils::ReadGwt(gwt_fname, 0);
+		ms.push_back(MsSince(start));
+		if (g) delete [] g;
+	}
+	AddTiming("ReadGwt", layer, ms, timings);
+	wxRemoveFile(gal_fname);
+	wxRemoveFile(gwt_fname);
+	
+	// LISA and Getis-Ord.  Construction includes the statistic and one
+	// permutation test with a fresh seed, CalcPseudoP reruns the test with
+	// a fixed seed.
+	std::vector<GeoDaVarInfo> var_info(1);
+	std::vector<SpaceTimePanel> data(1, SpaceTimePanel(1, n));
+	for (int i=0; i<n; i++) data[0].at(0, i) = layer.y_var[i];
+	{
+		ms.clear();
+		for (int r=0; r<reps; r++) {
+			ptime start = Now();
+			LisaCoordinator lc(&gal_w, n, var_info, data,
+							   LisaCoordinator::univariate);
+			ms.push_back(MsSince(start));
+		}
+		AddTiming("LisaCoordinator", layer, ms, timings);
+		LisaCoordinator lc(&gal_w, n, var_info, data,
+						   LisaCoordinator::univariate);
+		lc.SetLastUsedSeed(opt.seed);
+		lc.SetReuseLastSeed(true);
+		ms.clear();
+		for (int r=0; r<reps; r++) {
+			ptime start = Now();
+			lc.CalcPseudoP();
+			ms.push_back(MsSince(start));
+		}
+		AddTiming("LisaCoordinator::CalcPseudoP", layer, ms, timings);
+	}
+	{
+		// G statistics need non-negative values
+		double y_min = *std::min_element(layer.y_var.begin(),
+										 layer.y_var.end());
+		for (int i=0; i<n; i++) data[0].at(0, i) = layer.y_var[i] - y_min;
+		ms.clear();
+		for (int r=0; r<reps; r++) {
+			ptime start = Now();
+			GStatCoordinator gc(&gal_w, n, var_info, data, true);
+			ms.push_back(MsSince(start));
+		}
+		AddTiming("GStatCoordinator", layer, ms, timings);
+		GStatCoordinator gc(&gal_w, n, var_info, data, true);
+		gc.SetLastUsedSeed(opt.seed);
+		gc.SetReuseLastSeed(true);
+		ms.clear();
+		for (int r=0; r<reps; r++) {
+			ptime start = Now();
+			gc.CalcPseudoP();
+			ms.push_back(MsSince(start));
+		}
+		AddTiming("GStatCoordinator::CalcPseudoP", layer, ms, timings);
+	}
+	
+	{
+		Gda::dbl_int_pair_vec_type var(n);
+		for (int i=0; i<n; i++) {
+			var[i].first = layer.y_var[i];
+			var[i].second = i;
+		}
+		std::sort(var.begin(), var.end(), Gda::dbl_int_pair_cmp_less);
+		std::vector<double> breaks;
+		ms.clear();
+		for (int r=0; r<reps; r++) {
+			ptime start = Now();
+			CatClassification::FindNaturalBreaks(num_breaks_cats, var,
+												 breaks);
+			ms.push_back(MsSince(start));
+		}
+		AddTiming("FindNaturalBreaks", layer, ms, timings);
+	}
+	
+	// Regression of y on a constant, x1 and x2.  The inputs are copied
+	// afresh for every run.
+	{
+		const int nX = 3;
+		std::vector<double> y(n);
+		std::vector<double> x_data(nX*n);
+		double* x[nX];
+		for (int j=0; j<nX; j++) x[j] = &x_data[j*n];
+		ms.clear();
+		for (int r=0; r<reps; r++) {
+			for (int i=0; i<n; i++) {
+				y[i] = layer.y_var[i];
+				x[0][i] = 1.0;
+				x[1][i] = layer.x1_var[i];
+				x[2][i] = layer.x2_var[i];
+			}
+			DiagnosticReport dr(n, nX, true, true, 1);
+			ptime start = Now();
+			classicalRegression(gal, n, &y[0], n, x, nX, &dr, true, true, 0,
+								false);
+			ms.push_back(MsSince(start));
+			dr.release_Var();
+		}
+		AddTiming("classicalRegression", layer, ms, timings);
+		ms.clear();
+		for (int r=0; r<reps && n <= opt.max_lag_obs; r++) {
+			for (int i=0; i<n; i++) {
+				y[i] = layer.y_var[i];
+				x[0][i] = 1.0;
+				x[1][i] = layer.x1_var[i];
+				x[2][i] = layer.x2_var[i];
+			}
+			DiagnosticReport dr(n, nX+1, true, true, 2);
+			ptime start = Now();
+			spatialLagRegression(gal, n, &y[0], n, x, nX, &dr, true);
+			ms.push_back(MsSince(start));
+			dr.release_Var();
+		}
+		AddTiming("spatialLagRegression", layer, ms, timings);
+	}
+	
+	if (!WriteDbf(dbf_fname, layer) || !WriteCsv(csv_fname, layer)) {
+		err_msg = "Could not write table files to " + std::string(dir.mb_str());
+		return false;
+	}
+	ms.clear();
+	for (int r=0; r<reps; r++) {
+		ptime start = Now();
+		DbfFileReader dbf(dbf_fname);
+		std::vector<double> vals;
+		for (int f=0, fend=dbf.getNumFields(); f<fend; f++) {
+			dbf.getFieldValsDouble(f, vals);
+		}
+		ms.push_back(MsSince(start));
+	}
+	AddTiming("DbfFileReader", layer, ms, timings);
+	ms.clear();
+	for (int r=0; r<reps; r++) {
+		std::vector<Gda::CsvColumn> cols;
+		wxString csv_err;
+		ptime start = Now();
+		Gda::ReadCsvColumns(std::string(csv_fname.mb_str()), true, true,
+							cols, csv_err);
+		ms.push_back(MsSince(start));
+	}
+	AddTiming("ReadCsvColumns", layer, ms, timings);
+	wxRemoveFile(dbf_fname);
+	wxRemoveFile(csv_fname);
+	if (!RunCache(dir, layer, reps, timings, err_msg)) return false;
+	
+	// Map layer0: the batch scale transform and the drawing itself.
+	{
+		const int w = opt.canvas_width;
+		const int h = opt.canvas_height;
+		std::vector<GdaShape*> shps(n);
+		for (int i=0; i<n; i++) {
+			if (layer.IsPolygons()) {
+				shps[i] = new GdaPolygon((Shapefile::PolygonContents*)
+										 layer.main.records[i].contents_p);
+			} else {
+				shps[i] = new GdaPoint(layer.x[i], layer.y[i]);
+			}
+		}
+		const Shapefile::Header& hdr = layer.main.header;
+		double scale_x, scale_y, trans_x, trans_y;
+		GdaScaleTrans::calcAffineParams(hdr.bbox_x_min, hdr.bbox_y_min,
+										hdr.bbox_x_max, hdr.bbox_y_max,
+										10, 10, 10, 10, w, h, true, true,
+										&scale_x, &scale_y,
+										&trans_x, &trans_y);
+		GdaScaleTrans st(scale_x, scale_y, trans_x, trans_y);
+		ScaleTransBatch batch;
+		ms.clear();
+		for (int r=0; r<reps; r++) {
+			ptime start = Now();
+			batch.Apply(shps, st);
+			ms.push_back(MsSince(start));
+		}
+		AddTiming("ScaleTransBatch::Apply", layer, ms, timings);
+		
+		wxBitmap bm(w, h);
+		wxMemoryDC dc(bm);
+		PointRaster raster;
+		ms.clear();
+		for (int r=0; r<reps; r++) {
+			ptime start = Now();
+			DrawLayer0(dc, shps, layer.IsPolygons(), w, h, raster);
+			ms.push_back(MsSince(start));
+		}
+		AddTiming("DrawLayer0", layer, ms, timings);
+		dc.SelectObject(wxNullBitmap);
+		for (int i=0; i<n; i++) delete shps[i];
+	}
+	return true;
+}
+
+bool Gda::Benchmark::Run(const Options& opt, std::vector<Timing>& timings,
+						 std::string& err_msg)
+{
+	LOG_MSG("Entering Gda::Benchmark::Run");
+	for (int s=opt.min_scale; s<=opt.max_scale; s++) {
+		int n = 1;
+		for (int k=0; k<s; k++) n *= 10;
+		for (int g=0; g<num_generators; g++) {
+			Layer layer;
+			std::vector<double> ms(1);
+			boost::posix_time::ptime start = Now();
+			if (!Generate((Generator) g, n, opt.seed, layer)) {
+				err_msg = "Could not generate layer ";
+				err_msg += GeneratorName((Generator) g);
+				return false;
+			}
+			ms[0] = MsSince(start);
+			AddTiming("Generate", layer, ms, timings);
+			if (!RunLayer(opt, layer, timings, err_msg)) return false;
+		}
+	}
+	LOG_MSG("Exiting Gda::Benchmark::Run");
+	return true;
+}
+
+bool Gda::Benchmark::WriteJson(const std::string& file_name,
+							   const Options& opt,
+							   const std::vector<Timing>& timings)
+{
+	std::ofstream out(file_name.c_str());
+	if (!(out.is_open() && out.good())) return false;
+	out << "{\n";
+	out << "  \"geoda_version\": \"" << Gda::version_major << "."
+		<< Gda::version_minor << "." << Gda::version_build << "\",\n";
+	out << "  \"threads\": " << Gda::GetNumWorkers() << ",\n";
+	out << "  \"seed\": " << opt.seed << ",\n";
+	out << "  \"repeats\": " << opt.repeats << ",\n";
+	out << "  \"min_scale\": " << opt.min_scale << ",\n";
+	out << "  \"max_scale\": " << opt.max_scale << ",\n";
+	out << "  \"canvas\": [" << opt.canvas_width << ", "
+		<< opt.canvas_height << "],\n";
+	out << "  \"timings\": [";
+	out << std::fixed << std::setprecision(3);
+	for (size_t i=0; i<timings.size(); i++) {
+		const Timing& t = timings[i];
+		out << (i > 0 ? ",\n" : "\n") << "    {\"engine\": ";
+		JsonString(out, t.engine);
+		out << ", \"generator\": ";
+		JsonString(out, t.generator);
+		out << ", \"n\": " << t.num_obs << ", \"runs\": " << t.runs;
+		out << ", \"min_ms\": " << t.min_ms;
+		out << ", \"mean_ms\": " << t.mean_ms << "}";
+	}
+	out << "\n  ]\n}\n";
+	return out.good();
+}
@@ -0,0 +1,126 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_GDA_BENCHMARK_H__
+#define __GEODA_CENTER_GDA_BENCHMARK_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "ShapeOperations/ShpFile.h"
+
+/**
+ Reproducible timings of the core engines on synthetic layers, so that
+ performance can be compared between releases.  GeoDa runs the suite
+ instead of opening its main window when started with --benchmark.
+ 
+ Four generators build layers with exactly n observations: a regular grid
+ of unit squares, a lattice of hexagons, clustered random points and
+ irregular polygons (the Thiessen polygons of uniform random points).
+ Every vertex of the grid and hexagon layers has integer coordinates, so
+ contiguity is exact.  Each observation also gets three attributes: y and
+ x1 follow a smooth spatial trend plus noise and x2 is pure noise.  All
+ random numbers come from Gda::ThomasWangHashDouble, so the same seed
+ always gives the same layer.
+ 
+ For every generator and every n = 10^min_scale, ..., 10^max_scale the
+ suite times weights construction (MakeContiguity, DynKNN, attribute kNN
+ with WeightsBuildJob), weights file reading (ReadGal, ReadGwt), LISA and
+ Getis-Ord statistics with their permutation tests, natural breaks,
+ classical and spatial lag regression, DBF and CSV loading, a GdaCache
+ round trip with a SQLite layer, and the scale transform and drawing of
+ map layer0.  Spatial lag regression is skipped above max_lag_obs
+ observations.  Each timing is repeated and the fastest and mean run are
+ written as JSON.  The suite stops with an error if a cached layer does
+ not match its source.
+ */
+namespace Gda {
+	namespace Benchmark {
+		enum Generator { grid, hex_lattice, clustered_points,
+			irregular_polygons };
+		const int num_generators = 4;
+		const char* GeneratorName(Generator g);
+		
+		struct Layer {
+			Layer() : generator(grid), num_obs(0) {}
+			Generator generator;
+			int num_obs;
+			/** Point or polygon records, one per observation. */
+			Shapefile::Main main;
+			/** Points, or the centers of the polygons. */
+			std::vector<double> x;
+			std::vector<double> y;
+			std::vector<double> y_var;
+			std::vector<double> x1_var;
+			std::vector<double> x2_var;
+			bool IsPolygons() const {
+				return main.header.shape_type == Shapefile::POLYGON; }
+		private:
+			// Shapefile::MainRecord owns its contents, so layers are not
+			// copyable.
+			Layer(const Layer&);
+			Layer& operator=(const Layer&);
+		};
+		
+		/** Fill layer with n observations from generator g.  Returns false
+		 if n is too small for the generator. */
+		bool Generate(Generator g, int n, uint64_t seed, Layer& layer);
+		
+		struct Timing {
+			std::string engine;
+			std::string generator;
+			int num_obs;
+			int runs;
+			double min_ms;
+			double mean_ms;
+		};
+		
+		struct Options {
+			Options() : min_scale(3), max_scale(5), repeats(3), seed(123456789),
+			max_lag_obs(100000), canvas_width(1024), canvas_height(768) {}
+			int min_scale;
+			int max_scale;
+			int repeats;
+			uint64_t seed;
+			int max_lag_obs;
+			int canvas_width;
+			int canvas_height;
+			/** Directory for the generated DBF, CSV and weights files.
+			 The system temporary directory is used when empty. */
+			std::string work_dir;
+		};
+		
+		/** Run the whole suite, appending one Timing per engine, generator
+		 and size.  Returns false with err_msg set if a generated file could
+		 not be written. */
+		bool Run(const Options& opt, std::vector<Timing>& timings,
+				 std::string& err_msg);
+		/** Time every engine on one layer. */
+		bool RunLayer(const Options& opt, Layer& layer,
+					  std::vector<Timing>& timings, std::string& err_msg);
+		
+		/** Write the options, GeoDa version, number of worker threads and
+		 timings as a JSON object.  Returns false if the file could not be
+		 written. */
+		bool WriteJson(const std::string& file_name, const Options& opt,
+					   const std::vector<Timing>& timings);
+	}
+}
+
+#endif
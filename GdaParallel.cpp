@@ -0,0 +1,39 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "GdaParallel.h"
+
+int Gda::GetNumWorkers()
+{
+	int n = (int) boost::thread::hardware_concurrency();
+	return n < 1 ? 1 : n;
+}
+
+void Gda::PartitionRange(int n, int num_parts, std::vector<int>& starts)
+{
+	if (num_parts < 1) num_parts = 1;
+	if (num_parts > n) num_parts = n > 0 ? n : 1;
+	int quotient = n / num_parts;
+	int remainder = n % num_parts;
+	starts.resize(num_parts+1);
+	starts[0] = 0;
+	for (int i=0; i<num_parts; i++) {
+		starts[i+1] = starts[i] + quotient + (i < remainder ? 1 : 0);
+	}
+}
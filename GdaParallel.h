@@ -0,0 +1,79 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_GDA_PARALLEL_H__
+#define __GEODA_CENTER_GDA_PARALLEL_H__
+
+#include <vector>
+#include <boost/thread.hpp>
+
+namespace Gda {
+	/** Number of worker threads to use for data-parallel loops.  This is
+	 the number of hardware threads reported by the OS, but never less
+	 than one. */
+	int GetNumWorkers();
+	
+	/** Divide [0, n) into at most num_parts contiguous ranges whose sizes
+	 differ by at most one.  This is the same quotient / remainder split
+	 used by the LISA and G worker threads.  On return,
+	 range [starts[k], starts[k+1]) is the k-th range. */
+	void PartitionRange(int n, int num_parts, std::vector<int>& starts);
+	
+	template <class F>
+	struct ParallelRangeTask {
+		ParallelRangeTask(F* f_s, int start_s, int end_s, int thread_id_s)
+		: f(f_s), start(start_s), end(end_s), thread_id(thread_id_s) {}
+		void operator()() { (*f)(start, end, thread_id); }
+		F* f;
+		int start;
+		int end;
+		int thread_id;
+	};
+	
+	/** Call f(start, end, thread_id) over a partition of [0, n) with one
+	 boost::thread per range.  The call blocks until every range is done.
+	 Falls back to a single inline call when there is only one worker or
+	 when n is smaller than min_chunk.  f is shared by every thread, so its
+	 operator() must only write to memory owned by its range or by
+	 per-thread scratch indexed by thread_id. */
+	template <class F>
+	void ParallelFor(int n, F& f, int num_workers = -1, int min_chunk = 1)
+	{
+		if (n <= 0) return;
+		if (num_workers <= 0) num_workers = GetNumWorkers();
+		if (min_chunk < 1) min_chunk = 1;
+		if (num_workers > n / min_chunk) num_workers = n / min_chunk;
+		if (num_workers <= 1) {
+			f(0, n, 0);
+			return;
+		}
+		std::vector<int> starts;
+		PartitionRange(n, num_workers, starts);
+		boost::thread_group threads;
+		for (int t=1, tend=starts.size()-1; t<tend; t++) {
+			threads.create_thread(ParallelRangeTask<F>(&f, starts[t],
+													   starts[t+1], t));
+		}
+		// the calling thread takes the first range
+		f(starts[0], starts[1], 0);
+		threads.join_all();
+	}
+}
+
+#endif
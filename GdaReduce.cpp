@@ -0,0 +1,263 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include "GdaParallel.h"
+#include "GdaReduce.h"
+
+namespace {
+	/** Summary of one contiguous block.  The loops keep four independent
+	 accumulators so that the compiler can vectorize them; the squared
+	 deviations are taken in a second pass over the (cache resident) block
+	 to avoid the cancellation of the sum of squares formula. */
+	void SummarizeBlock(const double* x, int start, int end,
+						const std::vector<bool>* undef, Gda::ColumnSummary& s)
+	{
+		s.Reset();
+		if (start >= end) return;
+		if (undef) {
+			const std::vector<bool>& u = *undef;
+			for (int i=start; i<end; i++) {
+				if (u[i]) s.n_undef++; else s.Add(x[i]);
+			}
+			return;
+		}
+		const double* p = x + start;
+		int len = end - start;
+		double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+		double mn0 = p[0], mn1 = p[0], mn2 = p[0], mn3 = p[0];
+		double mx0 = p[0], mx1 = p[0], mx2 = p[0], mx3 = p[0];
+		int i = 0;
+		for (; i+4<=len; i+=4) {
+			s0 += p[i]; s1 += p[i+1]; s2 += p[i+2]; s3 += p[i+3];
+			mn0 = p[i] < mn0 ? p[i] : mn0;
+			mn1 = p[i+1] < mn1 ? p[i+1] : mn1;
+			mn2 = p[i+2] < mn2 ? p[i+2] : mn2;
+			mn3 = p[i+3] < mn3 ? p[i+3] : mn3;
+			mx0 = p[i] > mx0 ? p[i] : mx0;
+			mx1 = p[i+1] > mx1 ? p[i+1] : mx1;
+			mx2 = p[i+2] > mx2 ? p[i+2] : mx2;
+			mx3 = p[i+3] > mx3 ? p[i+3] : mx3;
+		}
+		for (; i<len; i++) {
+			s0 += p[i];
+			mn0 = p[i] < mn0 ? p[i] : mn0;
+			mx0 = p[i] > mx0 ? p[i] : mx0;
+		}
+		double mn01 = mn0 < mn1 ? mn0 : mn1, mn23 = mn2 < mn3 ? mn2 : mn3;
+		double mx01 = mx0 > mx1 ? mx0 : mx1, mx23 = mx2 > mx3 ? mx2 : mx3;
+		s.n = len;
+		s.min = mn01 < mn23 ? mn01 : mn23;
+		s.max = mx01 > mx23 ? mx01 : mx23;
+		s.mean = ((s0 + s1) + (s2 + s3)) / len;
+		
+		const double m = s.mean;
+		double q0 = 0, q1 = 0, q2 = 0, q3 = 0;
+		i = 0;
+		for (; i+4<=len; i+=4) {
+			double d0 = p[i]-m, d1 = p[i+1]-m, d2 = p[i+2]-m, d3 = p[i+3]-m;
+			q0 += d0*d0; q1 += d1*d1; q2 += d2*d2; q3 += d3*d3;
+		}
+		for (; i<len; i++) q0 += (p[i]-m)*(p[i]-m);
+		s.m2 = (q0 + q1) + (q2 + q3);
+	}
+	
+	struct SummarizeTask {
+		SummarizeTask(const double* x_s, int n_s, const std::vector<bool>* u_s,
+					  std::vector<Gda::ColumnSummary>& blocks_s)
+		: x(x_s), n(n_s), undef(u_s), blocks(blocks_s) {}
+		void operator()(int b_start, int b_end, int thread_id) {
+			for (int b=b_start; b<b_end; b++) {
+				int start = b * Gda::reduce_block_size;
+				int end = start + Gda::reduce_block_size;
+				if (end > n) end = n;
+				SummarizeBlock(x, start, end, undef, blocks[b]);
+			}
+		}
+		const double* x;
+		int n;
+		const std::vector<bool>* undef;
+		std::vector<Gda::ColumnSummary>& blocks;
+	};
+	
+	struct ShiftScaleTask {
+		ShiftScaleTask(double* x_s, double shift_s, double scale_s)
+		: x(x_s), shift(shift_s), scale(scale_s) {}
+		void operator()(int start, int end, int thread_id) {
+			for (int i=start; i<end; i++) x[i] = (x[i] - shift) * scale;
+		}
+		double* x;
+		double shift;
+		double scale;
+	};
+	
+	/** Blocks per thread below which threads are not worth starting. */
+	const int min_blocks_per_worker = 16;
+}
+
+Gda::ColumnSummary::ColumnSummary()
+{
+	Reset();
+}
+
+void Gda::ColumnSummary::Reset()
+{
+	n = 0;
+	n_undef = 0;
+	min = 0;
+	max = 0;
+	mean = 0;
+	m2 = 0;
+	minmax_valid = true;
+}
+
+double Gda::ColumnSummary::Variance(bool bessel) const
+{
+	if (n == 0) return 0;
+	if (n == 1 || !bessel) return m2 / n;
+	return m2 / (n-1);
+}
+
+double Gda::ColumnSummary::StdDev(bool bessel) const
+{
+	return sqrt(Variance(bessel));
+}
+
+/** Chan, Golub and LeVeque's pairwise update. */
+void Gda::ColumnSummary::Merge(const ColumnSummary& o)
+{
+	n_undef += o.n_undef;
+	if (o.n == 0) return;
+	if (n == 0) {
+		int u = n_undef;
+		*this = o;
+		n_undef = u;
+		return;
+	}
+	double n_a = n, n_b = o.n, n_ab = n_a + n_b;
+	double delta = o.mean - mean;
+	mean += delta * (n_b / n_ab);
+	m2 += o.m2 + delta * delta * (n_a * n_b / n_ab);
+	if (o.min < min) min = o.min;
+	if (o.max > max) max = o.max;
+	minmax_valid = minmax_valid && o.minmax_valid;
+	n += o.n;
+}
+
+void Gda::ColumnSummary::Add(double x)
+{
+	if (n == 0) {
+		n = 1;
+		mean = x;
+		m2 = 0;
+		min = x;
+		max = x;
+		return;
+	}
+	n++;
+	double delta = x - mean;
+	mean += delta / n;
+	m2 += delta * (x - mean);
+	if (x < min) min = x;
+	if (x > max) max = x;
+}
+
+void Gda::ColumnSummary::Remove(double x)
+{
+	if (n <= 1) {
+		int u = n_undef;
+		Reset();
+		n_undef = u;
+		return;
+	}
+	double old_mean = mean;
+	mean = (n * mean - x) / (n-1);
+	m2 -= (x - old_mean) * (x - mean);
+	if (m2 < 0) m2 = 0;
+	n--;
+	if (x <= min || x >= max) minmax_valid = false;
+}
+
+void Gda::ColumnSummary::Replace(double old_x, bool old_undef,
+								 double new_x, bool new_undef)
+{
+	if (old_undef) n_undef--; else Remove(old_x);
+	if (new_undef) n_undef++; else Add(new_x);
+}
+
+bool Gda::Summarize(const double* x, int n, const std::vector<bool>* undef,
+					ColumnSummary& s)
+{
+	s.Reset();
+	if (undef && (int) undef->size() < n) return false;
+	if (n <= 0) return true;
+	int n_blocks = (n + reduce_block_size - 1) / reduce_block_size;
+	std::vector<ColumnSummary> blocks(n_blocks);
+	SummarizeTask task(x, n, undef, blocks);
+	ParallelFor(n_blocks, task, -1, min_blocks_per_worker);
+	// pairwise merge keeps the rounding error of the sums O(log n)
+	for (int step=1; step<n_blocks; step*=2) {
+		for (int b=0; b+step<n_blocks; b+=2*step) {
+			blocks[b].Merge(blocks[b+step]);
+		}
+	}
+	s = blocks[0];
+	return true;
+}
+
+void Gda::Summarize(const std::vector<double>& x, ColumnSummary& s)
+{
+	if (x.empty()) {
+		s.Reset();
+		return;
+	}
+	Summarize(&x[0], x.size(), 0, s);
+}
+
+bool Gda::Summarize(const std::vector<double>& x,
+					const std::vector<bool>& undef, ColumnSummary& s)
+{
+	if (x.empty()) {
+		s.Reset();
+		return true;
+	}
+	return Summarize(&x[0], x.size(), &undef, s);
+}
+
+double Gda::Sum(const double* x, int n)
+{
+	ColumnSummary s;
+	Summarize(x, n, 0, s);
+	return s.Sum();
+}
+
+void Gda::MinMax(const double* x, int n, double& min, double& max)
+{
+	if (n <= 0) return;
+	ColumnSummary s;
+	Summarize(x, n, 0, s);
+	min = s.min;
+	max = s.max;
+}
+
+void Gda::ShiftScale(double* x, int n, double shift, double scale)
+{
+	ShiftScaleTask task(x, shift, scale);
+	ParallelFor(n, task, -1, min_blocks_per_worker * reduce_block_size);
+}
@@ -0,0 +1,77 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_GDA_REDUCE_H__
+#define __GEODA_CENTER_GDA_REDUCE_H__
+
+#include <vector>
+
+namespace Gda {
+	/** Summary statistics of the defined values of a column.  m2 is the
+	 sum of squared deviations from the mean, so variances are m2/n or
+	 m2/(n-1).  Summaries of disjoint parts of a column are combined with
+	 Merge(), and single values are added or removed with Welford's update,
+	 which is how a cached summary follows edits of one cell. */
+	struct ColumnSummary {
+		ColumnSummary();
+		void Reset();
+		
+		int n; // number of defined values
+		int n_undef;
+		double min;
+		double max;
+		double mean;
+		double m2;
+		/** false once an edit removed the current min or max.  Mean and
+		 variance stay exact, but min and max need a new pass. */
+		bool minmax_valid;
+		
+		double Sum() const { return mean * n; }
+		double Variance(bool bessel=true) const;
+		double StdDev(bool bessel=true) const;
+		
+		void Merge(const ColumnSummary& o);
+		void Add(double x);
+		void Remove(double x);
+		/** Update for cell value old_x changing to new_x. */
+		void Replace(double old_x, bool old_undef, double new_x, bool new_undef);
+	};
+	
+	/** Rows per block in the reductions below.  Blocks are reduced in
+	 parallel and their summaries merged pairwise. */
+	const int reduce_block_size = 4096;
+	
+	/** Summarize x[0..n), skipping rows where undef is set.  undef may be
+	 NULL; otherwise it needs at least n entries, and if it is shorter s is
+	 reset and false is returned. */
+	bool Summarize(const double* x, int n, const std::vector<bool>* undef,
+				   ColumnSummary& s);
+	void Summarize(const std::vector<double>& x, ColumnSummary& s);
+	bool Summarize(const std::vector<double>& x,
+				   const std::vector<bool>& undef, ColumnSummary& s);
+	
+	/** Pairwise (block-wise) sum of x[0..n). */
+	double Sum(const double* x, int n);
+	void MinMax(const double* x, int n, double& min, double& max);
+	
+	/** x[i] = (x[i] - shift) * scale for all i. */
+	void ShiftScale(double* x, int n, double shift, double scale);
+}
+
+#endif
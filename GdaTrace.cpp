@@ -0,0 +1,302 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include "GdaTrace.h"
+
+bool Gda::Trace::enabled = false;
+
+namespace {
+	struct TraceEvent {
+		const char* stage;
+		const char* name;
+		uint64_t start_us;
+		uint64_t dur_us;
+		int64_t count;
+		bool is_count;
+	};
+	
+	/** Events recorded by one thread.  A buffer is handed to a new thread
+	 when its previous owner exits, so the number of buffers is bounded by
+	 the number of threads alive at once rather than by the number of
+	 threads ever started.  The mutex is only contended while exporting. */
+	struct ThreadBuffer {
+		ThreadBuffer(int tid_s) : tid(tid_s), in_use(true), dropped(0) {}
+		int tid;
+		bool in_use;
+		int64_t dropped;
+		boost::mutex mutex;
+		std::vector<TraceEvent> events;
+	};
+	
+	const size_t max_events_per_thread = 1<<20;
+	
+	void ReleaseBuffer(ThreadBuffer* buf);
+	
+	/** Never deleted, so that threads exiting during static destruction
+	 can still release their buffers. */
+	struct TraceRegistry {
+		TraceRegistry() : epoch_set(false), tls(ReleaseBuffer) {}
+		boost::mutex mutex;
+		std::vector<ThreadBuffer*> buffers;
+		bool epoch_set;
+		boost::posix_time::ptime epoch;
+		boost::thread_specific_ptr<ThreadBuffer> tls;
+	};
+	
+	TraceRegistry& Registry()
+	{
+		static TraceRegistry* r = new TraceRegistry();
+		return *r;
+	}
+	
+	void ReleaseBuffer(ThreadBuffer* buf)
+	{
+		boost::mutex::scoped_lock lock(Registry().mutex);
+		buf->in_use = false;
+	}
+	
+	ThreadBuffer* GetThreadBuffer()
+	{
+		TraceRegistry& r = Registry();
+		ThreadBuffer* buf = r.tls.get();
+		if (buf) return buf;
+		{
+			boost::mutex::scoped_lock lock(r.mutex);
+			for (size_t i=0; i<r.buffers.size() && !buf; i++) {
+				if (!r.buffers[i]->in_use) {
+					buf = r.buffers[i];
+					buf->in_use = true;
+				}
+			}
+			if (!buf) {
+				buf = new ThreadBuffer(r.buffers.size());
+				r.buffers.push_back(buf);
+			}
+		}
+		r.tls.reset(buf);
+		return buf;
+	}
+	
+	void AppendEvent(const TraceEvent& e)
+	{
+		ThreadBuffer* buf = GetThreadBuffer();
+		boost::mutex::scoped_lock lock(buf->mutex);
+		if (buf->events.size() >= max_events_per_thread) {
+			buf->dropped++;
+			return;
+		}
+		buf->events.push_back(e);
+	}
+	
+	void WriteJsonString(std::ostream& out, const char* s)
+	{
+		out << '"';
+		for (; s && *s; s++) {
+			char c = *s;
+			if (c == '"' || c == '\\') {
+				out << '\\' << c;
+			} else if ((unsigned char) c < 0x20) {
+				char hex[8];
+				sprintf(hex, "\\u%04x", (int) c);
+				out << hex;
+			} else {
+				out << c;
+			}
+		}
+		out << '"';
+	}
+	
+	bool SummaryGreater(const Gda::Trace::StageSummary& a,
+						const Gda::Trace::StageSummary& b)
+	{
+		return a.total_ms > b.total_ms;
+	}
+}
+
+void Gda::Trace::SetEnabled(bool enable)
+{
+	if (enable) {
+		TraceRegistry& r = Registry();
+		boost::mutex::scoped_lock lock(r.mutex);
+		if (!r.epoch_set) {
+			r.epoch = boost::posix_time::microsec_clock::universal_time();
+			r.epoch_set = true;
+		}
+	}
+	enabled = enable;
+}
+
+void Gda::Trace::Clear()
+{
+	TraceRegistry& r = Registry();
+	boost::mutex::scoped_lock lock(r.mutex);
+	for (size_t i=0; i<r.buffers.size(); i++) {
+		boost::mutex::scoped_lock buf_lock(r.buffers[i]->mutex);
+		r.buffers[i]->events.clear();
+		r.buffers[i]->dropped = 0;
+	}
+}
+
+uint64_t Gda::Trace::NowMicros()
+{
+	TraceRegistry& r = Registry();
+	if (!r.epoch_set) return 0;
+	boost::posix_time::time_duration d =
+		boost::posix_time::microsec_clock::universal_time() - r.epoch;
+	return d.is_negative() ? 0 : (uint64_t) d.total_microseconds();
+}
+
+void Gda::Trace::RecordSpan(const char* stage, const char* name,
+							uint64_t start_us, uint64_t end_us)
+{
+	TraceEvent e;
+	e.stage = stage;
+	e.name = name;
+	e.start_us = start_us;
+	e.dur_us = end_us > start_us ? end_us - start_us : 0;
+	e.count = 0;
+	e.is_count = false;
+	AppendEvent(e);
+}
+
+void Gda::Trace::AddCount(const char* stage, const char* name, int64_t n)
+{
+	TraceEvent e;
+	e.stage = stage;
+	e.name = name;
+	e.start_us = NowMicros();
+	e.dur_us = 0;
+	e.count = n;
+	e.is_count = true;
+	AppendEvent(e);
+}
+
+void Gda::Trace::GetSummary(std::vector<StageSummary>& summary)
+{
+	typedef std::pair<std::string, std::string> key_type;
+	std::map<key_type, StageSummary> stages;
+	TraceRegistry& r = Registry();
+	boost::mutex::scoped_lock lock(r.mutex);
+	for (size_t i=0; i<r.buffers.size(); i++) {
+		ThreadBuffer* buf = r.buffers[i];
+		boost::mutex::scoped_lock buf_lock(buf->mutex);
+		for (size_t j=0; j<buf->events.size(); j++) {
+			const TraceEvent& e = buf->events[j];
+			key_type key(e.stage, e.name);
+			std::map<key_type, StageSummary>::iterator it = stages.find(key);
+			if (it == stages.end()) {
+				StageSummary s;
+				s.stage = e.stage;
+				s.name = e.name;
+				s.calls = 0;
+				s.total_ms = 0;
+				s.max_ms = 0;
+				s.count = 0;
+				it = stages.insert(std::make_pair(key, s)).first;
+			}
+			if (e.is_count) {
+				it->second.count += e.count;
+			} else {
+				double ms = ((double) e.dur_us)/1000.0;
+				it->second.calls++;
+				it->second.total_ms += ms;
+				if (ms > it->second.max_ms) it->second.max_ms = ms;
+			}
+		}
+	}
+	summary.clear();
+	std::map<key_type, StageSummary>::iterator it;
+	for (it = stages.begin(); it != stages.end(); it++) {
+		summary.push_back(it->second);
+	}
+	std::sort(summary.begin(), summary.end(), SummaryGreater);
+}
+
+std::string Gda::Trace::GetSummaryTable()
+{
+	std::vector<StageSummary> summary;
+	GetSummary(summary);
+	std::ostringstream out;
+	out << std::left << std::setw(10) << "stage" << std::setw(40) << "name";
+	out << std::right << std::setw(8) << "calls" << std::setw(12) << "total ms";
+	out << std::setw(12) << "mean ms" << std::setw(12) << "max ms";
+	out << std::setw(14) << "count" << "\n";
+	out << std::fixed << std::setprecision(3);
+	for (size_t i=0; i<summary.size(); i++) {
+		const StageSummary& s = summary[i];
+		out << std::left << std::setw(10) << s.stage << std::setw(40) << s.name;
+		out << std::right << std::setw(8) << s.calls;
+		out << std::setw(12) << s.total_ms;
+		out << std::setw(12) << (s.calls > 0 ? s.total_ms/s.calls : 0.0);
+		out << std::setw(12) << s.max_ms;
+		out << std::setw(14) << s.count << "\n";
+	}
+	return out.str();
+}
+
+bool Gda::Trace::WriteChromeTrace(const std::string& file_name)
+{
+	std::ofstream out(file_name.c_str());
+	if (!out.is_open()) return false;
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	TraceRegistry& r = Registry();
+	boost::mutex::scoped_lock lock(r.mutex);
+	for (size_t i=0; i<r.buffers.size(); i++) {
+		ThreadBuffer* buf = r.buffers[i];
+		boost::mutex::scoped_lock buf_lock(buf->mutex);
+		std::map<const char*, int64_t> totals; // running counter values
+		for (size_t j=0; j<buf->events.size(); j++) {
+			const TraceEvent& e = buf->events[j];
+			out << (first ? "\n" : ",\n");
+			first = false;
+			out << "{\"name\":";
+			WriteJsonString(out, e.name);
+			out << ",\"cat\":";
+			WriteJsonString(out, e.stage);
+			out << ",\"pid\":1,\"tid\":" << buf->tid;
+			out << ",\"ts\":" << e.start_us;
+			if (e.is_count) {
+				int64_t& total = totals[e.name];
+				total += e.count;
+				out << ",\"ph\":\"C\",\"args\":{\"value\":" << total << "}}";
+			} else {
+				out << ",\"ph\":\"X\",\"dur\":" << e.dur_us << "}";
+			}
+		}
+		if (buf->dropped > 0) {
+			out << (first ? "\n" : ",\n");
+			first = false;
+			out << "{\"name\":\"dropped events\",\"ph\":\"i\",\"s\":\"t\"";
+			out << ",\"pid\":1,\"tid\":" << buf->tid << ",\"ts\":0";
+			out << ",\"args\":{\"count\":" << buf->dropped << "}}";
+		}
+	}
+	out << "\n]}\n";
+	return out.good();
+}
@@ -0,0 +1,103 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_GDA_TRACE_H__
+#define __GEODA_CENTER_GDA_TRACE_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ Lightweight per-stage timing.  Code marks a region with
+ GDA_TRACE_SCOPE(stage, name) and adds to a counter with
+ GDA_TRACE_COUNT(stage, name, n).  Stage is one of a small set of pipeline
+ steps such as "load", "weights", "classify", "permute" and "render", and
+ name identifies the region within the stage.  Both must be string literals
+ since only the pointers are kept.
+ 
+ When tracing is off, which is the default, a scope costs one test of a
+ global flag.  When on, every thread appends to its own buffer and the
+ results can be written as a Chrome trace (chrome://tracing) JSON file or
+ summarized per stage.  Define GDA_NO_TRACE to compile all of it out.
+ */
+namespace Gda {
+	namespace Trace {
+		extern bool enabled;
+		inline bool IsEnabled() { return enabled; }
+		/** Start or stop recording.  Timestamps are relative to the first
+		 call that turns tracing on. */
+		void SetEnabled(bool enable);
+		/** Discard all recorded spans and counts. */
+		void Clear();
+		/** Microseconds since tracing was first enabled. */
+		uint64_t NowMicros();
+		void RecordSpan(const char* stage, const char* name,
+						uint64_t start_us, uint64_t end_us);
+		void AddCount(const char* stage, const char* name, int64_t n);
+		
+		struct StageSummary {
+			std::string stage;
+			std::string name;
+			int calls;
+			double total_ms;
+			double max_ms;
+			int64_t count; // sum of GDA_TRACE_COUNT values
+		};
+		/** Aggregate everything recorded so far by stage and name, ordered
+		 by decreasing total time. */
+		void GetSummary(std::vector<StageSummary>& summary);
+		/** GetSummary formatted as a plain text table. */
+		std::string GetSummaryTable();
+		/** Write all recorded events as a Chrome trace JSON file.  Returns
+		 false if the file could not be written. */
+		bool WriteChromeTrace(const std::string& file_name);
+	}
+	
+	class ScopedTrace {
+	public:
+		ScopedTrace(const char* stage_s, const char* name_s)
+		: stage(stage_s), name(name_s), active(Trace::IsEnabled()),
+		start(active ? Trace::NowMicros() : 0) {}
+		~ScopedTrace() {
+			if (active) Trace::RecordSpan(stage, name, start,
+										  Trace::NowMicros());
+		}
+	private:
+		const char* stage;
+		const char* name;
+		bool active;
+		uint64_t start;
+	};
+}
+
+#define GDA_TRACE_CONCAT2(a, b) a##b
+#define GDA_TRACE_CONCAT(a, b) GDA_TRACE_CONCAT2(a, b)
+
+#if defined(GDA_NO_TRACE)
+#define GDA_TRACE_SCOPE(stage, name) do{}while(false)
+#define GDA_TRACE_COUNT(stage, name, n) do{}while(false)
+#else
+#define GDA_TRACE_SCOPE(stage, name) \
+Gda::ScopedTrace GDA_TRACE_CONCAT(gda_trace_scope_, __LINE__)(stage, name)
+#define GDA_TRACE_COUNT(stage, name, n) do { if (Gda::Trace::IsEnabled()) \
+Gda::Trace::AddCount(stage, name, n); } while(false)
+#endif
+
+#endif
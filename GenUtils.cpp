@@ -27,6 +27,7 @@
 #include <wx/msgdlg.h>
 #include "DataViewer/TableState.h"
 #include "GdaConst.h"
+#include "GdaReduce.h"
 #include "logger.h"
 #include "GenUtils.h"
 
@@ -271,26 +272,24 @@ void SampleStatistics::CalculateFromSample(const std::vector<double>& data)
 {
 	sample_size = data.size();
 	if (sample_size == 0) return;
-
-	CalcMinMax(data, min, max);
-	mean = CalcMean(data);
 	
-	double n = sample_size;
-	double sum_squares = 0;
-	for (int i=0, iend = data.size(); i<iend; i++) {
-		sum_squares += data[i] * data[i];
-	}
+	Gda::ColumnSummary s;
+	Gda::Summarize(data, s);
+	CalculateFromSummary(s);
+}
+
+void SampleStatistics::CalculateFromSummary(const Gda::ColumnSummary& s)
+{
+	sample_size = s.n;
+	if (sample_size == 0) return;
 	
-	var_without_bessel = (sum_squares/n) - (mean*mean);
+	min = s.min;
+	max = s.max;
+	mean = s.mean;
+	var_without_bessel = s.Variance(false);
 	sd_without_bessel = sqrt(var_without_bessel);
-	
-	if (sample_size == 1) {
-		var_with_bessel = var_without_bessel;
-		sd_with_bessel = sd_without_bessel;
-	} else {
-		var_with_bessel = (n/(n-1)) * var_without_bessel;
-		sd_with_bessel = sqrt(var_with_bessel);
-	}
+	var_with_bessel = s.Variance(true);
+	sd_with_bessel = sqrt(var_with_bessel);
 }
 
 /** We assume that the data has been sorted in ascending order */
@@ -305,19 +304,21 @@ void SampleStatistics::CalculateFromSample(
 	mean = CalcMean(data);
 	
 	double n = sample_size;
-	double sum_squares = 0;
+	// sum of squared deviations rather than of squares: no cancellation
+	double sum_sq_dev = 0;
 	for (int i=0, iend = data.size(); i<iend; i++) {
-		sum_squares += data[i].first * data[i].first;
+		double d = data[i].first - mean;
+		sum_sq_dev += d * d;
 	}
 	
-	var_without_bessel = (sum_squares/n) - (mean*mean);
+	var_without_bessel = sum_sq_dev/n;
 	sd_without_bessel = sqrt(var_without_bessel);
 	
 	if (sample_size == 1) {
 		var_with_bessel = var_without_bessel;
 		sd_with_bessel = sd_without_bessel;
 	} else {
-		var_with_bessel = (n/(n-1)) * var_without_bessel;
+		var_with_bessel = sum_sq_dev/(n-1);
 		sd_with_bessel = sqrt(var_with_bessel);
 	}
 }
@@ -358,26 +359,14 @@ void SampleStatistics::CalcMinMax(const std::vector<double>& data,
 								  double& min, double& max)
 {
 	if (data.size() == 0) return;
-	min = data[0];
-	max = data[0];
-	for (int i=1, iend=data.size(); i<iend; i++) {
-		if ( data[i] < min ) {
-			min = data[i];
-		} else if ( data[i] > max ) {
-			max = data[i];
-		}
-	}
+	Gda::MinMax(&data[0], data.size(), min, max);
 }
 
 
 double SampleStatistics::CalcMean(const std::vector<double>& data)
 {
 	if (data.size() == 0) return 0;
-	double total = 0;
-	for (int i=0, iend=data.size(); i<iend; i++) {
-		total += data[i];
-	}
-	return total / (double) data.size();
+	return Gda::Sum(&data[0], data.size()) / (double) data.size();
 }
 
 double SampleStatistics::CalcMean(
@@ -725,34 +714,32 @@ wxString GenUtils::PtToStr(const wxRealPoint& p)
 void GenUtils::DeviationFromMean(int nObs, double* data)
 {
 	if (nObs == 0) return;
-	double sum = 0.0;
-	for (int i=0, iend=nObs; i<iend; i++) sum += data[i];
-	const double mean = sum / (double) nObs;
-	for (int i=0, iend=nObs; i<iend; i++) data[i] -= mean;
+	const double mean = Gda::Sum(data, nObs) / (double) nObs;
+	Gda::ShiftScale(data, nObs, mean, 1.0);
 }
 
 void GenUtils::DeviationFromMean(std::vector<double>& data)
 {
 	LOG_MSG("Entering GenUtils::DeviationFromMean");
 	if (data.size() == 0) return;
-	double sum = 0.0;
-	for (int i=0, iend=data.size(); i<iend; i++) sum += data[i];
-	const double mean = sum / (double) data.size();
-	LOG(mean);
-	for (int i=0, iend=data.size(); i<iend; i++) data[i] -= mean;
+	GenUtils::DeviationFromMean(data.size(), &data[0]);
 	LOG_MSG("Exiting GenUtils::DeviationFromMean");
 }
 
+// mean and standard deviation come from one read of the data, followed by
+// one pass that writes the standardized values
 bool GenUtils::StandardizeData(int nObs, double* data)
 {
 	if (nObs <= 1) return false;
-	GenUtils::DeviationFromMean(nObs, data);
-	double ssum = 0.0;
-	for (int i=0, iend=nObs; i<iend; i++) ssum += data[i] * data[i];
-	const double sd = sqrt(ssum / (double) (nObs-1.0));
+	Gda::ColumnSummary s;
+	Gda::Summarize(data, nObs, 0, s);
+	const double sd = s.StdDev(true);
 	LOG(sd);
-	if (sd == 0) return false;
-	for (int i=0, iend=nObs; i<iend; i++) data[i] /= sd;
+	if (sd == 0) {
+		Gda::ShiftScale(data, nObs, s.mean, 1.0);
+		return false;
+	}
+	Gda::ShiftScale(data, nObs, s.mean, 1.0/sd);
 	return true;
 }
 
@@ -760,15 +747,9 @@ bool GenUtils::StandardizeData(std::vector<double>& data)
 {
 	LOG_MSG("Entering GenUtils::StandardizeData");
 	if (data.size() <= 1) return false;
-	GenUtils::DeviationFromMean(data);
-	double ssum = 0.0;
-	for (int i=0, iend=data.size(); i<iend; i++) ssum += data[i] * data[i];
-	const double sd = sqrt(ssum / (double) (data.size()-1.0));
-	LOG(sd);
-	if (sd == 0) return false;
-	for (int i=0, iend=data.size(); i<iend; i++) data[i] /= sd;
+	bool r = GenUtils::StandardizeData(data.size(), &data[0]);
 	LOG_MSG("Exiting GenUtils::StandardizeData");
-	return true;
+	return r;
 }
 
 wxString GenUtils::swapExtension(const wxString& fname, const wxString& ext)
@@ -47,6 +47,8 @@ class wxDC;
 class TableState;
 
 namespace Gda {
+	struct ColumnSummary;
+	
 	/** Returns a uniformly distributed
 	 random unsigned 64-bit integer given a seed.  Has the property
 	 that seed, seed+1, seed+2, .... seed+n are good random numbers. This
@@ -214,6 +216,7 @@ struct SampleStatistics {
     sd_with_bessel(0), sd_without_bessel(0) {}
 	SampleStatistics(const std::vector<double>& data);
 	void CalculateFromSample(const std::vector<double>& data);
+	void CalculateFromSummary(const Gda::ColumnSummary& s);
 	void CalculateFromSample(const std::vector<Gda::dbl_int_pair_type>& data);
 	std::string ToString();
 	
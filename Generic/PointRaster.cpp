@@ -0,0 +1,238 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "../GdaParallel.h"
+#include "GdaShape.h"
+#include "PointRaster.h"
+
+namespace {
+	const int raster_min_chunk = 16384;
+	
+	struct PointBinTask {
+		PointBinTask(const std::vector<GdaShape*>& shps_, int margin_,
+					 int grid_w_, int grid_h_, std::vector<int>& pix_)
+		: shps(shps_), margin(margin_), grid_w(grid_w_), grid_h(grid_h_),
+		pix(pix_) {}
+		void operator()(int start, int end, int thread_id) {
+			for (int i=start; i<end; i++) {
+				pix[i] = -1;
+				GdaShape* s = shps[i];
+				if (!s || s->isNull()) continue;
+				int x = s->center.x + margin;
+				int y = s->center.y + margin;
+				if (x < 0 || y < 0 || x >= grid_w || y >= grid_h) continue;
+				pix[i] = y*grid_w + x;
+			}
+		}
+		const std::vector<GdaShape*>& shps;
+		int margin, grid_w, grid_h;
+		std::vector<int>& pix;
+	};
+	
+	struct SquareCellTask {
+		SquareCellTask(const std::vector<int>& pix_, std::vector<int>& cell_,
+					   int grid_w_, int margin_, int w_, int h_,
+					   int cell_size_, int cols_)
+		: pix(pix_), cell(cell_), grid_w(grid_w_), margin(margin_),
+		w(w_), h(h_), cell_size(cell_size_), cols(cols_) {}
+		void operator()(int start, int end, int thread_id) {
+			for (int i=start; i<end; i++) {
+				cell[i] = -1;
+				if (pix[i] < 0) continue;
+				int x = pix[i] % grid_w - margin;
+				int y = pix[i] / grid_w - margin;
+				if (x < 0 || y < 0 || x >= w || y >= h) continue;
+				cell[i] = (y/cell_size)*cols + x/cell_size;
+			}
+		}
+		const std::vector<int>& pix;
+		std::vector<int>& cell;
+		int grid_w, margin, w, h, cell_size, cols;
+	};
+	
+	struct HexCellTask {
+		HexCellTask(const std::vector<int>& pix_, std::vector<int>& cell_,
+					int grid_w_, int margin_, double radius_,
+					int cols_, int rows_)
+		: pix(pix_), cell(cell_), grid_w(grid_w_), margin(margin_),
+		radius(radius_), cols(cols_), rows(rows_) {}
+		void operator()(int start, int end, int thread_id) {
+			const double sqrt3 = sqrt(3.0);
+			for (int i=start; i<end; i++) {
+				cell[i] = -1;
+				if (pix[i] < 0) continue;
+				double px = pix[i] % grid_w - margin;
+				double py = pix[i] / grid_w - margin;
+				// fractional axial coordinates rounded in cube coordinates
+				double q = (sqrt3/3.0*px - py/3.0) / radius;
+				double r = (2.0/3.0*py) / radius;
+				double s = -q - r;
+				double rq = floor(q+0.5), rr = floor(r+0.5), rs = floor(s+0.5);
+				double dq = fabs(rq-q), dr = fabs(rr-r), ds = fabs(rs-s);
+				if (dq > dr && dq > ds) {
+					rq = -rr-rs;
+				} else if (dr > ds) {
+					rr = -rq-rs;
+				}
+				int row = (int) rr;
+				// odd rows are shifted right by half a hexagon; column 0
+				// is the partial column left of the canvas
+				int col = (int) rq + (row - (row&1))/2 + 1;
+				if (row < 0 || col < 0 || row >= rows || col >= cols) continue;
+				cell[i] = row*cols + col;
+			}
+		}
+		const std::vector<int>& pix;
+		std::vector<int>& cell;
+		int grid_w, margin;
+		double radius;
+		int cols, rows;
+	};
+	
+	struct CellCountTask {
+		CellCountTask(const std::vector<int>& cell_, int num_cells_,
+					  std::vector<std::vector<int> >& local_)
+		: cell(cell_), num_cells(num_cells_), local(local_) {}
+		void operator()(int start, int end, int thread_id) {
+			std::vector<int>& counts = local[thread_id];
+			counts.assign(num_cells, 0);
+			for (int i=start; i<end; i++) {
+				if (cell[i] >= 0) counts[cell[i]]++;
+			}
+		}
+		const std::vector<int>& cell;
+		int num_cells;
+		std::vector<std::vector<int> >& local;
+	};
+	
+	struct CellSumTask {
+		CellSumTask(std::vector<std::vector<int> >& local_,
+					std::vector<int>& counts_)
+		: local(local_), counts(counts_) {}
+		void operator()(int start, int end, int thread_id) {
+			for (int c=start; c<end; c++) {
+				int sum = 0;
+				for (size_t t=0; t<local.size(); t++) {
+					if (!local[t].empty()) sum += local[t][c];
+				}
+				counts[c] = sum;
+			}
+		}
+		std::vector<std::vector<int> >& local;
+		std::vector<int>& counts;
+	};
+}
+
+PointRaster::PointRaster()
+: w(0), h(0), margin(0), grid_w(0), grid_h(0), stamp_gen(0)
+{
+}
+
+void PointRaster::Bin(const std::vector<GdaShape*>& shps, int w_, int h_,
+					  int margin_)
+{
+	w = w_ > 0 ? w_ : 0;
+	h = h_ > 0 ? h_ : 0;
+	margin = margin_ > 0 ? margin_ : 0;
+	grid_w = w + 2*margin;
+	grid_h = h + 2*margin;
+	if ((int) stamp.size() != grid_w*grid_h) {
+		stamp.assign(grid_w*grid_h, 0);
+		stamp_gen = 0;
+	}
+	pix.resize(shps.size());
+	PointBinTask task(shps, margin, grid_w, grid_h, pix);
+	Gda::ParallelFor((int) pix.size(), task, -1, raster_min_chunk);
+}
+
+void PointRaster::Decimate(const int* ids, int n, std::vector<int>& kept)
+{
+	if (++stamp_gen == 0) {
+		// wrapped around: old marks could collide with the new generation
+		std::fill(stamp.begin(), stamp.end(), 0);
+		stamp_gen = 1;
+	}
+	for (int i=0; i<n; i++) {
+		int p = pix[ids[i]];
+		if (p < 0 || stamp[p] == stamp_gen) continue;
+		stamp[p] = stamp_gen;
+		kept.push_back(ids[i]);
+	}
+}
+
+void PointRaster::DecimateHighlighted(const std::vector<bool>& hs,
+									  std::vector<int>& kept)
+{
+	if (++stamp_gen == 0) {
+		std::fill(stamp.begin(), stamp.end(), 0);
+		stamp_gen = 1;
+	}
+	for (int i=0, iend=pix.size(); i<iend; i++) {
+		if (!hs[i]) continue;
+		int p = pix[i];
+		if (p < 0 || stamp[p] == stamp_gen) continue;
+		stamp[p] = stamp_gen;
+		kept.push_back(i);
+	}
+}
+
+void PointRaster::SquareCounts(int cell_size, int& cols, int& rows,
+							   std::vector<int>& counts)
+{
+	if (cell_size < 1) cell_size = 1;
+	cols = (w + cell_size - 1) / cell_size;
+	rows = (h + cell_size - 1) / cell_size;
+	cell.resize(pix.size());
+	SquareCellTask task(pix, cell, grid_w, margin, w, h, cell_size, cols);
+	Gda::ParallelFor((int) cell.size(), task, -1, raster_min_chunk);
+	CountCells(cols*rows, counts);
+}
+
+void PointRaster::HexCounts(double radius, int& cols, int& rows,
+							std::vector<int>& counts)
+{
+	if (radius < 1) radius = 1;
+	cols = (int) ceil(w / (sqrt(3.0)*radius)) + 2;
+	rows = (int) ceil(h / (1.5*radius)) + 1;
+	cell.resize(pix.size());
+	HexCellTask task(pix, cell, grid_w, margin, radius, cols, rows);
+	Gda::ParallelFor((int) cell.size(), task, -1, raster_min_chunk);
+	CountCells(cols*rows, counts);
+}
+
+wxPoint PointRaster::HexCenter(double radius, int col, int row)
+{
+	double x = sqrt(3.0)*radius*((col-1) + 0.5*(row&1));
+	double y = 1.5*radius*row;
+	return wxPoint((int) floor(x+0.5), (int) floor(y+0.5));
+}
+
+void PointRaster::CountCells(int num_cells, std::vector<int>& counts)
+{
+	counts.assign(num_cells, 0);
+	// one histogram per worker, then summed cell by cell
+	std::vector<std::vector<int> > local(Gda::GetNumWorkers());
+	CellCountTask count_task(cell, num_cells, local);
+	Gda::ParallelFor((int) cell.size(), count_task, (int) local.size(),
+					 raster_min_chunk);
+	CellSumTask sum_task(local, counts);
+	Gda::ParallelFor(num_cells, sum_task, (int) local.size(), raster_min_chunk);
+}
@@ -0,0 +1,86 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_POINT_RASTER_H__
+#define __GEODA_CENTER_POINT_RASTER_H__
+
+#include <vector>
+#include <wx/gdicmn.h>
+
+class GdaShape;
+
+/**
+ Bins the centers of selectable point shapes into the pixel grid of a
+ canvas so that large point layers can be drawn with one mark per occupied
+ pixel, or summarized as counts in square or hexagonal cells.  Binning
+ and counting are done in parallel with Gda::ParallelFor.  The shapes
+ themselves are never changed, so selection and hit-testing still work on
+ every observation.
+ 
+ The grid extends margin pixels past each side of the w by h canvas so
+ that marks whose center lies just outside the canvas are still drawn.
+ Centers further out are dropped.
+ */
+class PointRaster {
+public:
+	PointRaster();
+	
+	/** Bin the center of every non-null shape in shps. */
+	void Bin(const std::vector<GdaShape*>& shps, int w, int h, int margin);
+	
+	/** Append to kept the first of the n observations in ids for each
+	 occupied pixel, in the order of ids. */
+	void Decimate(const int* ids, int n, std::vector<int>& kept);
+	void Decimate(const std::vector<int>& ids, std::vector<int>& kept) {
+		if (!ids.empty()) Decimate(&ids[0], ids.size(), kept); }
+	/** Append to kept the first highlighted observation in each occupied
+	 pixel. */
+	void DecimateHighlighted(const std::vector<bool>& hs,
+							 std::vector<int>& kept);
+	
+	/** Number of points in each cell_size by cell_size square of the
+	 canvas.  counts is row-major over cols by rows cells, and cell (c, r)
+	 has its top-left corner at (c*cell_size, r*cell_size). */
+	void SquareCounts(int cell_size, int& cols, int& rows,
+					  std::vector<int>& counts);
+	/** Number of points in each pointy-top hexagon with the given center
+	 to corner radius.  counts is row-major over cols by rows cells, and
+	 HexCenter gives the center of cell (c, r). */
+	void HexCounts(double radius, int& cols, int& rows,
+				   std::vector<int>& counts);
+	static wxPoint HexCenter(double radius, int col, int row);
+	
+	int GetWidth() { return w; }
+	int GetHeight() { return h; }
+	int GetNumPoints() { return pix.size(); }
+	
+private:
+	void CountCells(int num_cells, std::vector<int>& counts);
+	
+	int w, h, margin, grid_w, grid_h;
+	/** Extended grid index of each observation, or -1 if not binned. */
+	std::vector<int> pix;
+	/** Cell of each observation for the current count, or -1. */
+	std::vector<int> cell;
+	/** Pixels marked by the last Decimate call hold stamp_gen. */
+	std::vector<unsigned int> stamp;
+	unsigned int stamp_gen;
+};
+
+#endif
@@ -0,0 +1,358 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <typeinfo>
+#include "../GdaParallel.h"
+#include "../ShapeOperations/ShpFile.h"
+#include "ScaleTransBatch.h"
+
+namespace {
+	const int shape_min_chunk = 64;
+	
+	/** Transform n points with x and y members, write them to out and
+	 return their bounding box. */
+	template <class P>
+	wxRect TransformPoints(const P* pts, int n, const GdaScaleTrans& A,
+						   wxPoint* out)
+	{
+		const double sx = A.scale_x, sy = A.scale_y;
+		const double tx = A.trans_x, ty = A.trans_y;
+		int xmin = INT_MAX, ymin = INT_MAX, xmax = INT_MIN, ymax = INT_MIN;
+		for (int i=0; i<n; i++) {
+			int x = (int) (pts[i].x * sx + tx);
+			int y = (int) (pts[i].y * sy + ty);
+			out[i].x = x;
+			out[i].y = y;
+			xmin = std::min(xmin, x);
+			xmax = std::max(xmax, x);
+			ymin = std::min(ymin, y);
+			ymax = std::max(ymax, y);
+		}
+		if (n == 0) return wxRect();
+		return wxRect(xmin, ymin, xmax-xmin+1, ymax-ymin+1);
+	}
+	
+	/** As TransformPoints, for coordinates held in separate x and y
+	 arrays. */
+	wxRect TransformFlat(const double* xs, const double* ys, int n,
+						 const GdaScaleTrans& A, wxPoint* out)
+	{
+		const double sx = A.scale_x, sy = A.scale_y;
+		const double tx = A.trans_x, ty = A.trans_y;
+		int xmin = INT_MAX, ymin = INT_MAX, xmax = INT_MIN, ymax = INT_MIN;
+		for (int i=0; i<n; i++) {
+			int x = (int) (xs[i] * sx + tx);
+			int y = (int) (ys[i] * sy + ty);
+			out[i].x = x;
+			out[i].y = y;
+			xmin = std::min(xmin, x);
+			xmax = std::max(xmax, x);
+			ymin = std::min(ymin, y);
+			ymax = std::max(ymax, y);
+		}
+		if (n == 0) return wxRect();
+		return wxRect(xmin, ymin, xmax-xmin+1, ymax-ymin+1);
+	}
+	
+	template <class P>
+	void GatherPoints(const P* pts, int n, double* xs, double* ys)
+	{
+		for (int i=0; i<n; i++) {
+			xs[i] = pts[i].x;
+			ys[i] = pts[i].y;
+		}
+	}
+	
+	/** A polygon projects to a single point exactly when its screen box
+	 is one pixel at its screen center. */
+	bool AllPointsSame(const wxRect& bb, const wxPoint& center)
+	{
+		return (bb.width <= 1 && bb.height <= 1 &&
+				bb.x == center.x && bb.y == center.y);
+	}
+}
+
+struct ScaleTransTask {
+	enum Mode { apply_mode, gather_mode, transform_mode, copy_mode };
+	ScaleTransTask(ScaleTransBatch& b_, Mode mode_, int gen_ = 0)
+	: b(b_), mode(mode_), gen(gen_) {}
+	void operator()(int start, int end, int thread_id) {
+		if (mode == apply_mode) {
+			b.ApplyRange(start, end);
+		} else if (mode == gather_mode) {
+			b.GatherRange(start, end);
+		} else if (mode == transform_mode) {
+			b.TransformRange(start, end, gen);
+		} else {
+			b.CopyRange(start, end);
+		}
+	}
+	ScaleTransBatch& b;
+	Mode mode;
+	int gen;
+};
+
+struct ScaleTransJob {
+	ScaleTransJob(ScaleTransBatch* b_, int gen_) : b(b_), gen(gen_) {}
+	void operator()() { b->Run(gen); }
+	ScaleTransBatch* b;
+	int gen;
+};
+
+ScaleTransBatch::ScaleTransBatch() : job(0), generation(0), done(false)
+{
+}
+
+ScaleTransBatch::~ScaleTransBatch()
+{
+	Cancel();
+}
+
+void ScaleTransBatch::Classify(const std::vector<GdaShape*>& shps_s)
+{
+	shps = shps_s;
+	int n = shps.size();
+	kind.resize(n);
+	v_start.resize(n+1);
+	bounds.resize(n);
+	int nv = 0;
+	for (int k=0; k<n; k++) {
+		v_start[k] = nv;
+		GdaShape* s = shps[k];
+		if (!s || s->isNull()) {
+			kind[k] = null_kind;
+		} else if (typeid(*s) == typeid(GdaPolygon)) {
+			kind[k] = polygon_kind;
+			nv += ((GdaPolygon*) s)->n;
+		} else if (typeid(*s) == typeid(GdaPolyLine)) {
+			kind[k] = polyline_kind;
+			nv += ((GdaPolyLine*) s)->n;
+		} else if (typeid(*s) == typeid(GdaPoint)) {
+			kind[k] = point_kind;
+		} else {
+			// subclasses may override applyScaleTrans
+			kind[k] = other_kind;
+		}
+	}
+	v_start[n] = nv;
+}
+
+void ScaleTransBatch::ApplyRange(int start, int end)
+{
+	const GdaScaleTrans& A = trans;
+	for (int k=start; k<end; k++) {
+		GdaShape* s = shps[k];
+		if (kind[k] == null_kind || kind[k] == other_kind) {
+			bounds[k] = wxRect();
+			continue;
+		}
+		A.transform(s->center_o, &s->center);
+		if (kind[k] == point_kind) {
+			bounds[k] = wxRect(s->center.x, s->center.y, 1, 1);
+		} else if (kind[k] == polygon_kind) {
+			GdaPolygon* p = (GdaPolygon*) s;
+			if (p->points_o) {
+				bounds[k] = TransformPoints(p->points_o, p->n, A, p->points);
+			} else {
+				bounds[k] = TransformPoints(&p->pc->points[0], p->n, A,
+											p->points);
+			}
+			p->all_points_same = AllPointsSame(bounds[k], p->center);
+		} else {
+			GdaPolyLine* p = (GdaPolyLine*) s;
+			if (p->points_o) {
+				bounds[k] = TransformPoints(p->points_o, p->n, A, p->points);
+			} else {
+				bounds[k] = TransformPoints(&p->pc->points[0], p->n, A,
+											p->points);
+			}
+		}
+	}
+}
+
+void ScaleTransBatch::GatherRange(int start, int end)
+{
+	for (int k=start; k<end; k++) {
+		GdaShape* s = shps[k];
+		if (kind[k] == null_kind || kind[k] == other_kind) continue;
+		cxs[k] = s->center_o.x;
+		cys[k] = s->center_o.y;
+		int v = v_start[k];
+		if (kind[k] == polygon_kind) {
+			GdaPolygon* p = (GdaPolygon*) s;
+			if (p->points_o) {
+				GatherPoints(p->points_o, p->n, &xs[v], &ys[v]);
+			} else {
+				GatherPoints(&p->pc->points[0], p->n, &xs[v], &ys[v]);
+			}
+		} else if (kind[k] == polyline_kind) {
+			GdaPolyLine* p = (GdaPolyLine*) s;
+			if (p->points_o) {
+				GatherPoints(p->points_o, p->n, &xs[v], &ys[v]);
+			} else {
+				GatherPoints(&p->pc->points[0], p->n, &xs[v], &ys[v]);
+			}
+		}
+	}
+}
+
+bool ScaleTransBatch::TransformRange(int start, int end, int gen)
+{
+	const GdaScaleTrans& A = trans;
+	int since_check = 0;
+	for (int k=start; k<end; k++) {
+		if (kind[k] == null_kind || kind[k] == other_kind) {
+			bounds[k] = wxRect();
+			continue;
+		}
+		A.transform(wxRealPoint(cxs[k], cys[k]), &scr_c[k]);
+		int v = v_start[k];
+		int nv = v_start[k+1] - v;
+		if (kind[k] == point_kind) {
+			bounds[k] = wxRect(scr_c[k].x, scr_c[k].y, 1, 1);
+		} else {
+			bounds[k] = TransformFlat(&xs[v], &ys[v], nv, A, &scr[v]);
+		}
+		since_check += nv + 1;
+		if (since_check >= block_size) {
+			if (!IsCurrent(gen)) return false;
+			since_check = 0;
+		}
+	}
+	return true;
+}
+
+void ScaleTransBatch::CopyRange(int start, int end)
+{
+	for (int k=start; k<end; k++) {
+		GdaShape* s = shps[k];
+		if (kind[k] == null_kind || kind[k] == other_kind) continue;
+		s->center = scr_c[k];
+		int v = v_start[k];
+		if (kind[k] == polygon_kind) {
+			GdaPolygon* p = (GdaPolygon*) s;
+			std::copy(scr.begin()+v, scr.begin()+v+p->n, p->points);
+			p->all_points_same = AllPointsSame(bounds[k], p->center);
+		} else if (kind[k] == polyline_kind) {
+			GdaPolyLine* p = (GdaPolyLine*) s;
+			std::copy(scr.begin()+v, scr.begin()+v+p->n, p->points);
+		}
+	}
+}
+
+void ScaleTransBatch::ApplyOthers()
+{
+	for (size_t k=0; k<shps.size(); k++) {
+		if (kind[k] == other_kind) shps[k]->applyScaleTrans(trans);
+	}
+}
+
+void ScaleTransBatch::Apply(const std::vector<GdaShape*>& shps_s,
+							const GdaScaleTrans& A)
+{
+	Cancel();
+	Classify(shps_s);
+	trans = A;
+	ScaleTransTask task(*this, ScaleTransTask::apply_mode);
+	Gda::ParallelFor((int) shps.size(), task, -1, shape_min_chunk);
+	ApplyOthers();
+}
+
+bool ScaleTransBatch::Start(const std::vector<GdaShape*>& shps_s,
+							const GdaScaleTrans& A)
+{
+	Cancel();
+	Classify(shps_s);
+	trans = A;
+	if (v_start.back() < async_min_vertices) {
+		ScaleTransTask task(*this, ScaleTransTask::apply_mode);
+		Gda::ParallelFor((int) shps.size(), task, -1, shape_min_chunk);
+		ApplyOthers();
+		return false;
+	}
+	// the background thread only sees copies of the coordinates
+	int n = shps.size();
+	xs.resize(v_start[n]);
+	ys.resize(v_start[n]);
+	scr.resize(v_start[n]);
+	cxs.resize(n);
+	cys.resize(n);
+	scr_c.resize(n);
+	ScaleTransTask task(*this, ScaleTransTask::gather_mode);
+	Gda::ParallelFor(n, task, -1, shape_min_chunk);
+	int gen;
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		gen = generation;
+		done = false;
+	}
+	job = new boost::thread(ScaleTransJob(this, gen));
+	return true;
+}
+
+void ScaleTransBatch::Run(int gen)
+{
+	ScaleTransTask task(*this, ScaleTransTask::transform_mode, gen);
+	Gda::ParallelFor((int) shps.size(), task, -1, shape_min_chunk);
+	boost::mutex::scoped_lock lock(mutex);
+	if (gen == generation) done = true;
+}
+
+bool ScaleTransBatch::IsCurrent(int gen)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return gen == generation;
+}
+
+bool ScaleTransBatch::IsDone()
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return job != 0 && done;
+}
+
+bool ScaleTransBatch::Commit(const std::vector<GdaShape*>& shps_s)
+{
+	if (!job) return false;
+	if (shps_s.size() != shps.size()) {
+		Cancel();
+		return false;
+	}
+	job->join();
+	delete job;
+	job = 0;
+	ScaleTransTask task(*this, ScaleTransTask::copy_mode);
+	Gda::ParallelFor((int) shps.size(), task, -1, shape_min_chunk);
+	ApplyOthers();
+	return true;
+}
+
+void ScaleTransBatch::Cancel()
+{
+	if (!job) return;
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		generation++;
+		done = false;
+	}
+	job->join();
+	delete job;
+	job = 0;
+}
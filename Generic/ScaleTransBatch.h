@@ -0,0 +1,117 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_SCALE_TRANS_BATCH_H__
+#define __GEODA_CENTER_SCALE_TRANS_BATCH_H__
+
+#include <vector>
+#include <boost/thread.hpp>
+#include <wx/gdicmn.h>
+#include "GdaShape.h"
+
+/**
+ Applies a GdaScaleTrans to all selectable shapes of a canvas in one
+ batch instead of one virtual applyScaleTrans call per shape.  Polygons,
+ polylines and points are transformed in parallel with Gda::ParallelFor.
+ Each pass writes the integer screen vertices and the screen bounding box
+ of every shape.  The inner loops run over contiguous arrays of double
+ coordinates with no calls, so the compiler can vectorize them.  Circles,
+ text and other shapes are still transformed with applyScaleTrans.
+ 
+ Apply transforms the shapes in place.  Start copies the original
+ coordinates into flat x and y arrays and transforms those on a background
+ thread, so the shapes are only touched again when the result is picked
+ up with Commit.  The shapes must not be deleted or replaced while a
+ transform is pending; the owner calls Cancel first.  Starting another
+ transform, or calling Cancel, supersedes the one in progress: workers
+ check the generation every block_size vertices and stop early once it
+ has changed.  Apply, Start, Commit and Cancel must all be called from the
+ thread that owns the shapes.
+ */
+class ScaleTransBatch {
+public:
+	ScaleTransBatch();
+	virtual ~ScaleTransBatch();
+	
+	/** Transform every shape in shps before returning. */
+	void Apply(const std::vector<GdaShape*>& shps, const GdaScaleTrans& A);
+	/** Begin transforming shps on a background thread.  When shps has
+	 fewer than async_min_vertices polygon and polyline vertices the shapes
+	 are transformed in place as with Apply and false is returned. */
+	bool Start(const std::vector<GdaShape*>& shps, const GdaScaleTrans& A);
+	/** True between a successful Start and the matching Commit or Cancel. */
+	bool IsPending() { return job != 0; }
+	/** True when the pending transform has finished. */
+	bool IsDone();
+	/** Wait for the pending transform, then write its results into shps,
+	 which must still hold the shapes given to Start: call Cancel before
+	 any of them are deleted or replaced.  Returns false, leaving shps
+	 unchanged, if nothing was pending or shps has a different size. */
+	bool Commit(const std::vector<GdaShape*>& shps);
+	/** Stop the pending transform, if any, without changing any shapes. */
+	void Cancel();
+	
+	/** Screen bounding box of shps[k] after the last Apply or Commit.  Null
+	 shapes and shapes that are not polygons, polylines or points have an
+	 empty box. */
+	const wxRect& GetBounds(int k) { return bounds[k]; }
+	
+	/** Vertices transformed between generation checks. */
+	static const int block_size = 16384;
+	/** Fewest vertices for which Start uses a background thread. */
+	static const int async_min_vertices = 200000;
+	
+private:
+	enum ShapeKind { null_kind, other_kind, point_kind, polygon_kind,
+		polyline_kind };
+	
+	void Classify(const std::vector<GdaShape*>& shps);
+	void ApplyRange(int start, int end);
+	void GatherRange(int start, int end);
+	bool TransformRange(int start, int end, int gen);
+	void CopyRange(int start, int end);
+	void ApplyOthers();
+	void Run(int gen);
+	bool IsCurrent(int gen);
+	
+	std::vector<GdaShape*> shps;
+	std::vector<char> kind;
+	/** Vertices of shps[k] are [v_start[k], v_start[k+1]). */
+	std::vector<int> v_start;
+	/** Original coordinates gathered by Start. */
+	std::vector<double> xs;
+	std::vector<double> ys;
+	std::vector<double> cxs;
+	std::vector<double> cys;
+	/** Screen coordinates computed by the background transform. */
+	std::vector<wxPoint> scr;
+	std::vector<wxPoint> scr_c;
+	std::vector<wxRect> bounds;
+	
+	GdaScaleTrans trans;
+	boost::thread* job;
+	boost::mutex mutex;
+	int generation;
+	bool done;
+	
+	friend struct ScaleTransTask;
+	friend struct ScaleTransJob;
+};
+
+#endif
@@ -18,6 +18,7 @@
  */
 
 #undef check // undefine needed for Xcode compilation and Boost.Geometry
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -120,6 +121,8 @@
 #include "GdaException.h"
 #include "FramesManager.h"
 #include "GdaConst.h"
+#include "GdaTrace.h"
+#include "GdaBenchmark.h"
 #include "GeneralWxUtils.h"
 #include "GenUtils.h"
 #include "logger.h"
@@ -146,7 +149,7 @@ const int ID_TEST_MAP_FRAME = wxID_HIGHEST + 10;
 
 IMPLEMENT_APP(GdaApp)
 
-GdaApp::GdaApp() : checker(0), server(0)
+GdaApp::GdaApp() : cmd_line_benchmark_scale(0), checker(0), server(0)
 {
 	LOG_MSG("Entering GdaApp::GdaApp");
 	//Don't call wxHandleFatalExceptions so that a core dump file will be
@@ -168,6 +171,22 @@ bool GdaApp::OnInit(void)
 
 	if (!wxApp::OnInit()) return false;
 	
+	// Setting GEODA_TRACE to a file name turns on per-stage timing.  The
+	// trace is written there in Chrome trace format on exit, along with a
+	// summary table in the same file name with .txt appended.
+	wxString trace_file;
+	if (wxGetEnv("GEODA_TRACE", &trace_file) && !trace_file.IsEmpty()) {
+		Gda::Trace::SetEnabled(true);
+	}
+	
+	if (!cmd_line_benchmark_file.IsEmpty()) {
+		// Headless: OnRun runs the benchmark suite instead of the main
+		// loop, and no frame or single-instance server is created.
+		setlocale(LC_ALL, "C");
+		GdaConst::init();
+		return true;
+	}
+	
 	if (!GeneralWxUtils::isMac()) {
 		// GeoDa operates in single-instance mode.  This means that for
 		// a given user, only one instance of GeoDa will remain open
@@ -332,10 +351,47 @@ bool GdaApp::OnInit(void)
 	return true;
 }
 
+int GdaApp::OnRun(void)
+{
+	if (cmd_line_benchmark_file.IsEmpty()) return wxApp::OnRun();
+	return RunBenchmark() ? 0 : 1;
+}
+
+/** Run the benchmark suite requested on the command line and write its
+ timings as JSON.  See GdaBenchmark.h for what is timed. */
+bool GdaApp::RunBenchmark()
+{
+	LOG_MSG("Entering GdaApp::RunBenchmark");
+	Gda::Benchmark::Options opt;
+	if (cmd_line_benchmark_scale > 0) {
+		opt.max_scale = GenUtils::min<int>(cmd_line_benchmark_scale, 7);
+		opt.min_scale = GenUtils::min<int>(opt.min_scale, opt.max_scale);
+	}
+	std::vector<Gda::Benchmark::Timing> timings;
+	std::string err_msg;
+	bool ok = Gda::Benchmark::Run(opt, timings, err_msg);
+	if (!ok) std::cerr << "Benchmark failed: " << err_msg << std::endl;
+	std::string fname(cmd_line_benchmark_file.mb_str());
+	if (!Gda::Benchmark::WriteJson(fname, opt, timings)) {
+		std::cerr << "Could not write " << fname << std::endl;
+		ok = false;
+	}
+	LOG_MSG("Exiting GdaApp::RunBenchmark");
+	return ok;
+}
+
 int GdaApp::OnExit(void)
 {
 	LOG_MSG("In GdaApp::OnExit");
 	if (checker) delete checker;
+	wxString trace_file;
+	if (Gda::Trace::IsEnabled() && wxGetEnv("GEODA_TRACE", &trace_file)) {
+		Gda::Trace::SetEnabled(false);
+		std::string fname(trace_file.mb_str());
+		Gda::Trace::WriteChromeTrace(fname);
+		std::ofstream out((fname + ".txt").c_str());
+		out << Gda::Trace::GetSummaryTable();
+	}
 	return 0;
 }
 
@@ -351,6 +407,12 @@ const wxCmdLineEntryDesc GdaApp::globalCmdLineDesc [] =
 	{ wxCMD_LINE_SWITCH, "h", "help",
 		"displays help on the command line parameters",
 		wxCMD_LINE_VAL_NONE, wxCMD_LINE_OPTION_HELP },
+	{ wxCMD_LINE_OPTION, NULL, "benchmark",
+		"run the benchmark suite and write the timings to this JSON file",
+		wxCMD_LINE_VAL_STRING, 0 },
+	{ wxCMD_LINE_OPTION, NULL, "benchmark-scale",
+		"largest benchmark layer as a power of ten, 3 to 7 (default 5)",
+		wxCMD_LINE_VAL_NUMBER, 0 },
 	{ wxCMD_LINE_PARAM, NULL, NULL, "project file",
 		wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL },
 	{ wxCMD_LINE_NONE }
@@ -378,6 +440,9 @@ bool GdaApp::OnCmdLineParsed(wxCmdLineParser& parser)
 	}
 	LOG_MSG(cmd_line_proj_file_name);
 	
+	parser.Found("benchmark", &cmd_line_benchmark_file);
+	parser.Found("benchmark-scale", &cmd_line_benchmark_scale);
+	
 	return true;
 }
 
@@ -432,6 +497,9 @@ EVT_MENU(XRCID("ID_FIXED_ASPECT_RATIO_MODE"),
 		 GdaFrame::OnFixedAspectRatioMode)
 EVT_MENU(XRCID("ID_ZOOM_MODE"), GdaFrame::OnZoomMode)
 EVT_MENU(XRCID("ID_PAN_MODE"), GdaFrame::OnPanMode)
+EVT_MENU(XRCID("ID_POINT_RENDER_MARKS"), GdaFrame::OnPointRenderMarks)
+EVT_MENU(XRCID("ID_POINT_RENDER_DENSITY"), GdaFrame::OnPointRenderDensity)
+EVT_MENU(XRCID("ID_POINT_RENDER_HEXBIN"), GdaFrame::OnPointRenderHexbin)
 // Print Canvas State to Log File.  Used for debugging.
 EVT_MENU(XRCID("ID_PRINT_CANVAS_STATE"), GdaFrame::OnPrintCanvasState)
 
@@ -644,6 +712,7 @@ EVT_MENU(XRCID("ID_SELECT_CORES_AND_NEIGHBORS"),
 
 EVT_MENU(XRCID("ID_MAP_ADDMEANCENTERS"), GdaFrame::OnAddMeanCenters)
 EVT_MENU(XRCID("ID_MAP_ADDCENTROIDS"), GdaFrame::OnAddCentroids)
+EVT_MENU(XRCID("ID_MAP_ADDAREAPERIM"), GdaFrame::OnAddAreasPerimeters)
 EVT_MENU(XRCID("ID_DISPLAY_MEAN_CENTERS"), GdaFrame::OnDisplayMeanCenters)
 EVT_MENU(XRCID("ID_DISPLAY_CENTROIDS"), GdaFrame::OnDisplayCentroids)
 EVT_MENU(XRCID("ID_DISPLAY_VORONOI_DIAGRAM"),
@@ -1014,6 +1083,7 @@ EVT_MENU(XRCID("ID_VIEW_REGRESSION_SELECTED"),
 EVT_MENU(XRCID("ID_VIEW_REGRESSION_SELECTED_EXCLUDED"),
 		 GdaFrame::OnViewRegressionSelectedExcluded)
 EVT_MENU(XRCID("ID_DISPLAY_STATISTICS"), GdaFrame::OnDisplayStatistics)
+EVT_MENU(XRCID("ID_PCP_LINE_DENSITY"), GdaFrame::OnPCPLineDensity)
 EVT_MENU(XRCID("ID_SHOW_AXES_THROUGH_ORIGIN"),
 		 GdaFrame::OnShowAxesThroughOrigin)
 EVT_MENU(XRCID("ID_DISPLAY_AXES_SCALE_VALUES"),
@@ -1905,6 +1975,27 @@ void GdaFrame::OnSelectionMode(wxCommandEvent& event)
 	t->OnSelectionMode(event);
 }
 
+void GdaFrame::OnPointRenderMarks(wxCommandEvent& event)
+{
+	TemplateFrame* t = TemplateFrame::GetActiveFrame();
+	if (!t) return;
+	t->OnPointRenderMarks(event);
+}
+
+void GdaFrame::OnPointRenderDensity(wxCommandEvent& event)
+{
+	TemplateFrame* t = TemplateFrame::GetActiveFrame();
+	if (!t) return;
+	t->OnPointRenderDensity(event);
+}
+
+void GdaFrame::OnPointRenderHexbin(wxCommandEvent& event)
+{
+	TemplateFrame* t = TemplateFrame::GetActiveFrame();
+	if (!t) return;
+	t->OnPointRenderHexbin(event);
+}
+
 void GdaFrame::OnFitToWindowMode(wxCommandEvent& event)
 {
 	TemplateFrame* t = TemplateFrame::GetActiveFrame();
@@ -4196,6 +4287,15 @@ void GdaFrame::OnAddCentroids(wxCommandEvent& event)
 	}
 }
 
+void GdaFrame::OnAddAreasPerimeters(wxCommandEvent& event)
+{
+	TemplateFrame* t = TemplateFrame::GetActiveFrame();
+	if (!t) return;
+	if (MapNewFrame* f = dynamic_cast<MapNewFrame*>(t)) {
+		f->GetProject()->AddAreasPerimeters();
+	}
+}
+
 void GdaFrame::OnDisplayMeanCenters(wxCommandEvent& event)
 {
 	TemplateFrame* t = TemplateFrame::GetActiveFrame();
@@ -4346,6 +4446,15 @@ void GdaFrame::OnViewOriginalData(wxCommandEvent& event)
 	}
 }
 
+void GdaFrame::OnPCPLineDensity(wxCommandEvent& event)
+{
+	TemplateFrame* t = TemplateFrame::GetActiveFrame();
+	if (!t) return;
+	if (PCPNewFrame* f = dynamic_cast<PCPNewFrame*>(t)) {
+		f->OnLineDensity(event);
+	}
+}
+
 void GdaFrame::OnViewRegimesRegression(wxCommandEvent& event)
 {
 	TemplateFrame* t = TemplateFrame::GetActiveFrame();
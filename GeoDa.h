@@ -52,6 +52,7 @@ public:
 	GdaApp();
 	virtual ~GdaApp();
 	virtual bool OnInit(void);
+	virtual int OnRun(void);
 	virtual int OnExit(void);
 	virtual void OnFatalException(void);
 	virtual void OnInitCmdLine(wxCmdLineParser& parser);
@@ -60,7 +61,11 @@ public:
 
 	static const wxCmdLineEntryDesc globalCmdLineDesc[];
 private:
+	bool RunBenchmark();
+	
 	wxString cmd_line_proj_file_name;
+	wxString cmd_line_benchmark_file;
+	long cmd_line_benchmark_scale;
 	wxSingleInstanceChecker* checker;
 	GdaServer* server;
 };
@@ -104,6 +109,9 @@ public:
 	void OnFixedAspectRatioMode(wxCommandEvent& event);
 	void OnZoomMode(wxCommandEvent& event);
 	void OnPanMode(wxCommandEvent& event);
+	void OnPointRenderMarks(wxCommandEvent& event);
+	void OnPointRenderDensity(wxCommandEvent& event);
+	void OnPointRenderHexbin(wxCommandEvent& event);
 	void OnPrintCanvasState(wxCommandEvent& event);
 	
 	void OnSaveCanvasImageAs(wxCommandEvent& event);
@@ -508,6 +516,7 @@ public:
 	
 	void OnAddMeanCenters(wxCommandEvent& event);
 	void OnAddCentroids(wxCommandEvent& event);
+	void OnAddAreasPerimeters(wxCommandEvent& event);
 	void OnDisplayMeanCenters(wxCommandEvent& event);
 	void OnDisplayCentroids(wxCommandEvent& event);
 	void OnDisplayVoronoiDiagram(wxCommandEvent& event);
@@ -519,6 +528,8 @@ public:
 	// ScatterPlot and PCP specific callbacks
 	void OnViewStandardizedData(wxCommandEvent& event);
 	void OnViewOriginalData(wxCommandEvent& event);
+	// PCP specific callbacks
+	void OnPCPLineDensity(wxCommandEvent& event);
 	// ScatterPlot specific callbacks
 	void OnViewRegimesRegression(wxCommandEvent& event);
 	void OnViewRegressionSelectedExcluded(wxCommandEvent& event);
@@ -18,6 +18,7 @@
  */
 
 #include <assert.h>
+#include <cmath>
 #include <list>
 #include <set>
 #include <sstream>
@@ -39,6 +40,7 @@
 #include "DefaultVarsPtree.h"
 #include "DataViewer/CustomClassifPtree.h"
 #include "DataViewer/OGRTable.h"
+#include "DataViewer/SortedColCache.h"
 #include "DataViewer/DbfTable.h"
 #include "DataViewer/TableBase.h"
 #include "DataViewer/TableFrame.h"
@@ -51,8 +53,10 @@
 #include "Explore/CatClassification.h"
 #include "Explore/CatClassifManager.h"
 #include "Generic/GdaShape.h"
+#include "ShapeOperations/CsrWeight.h"
 #include "ShapeOperations/DbfFile.h"
 #include "ShapeOperations/GalWeight.h"
+#include "ShapeOperations/GeomMeasures.h"
 #include "ShapeOperations/ShapeUtils.h"
 #include "ShapeOperations/shp2cnt.h" // only needed for IsLineShapeFile
 #include "ShapeOperations/VoronoiUtils.h"
@@ -67,8 +71,11 @@ i_array_type Project::shared_category_scratch; // used by TemplateCanvas
 Project::Project(const wxString& proj_fname)
 : is_project_valid(false),
 table_int(0), table_state(0), time_state(0), w_manager(0), save_manager(0),
+sorted_col_cache(0),
 frames_manager(0),cat_classif_manager(0), mean_centers(0), centroids(0),
-voronoi_rook_nbr_gal(0), default_var_name(4), default_var_time(4),
+geom_measures(0), geom_measures_saved(false),
+voronoi_rook_nbr_gal(0), voronoi_rook_nbrs(0), voronoi_queen_nbrs(0),
+default_var_name(4), default_var_time(4),
 point_duplicates_initialized(false), point_dups_warn_prev_displayed(false),
 num_records(0), layer_proxy(NULL)
 {
@@ -116,8 +123,11 @@ Project::Project(const wxString& proj_title,
                  IDataSource* p_datasource)
 : is_project_valid(false),
 table_int(0), table_state(0), time_state(0), w_manager(0), save_manager(0),
+sorted_col_cache(0),
 frames_manager(0),cat_classif_manager(0), mean_centers(0), centroids(0),
-voronoi_rook_nbr_gal(0), default_var_name(4), default_var_time(4),
+geom_measures(0), geom_measures_saved(false),
+voronoi_rook_nbr_gal(0), voronoi_rook_nbrs(0), voronoi_queen_nbrs(0),
+default_var_name(4), default_var_time(4),
 point_duplicates_initialized(false), point_dups_warn_prev_displayed(false),
 num_records(0), layer_proxy(NULL)
 {
@@ -171,10 +181,14 @@ Project::~Project()
     if (project_conf) delete project_conf;
 	datasource = 0;
 	if (cat_classif_manager) delete cat_classif_manager; cat_classif_manager=0;
+	if (sorted_col_cache) delete sorted_col_cache; sorted_col_cache=0;
 	if (w_manager) delete w_manager; w_manager = 0;
 	for (size_t i=0, iend=mean_centers.size(); i<iend; i++) delete mean_centers[i];
 	for (size_t i=0, iend=centroids.size(); i<iend; i++) delete centroids[i];
+	if (geom_measures) delete geom_measures; geom_measures = 0;
 	if (voronoi_rook_nbr_gal) delete [] voronoi_rook_nbr_gal;
+	if (voronoi_rook_nbrs) delete voronoi_rook_nbrs;
+	if (voronoi_queen_nbrs) delete voronoi_queen_nbrs;
 
 	OGRDataAdapter::GetInstance().Close();
 	
@@ -210,6 +224,7 @@ void Project::SetProjectFullPath(const wxString& proj_full_path)
     wxFileName temp(proj_full_path);
 	SetWorkingDir(proj_full_path);
     proj_file_no_ext = temp.GetName();
+	geom_measures_saved = false;
 	LOG_MSG("Exiting Project::SetProjectFullPath");
 }
 
@@ -395,10 +410,9 @@ void Project::SaveDataSourceAs(const wxString& new_ds_name, bool is_update)
             selected_rows.push_back(i);
         }
         
-        vector<OGRGeometry*> ogr_geometries;
 		OGRwkbGeometryType geom_type =
-			OGRDataAdapter::GetInstance().MakeOGRGeometries(
-				geometries, shape_type, ogr_geometries, selected_rows);
+			OGRDataAdapter::GetInstance().GetOGRGeometryType(
+				geometries, shape_type, selected_rows);
        
         // Start saving
         int prog_n_max = 0;
@@ -410,10 +424,15 @@ void Project::SaveDataSourceAs(const wxString& new_ds_name, bool is_update)
         OGRLayerProxy* new_layer =
         OGRDataAdapter::GetInstance().ExportDataSource(ds_format.ToStdString(),
 			new_ds_name.ToStdString(), layername.ToStdString(), geom_type,
-			ogr_geometries, table_int, selected_rows, spatial_ref, is_update);
+			geometries, shape_type, table_int, selected_rows, spatial_ref,
+			is_update);
         bool cont = true;
         while ( new_layer->export_progress < prog_n_max ) {
-            cont = prog_dlg.Update(new_layer->export_progress);
+            wxString prog_msg = "Saving data...";
+            if (new_layer->export_rate > 0)
+                prog_msg << wxString::Format(" (%.0f records/s)",
+                                             new_layer->export_rate);
+            cont = prog_dlg.Update(new_layer->export_progress, prog_msg);
             if ( !cont ) {
                 new_layer->stop_exporting = true;
                 OGRDataAdapter::GetInstance().CancelExport(new_layer);
@@ -457,6 +476,7 @@ void Project::SaveProjectConf()
 	}
 	UpdateProjectConf();
 	project_conf->Save(project_conf->GetFilePath());
+	SaveGeomMeasures();
 }
 
 void Project::SaveDataSourceData()
@@ -606,30 +626,54 @@ void Project::DisplayPointDupsWarning()
 	point_dups_warn_prev_displayed = true;
 }
 
-void Project::GetVoronoiRookNeighborMap(std::vector<std::set<int> >& nbr_map)
+void Project::InitVoronoiNeighbors()
 {
+	if (voronoi_rook_nbrs && voronoi_queen_nbrs) return;
 	IsPointDuplicates();
 	std::vector<double> x;
 	std::vector<double> y;
 	GetCenters(x, y);
-	Gda::VoronoiUtils::PointsToContiguity(x, y, false, nbr_map);
+	CsrWeight* queen = voronoi_queen_nbrs ? 0 : new CsrWeight;
+	CsrWeight* rook = voronoi_rook_nbrs ? 0 : new CsrWeight;
+	Gda::VoronoiUtils::PointsToContiguity(x, y, queen, rook);
+	if (queen) voronoi_queen_nbrs = queen;
+	if (rook) voronoi_rook_nbrs = rook;
 }
 
-void Project::GetVoronoiQueenNeighborMap(std::vector<std::set<int> >& nbr_map)
+bool Project::HasVoronoiNeighbors(bool queen)
 {
-	IsPointDuplicates();
-	std::vector<double> x;
-	std::vector<double> y;
-	GetCenters(x, y);
-	Gda::VoronoiUtils::PointsToContiguity(x, y, true, nbr_map);
+	return (queen ? voronoi_queen_nbrs : voronoi_rook_nbrs) != 0;
+}
+
+void Project::SetVoronoiNeighbors(const CsrWeight& queen,
+								  const CsrWeight& rook)
+{
+	if (!voronoi_queen_nbrs && queen.GetNumObs() > 0) {
+		voronoi_queen_nbrs = new CsrWeight(queen);
+	}
+	if (!voronoi_rook_nbrs && rook.GetNumObs() > 0) {
+		voronoi_rook_nbrs = new CsrWeight(rook);
+	}
+}
+
+void Project::GetVoronoiRookNeighbors(CsrWeight& w)
+{
+	InitVoronoiNeighbors();
+	w = *voronoi_rook_nbrs;
+}
+
+void Project::GetVoronoiQueenNeighbors(CsrWeight& w)
+{
+	InitVoronoiNeighbors();
+	w = *voronoi_queen_nbrs;
 }
 
 GalElement* Project::GetVoronoiRookNeighborGal()
 {
 	if (!voronoi_rook_nbr_gal) {
-		std::vector<std::set<int> > nbr_map;
-		GetVoronoiRookNeighborMap(nbr_map);
-		voronoi_rook_nbr_gal = Gda::VoronoiUtils::NeighborMapToGal(nbr_map);
+		CsrWeight w;
+		GetVoronoiRookNeighbors(w);
+		voronoi_rook_nbr_gal = w.ToGal();
 	}
 	return voronoi_rook_nbr_gal;
 }
@@ -827,6 +871,46 @@ void Project::AddCentroids()
 					   wxDefaultPosition, wxSize(400,400));
 	dlg.ShowModal();
 }
+
+void Project::AddAreasPerimeters()
+{
+	LOG_MSG("In Project::AddAreasPerimeters");
+	
+	if (!table_int || main_data.records.size() == 0) return;
+	const Gda::GeomMeasures& gm = GetGeomMeasures();
+	if (gm.GetNumObs() != num_records) return;
+	
+	std::vector<double> area(num_records, 0);
+	std::vector<double> perim(num_records, 0);
+	std::vector<bool> undef(num_records, false);
+	for (int i=0; i<num_records; i++) {
+		if (gm.IsNull(i)) {
+			undef[i] = true;
+		} else {
+			// outer rings are clockwise, so their signed area is negative
+			area[i] = fabs(gm.area[i]);
+			perim[i] = gm.perimeter[i];
+		}
+	}
+	
+	std::vector<SaveToTableEntry> data(2);
+	data[0].d_val = &area;
+	data[0].undefined = &undef;
+	data[0].label = "Area";
+	data[0].field_default = "AREA";
+	data[0].type = GdaConst::double_type;
+	
+	data[1].d_val = &perim;
+	data[1].undefined = &undef;
+	data[1].label = "Perimeter";
+	data[1].field_default = "PERIMETER";
+	data[1].type = GdaConst::double_type;
+	
+	SaveToTableDlg dlg(this, NULL, data,
+					   "Add Areas and Perimeters to Table",
+					   wxDefaultPosition, wxSize(400,400));
+	dlg.ShowModal();
+}
 	
 bool Project::GetCenters(std::vector<double>& x, std::vector<double>& y)
 {
@@ -834,11 +918,7 @@ bool Project::GetCenters(std::vector<double>& x, std::vector<double>& y)
 	x.resize(num_records);
 	y.resize(num_records);
 	
-	const std::vector<GdaPoint*>& pts = GetCentroids();
-	for (int i=0; i<num_records; i++) {
-		x[i] = pts[i]->center_o.x;
-		y[i] = pts[i]->center_o.y;
-	}
+	GetCentroids(x, y);
 	return true;
 }
 
@@ -846,31 +926,14 @@ const std::vector<GdaPoint*>& Project::GetMeanCenters()
 {
 	int num_obs = main_data.records.size();
 	if (mean_centers.size() == 0 && num_obs > 0) {
-		if (main_data.header.shape_type == Shapefile::POINT) {
-			mean_centers.resize(num_obs);
-			Shapefile::PointContents* pc;
-			for (int i=0; i<num_obs; i++) {
-				pc = (Shapefile::PointContents*)
-					main_data.records[i].contents_p;
-				if (pc->shape_type == 0) {
-					mean_centers[i] = new GdaPoint(wxRealPoint(pc->x, pc->y));
-				} else {
-					mean_centers[i] = new GdaPoint();
-				}
-			}
-		} else if (main_data.header.shape_type == Shapefile::POLYGON) {
-			mean_centers.resize(num_obs);
-			Shapefile::PolygonContents* pc;
-			for (int i=0; i<num_obs; i++) {
-				pc = (Shapefile::PolygonContents*)
-					main_data.records[i].contents_p;
-				GdaPolygon poly(pc);
-				if (poly.isNull()) {
-					mean_centers[i] = new GdaPoint();
-				} else {
-					mean_centers[i] =
-						new GdaPoint(GdaShapeAlgs::calculateMeanCenter(&poly));
-				}
+		const Gda::GeomMeasures& gm = GetGeomMeasures();
+		mean_centers.resize(num_obs);
+		for (int i=0; i<num_obs; i++) {
+			if (gm.IsNull(i)) {
+				mean_centers[i] = new GdaPoint();
+			} else {
+				mean_centers[i] = new GdaPoint(gm.mean_center_x[i],
+											   gm.mean_center_y[i]);
 			}
 		}
 	}
@@ -879,45 +942,28 @@ const std::vector<GdaPoint*>& Project::GetMeanCenters()
 
 void Project::GetMeanCenters(std::vector<double>& x, std::vector<double>& y)
 {
-    GetMeanCenters();
-    int num_obs = mean_centers.size();
-    if (x.size() < num_obs) x.resize(num_obs);
-    if (y.size() < num_obs) y.resize(num_obs);
-    for (int i=0; i<num_obs; i++) {
-        x[i] = mean_centers[i]->center_o.x;
-        y[i] = mean_centers[i]->center_o.y;
-    }
+	const Gda::GeomMeasures& gm = GetGeomMeasures();
+	int num_obs = gm.GetNumObs();
+	if (x.size() < num_obs) x.resize(num_obs);
+	if (y.size() < num_obs) y.resize(num_obs);
+	for (int i=0; i<num_obs; i++) {
+		x[i] = gm.mean_center_x[i];
+		y[i] = gm.mean_center_y[i];
+	}
 }
 
 const std::vector<GdaPoint*>& Project::GetCentroids()
 {
 	int num_obs = main_data.records.size();
 	if (centroids.size() == 0 && num_obs > 0) {
-		if (main_data.header.shape_type == Shapefile::POINT) {
-			centroids.resize(num_obs);
-			Shapefile::PointContents* pc;
-			for (int i=0; i<num_obs; i++) {
-				pc = (Shapefile::PointContents*)
-					main_data.records[i].contents_p;
-				if (pc->shape_type == 0) {
-					centroids[i] = new GdaPoint();
-				} else {
-					centroids[i] = new GdaPoint(wxRealPoint(pc->x, pc->y));
-				}
-			}
-		} else if (main_data.header.shape_type == Shapefile::POLYGON) {
-			centroids.resize(num_obs);
-			Shapefile::PolygonContents* pc;
-			for (int i=0; i<num_obs; i++) {
-				pc = (Shapefile::PolygonContents*)
-					main_data.records[i].contents_p;
-				GdaPolygon poly(pc);
-				if (poly.isNull()) {
-					centroids[i] = new GdaPoint();
-				} else {
-					centroids[i] =
-						new GdaPoint(GdaShapeAlgs::calculateCentroid(&poly));
-				}
+		const Gda::GeomMeasures& gm = GetGeomMeasures();
+		centroids.resize(num_obs);
+		for (int i=0; i<num_obs; i++) {
+			if (gm.IsNull(i)) {
+				centroids[i] = new GdaPoint();
+			} else {
+				centroids[i] = new GdaPoint(gm.centroid_x[i],
+											gm.centroid_y[i]);
 			}
 		}
 	}
@@ -926,13 +972,85 @@ const std::vector<GdaPoint*>& Project::GetCentroids()
 
 void Project::GetCentroids(std::vector<double>& x, std::vector<double>& y)
 {
-	GetCentroids();
-	int num_obs = centroids.size();
+	const Gda::GeomMeasures& gm = GetGeomMeasures();
+	int num_obs = gm.GetNumObs();
 	if (x.size() < num_obs) x.resize(num_obs);
 	if (y.size() < num_obs) y.resize(num_obs);
 	for (int i=0; i<num_obs; i++) {
-		x[i] = centroids[i]->center_o.x;
-		y[i] = centroids[i]->center_o.y;
+		x[i] = gm.centroid_x[i];
+		y[i] = gm.centroid_y[i];
+	}
+}
+
+const Gda::GeomMeasures& Project::GetGeomMeasures()
+{
+	if (!geom_measures) {
+		geom_measures = new Gda::GeomMeasures;
+		wxString fname = GetGeomMeasuresFile();
+		if (!fname.IsEmpty() &&
+			geom_measures->Load(fname, main_data, GetGeomSourceFile())) {
+			geom_measures_saved = true;
+		} else {
+			geom_measures->Compute(main_data);
+			SaveGeomMeasures();
+		}
+	}
+	return *geom_measures;
+}
+
+const Gda::GeomMeasures& Project::GetGeomMeasuresWithBorders()
+{
+	if (!GetGeomMeasures().HasSharedBorders()) {
+		geom_measures->ComputeSharedBorders(main_data);
+		geom_measures_saved = false;
+		SaveGeomMeasures();
+	}
+	return *geom_measures;
+}
+
+Gda::GeomMeasures* Project::GetGeomMeasuresForBorders()
+{
+	GetGeomMeasures();
+	return geom_measures;
+}
+
+void Project::SaveSharedBorders()
+{
+	if (!geom_measures || !geom_measures->HasSharedBorders()) return;
+	geom_measures_saved = false;
+	SaveGeomMeasures();
+}
+
+/** The geometry measures cache sits next to the project file, with the
+ extension ".geom".  Empty when there is no project file yet, or when the
+ geometries do not come from a file the cache can be checked against. */
+wxString Project::GetGeomMeasuresFile()
+{
+	wxString proj_fname = GetProjectFullPath();
+	if (proj_fname.IsEmpty() || GetGeomSourceFile().IsEmpty()) return "";
+	wxFileName fn(proj_fname);
+	fn.SetExt("geom");
+	return fn.GetFullPath();
+}
+
+/** The file the geometries were read from, for instance the .shp file of
+ a Shapefile.  Empty for databases and other non-file data sources. */
+wxString Project::GetGeomSourceFile()
+{
+	FileDataSource* fds = dynamic_cast<FileDataSource*>(datasource);
+	if (!fds || !wxFileExists(fds->GetFilePath())) return "";
+	return fds->GetFilePath();
+}
+
+void Project::SaveGeomMeasures()
+{
+	if (!geom_measures || geom_measures_saved) return;
+	wxString fname = GetGeomMeasuresFile();
+	if (fname.IsEmpty()) return;
+	geom_measures_saved = geom_measures->Save(fname, main_data,
+											  GetGeomSourceFile());
+	if (!geom_measures_saved) {
+		LOG_MSG("Could not write geometry measures cache " + fname);
 	}
 }
 
@@ -1003,9 +1121,11 @@ bool Project::CommonProjectInit()
 	
 	// Initialize various managers
 	save_manager = new SaveButtonManager(GetTableState());
+	sorted_col_cache = new SortedColCache(table_int, GetTableState());
 	frames_manager = new FramesManager;
 	highlight_state = new HighlightState;
 	cat_classif_manager = new CatClassifManager(table_int, GetTableState(),
+		sorted_col_cache,
         project_conf->GetLayerConfiguration()->GetCustClassifPtree());
 	highlight_state->SetSize(num_records);
 	w_manager = new WeightsManager(this);
@@ -1122,6 +1242,14 @@ bool Project::InitFromShapefileLayer()
 			return false;
 		}
 	}
+	// The table is opened for editing, so finish any in-place save of the
+	// DBF that was interrupted before reading it.
+	wxString jnl_err;
+	if (!DbfFileUtils::ApplyDbfJournal(dbf_fname, jnl_err)) {
+		open_err_msg << "Failed to recover an interrupted save of the DBF ";
+		open_err_msg << "file: " << jnl_err;
+		return false;
+	}
 	DbfFileReader dbf(dbf_fname);
 	if (!dbf.isDbfReadSuccess()) {
 		open_err_msg << "Failed to read DBF file.";
@@ -1246,9 +1374,8 @@ bool Project::InitFromOgrLayer()
 	if (!IsTableOnlyProject()) {
 		layer_proxy->ReadGeometries(main_data);
 	}
-	// run caching in background
-	//OGRDataAdapter::GetInstance().CacheLayer
-    //(ds_name.ToStdString(), layer_name.ToStdString(), layer_proxy);
+	// T_ReadLayer has already queued caching in the background if the
+	// cached copy of a database layer was missing or outdated
 	LOG_MSG("Exiting Project::InitFromOgrLayer");
 	return true;
 }
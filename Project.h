@@ -53,13 +53,16 @@ class TableState;
 class TimeState;
 class WeightsManager;
 class SaveButtonManager;
+class SortedColCache;
 class GalElement;
+class CsrWeight;
 class TimeChooserDlg;
 class GdaPoint;
 class GdaPolygon;
 class GdaShape;
 class wxGrid;
 class DataSource;
+namespace Gda { class GeomMeasures; }
 
 class Project {
 public:
@@ -107,6 +110,7 @@ public:
 	CatClassifManager*  GetCatClassifManager() { return cat_classif_manager; }
 	WeightsManager*     GetWManager() { return w_manager; }
 	SaveButtonManager*	GetSaveButtonManager() { return save_manager; }
+	SortedColCache*     GetSortedColCache() { return sorted_col_cache; }
 	FramesManager*      GetFramesManager() { return frames_manager; }
 	TableState*         GetTableState() { return table_state; }
 	TimeState*          GetTimeState() { return time_state; }
@@ -122,11 +126,18 @@ public:
 	void SaveVoronoiDupsToTable();
 	bool IsPointDuplicates();
 	void DisplayPointDupsWarning();
-	void GetVoronoiRookNeighborMap(std::vector<std::set<int> >& nbr_map);
-	void GetVoronoiQueenNeighborMap(std::vector<std::set<int> >& nbr_map);
+	/** Voronoi contiguity of the point centers.  Both are found from one
+	 diagram on first use and kept for the life of the project. */
+	void GetVoronoiRookNeighbors(CsrWeight& w);
+	void GetVoronoiQueenNeighbors(CsrWeight& w);
 	GalElement* GetVoronoiRookNeighborGal();
+	bool HasVoronoiNeighbors(bool queen);
+	/** Keeps Voronoi contiguity that a WeightsBuildJob found from the
+	 point centers.  Empty weights are ignored. */
+	void SetVoronoiNeighbors(const CsrWeight& queen, const CsrWeight& rook);
 	void AddMeanCenters();
 	void AddCentroids();
+	void AddAreasPerimeters();
     void GetSelectedRows(vector<int>& rowids);
 	
 	/// centroids by default
@@ -136,6 +147,16 @@ public:
 	const std::vector<GdaPoint*>& GetCentroids();
 	void GetCentroids(std::vector<double>& x, std::vector<double>& y);
 	const std::vector<GdaShape*>& GetVoronoiPolygons();
+	/** Centroids, mean centers, areas, perimeters and bounding boxes of
+	 every record.  Computed on first use, or read from the cache file next
+	 to the project file when it matches main_data. */
+	const Gda::GeomMeasures& GetGeomMeasures();
+	/** As GetGeomMeasures, with the shared borders computed as well. */
+	const Gda::GeomMeasures& GetGeomMeasuresWithBorders();
+	/** GetGeomMeasures for a WeightsBuildJob that computes the shared
+	 borders.  Call SaveSharedBorders once the job is done. */
+	Gda::GeomMeasures* GetGeomMeasuresForBorders();
+	void SaveSharedBorders();
 	
 	// default variables
 	wxString GetDefaultVarName(int var);
@@ -190,6 +211,7 @@ private:
 	CatClassifManager*  cat_classif_manager;
 	WeightsManager*     w_manager;
 	SaveButtonManager*  save_manager;
+	SortedColCache*     sorted_col_cache;
 	FramesManager*      frames_manager;
 	HighlightState*     highlight_state;
 	TableState*         table_state;
@@ -200,12 +222,20 @@ private:
 	std::vector<GdaPoint*> mean_centers;
 	std::vector<GdaPoint*> centroids;
 	std::vector<GdaShape*> voronoi_polygons;
+	Gda::GeomMeasures* geom_measures;
+	bool geom_measures_saved; // cache file written for current project file
+	wxString GetGeomMeasuresFile();
+	wxString GetGeomSourceFile();
+	void SaveGeomMeasures();
 
 	bool point_duplicates_initialized;
 	bool point_dups_warn_prev_displayed;
 	
 	std::list<std::list<int> > point_duplicates;
 	GalElement* voronoi_rook_nbr_gal;
+	CsrWeight* voronoi_rook_nbrs;
+	CsrWeight* voronoi_queen_nbrs;
+	void InitVoronoiNeighbors();
 	double voronoi_bb_xmin;
 	double voronoi_bb_ymin;
 	double voronoi_bb_xmax;
@@ -0,0 +1,122 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <boost/thread/mutex.hpp>
+#include "../kNN/ANN.h"
+#include "../GdaParallel.h"
+#include "../GdaTrace.h"
+#include "../GenUtils.h"
+#include "CsrWeight.h"
+#include "AttributeKnn.h"
+
+namespace {
+	/** One search per observation for k+1 neighbors, dropping the
+	 observation itself.  Rows of w have exactly k entries, so every
+	 thread writes straight into its own rows. */
+	struct AttributeKnnTask {
+		AttributeKnnTask(ANNkd_tree* tree_s, ANNpointArray pts_s, int k_s,
+						 double eps_s, CsrWeight& w_s,
+						 const volatile bool* cancel_s,
+						 volatile long* progress_s)
+		: tree(tree_s), pts(pts_s), k(k_s), eps(eps_s), w(w_s),
+		cancel(cancel_s), progress(progress_s), done(0) {}
+		
+		void operator()(int start, int end, int)
+		{
+			std::vector<ANNidx> nn_idx(k+1);
+			std::vector<ANNdist> dists(k+1);
+			for (int i=start; i<end; i++) {
+				if (cancel && *cancel) return;
+				tree->annkSearch(pts[i], k+1, &nn_idx[0], &dists[0], eps, 1);
+				int* nb = &w.nbrs[0] + (size_t) i*k;
+				double* wt = &w.weights[0] + (size_t) i*k;
+				int cnt = 0;
+				for (int j=0; j<=k && cnt<k; j++) {
+					if (nn_idx[j] == i) continue;
+					nb[cnt] = nn_idx[j];
+					wt[cnt] = sqrt(dists[j]); // ANN distances are squared
+					cnt++;
+				}
+				if (progress && (i-start) % 1024 == 1023) {
+					boost::mutex::scoped_lock lock(mutex);
+					done += 1024;
+					*progress = done;
+				}
+			}
+		}
+		
+		ANNkd_tree* tree;
+		ANNpointArray pts;
+		int k;
+		double eps;
+		CsrWeight& w;
+		const volatile bool* cancel;
+		volatile long* progress;
+		boost::mutex mutex;
+		long done;
+	};
+}
+
+void Gda::AttributeKnn::Standardize(std::vector<std::vector<double> >& cols)
+{
+	for (size_t j=0; j<cols.size(); j++) {
+		GenUtils::StandardizeData(cols[j]);
+	}
+}
+
+bool Gda::AttributeKnn::Knn(const std::vector<std::vector<double> >& cols,
+							int k, double eps, CsrWeight& w,
+							const volatile bool* cancel,
+							volatile long* progress)
+{
+	w.Clear();
+	if (cols.empty()) return false;
+	int dim = cols.size();
+	int num_obs = cols[0].size();
+	for (int j=1; j<dim; j++) {
+		if ((int) cols[j].size() != num_obs) return false;
+	}
+	if (k < 1 || k >= num_obs) return false;
+	GDA_TRACE_SCOPE("weights", "AttributeKnn::Knn");
+	
+	ANNpointArray pts = annAllocPts(num_obs, dim);
+	for (int i=0; i<num_obs; i++) {
+		for (int j=0; j<dim; j++) pts[i][j] = cols[j][i];
+	}
+	ANNkd_tree* tree = new ANNkd_tree(pts, num_obs, dim);
+	
+	w.num_obs = num_obs;
+	w.row_start.resize(num_obs+1);
+	for (int i=0; i<=num_obs; i++) w.row_start[i] = (long) i*k;
+	w.nbrs.resize((size_t) num_obs*k);
+	w.weights.resize((size_t) num_obs*k);
+	AttributeKnnTask task(tree, pts, k, eps < 0 ? 0 : eps, w, cancel,
+						  progress);
+	Gda::ParallelFor(num_obs, task, -1, 256);
+	
+	delete tree;
+	annDeallocPts(pts);
+	if (cancel && *cancel) {
+		w.Clear();
+		return false;
+	}
+	if (progress) *progress = num_obs;
+	return true;
+}
@@ -0,0 +1,59 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_ATTRIBUTE_KNN_H__
+#define __GEODA_CENTER_ATTRIBUTE_KNN_H__
+
+#include <vector>
+
+class CsrWeight;
+
+namespace Gda {
+	/**
+	 k nearest neighbor weights in the space of any number of variables,
+	 for neighbors in multivariate attribute space or, with the x and y
+	 coordinates added as two more variables, in combined geographic and
+	 attribute space.
+	 
+	 The variables are the columns of cols: cols[j][i] is the value of
+	 variable j for observation i.  They are usually standardized first so
+	 that every variable contributes equally to the distances.  Neighbors
+	 are found with one ANN kd-tree in cols.size() dimensions, and the
+	 queries for all observations run in parallel.  A positive eps gives
+	 approximate neighbors: the distance to the j-th neighbor found is at
+	 most (1+eps) times the true j-th nearest distance.
+	 */
+	namespace AttributeKnn {
+		/** Transforms every column to mean 0 and standard deviation 1.
+		 Constant columns are only centered. */
+		void Standardize(std::vector<std::vector<double> >& cols);
+		/** The k nearest neighbors of every observation, nearest first,
+		 with Euclidean distances in the space of cols as weights.  An
+		 observation is never its own neighbor, even when other
+		 observations have the same values.  Returns false, with w
+		 cleared, if cols is empty, the columns differ in length, k is
+		 not in [1, number of observations) or *cancel is set before the
+		 search finishes.  *progress counts the observations searched. */
+		bool Knn(const std::vector<std::vector<double> >& cols, int k,
+				 double eps, CsrWeight& w, const volatile bool* cancel = 0,
+				 volatile long* progress = 0);
+	}
+}
+
+#endif
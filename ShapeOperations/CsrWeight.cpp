@@ -0,0 +1,128 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "GalWeight.h"
+#include "GwtWeight.h"
+#include "CsrWeight.h"
+
+CsrWeight::CsrWeight() : num_obs(0), row_start(1, 0)
+{
+}
+
+CsrWeight::CsrWeight(const GalElement* gal, int num_obs_s) : num_obs(0)
+{
+	InitFromGal(gal, num_obs_s);
+}
+
+CsrWeight::CsrWeight(const GwtElement* gwt, int num_obs_s) : num_obs(0)
+{
+	InitFromGwt(gwt, num_obs_s);
+}
+
+void CsrWeight::Clear()
+{
+	num_obs = 0;
+	row_start.assign(1, 0);
+	nbrs.clear();
+	weights.clear();
+}
+
+void CsrWeight::InitFromGal(const GalElement* gal, int num_obs_s)
+{
+	Clear();
+	if (!gal || num_obs_s <= 0) return;
+	num_obs = num_obs_s;
+	row_start.resize(num_obs+1);
+	row_start[0] = 0;
+	for (int i=0; i<num_obs; i++) {
+		row_start[i+1] = row_start[i] + gal[i].Size();
+	}
+	nbrs.resize(row_start[num_obs]);
+	for (int i=0; i<num_obs; i++) {
+		long off = row_start[i];
+		for (long j=0, jend=gal[i].Size(); j<jend; j++) {
+			nbrs[off+j] = (int) gal[i].elt(j);
+		}
+	}
+}
+
+void CsrWeight::InitFromGwt(const GwtElement* gwt, int num_obs_s)
+{
+	Clear();
+	if (!gwt || num_obs_s <= 0) return;
+	num_obs = num_obs_s;
+	row_start.resize(num_obs+1);
+	row_start[0] = 0;
+	for (int i=0; i<num_obs; i++) {
+		row_start[i+1] = row_start[i] + gwt[i].Size();
+	}
+	nbrs.resize(row_start[num_obs]);
+	weights.resize(row_start[num_obs]);
+	for (int i=0; i<num_obs; i++) {
+		long off = row_start[i];
+		for (long j=0, jend=gwt[i].Size(); j<jend; j++) {
+			nbrs[off+j] = (int) gwt[i].data[j].nbx;
+			weights[off+j] = gwt[i].data[j].weight;
+		}
+	}
+}
+
+GalElement* CsrWeight::ToGal() const
+{
+	if (num_obs <= 0) return 0;
+	GalElement* gal = new GalElement[num_obs];
+	for (int i=0; i<num_obs; i++) {
+		int sz = Size(i);
+		if (sz == 0) continue;
+		gal[i].alloc(sz);
+		const int* nb = Nbrs(i);
+		for (int j=0; j<sz; j++) gal[i].Push(nb[j]);
+	}
+	return gal;
+}
+
+GwtElement* CsrWeight::ToGwt() const
+{
+	if (num_obs <= 0) return 0;
+	GwtElement* gwt = new GwtElement[num_obs];
+	for (int i=0; i<num_obs; i++) {
+		int sz = Size(i);
+		if (sz == 0) continue;
+		gwt[i].alloc(sz);
+		const int* nb = Nbrs(i);
+		const double* w = Weights(i);
+		for (int j=0; j<sz; j++) {
+			gwt[i].Push(GwtNeighbor(nb[j], w ? w[j] : 1.0));
+		}
+	}
+	return gwt;
+}
+
+bool CsrWeight::HasSelfNeighbor(int i) const
+{
+	const int* nb = Nbrs(i);
+	for (int j=0, sz=Size(i); j<sz; j++) if (nb[j] == i) return true;
+	return false;
+}
+
+bool CsrWeight::HasIsolates() const
+{
+	for (int i=0; i<num_obs; i++) if (IsIsolate(i)) return true;
+	return false;
+}
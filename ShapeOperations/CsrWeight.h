@@ -0,0 +1,72 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_CSR_WEIGHT_H__
+#define __GEODA_CENTER_CSR_WEIGHT_H__
+
+#include <vector>
+
+class GalElement;
+class GwtElement;
+
+/**
+ Compressed sparse row (CSR) copy of a spatial weights matrix.  The
+ neighbors of observation i are nbrs[row_start[i]] ... nbrs[row_start[i+1]-1]
+ and, for weights with explicit values, weights[] is parallel to nbrs[].
+ Unlike the GalElement / GwtElement arrays, all neighbor lists live in one
+ contiguous block, which makes it cheap to share a single read-only copy
+ between worker threads and to sweep all observations in order.
+ */
+class CsrWeight {
+public:
+	CsrWeight();
+	CsrWeight(const GalElement* gal, int num_obs);
+	CsrWeight(const GwtElement* gwt, int num_obs);
+	
+	void InitFromGal(const GalElement* gal, int num_obs);
+	void InitFromGwt(const GwtElement* gwt, int num_obs);
+	void Clear();
+	
+	/** Allocates and returns a new GalElement array with the same
+	 neighbor lists.  Caller is responsible for deleting the array. */
+	GalElement* ToGal() const;
+	/** Allocates and returns a new GwtElement array.  Binary weights
+	 are written with weight 1.  Caller is responsible for deleting. */
+	GwtElement* ToGwt() const;
+	
+	int GetNumObs() const { return num_obs; }
+	long GetNumNonZero() const { return nbrs.size(); }
+	int Size(int i) const { return (int) (row_start[i+1]-row_start[i]); }
+	const int* Nbrs(int i) const {
+		return nbrs.empty() ? 0 : &nbrs[0] + row_start[i]; }
+	/** Null for binary weights. */
+	const double* Weights(int i) const {
+		return weights.empty() ? 0 : &weights[0] + row_start[i]; }
+	bool IsBinary() const { return weights.empty(); }
+	bool IsIsolate(int i) const { return row_start[i+1] == row_start[i]; }
+	bool HasSelfNeighbor(int i) const;
+	bool HasIsolates() const;
+	
+	int num_obs;
+	std::vector<long> row_start; // size num_obs+1
+	std::vector<int> nbrs;
+	std::vector<double> weights; // empty for binary (GAL) weights
+};
+
+#endif
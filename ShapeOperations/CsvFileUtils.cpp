@@ -21,12 +21,311 @@
 #include <fstream>
 #include <set>
 #include <sstream>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
-#include <wx/stopwatch.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/scoped_ptr.hpp>
+#include "../GdaParallel.h"
+#include "../GdaTrace.h"
 #include "../logger.h"
 #include "CsvFileUtils.h"
 
+namespace {
+	// number of records used to guess column types
+	const int csv_sample_rows = 1000;
+	// smallest number of bytes worth handing to a worker thread
+	const size_t csv_min_chunk = 1 << 20;
+	
+	/** Read-only memory mapping of a whole file.  data is null if the
+	 file could not be opened or is empty. */
+	class CsvFileMap {
+	public:
+		CsvFileMap(const std::string& fname) : data(0), len(0) {
+			using namespace boost::interprocess;
+			try {
+				fm.reset(new file_mapping(fname.c_str(), read_only));
+				region.reset(new mapped_region(*fm, read_only));
+				data = static_cast<const char*>(region->get_address());
+				len = region->get_size();
+			} catch (interprocess_exception&) {
+				data = 0;
+				len = 0;
+			}
+			// skip a UTF-8 byte order mark
+			if (len >= 3 && (unsigned char) data[0] == 0xEF &&
+				(unsigned char) data[1] == 0xBB &&
+				(unsigned char) data[2] == 0xBF) {
+				data += 3;
+				len -= 3;
+			}
+		}
+		const char* data;
+		size_t len;
+	private:
+		boost::scoped_ptr<boost::interprocess::file_mapping> fm;
+		boost::scoped_ptr<boost::interprocess::mapped_region> region;
+	};
+	
+	inline bool IsCsvBlank(char c) { return c == ' ' || c == '\t'; }
+	
+	/** Parses the record that starts at p using the same rules as
+	 csv_record_grammar: fields are separated by commas, a field may be
+	 wrapped in double quotes (and may then contain commas, newlines and
+	 "" escaped quotes), and leading blanks are skipped.  The unescaped
+	 field values are written back to back into buf, with field k in
+	 [starts[k], starts[k+1]).  Returns the start of the next record.
+	 ok is false if the record is malformed; blank is true for an empty
+	 line. */
+	const char* ParseCsvRecord(const char* p, const char* end,
+							   std::vector<char>& buf,
+							   std::vector<size_t>& starts,
+							   bool& ok, bool& blank)
+	{
+		buf.clear();
+		starts.clear();
+		ok = true;
+		blank = false;
+		if (p >= end || *p == '\n' || *p == '\r') {
+			blank = true;
+			if (p < end && *p == '\r') p++;
+			if (p < end && *p == '\n') p++;
+			return p;
+		}
+		for (;;) {
+			starts.push_back(buf.size());
+			while (p < end && IsCsvBlank(*p)) p++;
+			if (p < end && *p == '"') {
+				p++;
+				for (;;) {
+					if (p >= end) { ok = false; break; }
+					if (*p == '"') {
+						if (p+1 < end && p[1] == '"') {
+							buf.push_back('"');
+							p += 2;
+						} else {
+							p++;
+							break;
+						}
+					} else {
+						buf.push_back(*p++);
+					}
+				}
+				while (p < end && IsCsvBlank(*p)) p++;
+				if (p < end && *p != ',' && *p != '\n' && *p != '\r') {
+					ok = false;
+				}
+			} else {
+				while (p < end && *p != ',' && *p != '\n' && *p != '\r') {
+					if (*p == '"') ok = false;
+					buf.push_back(*p++);
+				}
+			}
+			if (!ok) {
+				while (p < end && *p != '\n') p++;
+				if (p < end) p++;
+				return p;
+			}
+			if (p < end && *p == ',') {
+				p++;
+				continue;
+			}
+			break;
+		}
+		starts.push_back(buf.size());
+		if (p < end && *p == '\r') p++;
+		if (p < end && *p == '\n') p++;
+		return p;
+	}
+	
+	inline void TrimCsvField(const char*& b, const char*& e)
+	{
+		while (b < e && isspace((unsigned char) *b)) b++;
+		while (e > b && isspace((unsigned char) e[-1])) e--;
+	}
+	
+	/** Codes such as FIPS or ZIP codes are written with leading zeros
+	 that a number would lose, so "007" or "-01.5" is not a number. */
+	inline bool HasLeadingZero(const char* b, const char* e)
+	{
+		if (b < e && (*b == '-' || *b == '+')) b++;
+		return e-b > 1 && b[0] == '0' && b[1] >= '0' && b[1] <= '9';
+	}
+	
+	bool ParseCsvLong(const char* b, const char* e, wxInt64& v)
+	{
+		if (HasLeadingZero(b, e)) return false;
+		bool neg = false;
+		if (b < e && (*b == '-' || *b == '+')) neg = (*b++ == '-');
+		if (b == e) return false;
+		// accumulate as a negative number so that the minimum value fits
+		const wxInt64 lim = (-9223372036854775807LL - 1) / 10;
+		wxInt64 r = 0;
+		for (; b < e; b++) {
+			if (*b < '0' || *b > '9') return false;
+			int d = *b - '0';
+			if (r < lim || (r == lim && d > 8)) return false;
+			r = r*10 - d;
+		}
+		if (!neg) {
+			if (r == -9223372036854775807LL - 1) return false;
+			r = -r;
+		}
+		v = r;
+		return true;
+	}
+	
+	bool ParseCsvDouble(const char* b, const char* e, double& v)
+	{
+		char tmp[64];
+		size_t n = e-b;
+		if (n == 0 || n >= sizeof(tmp) || HasLeadingZero(b, e)) return false;
+		memcpy(tmp, b, n);
+		tmp[n] = '\0';
+		char* endp = 0;
+		v = strtod(tmp, &endp);
+		return endp == tmp+n;
+	}
+	
+	/** Appends one field to col.  Returns false if the value does not fit
+	 the column type, in which case a zero is stored in its place. */
+	bool AppendCsvValue(Gda::CsvColumn& col, Gda::CsvColumn::ColType type,
+						const char* b, const char* e)
+	{
+		if (type == Gda::CsvColumn::string_type) {
+			if (col.str_start.empty()) col.str_start.push_back(0);
+			col.str_data.insert(col.str_data.end(), b, e);
+			col.str_start.push_back(col.str_data.size());
+			col.valid.push_back(b != e);
+			return true;
+		}
+		TrimCsvField(b, e);
+		bool fits = true;
+		if (type == Gda::CsvColumn::long_type) {
+			wxInt64 v = 0;
+			if (b != e && !ParseCsvLong(b, e, v)) { v = 0; fits = false; }
+			col.l_vals.push_back(v);
+		} else {
+			double v = 0;
+			if (b != e && !ParseCsvDouble(b, e, v)) { v = 0; fits = false; }
+			col.d_vals.push_back(v);
+		}
+		col.valid.push_back(b != e && fits);
+		return fits;
+	}
+	
+	/** A newline-aligned byte range of the file and the columns parsed
+	 from it. */
+	struct CsvChunk {
+		CsvChunk() : begin(0), end(0), num_rows(0), err_row(-1),
+		err_fields(0) {}
+		const char* begin;
+		const char* end;
+		int num_rows;
+		int err_row; // first malformed record in this chunk, or -1
+		int err_fields; // field count of err_row, or -1 for a parse error
+		std::vector<Gda::CsvColumn> cols;
+		std::vector<bool> type_fail;
+	};
+	
+	/** Counts double quotes in each raw byte range.  A chunk starts inside
+	 a quoted field exactly when the number of quotes before it is odd. */
+	struct CsvQuoteCountTask {
+		CsvQuoteCountTask(const std::vector<const char*>& raw_s,
+						  std::vector<int>& odd_s)
+		: raw(raw_s), odd(odd_s) {}
+		void operator()(int start, int end, int) {
+			for (int k=start; k<end; k++) {
+				size_t cnt = 0;
+				for (const char* p=raw[k]; p<raw[k+1]; p++) {
+					if (*p == '"') cnt++;
+				}
+				odd[k] = cnt % 2;
+			}
+		}
+		const std::vector<const char*>& raw;
+		std::vector<int>& odd;
+	};
+	
+	/** Moves each raw chunk start forward to just past the first newline
+	 that is not inside a quoted field. */
+	struct CsvBoundaryTask {
+		CsvBoundaryTask(const std::vector<const char*>& raw_s,
+						const std::vector<int>& in_quote_s,
+						std::vector<const char*>& bound_s)
+		: raw(raw_s), in_quote(in_quote_s), bound(bound_s) {}
+		void operator()(int start, int end, int) {
+			for (int k=start; k<end; k++) {
+				if (k == 0) { bound[k] = raw[0]; continue; }
+				const char* stop = raw[raw.size()-1];
+				bool q = in_quote[k] != 0;
+				const char* p = raw[k];
+				for (; p < raw[k+1]; p++) {
+					if (*p == '"') q = !q;
+					else if (*p == '\n' && !q) break;
+				}
+				bound[k] = (p < raw[k+1]) ? p+1 : stop;
+			}
+		}
+		const std::vector<const char*>& raw;
+		const std::vector<int>& in_quote;
+		std::vector<const char*>& bound;
+	};
+	
+	struct CsvParseTask {
+		CsvParseTask(std::vector<CsvChunk>& chunks_s,
+					 const std::vector<Gda::CsvColumn::ColType>& types_s,
+					 const std::vector<bool>& redo_s)
+		: chunks(chunks_s), types(types_s), redo(redo_s) {}
+		
+		void operator()(int start, int end, int) {
+			std::vector<char> buf;
+			std::vector<size_t> starts;
+			for (int k=start; k<end; k++) ParseChunk(chunks[k], buf, starts);
+		}
+		
+		void ParseChunk(CsvChunk& ch, std::vector<char>& buf,
+						std::vector<size_t>& starts)
+		{
+			const int num_cols = types.size();
+			ch.cols.resize(num_cols);
+			ch.type_fail.assign(num_cols, false);
+			for (int c=0; c<num_cols; c++) {
+				if (redo[c]) ch.cols[c] = Gda::CsvColumn();
+			}
+			ch.num_rows = 0;
+			ch.err_row = -1;
+			const char* p = ch.begin;
+			while (p < ch.end) {
+				bool ok, blank;
+				p = ParseCsvRecord(p, ch.end, buf, starts, ok, blank);
+				if (blank) continue;
+				if (!ok || (int) starts.size()-1 != num_cols) {
+					ch.err_row = ch.num_rows;
+					ch.err_fields = ok ? starts.size()-1 : -1;
+					return;
+				}
+				const char* b = buf.empty() ? 0 : &buf[0];
+				for (int c=0; c<num_cols; c++) {
+					if (!redo[c]) continue;
+					if (!AppendCsvValue(ch.cols[c], types[c], b+starts[c],
+										b+starts[c+1])) {
+						ch.type_fail[c] = true;
+					}
+				}
+				ch.num_rows++;
+			}
+		}
+		
+		std::vector<CsvChunk>& chunks;
+		const std::vector<Gda::CsvColumn::ColType>& types;
+		const std::vector<bool>& redo;
+	};
+}
+
 /** This method makes a row in the Excel CSV format.
  The following rules are followed:
  1. If the string contanis no , or " chars, then leave as is
@@ -103,51 +402,43 @@ bool Gda::GetCsvStats(const std::string& csv_fname,
 {
 	using namespace std;
 	
-	ifstream file(csv_fname.c_str());
-	if (!file.is_open()) {
-		err_msg << "Unable to open CSV file.";
-		return false;
-	}
-	
-	typedef Gda::csv_record_grammar<string::const_iterator> csv_rec_gram;
-	csv_rec_gram csv_record; // CSV grammar instance
-	using boost::spirit::ascii::space;
-	
-	string line;
 	num_rows = 0;
 	num_cols = 0;
 	first_row.clear();
-	bool done = false;
-	bool blank_line_seen_once = false;
+	
+	CsvFileMap file(csv_fname);
+	if (!file.data) {
+		err_msg << "Unable to open CSV file.";
+		return false;
+	}
+	const char* p = file.data;
+	const char* end = file.data + file.len;
 	
 	// Parse the first line
-	Gda::safeGetline(file, line);
-	if (line.empty()) {
+	vector<char> buf;
+	vector<size_t> starts;
+	bool ok, blank;
+	p = ParseCsvRecord(p, end, buf, starts, ok, blank);
+	if (blank) {
 		err_msg << "First line of CSV is empty";
-		file.close();
 		return false;
-	} else {
-		string::const_iterator iter = line.begin();
-		string::const_iterator end = line.end();
-		bool r = phrase_parse(iter, end, csv_record, space, first_row);
-		if (!r || iter != end) {
-			err_msg << "Problem parsing first line of CSV.";
-			file.close();
-			return false;
-		}
-		num_cols = first_row.size();
-		num_rows++;
 	}
-	
-	// count remaining number of non-blank lines in file
-	while ( !file.eof() && file.good() && !done ) {
-		int pos = file.tellg();
-		Gda::safeGetline(file, line);
-		if (!line.empty()) num_rows++;
-		if (pos == file.tellg()) done = true;
+	if (!ok) {
+		err_msg << "Problem parsing first line of CSV.";
+		return false;
+	}
+	num_cols = starts.size()-1;
+	for (int c=0; c<num_cols; c++) {
+		first_row.push_back(string(buf.begin()+starts[c],
+								   buf.begin()+starts[c+1]));
 	}
+	num_rows++;
 	
-	file.close();
+	// count remaining number of non-blank records in file
+	while (p < end) {
+		p = ParseCsvRecord(p, end, buf, starts, ok, blank);
+		if (!blank) num_rows++;
+	}
 	return true;
 }
 
@@ -159,77 +450,240 @@ bool Gda::FillStringTableFromCsv(const std::string& csv_fname,
 								   wxString& err_msg)
 {
 	using namespace std;
-	wxStopWatch sw;
-	
-	int num_rows = 0;
-	int num_cols = 0;
-	std::vector<std::string> first_row;
-	wxString stats_err_msg;
-	bool success = Gda::GetCsvStats(csv_fname, num_rows, num_cols, first_row,
-									  stats_err_msg);
-	if (!success) {
-		err_msg = stats_err_msg;
+	
+	vector<CsvColumn> cols;
+	if (!ReadCsvColumns(csv_fname, first_row_field_names, false, cols,
+						err_msg)) {
 		return false;
 	}
-	if (first_row_field_names) num_rows--;
-	
+	int num_cols = cols.size();
+	int num_rows = num_cols > 0 ? cols[0].size() : 0;
 	string_table.resize(boost::extents[num_rows][num_cols]);
+	for (int col=0; col<num_cols; col++) {
+		for (int row=0; row<num_rows; row++) {
+			string_table[row][col] = cols[col].GetString(row);
+		}
+	}
+	return true;
+}
+
+std::string Gda::CsvColumn::GetString(size_t row) const
+{
+	if (type == long_type) {
+		if (!valid[row]) return std::string();
+		std::ostringstream ss;
+		ss << l_vals[row];
+		return ss.str();
+	}
+	if (type == double_type) {
+		if (!valid[row]) return std::string();
+		std::ostringstream ss;
+		ss.precision(17);
+		ss << d_vals[row];
+		return ss.str();
+	}
+	if (str_start.empty() || str_start[row] == str_start[row+1]) {
+		return std::string();
+	}
+	return std::string(&str_data[0] + str_start[row],
+					   &str_data[0] + str_start[row+1]);
+}
+
+bool Gda::ReadCsvColumns(const std::string& csv_fname,
+						 bool first_row_field_names, bool infer_types,
+						 std::vector<CsvColumn>& cols, wxString& err_msg)
+{
+	using namespace std;
+	GDA_TRACE_SCOPE("load", "Gda::ReadCsvColumns");
+	cols.clear();
 	
-	ifstream file(csv_fname.c_str());
-	if (!file.is_open()) {
-		cout << "Error: unable to open CSV file." << endl;
+	CsvFileMap file(csv_fname);
+	if (!file.data) {
+		err_msg << "Unable to open CSV file.";
+		return false;
+	}
+	const char* data_begin = file.data;
+	const char* data_end = file.data + file.len;
+	
+	// The first record gives the number of columns and possibly names
+	vector<char> buf;
+	vector<size_t> starts;
+	bool ok, blank;
+	const char* p = ParseCsvRecord(data_begin, data_end, buf, starts, ok,
+								   blank);
+	if (blank) {
+		err_msg << "First line of CSV is empty";
+		return false;
+	}
+	if (!ok) {
+		err_msg << "Problem parsing first line of CSV.";
 		return false;
 	}
+	const int num_cols = starts.size()-1;
+	cols.resize(num_cols);
+	if (first_row_field_names) {
+		for (int c=0; c<num_cols; c++) {
+			cols[c].name = string(buf.begin()+starts[c],
+								  buf.begin()+starts[c+1]);
+		}
+		data_begin = p;
+	}
+	
+	// Infer column types from a sample of records.  Columns with no
+	// values in the sample start as long and are demoted later if needed.
+	vector<CsvColumn::ColType> types(num_cols, CsvColumn::string_type);
+	if (infer_types) {
+		vector<bool> is_long(num_cols, true);
+		vector<bool> is_double(num_cols, true);
+		const char* q = data_begin;
+		for (int r=0; r<csv_sample_rows && q<data_end; ) {
+			q = ParseCsvRecord(q, data_end, buf, starts, ok, blank);
+			if (blank) continue;
+			if (!ok || (int) starts.size()-1 != num_cols) break;
+			const char* b = buf.empty() ? 0 : &buf[0];
+			for (int c=0; c<num_cols; c++) {
+				const char* fb = b+starts[c];
+				const char* fe = b+starts[c+1];
+				TrimCsvField(fb, fe);
+				if (fb == fe) continue;
+				wxInt64 l;
+				double d;
+				if (is_long[c] && !ParseCsvLong(fb, fe, l)) is_long[c] = false;
+				if (!is_long[c] && is_double[c] &&
+					!ParseCsvDouble(fb, fe, d)) is_double[c] = false;
+			}
+			r++;
+		}
+		for (int c=0; c<num_cols; c++) {
+			if (is_long[c]) types[c] = CsvColumn::long_type;
+			else if (is_double[c]) types[c] = CsvColumn::double_type;
+		}
+	}
+	
+	// Split the data into newline-aligned chunks.  Raw chunk starts are
+	// equally spaced; the number of quotes before each raw start tells
+	// whether it falls inside a quoted field, and each start is then moved
+	// just past the next record separator.
+	size_t data_len = data_end - data_begin;
+	int num_chunks = Gda::GetNumWorkers() * 4;
+	if ((size_t) num_chunks > data_len / csv_min_chunk) {
+		num_chunks = data_len / csv_min_chunk;
+	}
+	if (num_chunks < 1) num_chunks = 1;
+	vector<const char*> raw(num_chunks+1);
+	for (int k=0; k<num_chunks; k++) {
+		raw[k] = data_begin + (data_len / num_chunks) * k;
+	}
+	raw[num_chunks] = data_end;
+	vector<int> in_quote(num_chunks, 0);
+	if (num_chunks > 1) {
+		CsvQuoteCountTask quote_task(raw, in_quote);
+		Gda::ParallelFor(num_chunks, quote_task);
+		int odd = 0;
+		for (int k=0; k<num_chunks; k++) {
+			int cur = in_quote[k];
+			in_quote[k] = odd;
+			odd ^= cur;
+		}
+	}
+	vector<const char*> bound(num_chunks+1, data_end);
+	CsvBoundaryTask bound_task(raw, in_quote, bound);
+	Gda::ParallelFor(num_chunks, bound_task);
+	for (int k=num_chunks-1; k>=0; k--) {
+		if (bound[k] > bound[k+1]) bound[k] = bound[k+1];
+	}
+	vector<CsvChunk> chunks(num_chunks);
+	for (int k=0; k<num_chunks; k++) {
+		chunks[k].begin = bound[k];
+		chunks[k].end = bound[k+1];
+	}
 	
-	vector<string> v;
-	typedef Gda::csv_record_grammar<string::const_iterator> csv_rec_gram;
-	csv_rec_gram csv_record; // CSV grammar instance
-	using boost::spirit::ascii::space;
-	
-	int row = 0;
-	string line;
-	// skip first row if these are field names
-	if (first_row_field_names) Gda::safeGetline(file, line);
-	bool done = false;
-	while ( !file.eof() && file.good() && !done && row < num_rows ) {
-		int pos = file.tellg();
-		Gda::safeGetline(file, line);
-		if (!line.empty()) {
-			v.clear();
-			string::const_iterator iter = line.begin();
-			string::const_iterator end = line.end();
-			
-			bool r = phrase_parse(iter, end, csv_record, space, v);
-			if (!r || iter != end) {
-				int line_no = row+1;
+	// Parse every chunk, then re-parse only the columns whose type had to
+	// be demoted (long -> double -> string) until all values fit.
+	vector<bool> redo(num_cols, true);
+	for (;;) {
+		CsvParseTask parse_task(chunks, types, redo);
+		Gda::ParallelFor(num_chunks, parse_task);
+		
+		int rows_before = 0;
+		for (int k=0; k<num_chunks; k++) {
+			if (chunks[k].err_row >= 0) {
+				int line_no = rows_before + chunks[k].err_row + 1;
 				if (first_row_field_names) line_no++;
-				err_msg << "Problem parsing CSV file line " << line_no << ".";
-				file.close();
+				if (chunks[k].err_fields < 0) {
+					err_msg << "Problem parsing CSV file line " << line_no;
+					err_msg << ".";
+				} else {
+					err_msg << "First line of CSV file line has " << num_cols;
+					err_msg << " fields, but line " << line_no << " has ";
+					err_msg << chunks[k].err_fields << " fields.  This is ";
+					err_msg << "not valid in a CSV file.";
+				}
+				cols.clear();
 				return false;
 			}
-			if (v.size() != num_cols) {
-				err_msg << "First line of CSV file line has " << num_cols;
-				err_msg << " fields, but line " << row << " has ";
-				err_msg << v.size() << " fields.  This is not valid in ";
-				err_msg << "a CSV file.";
-				file.close();
-				return false;
+			rows_before += chunks[k].num_rows;
+		}
+		
+		bool any_demoted = false;
+		for (int c=0; c<num_cols; c++) {
+			redo[c] = false;
+			for (int k=0; k<num_chunks && !redo[c]; k++) {
+				if (chunks[k].type_fail[c]) redo[c] = true;
 			}
-			for (int col=0; col<num_cols; col++) {
-				string_table[row][col] = v[col];
+			if (redo[c]) {
+				types[c] = (types[c] == CsvColumn::long_type ?
+							CsvColumn::double_type : CsvColumn::string_type);
+				any_demoted = true;
 			}
-			row++;
 		}
-		if (pos == file.tellg()) done = true;
-	}
-	file.close();
-	if (row != num_rows) {
-		err_msg << "CSV file was specified as having " << num_rows;
-		err_msg << " records, but " << row << " records were parsed.";
-		return false;
+		if (!any_demoted) break;
 	}
 	
-	LOG_MSG(wxString::Format("CSV file parsing took %ld ms", (long)sw.Time()));
+	// Concatenate the chunk columns, releasing each chunk column as soon
+	// as it has been copied.
+	size_t num_rows = 0;
+	for (int k=0; k<num_chunks; k++) num_rows += chunks[k].num_rows;
+	for (int c=0; c<num_cols; c++) {
+		CsvColumn& col = cols[c];
+		col.type = types[c];
+		col.valid.resize(num_rows);
+		if (col.type == CsvColumn::long_type) col.l_vals.reserve(num_rows);
+		if (col.type == CsvColumn::double_type) col.d_vals.reserve(num_rows);
+		if (col.type == CsvColumn::string_type) {
+			size_t num_chars = 0;
+			for (int k=0; k<num_chunks; k++) {
+				num_chars += chunks[k].cols[c].str_data.size();
+			}
+			col.str_data.reserve(num_chars);
+			col.str_start.reserve(num_rows+1);
+			col.str_start.push_back(0);
+		}
+		size_t row = 0;
+		for (int k=0; k<num_chunks; k++) {
+			CsvColumn& ch_col = chunks[k].cols[c];
+			for (size_t i=0, sz=ch_col.valid.size(); i<sz; i++) {
+				if (ch_col.valid[i]) col.valid.set(row+i);
+			}
+			row += ch_col.valid.size();
+			if (col.type == CsvColumn::long_type) {
+				col.l_vals.insert(col.l_vals.end(), ch_col.l_vals.begin(),
+								  ch_col.l_vals.end());
+			} else if (col.type == CsvColumn::double_type) {
+				col.d_vals.insert(col.d_vals.end(), ch_col.d_vals.begin(),
+								  ch_col.d_vals.end());
+			} else if (!ch_col.str_start.empty()) {
+				size_t off = col.str_data.size();
+				col.str_data.insert(col.str_data.end(),
+									ch_col.str_data.begin(),
+									ch_col.str_data.end());
+				for (size_t i=1; i<ch_col.str_start.size(); i++) {
+					col.str_start.push_back(off + ch_col.str_start[i]);
+				}
+			}
+			ch_col = CsvColumn();
+		}
+	}
 	
 	return true;
 }
@@ -29,6 +29,7 @@
 #include <boost/spirit/include/phoenix_operator.hpp>
 #include <boost/spirit/include/phoenix_stl.hpp>
 #include <boost/multi_array.hpp>
+#include <boost/dynamic_bitset.hpp>
 #include <wx/string.h>
 
 
@@ -96,6 +97,39 @@ namespace Gda {
 	bool ConvertColToDoubles(const std_str_array_type& string_table,
 							 int col, std::vector<double>& v,
 							 std::vector<bool>& undef, int& failed_index);	
+	
+	/** One column of a CSV file decoded straight into a typed buffer.
+	 Only the vector that matches type is filled.  String values are
+	 stored back to back in str_data, so that a large file does not
+	 create one std::string object per field. */
+	struct CsvColumn {
+		enum ColType { string_type, long_type, double_type };
+		CsvColumn() : type(string_type) {}
+		
+		std::string name;
+		ColType type;
+		std::vector<wxInt64> l_vals;
+		std::vector<double> d_vals;
+		// value i is str_data[str_start[i]] ... str_data[str_start[i+1]-1]
+		std::vector<char> str_data;
+		std::vector<size_t> str_start;
+		boost::dynamic_bitset<> valid; // false for empty fields
+		
+		size_t size() const { return valid.size(); }
+		std::string GetString(size_t row) const;
+	};
+	
+	/** Reads a CSV file in a single pass.  The file is memory mapped and
+	 split into newline-aligned chunks (newlines inside quoted fields are
+	 respected) that are parsed in parallel.  When infer_types is true,
+	 column types are inferred from the first rows and then demoted
+	 (long to double to string) if a later value does not fit, otherwise
+	 every column is read as strings.  A value with a leading zero, such
+	 as a FIPS code, keeps its column a string column.  Blank lines are skipped.  If
+	 first_row_field_names is false, column names are left empty. */
+	bool ReadCsvColumns(const std::string& csv_fname,
+						bool first_row_field_names, bool infer_types,
+						std::vector<CsvColumn>& cols, wxString& err_msg);
 }
 
 #endif
@@ -24,6 +24,12 @@
 #include <wx/filename.h>
 //#include <time.h> // for random number generator
 #include <stdlib.h> // for random number generator and atoi
+#include <math.h>
+#include <string.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <wx/file.h>
+#include <wx/filefn.h>
 #include "../GdaConst.h"
 #include "../logger.h"
 #include "DbfFile.h"
@@ -263,6 +269,193 @@ void DbfFileUtils::strToInt64(const char *str, wxInt64 *val)
 	*val = minus ? -total : total;
 }
 
+namespace {
+	// exact powers of ten representable as doubles
+	const double dbf_pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	
+	inline bool IsDbfBlank(char c) {
+		return c == ' ' || c == '\0' || c == '\t';
+	}
+}
+
+bool DbfFileUtils::ParseDouble(const char* buf, int len, double* val)
+{
+	*val = 0;
+	const char* p = buf;
+	const char* end = buf + len;
+	while (p < end && IsDbfBlank(*p)) p++;
+	while (end > p && IsDbfBlank(end[-1])) end--;
+	if (p == end) return false;
+	
+	// Fast path: at most 19 significant digits and a small decimal
+	// exponent can be converted with a single correctly rounded multiply
+	// or divide.  Anything else goes through the slow path below.
+	const char* q = p;
+	bool neg = false;
+	if (*q == '-' || *q == '+') neg = (*q++ == '-');
+	wxUint64 mant = 0;
+	int sig_digits = 0;
+	int exp10 = 0;
+	int num_digits = 0;
+	for (; q < end && *q >= '0' && *q <= '9'; q++, num_digits++) {
+		if (mant == 0 && *q == '0') continue;
+		if (sig_digits < 19) {
+			mant = mant*10 + (*q - '0');
+			sig_digits++;
+		} else {
+			sig_digits = 20; // too many digits for the fast path
+		}
+	}
+	if (q < end && *q == '.') {
+		for (q++; q < end && *q >= '0' && *q <= '9'; q++, num_digits++) {
+			if (mant == 0 && *q == '0') { exp10--; continue; }
+			if (sig_digits < 19) {
+				mant = mant*10 + (*q - '0');
+				sig_digits++;
+				exp10--;
+			} else {
+				sig_digits = 20;
+			}
+		}
+	}
+	if (num_digits > 0 && q < end && (*q == 'e' || *q == 'E')) {
+		const char* e = q+1;
+		bool e_neg = false;
+		if (e < end && (*e == '-' || *e == '+')) e_neg = (*e++ == '-');
+		int ev = 0;
+		const char* e_start = e;
+		for (; e < end && *e >= '0' && *e <= '9' && ev < 10000; e++) {
+			ev = ev*10 + (*e - '0');
+		}
+		if (e > e_start) {
+			exp10 += e_neg ? -ev : ev;
+			q = e;
+		}
+	}
+	if (num_digits > 0 && q == end && sig_digits <= 19 &&
+		mant <= (((wxUint64) 1) << 53)) {
+		double d = (double) mant;
+		if (mant == 0) {
+			*val = neg ? -0.0 : 0.0;
+			return true;
+		}
+		if (exp10 >= 0 && exp10 <= 22) {
+			d *= dbf_pow10[exp10];
+			*val = neg ? -d : d;
+			return true;
+		}
+		if (exp10 < 0 && exp10 >= -22) {
+			d /= dbf_pow10[-exp10];
+			*val = neg ? -d : d;
+			return true;
+		}
+	}
+	
+	// Slow path, used for very long mantissas, large exponents and
+	// anything the fast path does not recognize.  As before, we are not
+	// using atof since it is difficult to choose a US locale on all
+	// systems so as to assume the DBF-required use of '.'
+	wxString temp(p, wxConvUTF8, end-p);
+	double x = 0;
+	if (!temp.ToCDouble(&x) || !(x == x) || x - x != 0) return false;
+	*val = x;
+	return true;
+}
+
+bool DbfFileUtils::ParseInt64(const char* buf, int len, wxInt64* val)
+{
+	*val = 0;
+	const char* p = buf;
+	const char* end = buf + len;
+	while (p < end && IsDbfBlank(*p)) p++;
+	while (end > p && IsDbfBlank(end[-1])) end--;
+	bool neg = false;
+	if (p < end && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+	if (p == end) return false;
+	// accumulate as a negative number so that the minimum value fits
+	const wxInt64 min_v = -9223372036854775807LL - 1;
+	const wxInt64 lim = min_v / 10;
+	wxInt64 r = 0;
+	for (; p < end; p++) {
+		if (*p < '0' || *p > '9') return false;
+		int d = *p - '0';
+		if (r < lim || (r == lim && d > 8)) return false;
+		r = r*10 - d;
+	}
+	if (!neg) {
+		if (r == min_v) return false;
+		r = -r;
+	}
+	*val = r;
+	return true;
+}
+
+void DbfFileUtils::FormatInt64(wxInt64 val, int len, char* buf)
+{
+	char digits[24];
+	int n = 0;
+	wxUint64 u = val < 0 ? ((wxUint64) 0) - ((wxUint64) val) : val;
+	do {
+		digits[n++] = '0' + (char) (u % 10);
+		u /= 10;
+	} while (u > 0);
+	if (val < 0) digits[n++] = '-';
+	// right justify, truncating on the right if too wide
+	int pad = len - n;
+	int j = 0;
+	for (; j < pad; j++) buf[j] = ' ';
+	for (int k=n-1; j < len; k--, j++) buf[j] = digits[k];
+}
+
+void DbfFileUtils::FormatDouble(double val, int len, int decimals, char* buf)
+{
+	// Fast path: round val*10^decimals to an integer and print its digits.
+	// This matches sprintf exactly as long as the scaled value is small
+	// enough that the multiplication error can not move it across a
+	// rounding boundary, and it is not (nearly) half way between two
+	// integers.
+	if (decimals >= 0 && decimals <= 15 && val == val) {
+		double scaled = val * dbf_pow10[decimals];
+		double a = scaled < 0 ? -scaled : scaled;
+		if (a < 1099511627776.0) { // 2^40
+			double fl = floor(a);
+			double frac = a - fl;
+			if (frac < 0.4999 || frac > 0.5001) {
+				wxUint64 u = (wxUint64) fl + (frac > 0.5 ? 1 : 0);
+				char digits[48];
+				int n = 0;
+				for (int k=0; k<decimals; k++) {
+					digits[n++] = '0' + (char) (u % 10);
+					u /= 10;
+				}
+				digits[n++] = '.';
+				do {
+					digits[n++] = '0' + (char) (u % 10);
+					u /= 10;
+				} while (u > 0);
+				// sprintf keeps the sign of values that round to zero
+				if (val < 0 || (val == 0 && 1/val < 0)) digits[n++] = '-';
+				int pad = len - n;
+				int j = 0;
+				for (; j < pad; j++) buf[j] = ' ';
+				for (int k=n-1; j < len; k--, j++) buf[j] = digits[k];
+				return;
+			}
+		}
+	}
+	
+	char temp[512];
+	sprintf(temp, "%#*.*f", len, decimals, val);
+	int n = strlen(temp);
+	for (int j=0; j<len; j++) {
+		buf[j] = j < n ? temp[j] : ' ';
+		if (buf[j] == ',') buf[j] = '.';
+	}
+}
+
 bool DbfFileReader::getFieldValsDouble(const wxString& f_name,
 									   std::vector<double>& vals)
 {
@@ -891,3 +1084,239 @@ wxString DbfFileUtils::GetMinDoubleString(int length, int decimals)
 
 
 
+
+namespace {
+	// The journal is only ever read back on the machine that wrote it, so
+	// integers are stored in native byte order.
+	const char dbf_jnl_magic[8] = {'G','D','A','D','B','F','J','2'};
+	const char dbf_jnl_done[8] = {'G','D','A','D','B','F','O','K'};
+	// bytes of the DBF file mapped at a time while applying a journal
+	const wxInt64 dbf_jnl_window = 1 << 26;
+	
+	// Layout of the DBF file the journal was written against.  A journal
+	// is only applied to a file that still has exactly this layout.
+	struct DbfJnlHead {
+		wxInt64 file_size;
+		wxInt32 num_records;
+		wxInt32 header_length;
+		wxInt32 length_each_record;
+		wxInt32 reserved;
+	};
+	
+	struct DbfJnlEntry {
+		wxInt64 offset;
+		wxInt32 len;
+		wxInt32 stride;
+		wxInt32 count;
+	};
+	
+	// smallest complete journal: magic, head, end mark and trailer
+	const std::streamoff dbf_jnl_min_len =
+		8 + sizeof(DbfJnlHead) + sizeof(DbfJnlEntry) + 8;
+}
+
+wxString DbfFileUtils::GetDbfJournalFileName(const wxString& dbf_fname)
+{
+	return dbf_fname + ".gdajnl";
+}
+
+bool DbfFileUtils::SyncFile(const wxString& fname)
+{
+	wxFile f;
+	if (!f.Open(fname, wxFile::read_write)) return false;
+	// wxFile::Flush is fsync on Unix and _commit on Windows
+	bool ok = f.Flush();
+	f.Close();
+	return ok;
+}
+
+bool DbfFileUtils::WriteDbfJournal(const wxString& dbf_fname,
+								   const DbfFileHeader& header,
+								   const std::vector<DbfPatch>& patches,
+								   wxString& err_msg)
+{
+	wxString jnl_fname = GetDbfJournalFileName(dbf_fname);
+	std::ofstream out(jnl_fname.fn_str(), std::ios::out | std::ios::binary);
+	if (!(out.is_open() && out.good())) {
+		err_msg << "Problem opening \"" << jnl_fname << "\"";
+		return false;
+	}
+	out.write(dbf_jnl_magic, 8);
+	DbfJnlHead h;
+	h.file_size = wxFileName::GetSize(dbf_fname).GetValue();
+	h.num_records = header.num_records;
+	h.header_length = header.header_length;
+	h.length_each_record = header.length_each_record;
+	h.reserved = 0;
+	out.write((const char*) &h, sizeof(DbfJnlHead));
+	std::vector<char> buf;
+	for (size_t i=0; i<patches.size(); ++i) {
+		const DbfPatch& p = patches[i];
+		if (p.count <= 0 || p.len <= 0) continue;
+		DbfJnlEntry e;
+		e.offset = p.offset;
+		e.len = p.len;
+		e.stride = p.stride;
+		e.count = p.count;
+		out.write((const char*) &e, sizeof(DbfJnlEntry));
+		// gather the strided source fields into contiguous blocks
+		int block = GenUtils::max<int>(1, (1 << 20) / p.len);
+		buf.resize((size_t) GenUtils::min<int>(block, p.count) * p.len);
+		for (int r=0; r<p.count; r+=block) {
+			int n = GenUtils::min<int>(block, p.count-r);
+			const char* src = p.src + (size_t) r * p.src_stride;
+			for (int k=0; k<n; k++) {
+				memcpy(&buf[(size_t) k*p.len], src, p.len);
+				src += p.src_stride;
+			}
+			out.write(&buf[0], (std::streamsize) n * p.len);
+		}
+	}
+	// the trailer is written last: a journal without it is ignored
+	DbfJnlEntry end_mark;
+	memset(&end_mark, 0, sizeof(DbfJnlEntry));
+	end_mark.offset = -1;
+	out.write((const char*) &end_mark, sizeof(DbfJnlEntry));
+	out.write(dbf_jnl_done, 8);
+	out.close();
+	// The journal must be on disk before the DBF is touched, otherwise a
+	// power loss could leave a torn DBF with nothing to repair it from.
+	if (out.fail() || !SyncFile(jnl_fname)) {
+		wxRemoveFile(jnl_fname);
+		err_msg << "Problem writing \"" << jnl_fname << "\"";
+		return false;
+	}
+	return true;
+}
+
+bool DbfFileUtils::ApplyDbfJournal(const wxString& dbf_fname,
+								   wxString& err_msg)
+{
+	wxString jnl_fname = GetDbfJournalFileName(dbf_fname);
+	if (!wxFileExists(jnl_fname)) return true;
+	
+	std::ifstream jnl(jnl_fname.fn_str(), std::ios::in | std::ios::binary);
+	if (!(jnl.is_open() && jnl.good())) {
+		err_msg << "Problem opening \"" << jnl_fname << "\"";
+		return false;
+	}
+	char magic[8];
+	bool complete = false;
+	jnl.seekg(0, std::ios::end);
+	std::streamoff jnl_len = jnl.tellg();
+	if (jnl_len >= dbf_jnl_min_len) {
+		jnl.seekg(0, std::ios::beg);
+		jnl.read(magic, 8);
+		bool head_ok = jnl.good() && memcmp(magic, dbf_jnl_magic, 8) == 0;
+		jnl.seekg(jnl_len-8, std::ios::beg);
+		jnl.read(magic, 8);
+		complete = (head_ok && jnl.good() &&
+					memcmp(magic, dbf_jnl_done, 8) == 0);
+	}
+	if (!complete) {
+		// Interrupted while writing the journal: the DBF is untouched.
+		LOG_MSG("Discarding incomplete DBF journal " + jnl_fname);
+		jnl.close();
+		wxRemoveFile(jnl_fname);
+		return true;
+	}
+	
+	// The journal must describe the file as it is now.  One left behind
+	// next to an older or since replaced copy of the DBF is stale.
+	DbfJnlHead h;
+	jnl.seekg(8, std::ios::beg);
+	jnl.read((char*) &h, sizeof(DbfJnlHead));
+	bool matches = false;
+	if (jnl.good() && wxFileExists(dbf_fname)) {
+		wxInt64 file_size = wxFileName::GetSize(dbf_fname).GetValue();
+		DbfFileReader dbf(dbf_fname);
+		if (dbf.isDbfReadSuccess()) {
+			DbfFileHeader header = dbf.getFileHeader();
+			matches = (h.file_size == file_size &&
+					   h.num_records == (wxInt32) header.num_records &&
+					   h.header_length == header.header_length &&
+					   h.length_each_record == header.length_each_record);
+		}
+		// every entry must lie within the file
+		std::streamoff data_pos = jnl.tellg();
+		DbfJnlEntry e;
+		e.offset = 0;
+		while (matches && jnl.read((char*) &e, sizeof(DbfJnlEntry)) &&
+			   e.offset >= 0) {
+			matches = (e.len > 0 && e.count > 0 && e.stride >= e.len &&
+					   e.offset + (wxInt64) (e.count-1) * e.stride + e.len
+					   <= file_size);
+			if (matches) {
+				jnl.seekg((std::streamoff) e.count * e.len, std::ios::cur);
+			}
+		}
+		matches = matches && jnl.good() && e.offset < 0;
+		jnl.clear();
+		jnl.seekg(data_pos, std::ios::beg);
+	}
+	if (!matches) {
+		LOG_MSG("Discarding DBF journal that does not match " + dbf_fname);
+		jnl.close();
+		wxRemoveFile(jnl_fname);
+		return true;
+	}
+	
+	std::vector<char> buf;
+	try {
+		using namespace boost::interprocess;
+		file_mapping fm((const char*) dbf_fname.mb_str(), read_write);
+		// The file is mapped in aligned windows so that the address space
+		// needed does not grow with the file.  A window stays mapped until
+		// an entry falls outside it, so a file no larger than one window is
+		// mapped and flushed only once for all entries.
+		mapped_region region;
+		wxInt64 win_start = 0;
+		wxInt64 win_end = 0;
+		DbfJnlEntry e;
+		while (jnl.read((char*) &e, sizeof(DbfJnlEntry)) && e.offset >= 0) {
+			int block = (int) GenUtils::max<wxInt64>(1,
+											dbf_jnl_window / e.stride);
+			for (int r=0; r<e.count; r+=block) {
+				int n = GenUtils::min<int>(block, e.count-r);
+				buf.resize((size_t) n * e.len);
+				if (!jnl.read(&buf[0], (std::streamsize) n * e.len)) {
+					err_msg << "Problem reading \"" << jnl_fname << "\"";
+					return false;
+				}
+				wxInt64 start = e.offset + (wxInt64) r * e.stride;
+				wxInt64 span = (wxInt64) (n-1) * e.stride + e.len;
+				if (start < win_start || start + span > win_end) {
+					if (win_end > win_start) region.flush();
+					win_start = (start / dbf_jnl_window) * dbf_jnl_window;
+					if (start + span > win_start + dbf_jnl_window) {
+						win_start = start;
+					}
+					win_end = GenUtils::min<wxInt64>(h.file_size,
+											win_start + dbf_jnl_window);
+					mapped_region w(fm, read_write, win_start,
+									(size_t) (win_end - win_start));
+					region.swap(w);
+				}
+				char* dst = (static_cast<char*>(region.get_address()) +
+							 (start - win_start));
+				for (int k=0; k<n; k++) {
+					memcpy(dst, &buf[(size_t) k*e.len], e.len);
+					dst += e.stride;
+				}
+			}
+		}
+		if (win_end > win_start) region.flush();
+	} catch (boost::interprocess::interprocess_exception&) {
+		// The journal is kept so that the patch can be retried.
+		err_msg << "Problem updating \"" << dbf_fname << "\"";
+		return false;
+	}
+	// the journal may only go once the patched fields are on disk
+	if (!SyncFile(dbf_fname)) {
+		err_msg << "Problem updating \"" << dbf_fname << "\"";
+		return false;
+	}
+	jnl.close();
+	wxRemoveFile(jnl_fname);
+	return true;
+}
@@ -118,6 +118,50 @@ namespace DbfFileUtils
 					  int* suggest_len=0, int* suggest_dec=0);
   wxString GetMinDoubleString(int length, int decimals);
   void strToInt64(const char *str, wxInt64 *val);
+	
+  // Locale-independent decoding of a fixed-width numeric DBF field of
+  // len bytes (need not be null-terminated).  Leading and trailing blanks
+  // are ignored.  Returns false if the field is empty, not a number, or
+  // not finite, in which case val is set to 0.
+  bool ParseDouble(const char* buf, int len, double* val);
+  bool ParseInt64(const char* buf, int len, wxInt64* val);
+  // Inverse of the above: write exactly len bytes, right justified and
+  // with '.' as the decimal point, as sprintf("%#*.*f") and
+  // sprintf("%*lld") would.  Output that is too wide is truncated.
+  void FormatDouble(double val, int len, int decimals, char* buf);
+  void FormatInt64(wxInt64 val, int len, char* buf);
+	
+  // A run of count fixed-width fields of len bytes to be written into a
+  // DBF file.  The first field is at byte offset in the file and the rest
+  // follow every stride bytes.  New contents are read from src, every
+  // src_stride bytes.
+  struct DbfPatch {
+	wxInt64 offset;
+	int len;
+	int stride;
+	int count;
+	const char* src;
+	int src_stride;
+  };
+	
+  // Forces the contents of fname to disk.  Returns false on failure.
+  bool SyncFile(const wxString& fname);
+	
+  // In-place patching is made crash safe with a redo journal kept next to
+  // the DBF file.  WriteDbfJournal records the layout of the DBF described
+  // by header and all new field contents, marks the journal complete and
+  // syncs it to disk.  ApplyDbfJournal copies a complete journal into the
+  // DBF through a memory mapping, syncs the DBF and removes the journal.
+  // An incomplete journal means the DBF was never touched, and a journal
+  // whose layout no longer matches the DBF is stale; both are discarded.
+  // ApplyDbfJournal is a no-op returning true if there is no journal, and
+  // returns false with err_msg set if the DBF could not be updated.
+  wxString GetDbfJournalFileName(const wxString& dbf_fname);
+  bool WriteDbfJournal(const wxString& dbf_fname,
+					   const DbfFileHeader& header,
+					   const std::vector<DbfPatch>& patches,
+					   wxString& err_msg);
+  bool ApplyDbfJournal(const wxString& dbf_fname, wxString& err_msg);
 }
 
 #endif
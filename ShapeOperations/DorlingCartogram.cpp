@@ -32,59 +32,91 @@
  */
 
 #include <wx/msgdlg.h>
+#include <math.h>
 #include <wx/stopwatch.h>
 #include "../logger.h"
+#include "../GdaParallel.h"
 #include "../GenUtils.h"
 #include "GalWeight.h"
+#include "GeomMeasures.h"
 #include "DorlingCartogram.h"
 
+namespace {
+	struct CartCellTask {
+		CartCellTask(DorlingCartogram* c_s) : c(c_s) {}
+		void operator()(int start, int end, int) {
+			c->assign_cells_range(start+1, end+1); }
+		DorlingCartogram* c;
+	};
+	
+	struct CartForceTask {
+		CartForceTask(DorlingCartogram* c_s) : c(c_s) {}
+		void operator()(int start, int end, int) {
+			c->calc_forces_range(start+1, end+1); }
+		DorlingCartogram* c;
+	};
+}
+
 CartNbrInfo::CartNbrInfo(GalElement* gal, int num_obs)
-: bodies(num_obs+1)
+: bodies(num_obs+1), nbours(num_obs+1, 0), nbour_start(num_obs+2, 0),
+perimeter(num_obs+1, 0)
 {
-	typedef int* int_ptr;
-	typedef double* dbl_ptr;
-	nbours = new int[bodies];
-	nbour = new int_ptr[bodies];
-	border = new dbl_ptr[bodies];
-	perimeter = new double[bodies];
-
 	for (int i=0; i<num_obs; i++) {
-		int n_cnt = gal[i].size;
-		nbours[i+1] = n_cnt;
-		nbour[i+1] = new int[n_cnt+1];
-		border[i+1] = new double[n_cnt+1];
-		perimeter[i+1] = n_cnt;
-		for (int j=0; j<n_cnt; j++) {
-			nbour[i+1][j+1] = gal[i].data[j]+1;
-			border[i+1][j+1] = 1;
+		nbours[i+1] = gal[i].size;
+		nbour_start[i+2] = nbour_start[i+1] + gal[i].size;
+	}
+	nbour.resize(nbour_start[bodies]);
+	border.resize(nbour_start[bodies], 1);
+	for (int i=0; i<num_obs; i++) {
+		int* nb = nbour.empty() ? 0 : &nbour[0] + nbour_start[i+1];
+		for (int j=0, n_cnt=gal[i].size; j<n_cnt; j++) {
+			nb[j] = gal[i].data[j]+1;
 		}
+		perimeter[i+1] = gal[i].size;
 	}
-	
-	//for (int i=1; i<=num_obs; i++) {
-	//	wxString msg;
-	//	msg << "obs: " << i << " perimeter: " << perimeter[i];
-	//	msg << " nbours: " << nbours[i];
-	//	for (int j=1; j<=nbours[i]; j++) {
-	//		msg << "\n         ";
-	//		msg << "nbour[" << i << "][" << j << "]: " << nbour[i][j];
-	//		msg << ", border: " << border[i][j];
-	//	}
-	//	LOG_MSG(msg);
-	//}
 	LOG_MSG("Done CartNbrInfo creation");
 }
 
-CartNbrInfo::~CartNbrInfo()
+CartNbrInfo::CartNbrInfo(const Gda::GeomMeasures& gm, GalElement* gal,
+						 int num_obs)
+: bodies(num_obs+1), nbours(num_obs+1, 0), nbour_start(num_obs+2, 0),
+perimeter(num_obs+1, 0)
 {
-	if (nbour) {
-		for (int i=1; i<bodies; i++) if (nbour[i]) delete [] nbour[i];
-		delete [] nbour;
+	bool has_borders = (gm.GetNumObs() == num_obs);
+	for (int i=0; i<num_obs; i++) {
+		int n_bord = 0;
+		if (has_borders) n_bord = gm.border_start[i+1]-gm.border_start[i];
+		nbours[i+1] = (n_bord > 0 || !gal) ? n_bord : gal[i].size;
+		nbour_start[i+2] = nbour_start[i+1] + nbours[i+1];
 	}
-	if (border) {
-		for (int i=1; i<bodies; i++) if (border[i]) delete [] border[i];
-		delete [] border;
+	nbour.resize(nbour_start[bodies]);
+	border.resize(nbour_start[bodies], 1);
+	for (int i=0; i<num_obs; i++) {
+		if (nbours[i+1] == 0) continue;
+		const long off = nbour_start[i+1];
+		int n_bord = 0;
+		if (has_borders) n_bord = gm.border_start[i+1]-gm.border_start[i];
+		if (n_bord > 0) {
+			const int b_off = gm.border_start[i];
+			double p = 0;
+			for (int j=0; j<n_bord; j++) {
+				nbour[off+j] = gm.border_nbr[b_off+j]+1;
+				border[off+j] = gm.border_len[b_off+j];
+				p += border[off+j];
+			}
+			perimeter[i+1] = p;
+		} else {
+			for (int j=0, n_cnt=gal[i].size; j<n_cnt; j++) {
+				nbour[off+j] = gal[i].data[j]+1;
+			}
+			perimeter[i+1] = gal[i].size;
+		}
 	}
-	if (perimeter) delete [] perimeter;
+	LOG_MSG("Done CartNbrInfo creation from shared borders");
+}
+
+CartNbrInfo::~CartNbrInfo()
+{
 }
 
 
@@ -92,7 +124,7 @@ const double DorlingCartogram::friction = 0.25;
 const double DorlingCartogram::ratio = 0.1;
 const double DorlingCartogram::pi = 3.14159265;
 
-DorlingCartogram::DorlingCartogram(CartNbrInfo* nbs,
+DorlingCartogram::DorlingCartogram(CartNbrInfo* nbs_s,
 								   const std::vector<double>& orig_x,
 								   const std::vector<double>& orig_y,
 								   const std::vector<double>& orig_data,
@@ -100,9 +132,9 @@ DorlingCartogram::DorlingCartogram(CartNbrInfo* nbs,
 								   const double& orig_data_max)
 : output_radius(orig_x.size()),
 output_x(orig_x.size()), output_y(orig_x.size()),
-bodies(orig_x.size()+1),
-nbours(nbs->nbours), nbour(nbs->nbour), border(nbs->border),
-perimeter(nbs->perimeter),
+bodies(orig_x.size()+1), nbs(nbs_s),
+grid_x0(0), grid_y0(0), grid_cell_sz(1), grid_nx(1), grid_ny(1),
+cell_of(orig_x.size()+1, 0), num_workers(-1),
 secs_per_iter(0.01)
 {
 	x = new double[bodies];
@@ -111,8 +143,6 @@ secs_per_iter(0.01)
 	radius = new double[bodies];
 	xvector = new double[bodies];
 	yvector = new double[bodies];
-	list = new int[bodies];
-	tree = new leaf[bodies];
 	
 	init_cartogram(orig_x, orig_y, orig_data, orig_data_min, orig_data_max);
 }
@@ -125,84 +155,6 @@ DorlingCartogram::~DorlingCartogram()
 	if (radius) delete [] radius;
 	if (xvector) delete [] xvector;
 	if (yvector) delete [] yvector;
-	if (list) delete [] list;
-	if (tree) delete [] tree;
-}
-
-// Global variables: tree, x, y, body
-void DorlingCartogram::add_point(int pointer, int axis, int body)
-{
-    if (tree[pointer].id == 0) {
-		tree[pointer].id = body;
-		tree[pointer].left = 0;
-		tree[pointer].right = 0;
-		tree[pointer].xpos = x[body];
-		tree[pointer].ypos = y[body];
-    } else {
-		if (axis == 1) {
-			if (x[body] >= tree[pointer].xpos) {
-				if (tree[pointer].left == 0){ 
-					end_pointer += 1;
-					tree[pointer].left = end_pointer;
-				}
-				add_point(tree[pointer].left, 3-axis, body);
-			} else {
-				if (tree[pointer].right == 0) { 
-					end_pointer +=1;
-					tree[pointer].right = end_pointer;
-				}
-				add_point(tree[pointer].right, 3-axis, body);
-			}
-		} else {
-			if (y[body] >= tree[pointer].ypos) {
-				if (tree[pointer].left == 0) {
-					end_pointer += 1;
-					tree[pointer].left = end_pointer;
-				}
-				add_point(tree[pointer].left, 3-axis, body);
-			} else {
-				if (tree[pointer].right == 0) { 
-					end_pointer += 1;
-					tree[pointer].right = end_pointer;
-				}
-				add_point(tree[pointer].right, 3-axis, body);
-			}
-		}
-	}
-}
-
-// Global variables: tree, x, y, body, list, number, distance
-// modified variables: list and number
-void DorlingCartogram::get_point(int pointer, int axis, int body)
-{
-	if (pointer > 0) {
-		if (tree[pointer].id > 0) {
-			if (axis == 1) { 
-				if (x[body]-distance < tree[pointer].xpos) {
-					get_point(tree[pointer].right, 3-axis, body);
-				}
-				if (x[body]+distance >= tree[pointer].xpos) {
-					get_point(tree[pointer].left, 3-axis, body);
-				}
-			}
-			if (axis == 2) {
-				if (y[body]-distance < tree[pointer].ypos) {
-					get_point(tree[pointer].right, 3-axis, body);
-				}
-				if (y[body] + distance >= tree[pointer].ypos) {
-					get_point(tree[pointer].left, 3-axis, body);
-				}
-			}
-			if ((x[body]-distance < tree[pointer].xpos) && 
-				(x[body]+distance >= tree[pointer].xpos)) {
-				if ((y[body]-distance < tree[pointer].ypos) &&
-					(y[body]+distance >= tree[pointer].ypos)) { 
-					number += 1;
-					list[number] = tree[pointer].id;
-				}
-			}
-		}
-	}
 }
 
 // We pass in orig_data_min(max) as parameters rather than calculating
@@ -266,14 +218,16 @@ void DorlingCartogram::init_cartogram(const std::vector<double>& orig_x,
 	double xd;
 	double yd;
 	for (int body=1; body<bodies; body++) {
-		for (int nb = 1; nb <= nbours[body]; nb++) {
-			if (nbour[body][nb] > 0) {
-				if (nbour[body][nb] < body) {
-					xd = x[body] - x[nbour[body][nb]];
-					yd = y[body] - y[nbour[body][nb]];
+		const long nb_off = nbs->nbour_start[body];
+		for (int nb = 0; nb < nbs->nbours[body]; nb++) {
+			int other = nbs->nbour[nb_off+nb];
+			if (other > 0) {
+				if (other < body) {
+					xd = x[body] - x[other];
+					yd = y[body] - y[other];
 					t_dist += sqrt(xd*xd+yd*yd);
 					t_radius += sqrt(people[body]/pi) +
-						sqrt(people[nbour[body][nb]]/pi);
+						sqrt(people[other]/pi);
 				}
 			}
 		}    
@@ -298,12 +252,62 @@ void DorlingCartogram::init_cartogram(const std::vector<double>& orig_x,
 }
 
 
-int DorlingCartogram::improve(int num_iters)
+void DorlingCartogram::build_grid()
 {
-	wxStopWatch sw;
+	double xmin = x[1], xmax = x[1], ymin = y[1], ymax = y[1];
+	for (int body=2; body<bodies; body++) {
+		if (x[body] < xmin) xmin = x[body];
+		if (x[body] > xmax) xmax = x[body];
+		if (y[body] < ymin) ymin = y[body];
+		if (y[body] > ymax) ymax = y[body];
+	}
+	// A body only interacts with bodies closer than widest + radius, so
+	// cells are 2*widest wide and a query touches at most 3x3 cells.
+	// Cells are made larger when needed to keep the grid no bigger than
+	// about one cell per body.
+	double w = xmax - xmin;
+	double h = ymax - ymin;
+	grid_cell_sz = 2*widest;
+	double min_sz = sqrt((w*h) / (bodies-1));
+	if (grid_cell_sz < min_sz) grid_cell_sz = min_sz;
+	if (grid_cell_sz < w / (bodies-1)) grid_cell_sz = w / (bodies-1);
+	if (grid_cell_sz < h / (bodies-1)) grid_cell_sz = h / (bodies-1);
+	if (grid_cell_sz <= 0) grid_cell_sz = 1.0;
+	grid_x0 = xmin;
+	grid_y0 = ymin;
+	grid_nx = ((int) (w / grid_cell_sz)) + 1;
+	grid_ny = ((int) (h / grid_cell_sz)) + 1;
 	
-	// start the big loop creating the tree each iter
+	CartCellTask cell_task(this);
+	Gda::ParallelFor(bodies-1, cell_task, num_workers, 1024);
 	
+	// counting sort of bodies by cell, stable in body order
+	int num_cells = grid_nx * grid_ny;
+	grid_start.assign(num_cells+1, 0);
+	for (int body=1; body<bodies; body++) grid_start[cell_of[body]+1]++;
+	for (int c=0; c<num_cells; c++) grid_start[c+1] += grid_start[c];
+	grid_bodies.resize(bodies-1);
+	std::vector<int> pos(grid_start.begin(), grid_start.end()-1);
+	for (int body=1; body<bodies; body++) {
+		grid_bodies[pos[cell_of[body]]++] = body;
+	}
+}
+
+void DorlingCartogram::assign_cells_range(int body_start, int body_end)
+{
+	for (int body=body_start; body<body_end; body++) {
+		int cx = (int) ((x[body]-grid_x0) / grid_cell_sz);
+		int cy = (int) ((y[body]-grid_y0) / grid_cell_sz);
+		if (cx >= grid_nx) cx = grid_nx-1;
+		if (cy >= grid_ny) cy = grid_ny-1;
+		cell_of[body] = cy*grid_nx + cx;
+	}
+}
+
+// Global variables (read only): x, y, radius, grid and neighbor info
+// modified variables: xvector[body] and yvector[body] for body in range
+void DorlingCartogram::calc_forces_range(int body_start, int body_end)
+{
 	int other;
 	double closest;
 	double dist;
@@ -319,101 +323,115 @@ int DorlingCartogram::improve(int num_iters)
 	double xd;
 	double yd;
 	
-    for (int itter=0; itter<num_iters; itter++) {
-        for (int body=1; body<bodies; body++) tree[body].id = 0;
-        end_pointer = 1;
+	for (int body=body_start; body<body_end; body++) {
+		// visit all bodies within <distance> using the grid
+		const double distance = widest + radius[body];
 		
-        for (int body=1; body<bodies; body++) add_point(1,1,body);
+		xrepel = yrepel = 0.0;
+		xattract = yattract = 0.0;
+		closest = widest;
+		
+		// work out repelling force of overlapping neighbors
+		int cx_lo = (int) floor((x[body]-distance-grid_x0) / grid_cell_sz);
+		int cx_hi = (int) floor((x[body]+distance-grid_x0) / grid_cell_sz);
+		int cy_lo = (int) floor((y[body]-distance-grid_y0) / grid_cell_sz);
+		int cy_hi = (int) floor((y[body]+distance-grid_y0) / grid_cell_sz);
+		if (cx_lo < 0) cx_lo = 0;
+		if (cy_lo < 0) cy_lo = 0;
+		if (cx_hi >= grid_nx) cx_hi = grid_nx-1;
+		if (cy_hi >= grid_ny) cy_hi = grid_ny-1;
+		for (int cy=cy_lo; cy<=cy_hi; cy++) {
+			for (int cx=cx_lo; cx<=cx_hi; cx++) {
+				int c = cy*grid_nx + cx;
+				for (int k=grid_start[c]; k<grid_start[c+1]; k++) {
+					other = grid_bodies[k];
+					if (other == body) continue;
+					// same bounding box test as Dorling's get_point
+					if (!(x[body]-distance < x[other] &&
+						  x[body]+distance >= x[other] &&
+						  y[body]-distance < y[other] &&
+						  y[body]+distance >= y[other])) continue;
+					xd = x[other]-x[body];
+					yd = y[other]-y[body];
+					dist = sqrt(xd*xd+yd*yd);
+					if (dist < closest) closest = dist;
+					overlap = radius[body] + radius[other]-dist;
+					if (overlap > 0 && dist > 1) {
+						xrepel = xrepel-overlap*(x[other]-x[body])/dist;
+						yrepel = yrepel-overlap*(y[other]-y[body])/dist;
+					}
+				}
+			}
+		}
 		
-		// loop of independent body movements
+		// work out forces of attraction between neighbours
 		
-        for (int body=1; body<bodies; body++) {
-            // get <number> of neighbors within <distance> into <list[]>
-            number = 0;
-            distance = widest + radius[body];
-            get_point(1,1,body);
-			
-            xrepel = yrepel = 0.0;
-            xattract = yattract = 0.0;
-            closest = widest;
-            //LOG_MSG(wxString::Format("  number %d:", number));
-			
-            // work out repelling force of overlapping neighbors
-            if (number > 0) {
-                for (int nb=1; nb<=number; nb++) {
-                    other = list[nb];
-                    if (other != body) {
-                        xd = x[other]-x[body];
-                        yd = y[other]-y[body];
-                        dist = sqrt(xd*xd+yd*yd);
-                        if (dist < closest) closest = dist;
-                        overlap = radius[body] + radius[other]-dist;
-                        if (overlap > 0 && dist > 1) {
-							xrepel = xrepel-overlap*(x[other]-x[body])/dist;
-							yrepel = yrepel-overlap*(y[other]-y[body])/dist;
-                        }
-                    }
-                }
-            }
-			
-			// work out forces of attraction between neighbours
-			
-            for (int nb=1; nb<=nbours[body]; nb++) {
-                other = nbour[body][nb];
-                if (other != 0) {
-                    xd = (x[body]-x[other]);
-                    yd = (y[body]-y[other]);
-                    dist = sqrt(xd*xd+yd*yd);
-                    overlap = dist - radius[body] - radius[other];
-                    if (overlap > 0.0) {
-						overlap = overlap *
-							border[body][nb]/perimeter[body];
-                        xattract = xattract + overlap*(x[other]-x[body])/dist;
-                        yattract = yattract + overlap*(y[other]-y[body])/dist;
-                    }
-                }
-            }
-			
-			// now work out the combined effect of attraction and repulsion
-			
-            atrdst = sqrt(xattract * xattract + yattract * yattract);
-            repdst = sqrt(xrepel * xrepel+ yrepel * yrepel);
-            if (repdst > closest) {
-                xrepel = closest * xrepel / (repdst +1.0);
-                yrepel = closest * yrepel / (repdst +1.0);
-                repdst = closest;
-            }
-            if (repdst > 0.0) {
-                xtotal = (1.0-ratio) * xrepel +
-					ratio*(repdst*xattract/(atrdst+1.0));
-                ytotal = (1.0-ratio) * yrepel +
-					ratio*(repdst*yattract/(atrdst+1.0));
-            } else {
-                if (atrdst > closest) {
-                    xattract = closest *xattract/(atrdst+1);
-                    yattract = closest *yattract/(atrdst+1);
-                }
-                xtotal = xattract;
-                ytotal = yattract;
-            }
-            xvector[body] = friction * (xvector[body]+xtotal);
-            yvector[body] = friction * (yvector[body]+ytotal);
-        }
+		const long nb_off = nbs->nbour_start[body];
+		for (int nb=0; nb<nbs->nbours[body]; nb++) {
+			other = nbs->nbour[nb_off+nb];
+			if (other != 0) {
+				xd = (x[body]-x[other]);
+				yd = (y[body]-y[other]);
+				dist = sqrt(xd*xd+yd*yd);
+				overlap = dist - radius[body] - radius[other];
+				if (overlap > 0.0) {
+					overlap = overlap *
+						nbs->border[nb_off+nb]/nbs->perimeter[body];
+					xattract = xattract + overlap*(x[other]-x[body])/dist;
+					yattract = yattract + overlap*(y[other]-y[body])/dist;
+				}
+			}
+		}
+		
+		// now work out the combined effect of attraction and repulsion
+		
+		atrdst = sqrt(xattract * xattract + yattract * yattract);
+		repdst = sqrt(xrepel * xrepel+ yrepel * yrepel);
+		if (repdst > closest) {
+			xrepel = closest * xrepel / (repdst +1.0);
+			yrepel = closest * yrepel / (repdst +1.0);
+			repdst = closest;
+		}
+		if (repdst > 0.0) {
+			xtotal = (1.0-ratio) * xrepel +
+				ratio*(repdst*xattract/(atrdst+1.0));
+			ytotal = (1.0-ratio) * yrepel +
+				ratio*(repdst*yattract/(atrdst+1.0));
+		} else {
+			if (atrdst > closest) {
+				xattract = closest *xattract/(atrdst+1);
+				yattract = closest *yattract/(atrdst+1);
+			}
+			xtotal = xattract;
+			ytotal = yattract;
+		}
+		xvector[body] = friction * (xvector[body]+xtotal);
+		yvector[body] = friction * (yvector[body]+ytotal);
+	}
+}
+
+int DorlingCartogram::improve(int num_iters)
+{
+	wxStopWatch sw;
+	
+	if (bodies <= 1) return 0;
+	
+	// start the big loop creating the grid each iter.  Forces are
+	// computed from the positions of the previous iteration only, so
+	// all bodies are independent and are updated in parallel.
+	CartForceTask force_task(this);
+	for (int itter=0; itter<num_iters; itter++) {
+		build_grid();
+		
+		Gda::ParallelFor(bodies-1, force_task, num_workers, 256);
 		
 		// update the positions
-        
+		
 		for (int body=1; body<bodies; body++) {
-            x[body] += (xvector[body]); //+ 0.5);
-            y[body] += (yvector[body]); // + 0.5);
-        }
-    }
-	
-	//LOG_MSG(wxString::Format("CartogramNewView after %d iterations:",
-	//						 num_iters));
-	//for (int b=1; b<bodies; b++) {
-	//	LOG_MSG(wxString::Format("  obs %d, r: %f x: %f y %f", b,
-	//							 radius[b], x[b], y[b]));
-	//}
+			x[body] += (xvector[body]); //+ 0.5);
+			y[body] += (yvector[body]); // + 0.5);
+		}
+	}
 	
 	for (int i=0, its=bodies-1; i<its; i++) {
 		output_x[i] = x[i+1];
@@ -424,8 +442,5 @@ int DorlingCartogram::improve(int num_iters)
 	secs_per_iter = (((double) ms)/1000.0) / ((double) num_iters);
 	LOG_MSG(wxString::Format("CartogramNewView after %d iterations took %d ms",
 							 num_iters, (int) ms));
-	//wxMessageBox(wxString::Format("CartogramNewView after %d iterations took %ld ms",
-	//							  num_iters, sw.Time()));
 	return ms;
 }
-
@@ -37,25 +37,30 @@
 #include <vector>
 
 class GalElement;
+namespace Gda { class GeomMeasures; }
 
-// nbour, border and perimeter not used in get_point or add_point
-//   also, these variables only depend on input x,y which is constant
-//   over time
-//int** nbour; // completely read only after initilized: list of neighbors
-//int* nbours; // read only after initialized.  Number of neighbors
-//double** border; // completely read only after initilized
-//double* perimeter; // read-only, based on border
+// nbour, border and perimeter only depend on input x,y which is constant
+//   over time, so a single CartNbrInfo is shared by the cartograms for
+//   every time period.  Neighbor lists are stored in flat arrays: the
+//   neighbors of body b are nbour[nbour_start[b]] ... nbour[nbour_start[b+1]-1]
+//   and border[] is parallel to nbour[].
+//   When built from the shared borders of a polygon layer, border[] holds
+//   the length of each shared border and perimeter[] their sum, as in
+//   Dorling's original program.  Bodies that share no border with any
+//   other (islands, points) take their neighbors from gal instead, with
+//   every border set to 1.
 struct CartNbrInfo {
 	CartNbrInfo(GalElement* gal, int num_obs);
+	CartNbrInfo(const Gda::GeomMeasures& gm, GalElement* gal, int num_obs);
 	virtual ~CartNbrInfo();
 	
 	int bodies; // num_obs+1.  Will follow Dorling convention of arrays
 	            // starting from 1
-	int* nbours;  // neighbor counts. Critical for border and nbour
-	//array allocations
-	int** nbour;  // neighbor ids.  ids start from 1
-	double** border; // borders will be 1.0
-	double* perimeter; // 1.0 * nbours[i]
+	std::vector<int> nbours;  // neighbor counts
+	std::vector<long> nbour_start; // size bodies+1
+	std::vector<int> nbour;  // neighbor ids.  ids start from 1
+	std::vector<double> border; // shared border lengths, or 1.0
+	std::vector<double> perimeter; // sum of border lengths for each body
 };
 
 
@@ -70,6 +75,13 @@ public:
 	virtual ~DorlingCartogram();
 	
 	int improve(int num_iters);
+	/** Number of threads used by improve().  Defaults to all cores; lower
+	 this when several cartograms are improved at the same time. */
+	void set_num_workers(int n) { num_workers = n; }
+	
+	// called by the worker threads
+	void assign_cells_range(int body_start, int body_end);
+	void calc_forces_range(int body_start, int body_end);
 	
 	std::vector<double> output_x;
 	std::vector<double> output_y;
@@ -92,21 +104,12 @@ protected:
 						const double& orig_data_min,
 						const double& orig_data_max);
 	
-	void add_point(int pointer, int axis, int body);
-	void get_point(int pointer, int axis, int body);
-	
-	struct leaf {
-		int id;
-		double xpos;
-		double ypos;
-		int left;
-		int right;
-	};
+	// Dorling's k-d tree (add_point / get_point) is replaced by a uniform
+	// grid that is rebuilt once per iteration.  Bodies in each cell are
+	// kept in ascending order, so results do not depend on thread count.
+	void build_grid();
 	
-	int* nbours;
-	int** nbour;
-	double** border;
-	double* perimeter;
+	const CartNbrInfo* nbs;
 	
 	// original population data.  This is read only, and is
 	// completely forgotten after it is used to defined the radius array
@@ -118,38 +121,34 @@ protected:
 	// so that data is bounded well away from zero.
 	
 
-	// arrays: read-only by get_point and add_point.  These are initially
+	// arrays: read-only while forces are computed.  These are initially
 	// set to the orginal position, but over time they are modified as the
 	// circles move after each iteration.
 	double* x;
 	double* y;
 	
-	// local arrays used to update x,y after each iteration.
+	// local arrays used to update x,y after each iteration.  Each body
+	// only writes its own entry, so all bodies can be updated in parallel.
 	double* xvector;
 	double* yvector;
 	
-	// similar use to xvector, yvector.  Does not need to
-	// be global, except for efficient reuse.  Radius is set once at the
-	// beginning, but then remains constant, so it is not quite like
-	// xvector and yvector which change every iteration.
-	//std::vector<double> radius;
+	// Radius is set once at the beginning, but then remains constant.
 	double* radius;
 	
-	// variables that do change after initialization	
-	int number; // modified by get_point and used as a global variable
-	   // for to index into list array.
-	
-	int end_pointer; // modified by add_point and used as a global variable
-
 	double widest; // also max in output_radius
-	double distance; // read-only in get_point.  Could be passed into
-	// get_point as a parameter
-	
-	int* list; // array that is modified by get_point and used
-	           // in main loop of iterations to keep track of neighbors
-	
 	
-	leaf* tree; // array of leaf structs
+	// grid of bodies, rebuilt every iteration.  The bodies in cell c are
+	// grid_bodies[grid_start[c]] ... grid_bodies[grid_start[c+1]-1]
+	double grid_x0;
+	double grid_y0;
+	double grid_cell_sz;
+	int grid_nx;
+	int grid_ny;
+	std::vector<int> cell_of; // cell of each body
+	std::vector<int> grid_start;
+	std::vector<int> grid_bodies;
+	
+	int num_workers;
 	
 	static const double friction;
 	static const double ratio;
@@ -156,8 +156,10 @@ GalElement* WeightUtils::ReadGal(const wxString& fname,
 			use_rec_order = true;
 		}
 	}
+	// Without a Table, ids can only be resolved in record order.
+	if (!table_int) use_rec_order = true;
 	
-	if (num_obs != table_int->GetNumberRows()) {
+	if (table_int && num_obs != table_int->GetNumberRows()) {
 		wxString msg = "The number of observations specified in chosen ";
 		msg << "weights file is " << num_obs << ", but the number in the ";
 		msg << "current Table is " << table_int->GetNumberRows();
@@ -67,6 +67,8 @@ public:
 };
 
 namespace WeightUtils {
+	/** table_int may be null, in which case the file must use record
+	 order ids. */
 	GalElement* ReadGal(const wxString& w_fname, TableInterface* table_int);
 }
 
@@ -1,9 +1,15 @@
 
 #include <string>
 #include <vector>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
 #include <map>
 #include <algorithm>
+#include <boost/bind.hpp>
 #include <wx/stdpaths.h>
+#include <cpl_conv.h>
+#include <cpl_string.h>
 
 #include "OGRDatasourceProxy.h"
 #include "OGRLayerProxy.h"
@@ -11,8 +17,105 @@
 #include "../GdaConst.h"
 #include "../GeneralWxUtils.h"
 #include "../GenUtils.h"
+#include "../logger.h"
 
 const std::string GdaCache::HIST_TABLE_NAME = "history";
+const std::string GdaCache::LAYER_META_TABLE_NAME = "gda_cache_layer_meta";
+const std::string GdaCache::CHUNK_META_TABLE_NAME = "gda_cache_chunks";
+const int GdaCache::CHUNK_SIZE;
+const size_t GdaCache::MAX_PENDING_JOBS;
+
+namespace {
+// FNV-1a, 64 bit
+const wxUint64 FNV_OFFSET = wxULL(14695981039346656037);
+const wxUint64 FNV_PRIME = wxULL(1099511628211);
+
+inline void HashBytes(wxUint64& h, const unsigned char* p, size_t n)
+{
+	for (size_t i=0; i<n; i++) {
+		h ^= p[i];
+		h *= FNV_PRIME;
+	}
+}
+
+/** Hash geometry (as WKB) and field values of a feature into h. */
+void HashFeature(wxUint64& h, OGRFeature* f, std::vector<unsigned char>& wkb)
+{
+	OGRGeometry* geom = f->GetGeometryRef();
+	if (geom) {
+		wkb.resize(geom->WkbSize());
+		if (!wkb.empty()) {
+			geom->exportToWkb(wkbNDR, &wkb[0]);
+			HashBytes(h, &wkb[0], wkb.size());
+		}
+	}
+	int n_fields = f->GetFieldCount();
+	for (int i=0; i<n_fields; i++) {
+		unsigned char is_set = f->IsFieldSet(i) ? 1 : 0;
+		HashBytes(h, &is_set, 1);
+		if (is_set) {
+			const char* val = f->GetFieldAsString(i);
+			HashBytes(h, (const unsigned char*)val, strlen(val) + 1);
+		}
+	}
+}
+
+std::string HashToString(wxUint64 h)
+{
+	return wxString::Format("%016" wxLongLongFmtSpec "x", h).ToStdString();
+}
+
+OGRGeometry* ForceGeometryType(OGRGeometry* geom, OGRwkbGeometryType eGType)
+{
+	if (geom == NULL) return NULL;
+	if( wkbFlatten(eGType) == wkbPolygon )
+		return OGRGeometryFactory::forceToPolygon(geom);
+	else if( wkbFlatten(eGType) == wkbMultiPolygon )
+		return OGRGeometryFactory::forceToMultiPolygon(geom);
+	else if( wkbFlatten(eGType) == wkbMultiLineString )
+		return OGRGeometryFactory::forceToMultiLineString(geom);
+	return geom;
+}
+
+bool SameSchema(OGRFeatureDefn* a, OGRFeatureDefn* b)
+{
+	if (a->GetFieldCount() != b->GetFieldCount()) return false;
+	for (int i=0; i<a->GetFieldCount(); i++) {
+		OGRFieldDefn* fa = a->GetFieldDefn(i);
+		OGRFieldDefn* fb = b->GetFieldDefn(i);
+		if (fa->GetType() != fb->GetType()) return false;
+		if (!EQUAL(fa->GetNameRef(), fb->GetNameRef())) return false;
+	}
+	return true;
+}
+
+void DestroyFeatures(std::vector<OGRFeature*>& features)
+{
+	for (size_t i=0; i<features.size(); i++) {
+		OGRFeature::DestroyFeature(features[i]);
+	}
+	features.clear();
+}
+
+/** Let SQLite memory map the cache file, so that reading a cached layer is
+ served from the page cache instead of read() calls.  The mmap pragma is set
+ on the given connection only, not on every SQLite datasource in GeoDa.
+ Write-ahead logging, which is stored in the cache file, lets the worker
+ update a layer while the main thread still reads the cached copy. */
+void SetCachePragmas(OGRDataSource* cache_ds)
+{
+	OGRLayer* rs = cache_ds->ExecuteSQL("PRAGMA mmap_size=268435456", 0, 0);
+	if (rs) cache_ds->ReleaseResultSet(rs);
+	rs = cache_ds->ExecuteSQL("PRAGMA journal_mode=WAL", 0, 0);
+	if (rs) cache_ds->ReleaseResultSet(rs);
+}
+
+bool SameExtent(const OGREnvelope& a, const OGREnvelope& b)
+{
+	return (a.MinX == b.MinX && a.MinY == b.MinY &&
+			a.MaxX == b.MaxX && a.MaxY == b.MaxY);
+}
+}
 const std::string GdaCache::DB_HOST_HIST	= "db_host";
 const std::string GdaCache::DB_PORT_HIST	= "db_port";
 const std::string GdaCache::DB_NAME_HIST	= "db_name";
@@ -27,9 +130,10 @@ wxString GdaCache::GetFullPath()
     return exeDir + "cache.sqlite";
 }
 
-GdaCache::GdaCache()
+GdaCache::GdaCache(const wxString& cache_path)
+: history_table(NULL), worker(NULL), stop_worker(false), cancel_job(false)
 {
-    wxString exePath = GdaCache::GetFullPath();
+    wxString exePath = cache_path;
 #ifdef __WIN32__
 	std::wstring ws(GET_ENCODED_FILENAME(exePath));
 	std::string s(ws.begin(), ws.end());
@@ -46,6 +150,7 @@ GdaCache::GdaCache()
 	// connect to cache file
     try {
         cach_ds_proxy = new OGRDatasourceProxy(cache_filename, true);
+        SetCachePragmas(cach_ds_proxy->ds);
         layer_names = cach_ds_proxy->GetLayerNames();
         std::string sql = "SELECT * FROM history";
         history_table = cach_ds_proxy->GetLayerProxyBySQL(sql);
@@ -59,6 +164,15 @@ GdaCache::GdaCache()
         
         history_table->ReadData();
         
+        // meta data of cached layers and their chunks
+        sql = "CREATE TABLE IF NOT EXISTS " + LAYER_META_TABLE_NAME +
+              " (layer_name TEXT, n_rows INTEGER, complete INTEGER,"
+              " min_x REAL, min_y REAL, max_x REAL, max_y REAL)";
+        cach_ds_proxy->ExecuteSQL(sql);
+        sql = "CREATE TABLE IF NOT EXISTS " + CHUNK_META_TABLE_NAME +
+              " (layer_name TEXT, chunk_id INTEGER, hash TEXT)";
+        cach_ds_proxy->ExecuteSQL(sql);
+        
         for ( int i=0; i< history_table->n_rows; i++){
             history_keys.push_back( history_table->GetValueAt(i, 0).ToStdString() );
             history_vals.push_back( history_table->GetValueAt(i, 1).ToStdString() );
@@ -70,6 +184,23 @@ GdaCache::GdaCache()
 
 GdaCache::~GdaCache()
 {
+	if (worker) {
+		{
+			boost::mutex::scoped_lock lock(job_mutex);
+			stop_worker = true;
+			cancel_job = true;
+			jobs.clear();
+			job_cond.notify_all();
+		}
+		worker->join();
+		delete worker;
+		worker = NULL;
+	}
+	std::map<std::string, OGRLayerProxy*>::iterator it;
+	for (it=cached_proxies.begin(); it!=cached_proxies.end(); ++it) {
+		delete it->second;
+	}
+	cached_proxies.clear();
 	delete history_table;
     history_table = NULL;
 	delete cach_ds_proxy;
@@ -110,144 +241,403 @@ void GdaCache::CleanHistory()
 	cach_ds_proxy->ExecuteSQL(sql);
 }
 
-bool GdaCache::UpdateLayer(std::string ext_ds_name, 
-						   OGRLayerProxy* ext_layer_proxy)
+std::string GdaCache::GetCacheLayerName(const std::string& ext_ds_name,
+										const std::string& ext_layer_name)
 {
-	return false;
+	std::string name = ext_ds_name + "_" + ext_layer_name;
+	wxUint64 h = FNV_OFFSET;
+	HashBytes(h, (const unsigned char*)name.c_str(), name.size());
+	return "gdacache_" + HashToString(h);
 }
 
-bool GdaCache::IsLayerUpdated(std::string ext_ds_name, 
-							  OGRLayerProxy* ext_layer_proxy)
+bool GdaCache::IsCacheable(GdaConst::DataSourceType ds_type)
 {
-	return false;
+	if (ds_type == GdaConst::ds_sqlite) {
+		return CSLTestBoolean(CPLGetConfigOption("GEODA_CACHE_SQLITE", "NO"));
+	}
+	return (ds_type == GdaConst::ds_oci ||
+			ds_type == GdaConst::ds_postgresql ||
+			ds_type == GdaConst::ds_mysql ||
+			ds_type == GdaConst::ds_ms_sql ||
+			ds_type == GdaConst::ds_odbc ||
+			ds_type == GdaConst::ds_esri_arc_sde);
 }
 
-bool GdaCache::IsLayerCached(std::string ext_ds_name, 
-							 std::string ext_layer_name)
+OGREnvelope GdaCache::GetSourceExtent(OGRLayer* src)
 {
-	for (size_t i=0; i<layer_names.size(); i++) {
-		std::string query_layer_name = ext_ds_name + "_" + ext_layer_name;
-		std::transform(query_layer_name.begin(), query_layer_name.end(), 
-					   query_layer_name.begin(), ::tolower);
-		if (layer_names[i] == query_layer_name) return true;
-	}
-	return false;
+	// forced, since most database drivers compute it on the server
+	OGREnvelope env;
+	if (src->GetExtent(&env, TRUE) != OGRERR_NONE) env = OGREnvelope();
+	return env;
 }
 
-OGRLayerProxy* GdaCache::GetLayerProxy(std::string ext_ds_name, 
-									   std::string ext_layer_name)
+bool GdaCache::ReadLayerMeta(OGRDataSource* cache_ds,
+							 const std::string& cache_layer_name,
+							 LayerMeta& meta)
 {
-	std::string query_layer_name = ext_ds_name + "_" + ext_layer_name;
-	std::transform(query_layer_name.begin(), query_layer_name.end(), 
-				   query_layer_name.begin(), ::tolower);
+	meta.n_rows = -1;
+	meta.complete = false;
+	meta.extent = OGREnvelope();
+	std::vector<std::string>& chunk_hashes = meta.chunk_hashes;
+	chunk_hashes.clear();
+	std::string sql = "SELECT n_rows, complete, min_x, min_y, max_x, max_y"
+		" FROM " + LAYER_META_TABLE_NAME +
+		" WHERE layer_name='" + cache_layer_name + "'";
+	OGRLayer* rs = cache_ds->ExecuteSQL(sql.c_str(), 0, 0);
+	if (rs == NULL) return false;
+	OGRFeature* f = rs->GetNextFeature();
+	bool found = f != NULL;
+	if (f) {
+		meta.n_rows = f->GetFieldAsInteger(0);
+		meta.complete = f->GetFieldAsInteger(1) != 0;
+		meta.extent.MinX = f->GetFieldAsDouble(2);
+		meta.extent.MinY = f->GetFieldAsDouble(3);
+		meta.extent.MaxX = f->GetFieldAsDouble(4);
+		meta.extent.MaxY = f->GetFieldAsDouble(5);
+		OGRFeature::DestroyFeature(f);
+	}
+	cache_ds->ReleaseResultSet(rs);
+	if (!found) return false;
 	
-	return cach_ds_proxy->GetLayerProxy(query_layer_name);
+	sql = "SELECT chunk_id, hash FROM " + CHUNK_META_TABLE_NAME +
+		" WHERE layer_name='" + cache_layer_name + "'";
+	rs = cache_ds->ExecuteSQL(sql.c_str(), 0, 0);
+	if (rs == NULL) return true;
+	while ((f = rs->GetNextFeature()) != NULL) {
+		int chunk_id = f->GetFieldAsInteger(0);
+		if (chunk_id >= 0) {
+			if (chunk_id >= (int)chunk_hashes.size())
+				chunk_hashes.resize(chunk_id+1);
+			chunk_hashes[chunk_id] = f->GetFieldAsString(1);
+		}
+		OGRFeature::DestroyFeature(f);
+	}
+	cache_ds->ReleaseResultSet(rs);
+	return true;
 }
 
-bool GdaCache::CacheLayer(std::string ext_ds_name, 
-						  OGRLayerProxy* ext_layer_proxy)
+OGRLayer* GdaCache::CreateCacheLayer(OGRLayer* poSrcLayer,
+									 OGRDataSource* cache_ds,
+									 const std::string& cache_layer_name)
 {
-	OGRLayer* poSrcLayer = ext_layer_proxy->layer;
-	
 	// get information from current layer: geomtype, layer_name
     // (NOTE: we don't consider coodinator system and translation here)
-    OGRFeatureDefn *poSrcFDefn = poSrcLayer->GetLayerDefn();
-    int eGType = poSrcFDefn->GetGeomType();
-    const char* pszNewLayerName = poSrcLayer->GetName();
-    int bForceToPolygon = FALSE;
-    int bForceToMultiPolygon = FALSE;
-    int bForceToMultiLineString = FALSE;
+	OGRFeatureDefn *poSrcFDefn = poSrcLayer->GetLayerDefn();
+	char** papszLCO = NULL;
+	papszLCO = CSLAddString(papszLCO, "OVERWRITE=yes");
+	OGRLayer *poDstLayer = cache_ds->CreateLayer(cache_layer_name.c_str(),
+												 poSrcLayer->GetSpatialRef(),
+												 poSrcFDefn->GetGeomType(),
+												 papszLCO);
+	CSLDestroy(papszLCO);
+	if (poDstLayer == NULL) return NULL;
 	
-    if( wkbFlatten(eGType) == wkbPolygon )
-        bForceToPolygon = TRUE;
-    else if( wkbFlatten(eGType) == wkbMultiPolygon )
-        bForceToMultiPolygon = TRUE;
-    else if( wkbFlatten(eGType) == wkbMultiLineString )
-        bForceToMultiLineString = TRUE;
+	// Add fields. here to copy all field.
+	int nSrcFieldCount = poSrcFDefn->GetFieldCount();
+	for (int iField = 0; iField < nSrcFieldCount; iField++) {
+		OGRFieldDefn oFieldDefn( poSrcFDefn->GetFieldDefn(iField) );
+		if (poDstLayer->CreateField( &oFieldDefn ) != OGRERR_NONE) {
+			return NULL;
+		}
+	}
+	std::string sql = "DELETE FROM " + CHUNK_META_TABLE_NAME +
+		" WHERE layer_name='" + cache_layer_name + "'";
+	cache_ds->ExecuteSQL(sql.c_str(), 0, 0);
+	sql = "DELETE FROM " + LAYER_META_TABLE_NAME +
+		" WHERE layer_name='" + cache_layer_name + "'";
+	cache_ds->ExecuteSQL(sql.c_str(), 0, 0);
+	sql = "INSERT INTO " + LAYER_META_TABLE_NAME + " VALUES('" +
+		cache_layer_name + "', 0, 0, 0, 0, 0, 0)";
+	cache_ds->ExecuteSQL(sql.c_str(), 0, 0);
+	return poDstLayer;
+}
+
+bool GdaCache::SyncLayer(OGRLayer* poSrcLayer, OGRDataSource* cache_ds,
+						 const std::string& cache_layer_name,
+						 bool check_only, bool& changed,
+						 const volatile bool* cancel)
+{
+	changed = false;
+	LayerMeta meta;
+	bool has_meta = ReadLayerMeta(cache_ds, cache_layer_name, meta);
+	int old_n_rows = meta.n_rows;
+	bool complete = meta.complete;
+	std::vector<std::string>& old_hashes = meta.chunk_hashes;
 	
-	//Setup coordinate transformation if we need it.
-	OGRCoordinateTransformation *poCT = NULL;
-	bool bTransform                   = FALSE;
-	OGRSpatialReference *poSourceSRS = NULL;
-	// todo
-	OGRSpatialReference *poOutputSRS = new OGRSpatialReference("EPSG:4326");
-
-	// Cache
-	char *papszLCO[] = {"OVERWRITE=yes","FORMAT=Spatialite"};
-	std::string cache_layer_name = ext_ds_name + "_"+ext_layer_proxy->name;
-    OGRDataSource *poDstDS = cach_ds_proxy->ds;
-    OGRLayer *poDstLayer = poDstDS->CreateLayer(cache_layer_name.c_str(), 
-												poOutputSRS, 
-												(OGRwkbGeometryType)eGType, 
-												papszLCO);
+	OGRLayer* poDstLayer = cache_ds->GetLayerByName(cache_layer_name.c_str());
+	if (poDstLayer && (!has_meta || !SameSchema(poSrcLayer->GetLayerDefn(),
+												poDstLayer->GetLayerDefn()))) {
+		// unknown or outdated structure: rebuild the cached copy
+		poDstLayer = NULL;
+	}
 	if (poDstLayer == NULL) {
-		// raise create cache failed.
-		return false;
+		changed = true;
+		if (check_only) return true;
+		poDstLayer = CreateCacheLayer(poSrcLayer, cache_ds, cache_layer_name);
+		if (poDstLayer == NULL) return false;
+		old_n_rows = 0;
+		old_hashes.clear();
+	} else if (!check_only) {
+		std::string sql = "UPDATE " + LAYER_META_TABLE_NAME +
+			" SET complete=0 WHERE layer_name='" + cache_layer_name + "'";
+		cache_ds->ExecuteSQL(sql.c_str(), 0, 0);
 	}
-    // Process Layer style table
-    poDstLayer->SetStyleTable( poSrcLayer->GetStyleTable () );
-	
-    // Add fields. here to copy all field.
-    int nSrcFieldCount = poSrcFDefn->GetFieldCount();
-    int iField;
-    OGRFeatureDefn *poDstFDefn = poDstLayer->GetLayerDefn();
+	if (!complete) changed = true;
 	
-    for( iField = 0; iField < nSrcFieldCount; iField++ )
-    {    
-        OGRFieldDefn* poSrcFieldDefn = poSrcFDefn->GetFieldDefn(iField);
-        OGRFieldDefn oFieldDefn( poSrcFieldDefn );
+	OGRwkbGeometryType eGType = poDstLayer->GetGeomType();
+	std::vector<OGRFeature*> chunk;
+	std::vector<unsigned char> wkb;
+	chunk.reserve(CHUNK_SIZE);
+	wxUint64 hash = FNV_OFFSET;
+	int row = 0;
+	int chunk_id = 0;
+	bool more = true;
+	poSrcLayer->ResetReading();
+	while (more) {
+		OGRFeature* poFeature = poSrcLayer->GetNextFeature();
+		more = poFeature != NULL;
+		if (poFeature) {
+			if (cancel && *cancel) {
+				OGRFeature::DestroyFeature(poFeature);
+				DestroyFeatures(chunk);
+				return false;
+			}
+			HashFeature(hash, poFeature, wkb);
+			chunk.push_back(poFeature);
+			row++;
+			if (row % CHUNK_SIZE != 0) continue;
+		}
+		if (chunk.empty()) break;
 		
-        // The field may have been already created at layer creation 
-		if (poDstLayer->CreateField( &oFieldDefn ) == OGRERR_NONE)
-        {    
-            // now that we've created a field, GetLayerDefn() won't return NULL
-            if (poDstFDefn == NULL)
-                poDstFDefn = poDstLayer->GetLayerDefn();
-        }    
-    }    
-	
-    // Transfer feature from Source Layer to Dest Layer
-    OGRFeature  *poFeature;
-    GIntBig      nFeaturesWritten = 0;
-    poSrcLayer->ResetReading();
+		// a full chunk, or the last partial one
+		std::string hex = HashToString(hash);
+		if (chunk_id < (int)old_hashes.size() && old_hashes[chunk_id] == hex) {
+			DestroyFeatures(chunk);
+		} else {
+			changed = true;
+			if (check_only) {
+				DestroyFeatures(chunk);
+				return true;
+			}
+			bool use_transactions =
+				poDstLayer->StartTransaction() == OGRERR_NONE;
+			for (size_t k=0; k<chunk.size(); k++) {
+				long fid = (long)chunk_id * CHUNK_SIZE + k + 1;
+				OGRFeature* poDstFeature =
+					OGRFeature::CreateFeature(poDstLayer->GetLayerDefn());
+				poDstFeature->SetFrom(chunk[k]);
+				poDstFeature->SetGeometryDirectly(
+					ForceGeometryType(poDstFeature->StealGeometry(), eGType));
+				poDstFeature->SetFID(fid);
+				OGRFeature* old = fid <= old_n_rows ?
+					poDstLayer->GetFeature(fid) : NULL;
+				OGRErr err;
+				if (old) {
+					OGRFeature::DestroyFeature(old);
+					err = poDstLayer->SetFeature(poDstFeature);
+				} else {
+					err = poDstLayer->CreateFeature(poDstFeature);
+				}
+				OGRFeature::DestroyFeature(poDstFeature);
+				if (err != OGRERR_NONE) {
+					if (use_transactions) poDstLayer->RollbackTransaction();
+					DestroyFeatures(chunk);
+					return false;
+				}
+			}
+			std::ostringstream sql;
+			sql << "DELETE FROM " << CHUNK_META_TABLE_NAME
+				<< " WHERE layer_name='" << cache_layer_name
+				<< "' AND chunk_id=" << chunk_id;
+			cache_ds->ExecuteSQL(sql.str().c_str(), 0, 0);
+			sql.str("");
+			sql << "INSERT INTO " << CHUNK_META_TABLE_NAME << " VALUES('"
+				<< cache_layer_name << "'," << chunk_id << ",'" << hex << "')";
+			cache_ds->ExecuteSQL(sql.str().c_str(), 0, 0);
+			if (use_transactions &&
+				poDstLayer->CommitTransaction() != OGRERR_NONE) {
+				DestroyFeatures(chunk);
+				return false;
+			}
+			DestroyFeatures(chunk);
+		}
+		hash = FNV_OFFSET;
+		chunk_id++;
+	}
+	if (row != old_n_rows) changed = true;
+	if (check_only) return true;
 	
-    while (poFeature = poSrcLayer->GetNextFeature())
-    {
-        OGRFeature *poDstFeature = OGRFeature::CreateFeature(
-										poDstLayer->GetLayerDefn() );
-        poDstFeature->SetFrom(poFeature);
-		
-        OGRGeometry *poDstGeometry = poDstFeature->GetGeometryRef();
-        if (poDstGeometry != NULL)
-        {
-            if( bForceToPolygon )
-            {
-                poDstFeature->SetGeometryDirectly(
-					OGRGeometryFactory::forceToPolygon(
-						poDstFeature->StealGeometry()));
-            }
-            else if( bForceToMultiPolygon )
-            {
-                poDstFeature->SetGeometryDirectly(
-					OGRGeometryFactory::forceToMultiPolygon(
-					    poDstFeature->StealGeometry() ) );
-            }
-            else if ( bForceToMultiLineString )
-            {
-                poDstFeature->SetGeometryDirectly(
-					OGRGeometryFactory::forceToMultiLineString(
-						poDstFeature->StealGeometry() ) );
-            }
-        }
-        if( poDstLayer->CreateFeature( poDstFeature ) == OGRERR_NONE )
-        {
-            nFeaturesWritten ++;
-        }            
-        OGRFeature::DestroyFeature( poDstFeature );
-        OGRFeature::DestroyFeature( poFeature );
-    }
-    OGRDataSource::DestroyDataSource(poDstDS);
-    // XXX
-    // delete poDstLayer;
+	// drop rows and chunks the source does not have anymore
+	for (long fid = row + 1; fid <= old_n_rows; fid++) {
+		poDstLayer->DeleteFeature(fid);
+	}
+	std::ostringstream sql;
+	sql << "DELETE FROM " << CHUNK_META_TABLE_NAME << " WHERE layer_name='"
+		<< cache_layer_name << "' AND chunk_id>=" << chunk_id;
+	cache_ds->ExecuteSQL(sql.str().c_str(), 0, 0);
+	sql.str("");
+	OGREnvelope env = GetSourceExtent(poSrcLayer);
+	sql << std::setprecision(17);
+	sql << "UPDATE " << LAYER_META_TABLE_NAME << " SET n_rows=" << row
+		<< ", complete=1, min_x=" << env.MinX << ", min_y=" << env.MinY
+		<< ", max_x=" << env.MaxX << ", max_y=" << env.MaxY
+		<< " WHERE layer_name='" << cache_layer_name << "'";
+	cache_ds->ExecuteSQL(sql.str().c_str(), 0, 0);
+	poDstLayer->SyncToDisk();
 	return true;
 }
+
+bool GdaCache::UpdateLayer(std::string ext_ds_name, 
+						   OGRLayerProxy* ext_layer_proxy)
+{
+	if (!IsLayerCached(ext_ds_name, ext_layer_proxy->name)) return false;
+	return CacheLayer(ext_ds_name, ext_layer_proxy);
+}
+
+bool GdaCache::IsLayerUpdated(std::string ext_ds_name, 
+							  OGRLayerProxy* ext_layer_proxy)
+{
+	std::string cache_layer_name =
+		GetCacheLayerName(ext_ds_name, ext_layer_proxy->name);
+	bool changed = false;
+	if (!SyncLayer(ext_layer_proxy->layer, cach_ds_proxy->ds,
+				   cache_layer_name, true, changed, NULL)) {
+		return true;
+	}
+	return changed;
+}
+
+bool GdaCache::IsLayerCached(std::string ext_ds_name, 
+							 std::string ext_layer_name)
+{
+	LayerMeta meta;
+	std::string cache_layer_name =
+		GetCacheLayerName(ext_ds_name, ext_layer_name);
+	return ReadLayerMeta(cach_ds_proxy->ds, cache_layer_name, meta) &&
+		meta.complete;
+}
+
+OGRLayerProxy* GdaCache::GetLayerProxy(std::string ext_ds_name, 
+									   OGRLayerProxy* ext_layer_proxy)
+{
+	std::string ext_layer_name = ext_layer_proxy->name;
+	std::string cache_layer_name =
+		GetCacheLayerName(ext_ds_name, ext_layer_name);
+	{
+		boost::mutex::scoped_lock lock(job_mutex);
+		if (active_cache_layer == cache_layer_name) return NULL;
+	}
+	LayerMeta meta;
+	if (!ReadLayerMeta(cach_ds_proxy->ds, cache_layer_name, meta) ||
+		!meta.complete) {
+		return NULL;
+	}
+	// Only metadata the source knows without sending features: the row
+	// count, read by the proxy already, and the extent.  The chunk hashes
+	// are compared by the worker (see RequestCacheLayer).
+	if (ext_layer_proxy->n_rows >= 0 &&
+		ext_layer_proxy->n_rows != meta.n_rows) return NULL;
+	if (!SameExtent(GetSourceExtent(ext_layer_proxy->layer), meta.extent)) {
+		return NULL;
+	}
+	
+	std::map<std::string, OGRLayerProxy*>::iterator it =
+		cached_proxies.find(cache_layer_name);
+	if (it != cached_proxies.end()) {
+		it->second->n_rows = meta.n_rows;
+		return it->second;
+	}
+	OGRLayer* layer =
+		cach_ds_proxy->ds->GetLayerByName(cache_layer_name.c_str());
+	if (layer == NULL) return NULL;
+	// A proxy of its own, rather than the pooled one of the cache
+	// datasource, carries the name of the external layer.  Edits have to
+	// go to the external datasource, not the cached copy.
+	OGRLayerProxy* layer_proxy =
+		new OGRLayerProxy(ext_layer_name, layer, cach_ds_proxy->ds_type);
+	layer_proxy->is_writable = false;
+	cached_proxies[cache_layer_name] = layer_proxy;
+	return layer_proxy;
+}
+
+bool GdaCache::CacheLayer(std::string ext_ds_name, 
+						  OGRLayerProxy* ext_layer_proxy)
+{
+	std::string cache_layer_name =
+		GetCacheLayerName(ext_ds_name, ext_layer_proxy->name);
+	bool changed = false;
+	return SyncLayer(ext_layer_proxy->layer, cach_ds_proxy->ds,
+					 cache_layer_name, false, changed, NULL);
+}
+
+void GdaCache::RequestCacheLayer(std::string ext_ds_name,
+								 std::string ext_layer_name)
+{
+	boost::mutex::scoped_lock lock(job_mutex);
+	std::pair<std::string, std::string> job(ext_ds_name, ext_layer_name);
+	if (std::find(jobs.begin(), jobs.end(), job) != jobs.end()) return;
+	// the worker is refreshing this layer right now
+	if (active_cache_layer == GetCacheLayerName(ext_ds_name, ext_layer_name)) {
+		return;
+	}
+	if (jobs.size() >= MAX_PENDING_JOBS) jobs.pop_front();
+	jobs.push_back(job);
+	if (worker == NULL) {
+		worker = new boost::thread(boost::bind(&GdaCache::WorkerLoop, this));
+	}
+	job_cond.notify_all();
+}
+
+void GdaCache::CancelCaching()
+{
+	boost::mutex::scoped_lock lock(job_mutex);
+	jobs.clear();
+	cancel_job = true;
+}
+
+void GdaCache::WorkerLoop()
+{
+	while (true) {
+		std::pair<std::string, std::string> job;
+		{
+			boost::mutex::scoped_lock lock(job_mutex);
+			while (jobs.empty() && !stop_worker) job_cond.wait(lock);
+			if (stop_worker) return;
+			job = jobs.front();
+			jobs.pop_front();
+			cancel_job = false;
+			active_cache_layer = GetCacheLayerName(job.first, job.second);
+		}
+		RunJob(job.first, job.second);
+		boost::mutex::scoped_lock lock(job_mutex);
+		active_cache_layer.clear();
+	}
+}
+
+void GdaCache::RunJob(const std::string& ext_ds_name,
+					  const std::string& ext_layer_name)
+{
+	// OGR datasources are not thread safe: use own connections here
+	OGRDataSource* src_ds = OGRSFDriverRegistrar::Open(ext_ds_name.c_str(),
+													   FALSE);
+	if (src_ds == NULL) return;
+	OGRDataSource* cache_ds = OGRSFDriverRegistrar::Open(cache_filename.c_str(),
+														 TRUE);
+	if (cache_ds == NULL) {
+		OGRDataSource::DestroyDataSource(src_ds);
+		return;
+	}
+	SetCachePragmas(cache_ds);
+	OGRLayer* src_layer = src_ds->GetLayerByName(ext_layer_name.c_str());
+	if (src_layer) {
+		std::string cache_layer_name =
+			GetCacheLayerName(ext_ds_name, ext_layer_name);
+		bool changed = false;
+		if (!SyncLayer(src_layer, cache_ds, cache_layer_name, false, changed,
+					   &cancel_job)) {
+			LOG_MSG("GdaCache: caching layer stopped before completion");
+		}
+	}
+	OGRDataSource::DestroyDataSource(cache_ds);
+	OGRDataSource::DestroyDataSource(src_ds);
+}
@@ -23,22 +23,32 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <deque>
+#include <boost/thread.hpp>
 
 #include "OGRDatasourceProxy.h"
 #include "OGRLayerProxy.h"
+#include "../GdaConst.h"
 
 /**
  * GdaCache is a spatialite based cache sytem that
  * stores remote fetching data locally for better I/O performance.
  *
+ * A cached layer is split into chunks of CHUNK_SIZE features. For each chunk
+ * the cache stores a content hash of the source features, so an update only
+ * rewrites the chunks whose hash changed. The row count and extent reported
+ * by the source are stored as well. A layer that is fully cached and still
+ * has that row count and extent is opened from the local copy (memory
+ * mapped by SQLite) instead of the remote database, and the chunk hashes are
+ * checked again by the background worker.
+ *
  * \code
  * // GeoDa Cache datasource name
  * string ds_name = GdaConst::cache_datasource_name;
- * // Layer name stored in GeoDa cache is composed by
- * // external datasource name plus layer name
+ * // Layer name stored in GeoDa cache is derived from the
+ * // external datasource name plus layer name, see GetCacheLayerName()
  * // Ex: OCI:oracle/oracle@192.168.56.101:1521/xe_TEST5
- * string layer_name = ext_ds_name + "_" + ext_layer_name;
- * OGRDataAdapter::GetInstance()->ReadLayer(ds_name, layer_name);
+ * OGRLayerProxy* layer = gda_cache->GetLayerProxy(ext_ds_name, ext_layer);
  * \endcode
  */
 class GdaCache  {
@@ -48,16 +58,25 @@ public:
 	 * Constructor of GdaCache. 
 	 *
 	 * Connect to spatialite local cache database. Get related meta information.
+	 * The database is cache.sqlite next to the executable unless cache_path
+	 * is given.
 	 */
-	GdaCache();
+	GdaCache(const wxString& cache_path = GetFullPath());
 	~GdaCache();
 	
+	//!< number of features per hashed/upserted chunk
+	static const int CHUNK_SIZE = 1000;
+	//!< max number of pending background cache requests
+	static const size_t MAX_PENDING_JOBS = 4;
+	
 private:
     std::string cache_filename;
 	OGRDatasourceProxy* cach_ds_proxy;
 	std::vector<std::string> layer_names; //<! layer name in cache is composed
 										  //<! by orginal ds_name and layer_name
 	static const std::string HIST_TABLE_NAME;
+	static const std::string LAYER_META_TABLE_NAME;
+	static const std::string CHUNK_META_TABLE_NAME;
 	static const std::string DB_HOST_HIST;
 	static const std::string DB_PORT_HIST;
 	static const std::string DB_NAME_HIST;
@@ -73,8 +92,66 @@ private:
 	std::vector<std::string> history_keys;
 	std::vector<std::string> history_vals;
 	
+	// read-only proxies of cached layers handed out by GetLayerProxy(),
+	// keyed by cache layer name and owned by the cache
+	std::map<std::string, OGRLayerProxy*> cached_proxies;
+	
+	// Background caching: a single worker thread takes (ds_name, layer_name)
+	// requests from a bounded queue and synchronizes them into the cache
+	// using its own connections to the external and cache datasources.
+	boost::thread* worker;
+	boost::mutex job_mutex;
+	boost::condition_variable job_cond;
+	std::deque<std::pair<std::string, std::string> > jobs;
+	std::string active_cache_layer; //<! cache layer the worker is writing
+	bool stop_worker;
+	volatile bool cancel_job;
+	
+	void WorkerLoop();
+	void RunJob(const std::string& ext_ds_name,
+				const std::string& ext_layer_name);
+	
+	/**
+	 * Read the source layer once, hashing every chunk of CHUNK_SIZE features.
+	 * Unless check_only is set, chunks whose hash differs from the stored one
+	 * are upserted into the cache layer, each in one transaction. changed is
+	 * set if the row count or any chunk differs. Returns false on error or
+	 * when cancelled through *cancel.
+	 */
+	static bool SyncLayer(OGRLayer* src, OGRDataSource* cache_ds,
+						  const std::string& cache_layer_name,
+						  bool check_only, bool& changed,
+						  const volatile bool* cancel);
+	static OGRLayer* CreateCacheLayer(OGRLayer* src, OGRDataSource* cache_ds,
+									  const std::string& cache_layer_name);
+	struct LayerMeta {
+		int n_rows;
+		bool complete;
+		OGREnvelope extent; //!< as reported by the source at the last sync
+		std::vector<std::string> chunk_hashes;
+	};
+	static bool ReadLayerMeta(OGRDataSource* cache_ds,
+							  const std::string& cache_layer_name,
+							  LayerMeta& meta);
+	/** Extent of src as the datasource reports it, all zero if unknown. */
+	static OGREnvelope GetSourceExtent(OGRLayer* src);
+	
 public:
     static wxString GetFullPath();
+	/**
+	 * Name of the layer in cache for an external layer. The name is a hash
+	 * of ext_ds_name and ext_layer_name, so connection strings (and their
+	 * passwords) are not written into the cache schema.
+	 */
+	static std::string GetCacheLayerName(const std::string& ext_ds_name,
+										 const std::string& ext_layer_name);
+	/**
+	 * Only layers from database datasources are worth caching locally. A
+	 * local SQLite file is cacheable too when the GDAL config option (or
+	 * environment variable) GEODA_CACHE_SQLITE is YES, so that the cache can
+	 * be tested against a local file standing in for a remote database.
+	 */
+	static bool IsCacheable(GdaConst::DataSourceType ds_type);
 	/**
 	 * Get history information for autocompletion.
 	 * For example:
@@ -93,11 +170,10 @@ public:
 	void CleanHistory();
 	
 	/**
-	 * GdaCache is used to store OGR layer (in memory) to local Spatialite.
-	 * This is done in a thread that will not impact the usage of main program.
+	 * Store an OGR layer to local Spatialite in the calling thread.
 	 *
-	 * If layer has been cached before, update the layer in cache.
-	 * Otherwise, create a new layer and store it in Geoda cache.
+	 * If layer has been cached before, update the changed chunks of the layer
+	 * in cache. Otherwise, create a new layer and store it in Geoda cache.
 	 */
 	bool CacheLayer(std::string ext_ds_name, 
 					OGRLayerProxy* ext_layer_proxy);
@@ -105,14 +181,40 @@ public:
 	bool UpdateLayer(std::string ext_ds_name, 
 					 OGRLayerProxy* ext_layer_proxy);
 	
+	/**
+	 * Compare the row count and chunk hashes of the external layer with the
+	 * cached ones. Stops reading at the first changed chunk.
+	 */
 	bool IsLayerUpdated(std::string ext_ds_name, 
 						OGRLayerProxy* ext_layer_proxy);
 	
 	bool IsLayerCached(std::string ext_ds_name, 
 					   std::string ext_layer_name);
 	
+	/**
+	 * Cache-hit fast path: return a read-only proxy of the cached copy if the
+	 * layer is completely cached, is not being updated by the worker, and
+	 * ext_layer_proxy's layer still reports the row count and extent stored
+	 * at the last sync. No features of the external layer are read; callers
+	 * should queue RequestCacheLayer to compare the chunk hashes in the
+	 * background. The proxy is named after the external layer and owned by
+	 * the cache. Otherwise return NULL.
+	 */
 	OGRLayerProxy* GetLayerProxy(std::string ext_ds_name, 
-								 std::string ext_layer_name);
+								 OGRLayerProxy* ext_layer_proxy);
+	
+	/**
+	 * Queue caching (or refreshing) a layer on the background worker. When
+	 * MAX_PENDING_JOBS are already pending the oldest request is dropped.
+	 */
+	void RequestCacheLayer(std::string ext_ds_name,
+						   std::string ext_layer_name);
+	
+	/**
+	 * Drop pending requests and stop the one that is running. The running
+	 * job keeps the chunks it has committed.
+	 */
+	void CancelCaching();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,504 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <cstring>
+#include <boost/thread/mutex.hpp>
+#include <wx/filename.h>
+#include "../GdaParallel.h"
+#include "../GenUtils.h"
+#include "../Generic/GdaShape.h"
+#include "CsrWeight.h"
+#include "GeomMeasures.h"
+
+namespace {
+	const char file_magic[8] = { 'G','D','A','G','E','O','M','3' };
+	
+	struct EdgeRec {
+		EdgeRec(const Shapefile::Edge& e_s, int obs_s, double len_s)
+		: e(e_s), obs(obs_s), len(len_s) {}
+		Shapefile::Edge e;
+		int obs;
+		double len;
+	};
+	
+	bool EdgeLess(const EdgeRec& r1, const EdgeRec& r2)
+	{
+		if (r1.e.a.x != r2.e.a.x) return r1.e.a.x < r2.e.a.x;
+		if (r1.e.a.y != r2.e.a.y) return r1.e.a.y < r2.e.a.y;
+		if (r1.e.b.x != r2.e.b.x) return r1.e.b.x < r2.e.b.x;
+		if (r1.e.b.y != r2.e.b.y) return r1.e.b.y < r2.e.b.y;
+		return r1.obs < r2.obs;
+	}
+	
+	struct BorderPair {
+		BorderPair(int i_s, int j_s, double len_s)
+		: i(i_s), j(j_s), len(len_s) {}
+		int i; // i < j
+		int j;
+		double len;
+	};
+	
+	bool PairLess(const BorderPair& p1, const BorderPair& p2)
+	{
+		return p1.i < p2.i || (p1.i == p2.i && p1.j < p2.j);
+	}
+	
+	typedef std::vector<std::vector<EdgeRec> > EdgeBuckets;
+	
+	/** Measure the records in [start, end). */
+	struct MeasureTask {
+		MeasureTask(const Shapefile::Main& main_s, Gda::GeomMeasures& gm_s)
+		: main(main_s), gm(gm_s) {}
+		void operator()(int start, int end, int thread_id) {
+			for (int i=start; i<end; i++) {
+				Shapefile::RecordContents* rc = main.records[i].contents_p;
+				if (!rc || rc->shape_type == 0) continue;
+				if (main.header.shape_type == Shapefile::POINT) {
+					MeasurePoint(i, (Shapefile::PointContents*) rc);
+				} else if (main.header.shape_type == Shapefile::POLYGON) {
+					MeasurePolygon(i, (Shapefile::PolygonContents*) rc);
+				}
+			}
+		}
+		void MeasurePoint(int i, Shapefile::PointContents* pc) {
+			gm.null_shp[i] = 0;
+			gm.centroid_x[i] = gm.mean_center_x[i] = pc->x;
+			gm.centroid_y[i] = gm.mean_center_y[i] = pc->y;
+			gm.bb_xmin[i] = gm.bb_xmax[i] = pc->x;
+			gm.bb_ymin[i] = gm.bb_ymax[i] = pc->y;
+		}
+		void MeasurePolygon(int i, Shapefile::PolygonContents* pc) {
+			int n = pc->num_points;
+			if (n == 0 || (int) pc->points.size() < n) return;
+			const std::vector<Shapefile::Point>& pts = pc->points;
+			gm.null_shp[i] = 0;
+			wxRealPoint mc = GdaShapeAlgs::calculateMeanCenter(pts);
+			gm.mean_center_x[i] = mc.x;
+			gm.mean_center_y[i] = mc.y;
+			int num_parts = pc->parts.size();
+			int first_cnt = num_parts > 1 ? pc->parts[1]-pc->parts[0] : n;
+			wxRealPoint c = GdaShapeAlgs::calculateCentroid(first_cnt, pts);
+			gm.centroid_x[i] = c.x;
+			gm.centroid_y[i] = c.y;
+			
+			double xmin = pts[0].x, xmax = pts[0].x;
+			double ymin = pts[0].y, ymax = pts[0].y;
+			double a = 0, perim = 0;
+			for (int part=0; part<std::max(num_parts, 1); part++) {
+				int ps = num_parts > 0 ? pc->parts[part] : 0;
+				int pe = part+1 < num_parts ? pc->parts[part+1] : n;
+				int m = pe - ps;
+				if (m <= 0) continue;
+				const Shapefile::Point* r = &pts[ps];
+				for (int k=0; k<m; k++) {
+					xmin = std::min(xmin, r[k].x);
+					xmax = std::max(xmax, r[k].x);
+					ymin = std::min(ymin, r[k].y);
+					ymax = std::max(ymax, r[k].y);
+				}
+				if (m <= 2) continue;
+				// ring is a p-gon, whether or not it is closed
+				int p = (r[0].x == r[m-1].x && r[0].y == r[m-1].y) ? m-1 : m;
+				for (int k=0; k<p; k++) {
+					const Shapefile::Point& u = r[k];
+					const Shapefile::Point& v = r[(k+1)%p];
+					a += u.x * v.y - v.x * u.y;
+					double dx = v.x - u.x, dy = v.y - u.y;
+					perim += sqrt(dx*dx + dy*dy);
+				}
+			}
+			gm.area[i] = a/2.0;
+			gm.perimeter[i] = perim;
+			gm.bb_xmin[i] = xmin;
+			gm.bb_ymin[i] = ymin;
+			gm.bb_xmax[i] = xmax;
+			gm.bb_ymax[i] = ymax;
+		}
+		const Shapefile::Main& main;
+		Gda::GeomMeasures& gm;
+	};
+	
+	/** Add each polygon edge of the records in [start, end) to the bucket
+	 of this thread picked by its hash.  progress counts records. */
+	struct EdgeTask {
+		EdgeTask(const Shapefile::Main& main_s, EdgeBuckets& buckets_s,
+				 int num_buckets_s, const volatile bool* cancel_s,
+				 volatile long* progress_s)
+		: main(main_s), buckets(buckets_s), num_buckets(num_buckets_s),
+		cancel(cancel_s), progress(progress_s), done(0) {}
+		void operator()(int start, int end, int thread_id) {
+			std::vector<EdgeRec>* local = &buckets[thread_id*num_buckets];
+			for (int i=start; i<end; i++) {
+				if (cancel && *cancel) return;
+				if (progress && (i-start) % 256 == 255) {
+					boost::mutex::scoped_lock lock(mutex);
+					done += 256;
+					*progress = done;
+				}
+				Shapefile::PolygonContents* pc =
+					(Shapefile::PolygonContents*) main.records[i].contents_p;
+				if (!pc || pc->shape_type == 0) continue;
+				int n = pc->num_points;
+				if (n == 0 || (int) pc->points.size() < n) continue;
+				int num_parts = pc->parts.size();
+				for (int part=0; part<std::max(num_parts, 1); part++) {
+					int ps = num_parts > 0 ? pc->parts[part] : 0;
+					int pe = part+1 < num_parts ? pc->parts[part+1] : n;
+					int m = pe - ps;
+					if (m <= 2) continue;
+					const Shapefile::Point* r = &pc->points[ps];
+					int p = (r[0].x == r[m-1].x && r[0].y == r[m-1].y) ? m-1 : m;
+					for (int k=0; k<p; k++) {
+						const Shapefile::Point& u = r[k];
+						const Shapefile::Point& v = r[(k+1)%p];
+						double dx = v.x - u.x, dy = v.y - u.y;
+						if (dx == 0 && dy == 0) continue;
+						Shapefile::Edge e(u, v);
+						int b = Shapefile::hash_value(e) % num_buckets;
+						local[b].push_back(EdgeRec(e, i, sqrt(dx*dx + dy*dy)));
+					}
+				}
+			}
+		}
+		const Shapefile::Main& main;
+		EdgeBuckets& buckets;
+		int num_buckets;
+		const volatile bool* cancel;
+		volatile long* progress;
+		boost::mutex mutex;
+		long done;
+	};
+	
+	/** Match the edges of buckets [start, end) across all threads and
+	 record one BorderPair per edge shared by two observations. */
+	struct MatchTask {
+		MatchTask(EdgeBuckets& buckets_s, int num_buckets_s,
+				  int num_threads_s, std::vector<std::vector<BorderPair> >& pairs_s,
+				  const volatile bool* cancel_s)
+		: buckets(buckets_s), num_buckets(num_buckets_s),
+		num_threads(num_threads_s), pairs(pairs_s), cancel(cancel_s) {}
+		void operator()(int start, int end, int thread_id) {
+			std::vector<EdgeRec> edges;
+			for (int b=start; b<end; b++) {
+				if (cancel && *cancel) return;
+				edges.clear();
+				for (int t=0; t<num_threads; t++) {
+					std::vector<EdgeRec>& v = buckets[t*num_buckets+b];
+					edges.insert(edges.end(), v.begin(), v.end());
+					std::vector<EdgeRec>().swap(v);
+				}
+				std::sort(edges.begin(), edges.end(), EdgeLess);
+				for (size_t s=0, e=0; s<edges.size(); s=e) {
+					e = s+1;
+					while (e < edges.size() && edges[e].e == edges[s].e) e++;
+					// every distinct pair of observations along this edge
+					for (size_t u=s; u<e; u++) {
+						for (size_t v=u+1; v<e; v++) {
+							if (edges[u].obs == edges[v].obs) continue;
+							pairs[b].push_back(BorderPair(edges[u].obs,
+														  edges[v].obs,
+														  edges[u].len));
+						}
+					}
+				}
+			}
+		}
+		EdgeBuckets& buckets;
+		int num_buckets;
+		int num_threads;
+		std::vector<std::vector<BorderPair> >& pairs;
+		const volatile bool* cancel;
+	};
+	
+	template <class T>
+	void WriteVec(std::ofstream& out, const std::vector<T>& v)
+	{
+		wxInt64 n = v.size();
+		out.write((const char*) &n, sizeof(n));
+		if (n > 0) out.write((const char*) &v[0], sizeof(T)*n);
+	}
+	
+	template <class T>
+	bool ReadVec(std::ifstream& in, std::vector<T>& v, wxInt64 expected)
+	{
+		wxInt64 n = 0;
+		in.read((char*) &n, sizeof(n));
+		if (!in.good() || (expected >= 0 && n != expected) || n < 0) {
+			return false;
+		}
+		v.resize(n);
+		if (n > 0) in.read((char*) &v[0], sizeof(T)*n);
+		return in.good();
+	}
+}
+
+Gda::GeomMeasures::Signature::Signature()
+: num_obs(0), shape_type(0), num_points(0), src_size(-1), src_mtime(0)
+{
+	for (int i=0; i<4; i++) bbox[i] = 0;
+}
+
+Gda::GeomMeasures::Signature::Signature(const Shapefile::Main& main,
+										const wxString& src_fname)
+: num_obs(main.records.size()), shape_type(main.header.shape_type),
+num_points(0), src_size(-1), src_mtime(0)
+{
+	bbox[0] = main.header.bbox_x_min;
+	bbox[1] = main.header.bbox_y_min;
+	bbox[2] = main.header.bbox_x_max;
+	bbox[3] = main.header.bbox_y_max;
+	wxFileName fn(src_fname);
+	if (!src_fname.IsEmpty() && fn.FileExists()) {
+		src_size = fn.GetSize().GetValue();
+		src_mtime = fn.GetModificationTime().GetTicks();
+	}
+	if (shape_type != Shapefile::POLYGON) return;
+	for (int i=0; i<num_obs; i++) {
+		Shapefile::RecordContents* rc = main.records[i].contents_p;
+		if (rc) num_points += ((Shapefile::PolygonContents*) rc)->num_points;
+	}
+}
+
+bool Gda::GeomMeasures::Signature::operator==(const Signature& s) const
+{
+	return (num_obs == s.num_obs && shape_type == s.shape_type &&
+			num_points == s.num_points && src_size == s.src_size &&
+			src_mtime == s.src_mtime &&
+			bbox[0] == s.bbox[0] &&
+			bbox[1] == s.bbox[1] && bbox[2] == s.bbox[2] &&
+			bbox[3] == s.bbox[3]);
+}
+
+Gda::GeomMeasures::GeomMeasures() : num_obs(0)
+{
+}
+
+Gda::GeomMeasures::~GeomMeasures()
+{
+}
+
+void Gda::GeomMeasures::Resize(int n)
+{
+	num_obs = n;
+	null_shp.assign(n, 1);
+	centroid_x.assign(n, 0);
+	centroid_y.assign(n, 0);
+	mean_center_x.assign(n, 0);
+	mean_center_y.assign(n, 0);
+	area.assign(n, 0);
+	perimeter.assign(n, 0);
+	bb_xmin.assign(n, 0);
+	bb_ymin.assign(n, 0);
+	bb_xmax.assign(n, 0);
+	bb_ymax.assign(n, 0);
+	border_start.clear();
+	border_nbr.clear();
+	border_len.clear();
+}
+
+void Gda::GeomMeasures::Compute(const Shapefile::Main& main)
+{
+	Resize(main.records.size());
+	MeasureTask measure_task(main, *this);
+	Gda::ParallelFor(num_obs, measure_task, -1, 256);
+}
+
+bool Gda::GeomMeasures::ComputeSharedBorders(const Shapefile::Main& main,
+											 const volatile bool* cancel,
+											 volatile long* progress)
+{
+	border_start.clear();
+	border_nbr.clear();
+	border_len.clear();
+	if (main.header.shape_type != Shapefile::POLYGON ||
+		(int) main.records.size() != num_obs) {
+		border_start.assign(num_obs+1, 0);
+		return true;
+	}
+	int num_threads = Gda::GetNumWorkers();
+	int num_buckets = 4*num_threads;
+	EdgeBuckets buckets(num_threads*num_buckets);
+	EdgeTask edge_task(main, buckets, num_buckets, cancel, progress);
+	Gda::ParallelFor(num_obs, edge_task, num_threads, 256);
+	if (cancel && *cancel) return false;
+	
+	std::vector<std::vector<BorderPair> > bucket_pairs(num_buckets);
+	MatchTask match_task(buckets, num_buckets, num_threads, bucket_pairs,
+						 cancel);
+	Gda::ParallelFor(num_buckets, match_task, num_threads);
+	if (cancel && *cancel) return false;
+	
+	std::vector<BorderPair> pairs;
+	for (int b=0; b<num_buckets; b++) {
+		pairs.insert(pairs.end(), bucket_pairs[b].begin(),
+					 bucket_pairs[b].end());
+		std::vector<BorderPair>().swap(bucket_pairs[b]);
+	}
+	for (size_t k=0; k<pairs.size(); k++) {
+		if (pairs[k].i > pairs[k].j) std::swap(pairs[k].i, pairs[k].j);
+	}
+	std::sort(pairs.begin(), pairs.end(), PairLess);
+	// sum the lengths of all edges shared by each pair
+	size_t num_pairs = 0;
+	for (size_t k=0; k<pairs.size(); k++) {
+		if (num_pairs > 0 && pairs[num_pairs-1].i == pairs[k].i &&
+			pairs[num_pairs-1].j == pairs[k].j) {
+			pairs[num_pairs-1].len += pairs[k].len;
+		} else {
+			pairs[num_pairs++] = pairs[k];
+		}
+	}
+	pairs.erase(pairs.begin()+num_pairs, pairs.end());
+	
+	// pairs are sorted by i then j, so filling rows in pair order leaves
+	// every row sorted by neighbor
+	border_start.assign(num_obs+1, 0);
+	std::vector<int> row_cnt(num_obs, 0);
+	for (size_t k=0; k<num_pairs; k++) {
+		row_cnt[pairs[k].i]++;
+		row_cnt[pairs[k].j]++;
+	}
+	for (int i=0; i<num_obs; i++) {
+		border_start[i+1] = border_start[i] + row_cnt[i];
+	}
+	border_nbr.resize(border_start[num_obs]);
+	border_len.resize(border_start[num_obs]);
+	std::vector<int> pos(border_start.begin(), border_start.end()-1);
+	for (size_t k=0; k<num_pairs; k++) {
+		int i = pairs[k].i, j = pairs[k].j;
+		border_nbr[pos[i]] = j;
+		border_len[pos[i]++] = pairs[k].len;
+		border_nbr[pos[j]] = i;
+		border_len[pos[j]++] = pairs[k].len;
+	}
+	if (progress) *progress = num_obs;
+	return true;
+}
+
+double Gda::GeomMeasures::GetSharedBorder(int obs) const
+{
+	if (!HasSharedBorders()) return 0;
+	double s = 0;
+	for (int k=border_start[obs]; k<border_start[obs+1]; k++) {
+		s += border_len[k];
+	}
+	return s;
+}
+
+double Gda::GeomMeasures::GetSharedBorder(int obs, int nbr) const
+{
+	if (!HasSharedBorders()) return 0;
+	std::vector<int>::const_iterator b = border_nbr.begin()+border_start[obs];
+	std::vector<int>::const_iterator e = border_nbr.begin()+border_start[obs+1];
+	std::vector<int>::const_iterator it = std::lower_bound(b, e, nbr);
+	if (it == e || *it != nbr) return 0;
+	return border_len[it - border_nbr.begin()];
+}
+
+void Gda::GeomMeasures::GetSharedBorderWeights(CsrWeight& w) const
+{
+	w.Clear();
+	w.num_obs = num_obs;
+	w.row_start.assign(border_start.begin(), border_start.end());
+	if (w.row_start.empty()) w.row_start.resize(num_obs+1, 0);
+	w.nbrs = border_nbr;
+	w.weights = border_len;
+}
+
+bool Gda::GeomMeasures::Save(const wxString& fname,
+							 const Shapefile::Main& main,
+							 const wxString& src_fname) const
+{
+	Signature sig(main, src_fname);
+	if (sig.src_size < 0 || sig.num_obs != num_obs) return false;
+	std::ofstream out;
+	out.open(GET_ENCODED_FILENAME(fname), std::ios::out | std::ios::binary);
+	if (!(out.is_open() && out.good())) return false;
+	out.write(file_magic, sizeof(file_magic));
+	out.write((const char*) &sig, sizeof(sig));
+	WriteVec(out, null_shp);
+	WriteVec(out, centroid_x);
+	WriteVec(out, centroid_y);
+	WriteVec(out, mean_center_x);
+	WriteVec(out, mean_center_y);
+	WriteVec(out, area);
+	WriteVec(out, perimeter);
+	WriteVec(out, bb_xmin);
+	WriteVec(out, bb_ymin);
+	WriteVec(out, bb_xmax);
+	WriteVec(out, bb_ymax);
+	WriteVec(out, border_start);
+	WriteVec(out, border_nbr);
+	WriteVec(out, border_len);
+	bool ok = out.good();
+	out.close();
+	return ok;
+}
+
+bool Gda::GeomMeasures::Load(const wxString& fname,
+							 const Shapefile::Main& main,
+							 const wxString& src_fname)
+{
+	Signature sig(main, src_fname);
+	if (sig.src_size < 0) return false;
+	std::ifstream in;
+	in.open(GET_ENCODED_FILENAME(fname), std::ios::in | std::ios::binary);
+	if (!(in.is_open() && in.good())) return false;
+	char magic[sizeof(file_magic)];
+	in.read(magic, sizeof(magic));
+	if (!in.good() || memcmp(magic, file_magic, sizeof(magic)) != 0) {
+		return false;
+	}
+	Signature s;
+	in.read((char*) &s, sizeof(s));
+	if (!in.good() || !(s == sig)) return false;
+	
+	GeomMeasures g;
+	wxInt64 n = s.num_obs;
+	bool ok = (ReadVec(in, g.null_shp, n) &&
+			   ReadVec(in, g.centroid_x, n) &&
+			   ReadVec(in, g.centroid_y, n) &&
+			   ReadVec(in, g.mean_center_x, n) &&
+			   ReadVec(in, g.mean_center_y, n) &&
+			   ReadVec(in, g.area, n) &&
+			   ReadVec(in, g.perimeter, n) &&
+			   ReadVec(in, g.bb_xmin, n) &&
+			   ReadVec(in, g.bb_ymin, n) &&
+			   ReadVec(in, g.bb_xmax, n) &&
+			   ReadVec(in, g.bb_ymax, n) &&
+			   ReadVec(in, g.border_start, -1) &&
+			   ReadVec(in, g.border_nbr, -1));
+	if (!ok) return false;
+	wxInt64 nb = g.border_nbr.size();
+	if (!ReadVec(in, g.border_len, nb)) return false;
+	// the shared borders are only present once they have been requested
+	if (g.border_start.empty()) {
+		if (nb != 0) return false;
+	} else if ((wxInt64) g.border_start.size() != n+1 ||
+			   g.border_start[0] != 0 || g.border_start[n] != nb) {
+		return false;
+	}
+	
+	g.num_obs = n;
+	*this = g;
+	return true;
+}
@@ -0,0 +1,126 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_GEOM_MEASURES_H__
+#define __GEODA_CENTER_GEOM_MEASURES_H__
+
+#include <vector>
+#include <wx/string.h>
+#include "ShpFile.h"
+
+class CsrWeight;
+
+namespace Gda {
+	/**
+	 Per-observation geometric measures of a point or polygon layer:
+	 centroids, mean centers, signed areas, perimeters, bounding boxes and
+	 the lengths of borders shared with neighboring polygons.  The
+	 measures are computed by Compute in one pass over the records with
+	 Gda::ParallelFor.
+	 
+	 Centroids are computed as GdaShapeAlgs::calculateCentroid always has,
+	 from the first ring of each polygon only, so that existing weights
+	 and results do not change.  Areas and perimeters sum over every ring.
+	 Shapefile rings are clockwise for outer boundaries and
+	 counter-clockwise for holes, so the signed area of a well-formed
+	 polygon is the negated area of its outer rings less its holes.
+	 
+	 Shared borders are only computed by ComputeSharedBorders, since most
+	 callers need the centroids alone.  Two polygons share a border where
+	 they have an edge with the same two end points.  Edges are bucketed by
+	 Shapefile::hash_value and each bucket is matched in parallel.  Layers
+	 whose neighbors do not share vertices along a common boundary report
+	 no shared border there.
+	 
+	 The results can be written to and read back from a binary cache file.
+	 The file is keyed on cheap metadata only, so that checking it costs
+	 far less than recomputing: the size and modification time of the
+	 source file src_fname the records were read from, and the record
+	 count, shape type, header bounding box and total number of points.
+	 Save and Load fail if src_fname is not an existing file.
+	 */
+	class GeomMeasures {
+	public:
+		GeomMeasures();
+		virtual ~GeomMeasures();
+		
+		void Compute(const Shapefile::Main& main);
+		/** Fills the shared borders.  Call after Compute or Load.  Returns
+		 false, with no shared borders, if *cancel is set first.  *progress
+		 counts records up to GetNumObs. */
+		bool ComputeSharedBorders(const Shapefile::Main& main,
+								  const volatile bool* cancel = 0,
+								  volatile long* progress = 0);
+		bool HasSharedBorders() const {
+			return (int) border_start.size() == num_obs+1; }
+		bool Save(const wxString& fname, const Shapefile::Main& main,
+				  const wxString& src_fname) const;
+		bool Load(const wxString& fname, const Shapefile::Main& main,
+				  const wxString& src_fname);
+		
+		int GetNumObs() const { return num_obs; }
+		bool IsNull(int obs) const { return null_shp[obs] != 0; }
+		/** Sum of the lengths of all borders obs shares with others. */
+		double GetSharedBorder(int obs) const;
+		/** Length of the border shared by obs and nbr, or 0. */
+		double GetSharedBorder(int obs, int nbr) const;
+		/** Fills w with the polygons that share a border as neighbors and
+		 the shared border lengths as weights. */
+		void GetSharedBorderWeights(CsrWeight& w) const;
+		
+		std::vector<char> null_shp;
+		std::vector<double> centroid_x;
+		std::vector<double> centroid_y;
+		std::vector<double> mean_center_x;
+		std::vector<double> mean_center_y;
+		std::vector<double> area; // signed, see above
+		std::vector<double> perimeter;
+		std::vector<double> bb_xmin;
+		std::vector<double> bb_ymin;
+		std::vector<double> bb_xmax;
+		std::vector<double> bb_ymax;
+		/** Shared borders in compressed rows, empty until
+		 ComputeSharedBorders: the neighbors of obs are
+		 border_nbr[border_start[obs]] ... border_nbr[border_start[obs+1]-1]
+		 in increasing order, and border_len is parallel to border_nbr. */
+		std::vector<int> border_start;
+		std::vector<int> border_nbr;
+		std::vector<double> border_len;
+		
+		/** Identifies the records the measures were computed from. */
+		struct Signature {
+			Signature();
+			Signature(const Shapefile::Main& main, const wxString& src_fname);
+			bool operator==(const Signature& s) const;
+			wxInt32 num_obs;
+			wxInt32 shape_type;
+			wxInt64 num_points;
+			double bbox[4];
+			wxInt64 src_size;
+			wxInt64 src_mtime;
+		};
+		
+	private:
+		void Resize(int n);
+		
+		int num_obs;
+	};
+}
+
+#endif
@@ -85,6 +85,8 @@ public:
 };
 
 namespace WeightUtils {
+	/** For both readers table_int may be null, in which case the file
+	 must use record order ids. */
 	GalElement* ReadGwtAsGal(const wxString& w_fname,
 							TableInterface* table_int);
 	GwtElement* ReadGwt(const wxString& w_fname, TableInterface* table_int);
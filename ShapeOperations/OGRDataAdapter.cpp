@@ -78,8 +78,11 @@ void OGRDataAdapter::Close()
         }
 	}
 	ogr_ds_pool.clear();
-	// clean gda_cache
-	if ( !gda_cache) delete gda_cache;
+	// clean gda_cache, this also stops its caching thread
+	if (gda_cache) {
+		delete gda_cache;
+		gda_cache = NULL;
+	}
 }
 
 OGRDatasourceProxy* OGRDataAdapter::GetDatasourceProxy(string ds_name)
@@ -126,16 +129,19 @@ vector<string> OGRDataAdapter::GetLayerNames(string ds_name)
 // there.
 OGRLayerProxy* OGRDataAdapter::T_ReadLayer(string ds_name, string layer_name)
 {
-	OGRLayerProxy* layer_proxy = NULL;
-	//XXX: we don't cache layer in 1.5.x
-	//if (enable_cache && gda_cache) {
-	//	if (gda_cache->IsLayerCached(ds_name, layer_name)) {
-	//		layer_proxy =  gda_cache->GetLayerProxy(ds_name,layer_name);
-	//	}
-	//} 
-	if (layer_proxy == NULL) {
-		OGRDatasourceProxy* ds_proxy = GetDatasourceProxy(ds_name);
-		layer_proxy = ds_proxy->GetLayerProxy(layer_name);
+	OGRDatasourceProxy* ds_proxy = GetDatasourceProxy(ds_name);
+	OGRLayerProxy* layer_proxy = ds_proxy->GetLayerProxy(layer_name);
+	
+	// database layers whose cached copy has the same row count and extent
+	// are read from the local copy instead, which is read-only. The worker
+	// then compares the chunk hashes, or fills a missing copy, in the
+	// background, so that a changed layer is fresh the next time.
+	if (enable_cache && GdaCache::IsCacheable(ds_proxy->ds_type)) {
+		if (gda_cache==NULL) gda_cache = new GdaCache();
+		OGRLayerProxy* cached_proxy =
+			gda_cache->GetLayerProxy(ds_name, layer_proxy);
+		if (cached_proxy) layer_proxy = cached_proxy;
+		gda_cache->RequestCacheLayer(ds_name, layer_name);
 	}
 
 	// read actual data in a thread
@@ -165,12 +171,14 @@ void OGRDataAdapter::SaveLayer(OGRLayerProxy* layer_proxy)
 void OGRDataAdapter::CacheLayer
 (string ds_name, string layer_name, OGRLayerProxy* layer_proxy)
 {
-	//XXX: we don't cache layer in 1.5.x
-	// cache current layer in a thread
-	if (enable_cache && !gda_cache->IsLayerCached(ds_name, layer_name)) {
-		boost::thread cache_thread(boost::bind(
-			&GdaCache::CacheLayer, gda_cache, ds_name, layer_proxy));
-	}
+	// cache (or refresh the cached copy of) a database layer in the
+	// background; the cache worker uses its own connections, so layer_proxy
+	// is not touched by it
+	if (!enable_cache) return;
+	OGRDatasourceProxy* ds_proxy = GetDatasourceProxy(ds_name);
+	if (!GdaCache::IsCacheable(ds_proxy->ds_type)) return;
+	if (gda_cache==NULL) gda_cache = new GdaCache();
+	gda_cache->RequestCacheLayer(ds_name, layer_name);
 }
 
 void OGRDataAdapter::StopExport()
@@ -194,8 +202,38 @@ OGRDataAdapter::MakeOGRGeometries(vector<GdaShape*>& geometries,
 								  vector<OGRGeometry*>& ogr_geometries,
 								  vector<int>& selected_rows)
 {
+	return MakeOGRGeometries(geometries, shape_type, ogr_geometries,
+							 selected_rows, 0, selected_rows.size());
+}
+
+OGRwkbGeometryType
+OGRDataAdapter::GetOGRGeometryType(vector<GdaShape*>& geometries,
+								   Shapefile::ShapeType shape_type,
+								   vector<int>& selected_rows)
+{
+	if (shape_type == Shapefile::POINT) {
+		return selected_rows.empty() ? wkbNone : wkbPoint;
+	}
+	if (shape_type != Shapefile::POLYGON) return wkbNone;
 	OGRwkbGeometryType eGType = wkbNone;
-    for (size_t i = 0; i < selected_rows.size(); i++ ) {
+	for (size_t i = 0; i < selected_rows.size(); i++ ) {
+		GdaPolygon* poly = (GdaPolygon*) geometries[selected_rows[i]];
+		if (poly->isNull()) continue;
+		if (poly->n_count > 1) return wkbMultiPolygon;
+		eGType = wkbPolygon;
+	}
+	return eGType;
+}
+
+OGRwkbGeometryType
+OGRDataAdapter::MakeOGRGeometries(vector<GdaShape*>& geometries, 
+								  Shapefile::ShapeType shape_type,
+								  vector<OGRGeometry*>& ogr_geometries,
+								  vector<int>& selected_rows,
+								  size_t start, size_t end)
+{
+	OGRwkbGeometryType eGType = wkbNone;
+    for (size_t i = start; i < end; i++ ) {
         int id = selected_rows[i];
         if ( shape_type == Shapefile::POINT ) {
             eGType = wkbPoint;
@@ -280,7 +318,8 @@ OGRDataAdapter::ExportDataSource(string o_ds_format,
 								 string o_ds_name,
                                  string o_layer_name,
                                  OGRwkbGeometryType geom_type,
-                                 vector<OGRGeometry*> ogr_geometries,
+                                 vector<GdaShape*>& geometries,
+                                 Shapefile::ShapeType shape_type,
                                  TableInterface* table,
 								 vector<int>& selected_rows,
                                  OGRSpatialReference* spatial_ref,
@@ -338,17 +377,18 @@ OGRDataAdapter::ExportDataSource(string o_ds_format,
         // update layer in datasources, e.g. Sqlite
         export_ds = new OGRDatasourceProxy(o_ds_name, true);
         new_layer_proxy = export_ds->CreateLayer(
-            o_layer_name, geom_type, ogr_geometries, table,
+            o_layer_name, geom_type, table,
             field_dict, selected_rows, spatial_ref);
     } else {
         export_ds = new OGRDatasourceProxy(o_ds_format, o_ds_name);
         new_layer_proxy = export_ds->CreateLayer(
-            o_layer_name, geom_type, ogr_geometries, table,
+            o_layer_name, geom_type, table,
             field_dict, selected_rows, spatial_ref);
     }
 
     export_thread = new boost::thread(boost::bind(&OGRLayerProxy::AddFeatures,
-		new_layer_proxy, ogr_geometries, table, field_dict, selected_rows));
+		new_layer_proxy, boost::ref(geometries), shape_type, table,
+		field_dict, boost::ref(selected_rows)));
    
     return new_layer_proxy;
 }
@@ -475,9 +515,18 @@ void OGRDataAdapter::Export(OGRLayerProxy* source_layer_proxy,
         }
     }
 	//////////////////////////////////////////////////////////////
-	// Create OGR geometry features
+	// Create OGR geometry features, committed every export_batch_size
+	// features when the driver supports transactions
+	const int batch_size = OGRLayerProxy::export_batch_size;
+	bool use_transactions = poDstLayer->TestCapability(OLCTransactions) != 0;
 	for(int row=0; row< number_rows; row++){
-		if(stop_exporting) return;
+		if(stop_exporting) {
+			if (use_transactions) poDstLayer->RollbackTransaction();
+			return;
+		}
+		if (use_transactions && row % batch_size == 0) {
+			use_transactions = poDstLayer->StartTransaction() == OGRERR_NONE;
+		}
 		export_progress++;
 		OGRFeature *poFeature;
 		poFeature = OGRFeature::CreateFeature(poDstLayer->GetLayerDefn());
@@ -507,10 +556,20 @@ void OGRDataAdapter::Export(OGRLayerProxy* source_layer_proxy,
 			// raise "Failed to create feature in shapefile.\n"
 			error_message << "Creating feature (" <<row<<") failed."
             << "\n" << CPLGetLastErrorMsg();
+			if (use_transactions) poDstLayer->RollbackTransaction();
 			export_progress = -1;
 			return;
         }
 		OGRFeature::DestroyFeature( poFeature );
+		if (use_transactions &&
+			((row+1) % batch_size == 0 || row+1 == number_rows)) {
+			if (poDstLayer->CommitTransaction() != OGRERR_NONE) {
+				error_message << "Committing features failed."
+                << "\n" << CPLGetLastErrorMsg();
+				export_progress = -1;
+				return;
+			}
+		}
 	}
 	//////////////////////////////////////////////////////////////
 	// Clean
@@ -139,7 +139,8 @@ public:
 	vector<string> GetLayerNames(string ds_name);
 
 	/**
-	 * cacher existing layer (memory) to local spatialite
+	 * cache existing layer to local spatialite in the background.
+	 * Only database layers are cached, see GdaCache::IsCacheable()
 	 */
 	void CacheLayer(string ds_name, string layer_name,
                     OGRLayerProxy* layer_proxy);
@@ -166,12 +167,16 @@ public:
     
     /**
      * Create a OGR datasource that contains input geometries and table.
+     * Features are converted and written in batches on a separate thread,
+     * see OGRLayerProxy::AddFeatures().  geometries must stay valid until
+     * StopExport() or CancelExport() returns.
      */
     OGRLayerProxy* ExportDataSource(string o_ds_format, 
 								string o_ds_name,
                                  string o_layer_name,
                                  OGRwkbGeometryType geom_type,
-                                 vector<OGRGeometry*> ogr_geometries,
+                                 vector<GdaShape*>& geometries,
+                                 Shapefile::ShapeType shape_type,
                                  TableInterface* table,
 								 vector<int>& selected_rows,
                                  OGRSpatialReference* spatial_ref,
@@ -189,5 +194,20 @@ public:
 								  Shapefile::ShapeType shape_type,
 								  vector<OGRGeometry*>& ogr_geometries,
 								  vector<int>& selected_rows);
+	/**
+	 * Same as above for selected_rows[start] to selected_rows[end-1] only.
+	 */
+	OGRwkbGeometryType MakeOGRGeometries(vector<GdaShape*>& geometries, 
+								  Shapefile::ShapeType shape_type,
+								  vector<OGRGeometry*>& ogr_geometries,
+								  vector<int>& selected_rows,
+								  size_t start, size_t end);
+	/**
+	 * Layer geometry type for the selected geometries without converting
+	 * them: wkbMultiPolygon if any selected polygon has several parts.
+	 */
+	OGRwkbGeometryType GetOGRGeometryType(vector<GdaShape*>& geometries,
+								  Shapefile::ShapeType shape_type,
+								  vector<int>& selected_rows);
 };
 #endif
\ No newline at end of file
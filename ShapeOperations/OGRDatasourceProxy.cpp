@@ -22,6 +22,7 @@
 #include <map>
 #include <ogrsf_frmts.h>
 #include <cpl_port.h>
+#include <cpl_conv.h>
 #include <boost/thread.hpp>
 #include <boost/bind.hpp>
 
@@ -266,6 +267,12 @@ OGRLayerProxy* OGRDatasourceProxy::GetLayerProxy(string layer_name)
 		}
 		//bool is_thread_safe = layer->TestCapability(OLCRandomRead);
 		layer_proxy = new OGRLayerProxy(layer_name, layer, ds_type);
+		if (ds_type == GdaConst::ds_csv) {
+			// a CSV datasource is either the file or its directory
+			layer_proxy->csv_fname =
+				EQUAL(CPLGetExtension(ds_name.c_str()), "csv") ? ds_name :
+				CPLFormFilename(ds_name.c_str(), layer->GetName(), "csv");
+		}
 		//todo: if there is one already existed, clean/delete the old first
 		layer_pool[layer_name] = layer_proxy;
 	}
@@ -310,7 +317,6 @@ void OGRDatasourceProxy::CreateDataSource(string format,
 OGRLayerProxy*
 OGRDatasourceProxy::CreateLayer(string layer_name,
                                 OGRwkbGeometryType eGType,
-                                vector<OGRGeometry*>& geometries,
                                 TableInterface* table,
                                 map<wxString, pair<int, int> >& field_dict,
                                 vector<int>& selected_rows,
@@ -382,7 +388,6 @@ OGRDatasourceProxy::CreateLayer(string layer_name,
     }
     
     OGRLayerProxy* layer =  new OGRLayerProxy(poDstLayer, ds_type, eGType);
-    //layer->AddFeatures(geometries, table, field_dict, selected_rows);
     
     layer_pool[layer_name] = layer;
     return layer;
@@ -117,7 +117,6 @@ public:
 
     OGRLayerProxy* CreateLayer(string layer_name,
                                OGRwkbGeometryType eGType,
-                               vector<OGRGeometry*>& geometries,
                                TableInterface* table,
                                map<wxString, pair<int, int> >& field_dict,
                                vector<int>& selected_rows,
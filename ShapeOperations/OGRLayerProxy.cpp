@@ -19,29 +19,147 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 #include <ogrsf_frmts.h>
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "../ShapeOperations/ShpFile.h"
+#include "../ShapeOperations/CsvFileUtils.h"
 #include "../GdaException.h"
+#include "../GdaTrace.h"
 #include "../logger.h"
 #include "../GeneralWxUtils.h"
 #include "../Generic/GdaShape.h"
 
 #include "OGRLayerProxy.h"
 #include "OGRFieldProxy.h"
+#include "OGRDataAdapter.h"
 
 
 using namespace std;
 
+const int OGRLayerProxy::export_batch_size;
+
+namespace {
+/**
+ * Converts GdaShape geometries of selected rows to OGR geometries in
+ * batches on its own thread.  At most max_queued converted batches are
+ * held, so the producer blocks until the writer has taken one.  Rows
+ * without geometry are passed on as NULL.
+ */
+class OGRGeometryBatcher
+{
+public:
+	OGRGeometryBatcher(vector<GdaShape*>& geometries_,
+					   Shapefile::ShapeType shape_type_,
+					   vector<int>& selected_rows_,
+					   size_t batch_size_, size_t max_queued_)
+	: geometries(geometries_), shape_type(shape_type_),
+	selected_rows(selected_rows_), batch_size(batch_size_),
+	max_queued(max_queued_), done(false), cancelled(false), worker(0)
+	{
+		worker = new boost::thread(boost::bind(&OGRGeometryBatcher::Run,
+											   this));
+	}
+	virtual ~OGRGeometryBatcher() { Cancel(); }
+	
+	/** Wait for the next batch.  Returns false once all have been taken. */
+	bool Pop(vector<OGRGeometry*>& batch)
+	{
+		batch.clear();
+		boost::mutex::scoped_lock lock(mutex);
+		while (queue.empty() && !done) cond.wait(lock);
+		if (queue.empty()) return false;
+		batch.swap(*queue.front());
+		delete queue.front();
+		queue.pop_front();
+		cond.notify_all();
+		return true;
+	}
+	
+	/** Stop the producer and destroy any batch not taken yet. */
+	void Cancel()
+	{
+		if (!worker) return;
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			cancelled = true;
+			cond.notify_all();
+		}
+		worker->join();
+		delete worker;
+		worker = 0;
+		while (!queue.empty()) {
+			Destroy(*queue.front(), 0);
+			delete queue.front();
+			queue.pop_front();
+		}
+	}
+	
+	static void Destroy(vector<OGRGeometry*>& batch, size_t from)
+	{
+		for (size_t i=from; i<batch.size(); i++) {
+			if (batch[i]) OGRGeometryFactory::destroyGeometry(batch[i]);
+		}
+		batch.clear();
+	}
+	
+private:
+	void Run()
+	{
+		bool has_geoms = !geometries.empty() &&
+			(shape_type == Shapefile::POINT ||
+			 shape_type == Shapefile::POLYGON);
+		size_t n = selected_rows.size();
+		for (size_t start=0; start<n; start+=batch_size) {
+			size_t end = start + batch_size < n ? start + batch_size : n;
+			vector<OGRGeometry*>* batch = new vector<OGRGeometry*>;
+			batch->reserve(end-start);
+			if (has_geoms) {
+				OGRDataAdapter::GetInstance().MakeOGRGeometries(geometries,
+					shape_type, *batch, selected_rows, start, end);
+			} else {
+				batch->resize(end-start, NULL);
+			}
+			boost::mutex::scoped_lock lock(mutex);
+			while (queue.size() >= max_queued && !cancelled) cond.wait(lock);
+			if (cancelled) {
+				Destroy(*batch, 0);
+				delete batch;
+				return;
+			}
+			queue.push_back(batch);
+			cond.notify_all();
+		}
+		boost::mutex::scoped_lock lock(mutex);
+		done = true;
+		cond.notify_all();
+	}
+	
+	vector<GdaShape*>& geometries;
+	Shapefile::ShapeType shape_type;
+	vector<int>& selected_rows;
+	size_t batch_size;
+	size_t max_queued;
+	bool done;
+	bool cancelled;
+	std::deque<vector<OGRGeometry*>* > queue;
+	boost::mutex mutex;
+	boost::condition_variable cond;
+	boost::thread* worker;
+};
+}
+
 /**
  * Create a OGRLayerProxy from an existing OGRLayer
  */
 OGRLayerProxy::OGRLayerProxy(string layer_name, OGRLayer* _layer,
                              GdaConst::DataSourceType _ds_type, bool isNew)
 : n_rows(0), n_cols(0), name(layer_name), ds_type(_ds_type), layer(_layer),
-load_progress(0), stop_reading(false), export_progress(0)
+load_progress(0), stop_reading(false), export_progress(0),
+stop_exporting(false), export_rate(0)
 {
     if (!isNew) n_rows = layer->GetFeatureCount();
     is_writable = layer->TestCapability(OLCCreateField) != 0;
@@ -62,7 +180,8 @@ OGRLayerProxy::OGRLayerProxy(OGRLayer* _layer,
                              OGRwkbGeometryType eGType,
                              int _n_rows)
 : layer(_layer), name(_layer->GetName()), ds_type(_ds_type), n_rows(_n_rows),
-eLayerType(eGType), load_progress(0), stop_reading(false)
+eLayerType(eGType), load_progress(0), stop_reading(false), export_progress(0),
+stop_exporting(false), export_rate(0)
 {
     //if (n_rows==0)
     //    n_rows = layer->GetFeatureCount();
@@ -296,88 +415,114 @@ bool OGRLayerProxy::UpdateColumn()
 }
 
 void
-OGRLayerProxy::AddFeatures(vector<OGRGeometry*>& geometries,
+OGRLayerProxy::AddFeatures(vector<GdaShape*>& geometries,
+                           Shapefile::ShapeType shape_type,
                            TableInterface* table,
                            map<wxString, pair<int, int> >& field_dict,
                            vector<int>& selected_rows)
 {
     export_progress = 0;
     stop_exporting = false;
-	map<wxString, pair<int, int> >::iterator field_it;
-
-    for (size_t i=0; i<selected_rows.size();++i) {
-        if (stop_exporting) return;
-        OGRFeature *poFeature = OGRFeature::CreateFeature(featureDefn);
-        if ( !geometries.empty()) {
-            poFeature->SetGeometryDirectly( geometries[i] );
-        }
-        data.push_back(poFeature);
-    }
-    int export_size = data.size()==0 ? table->GetNumberRows() : data.size();
-    export_progress = export_size / 4;
+    export_rate = 0;
+    int export_size = selected_rows.size();
+    if (export_size == 0 && table) export_size = table->GetNumberRows();
     
-    // set other data
+    // read the exported table columns once; features are filled row by row
+    size_t n_fields = fields.size();
+    vector<GdaConst::FieldType> col_types(n_fields, GdaConst::placeholder_type);
+    vector<vector<double> > dbl_cols(n_fields);
+    vector<vector<wxInt64> > int_cols(n_fields);
+    vector<vector<wxString> > str_cols(n_fields);
     if (table != NULL) {
-        for (size_t j=0; j< fields.size(); j++) {
+        for (size_t j=0; j<n_fields; j++) {
+            if (stop_exporting) return;
             wxString fname = fields[j]->GetName();
             pair<int, int> field_idn = field_dict[fname];
             int col_pos = field_idn.first;
             int time_step = field_idn.second;
             GdaConst::FieldType ftype = table->GetColType(col_pos, time_step);
-            if ( ftype == GdaConst::long64_type) {
-                vector<wxInt64> col_data;
-                table->GetColData(col_pos, time_step, col_data);
-                for (size_t k=0; k<selected_rows.size();++k) {
-                    data[k]->SetField(j, (int)col_data[ selected_rows[k] ]);
-                    if (stop_exporting) return;
-                }
+            col_types[j] = ftype;
+            if (ftype == GdaConst::long64_type ||
+                ftype == GdaConst::date_type) {
+                table->GetColData(col_pos, time_step, int_cols[j]);
             } else if (ftype == GdaConst::double_type) {
-                vector<double> col_data;
-                table->GetColData(col_pos, time_step, col_data);
-                for (size_t k=0; k<selected_rows.size();++k) {
-                    data[k]->SetField(j, col_data[ selected_rows[k] ]);
-                    if (stop_exporting) return;
-                }
-            } else if (ftype == GdaConst::date_type) {
-                vector<wxInt64> col_data;
-                table->GetColData(col_pos, time_step, col_data);
-                for (size_t k=0; k<selected_rows.size();++k) {
-                    wxInt64 val = col_data[ selected_rows[k] ];
-                    int year    = val/10000;
-                    int month   = (val % 10000) /100;
-                    int day     = val % 10;
-                    data[k]->SetField(j, year, month, day);
-                    if (stop_exporting) return;
-                }
+                table->GetColData(col_pos, time_step, dbl_cols[j]);
             } else if (ftype == GdaConst::placeholder_type) {
                 // KML case: there are by default two fields:
                 // [Name, Description], so if placeholder that
                 // means table is empty. Then do nothing
             } else {
                 // others are treated as string_type
-                // XXX encodings
-                vector<wxString> col_data;
-                table->GetColData(col_pos, time_step, col_data);
-                for (size_t k=0; k<selected_rows.size();++k) {
-                    data[k]->SetField(j, col_data[ selected_rows[k] ].mb_str());
-                    if (stop_exporting) return;
-                }
+                table->GetColData(col_pos, time_step, str_cols[j]);
             }
-            if (stop_exporting) return;
         }
     }
-    export_progress = export_size / 2;
     
-    for (size_t i=0; i<data.size(); i++) {
-        if (stop_exporting) return;
-        if ((i+1)%2==0) export_progress++;
-        if( layer->CreateFeature( data[i] ) != OGRERR_NONE ) {
-			// raise "Failed to create feature.\n"
-			error_message << " Object Geometry contains NULL rings. "
+    bool use_transactions = layer->TestCapability(OLCTransactions) != 0;
+    boost::posix_time::ptime start_time =
+        boost::posix_time::microsec_clock::local_time();
+    OGRGeometryBatcher batcher(geometries, shape_type, selected_rows,
+                               export_batch_size, 2);
+    vector<OGRGeometry*> batch;
+    size_t i = 0;
+    while (batcher.Pop(batch)) {
+        if (use_transactions) {
+            use_transactions = layer->StartTransaction() == OGRERR_NONE;
+        }
+        for (size_t b=0; b<batch.size(); b++, i++) {
+            if (stop_exporting) {
+                OGRGeometryBatcher::Destroy(batch, b);
+                if (use_transactions) layer->RollbackTransaction();
+                return;
+            }
+            OGRFeature *poFeature = OGRFeature::CreateFeature(featureDefn);
+            if (batch[b]) poFeature->SetGeometryDirectly(batch[b]);
+            int row = selected_rows[i];
+            for (size_t j=0; j<n_fields; j++) {
+                GdaConst::FieldType ftype = col_types[j];
+                if (ftype == GdaConst::long64_type) {
+                    poFeature->SetField(j, (int)int_cols[j][row]);
+                } else if (ftype == GdaConst::double_type) {
+                    poFeature->SetField(j, dbl_cols[j][row]);
+                } else if (ftype == GdaConst::date_type) {
+                    wxInt64 val = int_cols[j][row];
+                    int year    = val/10000;
+                    int month   = (val % 10000) /100;
+                    int day     = val % 100;
+                    poFeature->SetField(j, year, month, day);
+                } else if (ftype != GdaConst::placeholder_type) {
+                    // XXX encodings
+                    poFeature->SetField(j, str_cols[j][row].mb_str());
+                }
+            }
+            OGRErr err = layer->CreateFeature( poFeature );
+            OGRFeature::DestroyFeature( poFeature );
+            if ( err != OGRERR_NONE ) {
+                // raise "Failed to create feature.\n"
+                error_message << " Object Geometry contains NULL rings. "
+                << CPLGetLastErrorMsg();
+                OGRGeometryBatcher::Destroy(batch, b+1);
+                if (use_transactions) layer->RollbackTransaction();
+                batcher.Cancel();
+                export_progress = -1;
+                return;
+            }
+        }
+        if (use_transactions && layer->CommitTransaction() != OGRERR_NONE) {
+            error_message << "Committing features failed. "
             << CPLGetLastErrorMsg();
+            batcher.Cancel();
             export_progress = -1;
-			return;
+            return;
+        }
+        boost::posix_time::time_duration elapsed =
+            boost::posix_time::microsec_clock::local_time() - start_time;
+        if (elapsed.total_milliseconds() > 0) {
+            export_rate = i * 1000.0 / elapsed.total_milliseconds();
         }
+        // the caller stops polling at export_size, so hold the last step
+        // back until Save() below has finished
+        if ((int)i < export_size) export_progress = i;
     }
     Save();
     export_progress = export_size;
@@ -408,6 +553,7 @@ bool OGRLayerProxy::HasError()
 
 bool OGRLayerProxy::ReadData()
 {
+	GDA_TRACE_SCOPE("load", "OGRLayerProxy::ReadData");
 	if (n_rows > 0 && n_rows == data.size()) {
         // if data already been read, skip
         return true;
@@ -417,6 +563,7 @@ bool OGRLayerProxy::ReadData()
         // SDE engine. we will count it feature by feature
         n_rows = -1;
     }
+	if (data.empty() && ReadCsvData()) return true;
 	int row_idx = 0;
 	OGRFeature *feature = NULL;
     map<int, OGRFeature*> feature_dict;
@@ -447,10 +594,54 @@ bool OGRLayerProxy::ReadData()
     }
     load_progress = n_rows;
     feature_dict.clear();
+    GDA_TRACE_COUNT("load", "OGR features read", n_rows);
     
 	return true;
 }
 
+/** The OGR driver reads a CSV file line by line.  ReadCsvColumns parses
+ the memory mapped file in parallel chunks instead.  Values are kept as
+ strings, which is how the driver reports CSV fields, so the table gets the
+ same columns either way.  Layers with a geometry column are left to the
+ driver. */
+bool OGRLayerProxy::ReadCsvData()
+{
+	if (csv_fname.empty() || layer->GetGeomType() != wkbNone) return false;
+	OGRFeatureDefn* defn = layer->GetLayerDefn();
+	int num_cols = defn->GetFieldCount();
+	if (num_cols == 0) return false;
+	for (int c=0; c<num_cols; c++) {
+		if (defn->GetFieldDefn(c)->GetType() != OFTString) return false;
+	}
+	// the driver names the fields field_1, field_2, ... when the first line
+	// holds values rather than names
+	bool has_names = !EQUAL(defn->GetFieldDefn(0)->GetNameRef(), "field_1");
+	std::vector<Gda::CsvColumn> cols;
+	wxString err_msg;
+	if (!Gda::ReadCsvColumns(csv_fname, has_names, false, cols, err_msg) ||
+		(int) cols.size() != num_cols || cols[0].size() == 0) {
+		return false;
+	}
+	
+	int num_rows = cols[0].size();
+	data.reserve(num_rows);
+	for (int i=0; i<num_rows && !stop_reading; i++) {
+		OGRFeature* feature = OGRFeature::CreateFeature(defn);
+		feature->SetFID(i+1); // as the driver numbers CSV lines
+		for (int c=0; c<num_cols; c++) {
+			if (cols[c].valid[i]) {
+				feature->SetField(c, cols[c].GetString(i).c_str());
+			}
+		}
+		data.push_back(feature);
+		load_progress = i;
+	}
+	n_rows = data.size();
+	load_progress = n_rows;
+	GDA_TRACE_COUNT("load", "CSV records read", n_rows);
+	return true;
+}
+
 void OGRLayerProxy::GetExtent(Shapefile::Main& p_main,
                               Shapefile::PointContents* pc, int row_idx)
 {
@@ -891,9 +1082,17 @@ void OGRLayerProxy::Export(std::string format,
         }   
     }
 	//////////////////////////////////////////////////////////////
-	// Create OGR geometry features
+	// Create OGR geometry features, committed every export_batch_size
+	// features when the driver supports transactions
+	bool use_transactions = poDstLayer->TestCapability(OLCTransactions) != 0;
 	for(int row=0; row< this->n_rows; row++){
-		if(stop_exporting) return;
+		if(stop_exporting) {
+			if (use_transactions) poDstLayer->RollbackTransaction();
+			return;
+		}
+		if (use_transactions && row % export_batch_size == 0) {
+			use_transactions = poDstLayer->StartTransaction() == OGRERR_NONE;
+		}
 		export_progress++;
 		OGRFeature *poFeature;
 		poFeature = OGRFeature::CreateFeature(poDstLayer->GetLayerDefn());		
@@ -923,10 +1122,20 @@ void OGRLayerProxy::Export(std::string format,
 			// raise "Failed to create feature in shapefile.\n"		
 			error_message << "Creating feature (" <<row<<") failed."
                           << "\n" << CPLGetLastErrorMsg();
+			if (use_transactions) poDstLayer->RollbackTransaction();
 			export_progress = -1;
 			return;
         }
 		OGRFeature::DestroyFeature( poFeature );
+		if (use_transactions &&
+			((row+1) % export_batch_size == 0 || row+1 == this->n_rows)) {
+			if (poDstLayer->CommitTransaction() != OGRERR_NONE) {
+				error_message << "Committing features failed."
+                              << "\n" << CPLGetLastErrorMsg();
+				export_progress = -1;
+				return;
+			}
+		}
 	}
 	//////////////////////////////////////////////////////////////
 	// Clean
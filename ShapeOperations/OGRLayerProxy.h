@@ -64,8 +64,14 @@ public:
 	bool        stop_reading;
 	int         export_progress;
 	bool        stop_exporting;
+	//!< features written per second by the running/last AddFeatures() call
+	double      export_rate;
+	//!< number of features written per transaction/geometry batch on export
+	static const int export_batch_size = 10000;
 	bool        is_writable;
 	std::string name;
+	//!< file of a CSV layer, read by ReadCsvData
+	std::string csv_fname;
 	int			n_rows;
 	int			n_cols;
 	OGRLayer*	layer;
@@ -96,6 +102,13 @@ private:
 	 * Read field information and save to OGRFieldProxy array.
 	 */
 	bool ReadFieldInfo();
+	
+    /**
+	 * Read a CSV layer with Gda::ReadCsvColumns instead of the OGR driver.
+	 * Returns false, with no data read, if the file does not have the
+	 * fields of the layer.
+	 */
+	bool ReadCsvData();
     
 public:
 	static OGRFieldType GetOGRFieldType(GdaConst::FieldType field_type);
@@ -125,9 +138,14 @@ public:
 
     /**
      * Add new features to an empty OGRLayer
-     * This function should be only used when create a new OGRLayer
+     * This function should be only used when create a new OGRLayer.
+     * GdaShape geometries of selected_rows are converted to OGR geometries
+     * export_batch_size at a time on a helper thread while the previous
+     * batch is written, and each batch is committed as one transaction if
+     * the driver supports it.  Only two batches are alive at any time.
      */
-    void AddFeatures(std::vector<OGRGeometry*>& geometries,
+    void AddFeatures(std::vector<GdaShape*>& geometries,
+                     Shapefile::ShapeType shape_type,
                      TableInterface* table,
                      std::map<wxString, std::pair<int, int> >& field_dict,
                      std::vector<int>& selected_rows);
@@ -17,10 +17,31 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "../GdaParallel.h"
+#include "CsrWeight.h"
 #include "GalWeight.h"
 #include "RateSmoothing.h"
 #include "../logger.h"
 
+namespace {
+	// Observations are handed to worker threads in whole bitmap blocks so
+	// that no two threads ever write to the same block of a bitmap.
+	const int obs_per_blk = boost::dynamic_bitset<>::bits_per_block;
+	
+	struct RateLoadTask {
+		RateLoadTask(GdaAlgs::RateSmootherBatch* b_s) : b(b_s) {}
+		void operator()(int start, int end, int) { b->Load_range(start, end); }
+		GdaAlgs::RateSmootherBatch* b;
+	};
+	
+	struct RateSmoothTask {
+		RateSmoothTask(GdaAlgs::RateSmootherBatch* b_s) : b(b_s) {}
+		void operator()(int start, int end, int) {
+			b->Smooth_range(start, end); }
+		GdaAlgs::RateSmootherBatch* b;
+	};
+}
+
 bool GdaAlgs::RateStandardizeEB(const int obs, const double* P,
 								  const double* E, double* m_results,
 								  std::vector<bool>& undefined)
@@ -262,3 +283,259 @@ bool GdaAlgs::RateSmoother_SRS(int obs, GalElement* m_gal, double *P,
 	for (int i=0; i<obs; ++i) if (undefined[i]) has_undefined = true;
 	return has_undefined;
 }
+
+GdaAlgs::RateSmootherBatch::RateSmootherBatch()
+: type(raw_rate), num_obs(0), num_times(0), w(0), P_in(0), E_in(0),
+results(0)
+{
+}
+
+GdaAlgs::RateSmootherBatch::~RateSmootherBatch()
+{
+}
+
+bool GdaAlgs::RateSmootherBatch::Smooth(RateSmoothingType type_s,
+										int num_obs_s, const CsrWeight* w_s,
+										const std::vector<const double*>& P,
+										const std::vector<const double*>& E,
+										const std::vector<double*>& results_s)
+{
+	type = type_s;
+	num_obs = num_obs_s;
+	num_times = P.size();
+	w = w_s;
+	P_in = &P;
+	E_in = &E;
+	results = &results_s;
+	if ((type == spatial_rate || type == spatial_empirical_bayes) &&
+		(!w || w->GetNumObs() != num_obs)) {
+		return false;
+	}
+	
+	size_t sz = (size_t) num_obs * num_times;
+	P_blk.resize(sz);
+	E_blk.resize(sz);
+	pi_blk.resize(sz);
+	SP.assign(num_times, 0);
+	SE.assign(num_times, 0);
+	theta1.assign(num_times, 1);
+	theta2.assign(num_times, 0);
+	valid.assign(num_times, true);
+	undefined.resize(num_times);
+	for (int t=0; t<num_times; t++) {
+		undefined[t].resize(num_obs);
+		undefined[t].reset();
+	}
+	
+	int num_blks = (num_obs + obs_per_blk - 1) / obs_per_blk;
+	RateLoadTask load_task(this);
+	Gda::ParallelFor(num_blks, load_task);
+	CalcGlobals();
+	RateSmoothTask smooth_task(this);
+	Gda::ParallelFor(num_blks, smooth_task);
+	
+	bool has_undefined = false;
+	for (int t=0; t<num_times && !has_undefined; t++) {
+		if (undefined[t].any()) has_undefined = true;
+	}
+	return has_undefined;
+}
+
+/** Interleave base and event values and compute raw rates. */
+void GdaAlgs::RateSmootherBatch::Load_range(int blk_start, int blk_end)
+{
+	const int T = num_times;
+	int obs_start = blk_start * obs_per_blk;
+	int obs_end = std::min(blk_end * obs_per_blk, num_obs);
+	for (int i=obs_start; i<obs_end; i++) {
+		size_t off = (size_t) i*T;
+		for (int t=0; t<T; t++) {
+			double p = (*P_in)[t][i];
+			double e = (*E_in)[t][i];
+			P_blk[off+t] = p;
+			E_blk[off+t] = e;
+			if (type == eb_rate_standardized) {
+				pi_blk[off+t] = p != 0.0 ? e / p : 0;
+				if (p == 0.0) undefined[t].set(i);
+			} else if (type == spatial_empirical_bayes) {
+				pi_blk[off+t] = p > 0 ? e / p : 1;
+				if (p <= 0) undefined[t].set(i);
+			} else {
+				pi_blk[off+t] = p > 0 ? e / p : 0;
+			}
+		}
+	}
+}
+
+/** Whole-map sums and variance estimates needed by the non-spatial
+ smoothers.  These are cheap compared to the per-observation passes
+ and are accumulated in observation order so that results do not
+ depend on the number of threads. */
+void GdaAlgs::RateSmootherBatch::CalcGlobals()
+{
+	const int T = num_times;
+	if (type == spatial_rate || type == spatial_empirical_bayes) return;
+	
+	for (int i=0; i<num_obs; i++) {
+		const double* p = &P_blk[(size_t) i*T];
+		const double* e = &E_blk[(size_t) i*T];
+		if (type == eb_rate_standardized) {
+			for (int t=0; t<T; t++) {
+				if (p[t] != 0.0) {
+					SP[t] += p[t];
+					SE[t] += e[t];
+				}
+			}
+		} else {
+			for (int t=0; t<T; t++) {
+				SP[t] += p[t];
+				SE[t] += e[t];
+			}
+		}
+	}
+	
+	for (int t=0; t<T; t++) {
+		if (type == eb_rate_standardized && SP[t] == 0.0) valid[t] = false;
+		theta1[t] = SP[t] > 0 ? SE[t] / SP[t] : 1;
+		if (type == eb_rate_standardized && valid[t]) {
+			theta1[t] = SE[t] / SP[t]; // b_hat
+		}
+	}
+	
+	if (type != empirical_bayes && type != eb_rate_standardized) return;
+	
+	std::vector<double> q1(T, 0);
+	for (int i=0; i<num_obs; i++) {
+		const double* p = &P_blk[(size_t) i*T];
+		const double* pi = &pi_blk[(size_t) i*T];
+		for (int t=0; t<T; t++) {
+			bool def = (type == empirical_bayes) ? p[t] > 0 : p[t] != 0.0;
+			if (def) q1[t] += p[t] * (pi[t]-theta1[t]) * (pi[t]-theta1[t]);
+		}
+	}
+	for (int t=0; t<T; t++) {
+		if (!valid[t]) continue;
+		double pbar = SP[t] / num_obs;
+		theta2[t] = (q1[t] / SP[t]) - (theta1[t] / pbar);
+		if (theta2[t] < 0 || SP[t] == 0) theta2[t] = 0.0;
+	}
+}
+
+void GdaAlgs::RateSmootherBatch::Smooth_range(int blk_start, int blk_end)
+{
+	const int T = num_times;
+	int obs_start = blk_start * obs_per_blk;
+	int obs_end = std::min(blk_end * obs_per_blk, num_obs);
+	std::vector<double> sp(T), se(T), th1(T), q1(T);
+	std::vector<bool> undef_i(T);
+	
+	for (int i=obs_start; i<obs_end; i++) {
+		size_t off = (size_t) i*T;
+		const double* p = &P_blk[off];
+		const double* e = &E_blk[off];
+		const double* pi = &pi_blk[off];
+		
+		if (type == raw_rate) {
+			for (int t=0; t<T; t++) {
+				(*results)[t][i] = p[t] > 0 ? pi[t] : 0;
+				if (p[t] <= 0) undefined[t].set(i);
+			}
+		} else if (type == excess_risk) {
+			for (int t=0; t<T; t++) {
+				double E_hat = p[t] * theta1[t];
+				(*results)[t][i] = E_hat > 0 ? e[t] / E_hat : 0;
+				if (E_hat <= 0) undefined[t].set(i);
+			}
+		} else if (type == empirical_bayes) {
+			for (int t=0; t<T; t++) {
+				(*results)[t][i] = 0;
+				if (p[t] <= 0) {
+					undefined[t].set(i);
+					continue;
+				}
+				double q = theta2[t] + (theta1[t]/p[t]);
+				double wt = (q > 0) ? theta2[t] / q : 1;
+				(*results)[t][i] = (wt * pi[t]) + ((1-wt) * theta1[t]);
+			}
+		} else if (type == eb_rate_standardized) {
+			for (int t=0; t<T; t++) {
+				(*results)[t][i] = 0;
+				if (!valid[t]) {
+					undefined[t].set(i);
+					continue;
+				}
+				if (undefined[t][i]) continue;
+				const double se = p[t] > 0 ? sqrt(theta2[t] + theta1[t]/p[t]) : 0;
+				if (se > 0) (*results)[t][i] = (pi[t] - theta1[t]) / se;
+			}
+		} else if (type == spatial_rate) {
+			const int nbr = w->Size(i);
+			const int* dt = w->Nbrs(i);
+			for (int t=0; t<T; t++) {
+				sp[t] = p[t];
+				se[t] = e[t];
+			}
+			for (int j=0; j<nbr; j++) {
+				const double* pj = &P_blk[(size_t) dt[j]*T];
+				const double* ej = &E_blk[(size_t) dt[j]*T];
+				for (int t=0; t<T; t++) {
+					sp[t] += pj[t];
+					se[t] += ej[t];
+				}
+			}
+			for (int t=0; t<T; t++) {
+				(*results)[t][i] = 0;
+				if (nbr > 0 && sp[t] > 0) {
+					(*results)[t][i] = se[t] / sp[t];
+				} else {
+					undefined[t].set(i);
+				}
+			}
+		} else if (type == spatial_empirical_bayes) {
+			const int nbr = w->Size(i);
+			const int* dt = w->Nbrs(i);
+			for (int t=0; t<T; t++) {
+				(*results)[t][i] = 0;
+				undef_i[t] = undefined[t][i] || nbr == 0;
+				sp[t] = p[t];
+				se[t] = e[t];
+			}
+			for (int j=0; j<nbr; j++) {
+				const double* pj = &P_blk[(size_t) dt[j]*T];
+				const double* ej = &E_blk[(size_t) dt[j]*T];
+				for (int t=0; t<T; t++) {
+					sp[t] += pj[t];
+					se[t] += ej[t];
+				}
+			}
+			for (int t=0; t<T; t++) {
+				th1[t] = sp[t] > 0 ? se[t] / sp[t] : 1;
+				q1[t] = p[t] * (pi[t] - th1[t]) * (pi[t] - th1[t]);
+			}
+			// second sweep over the same neighbor list, still in cache
+			for (int j=0; j<nbr; j++) {
+				const double* pj = &P_blk[(size_t) dt[j]*T];
+				const double* pij = &pi_blk[(size_t) dt[j]*T];
+				for (int t=0; t<T; t++) {
+					if (pj[t] <= 0) {
+						undef_i[t] = true;
+					} else {
+						q1[t] += pj[t] * (pij[t] - th1[t]) * (pij[t] - th1[t]);
+					}
+				}
+			}
+			for (int t=0; t<T; t++) {
+				if (undef_i[t]) {
+					undefined[t].set(i);
+					continue;
+				}
+				double pbar = sp[t] / (nbr + 1);
+				double th2 = (q1[t]/sp[t]) - (th1[t]/pbar);
+				if (th2 < 0) th2 = 0.0;
+				double q = (th2 + (th1[t]/p[t]));
+				double wt = (q > 0) ? th2 / q : 1;
+				(*results)[t][i] = (wt * pi[t]) + ((1-wt) * th1[t]);
+			}
+		}
+	}
+}
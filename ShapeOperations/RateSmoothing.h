@@ -21,7 +21,9 @@
 #define __GEODA_CENTER_RATE_SMOOTHING_H__
 
 #include <vector>
+#include <boost/dynamic_bitset.hpp>
 class GalElement;
+class CsrWeight;
 
 namespace GdaAlgs {
 	bool RateStandardizeEB(const int nObs, const double* P, const double* E,
@@ -37,6 +39,72 @@ namespace GdaAlgs {
 						   double *m_results, std::vector<bool>& undefined);
 	bool RateSmoother_SRS(int obs, GalElement* m_gal, double *P, double *E,
 						  double *m_results, std::vector<bool>& undefined);
+	
+	enum RateSmoothingType { raw_rate, excess_risk, empirical_bayes,
+		spatial_rate, spatial_empirical_bayes, eb_rate_standardized };
+	
+	/**
+	 Applies one of the rate smoothers above to every time period of a
+	 space-time variable at once.  Base and event values are interleaved
+	 into observation-major scratch buffers so that the spatial smoothers
+	 walk each neighbor list once for all periods, and observations are
+	 processed in parallel.  Scratch memory is kept between calls, so a
+	 single RateSmootherBatch can be reused for many variables.
+	 
+	 Undefined results are reported as one bitmap per period.  Results
+	 match the single-period functions, except that for spatial empirical
+	 Bayes an observation is undefined only if its own base or a
+	 neighbor's base is zero; it does not depend on the order in which
+	 observations are visited.
+	 */
+	class RateSmootherBatch {
+	public:
+		RateSmootherBatch();
+		virtual ~RateSmootherBatch();
+		
+		/** P[t] and E[t] are the base and event values for period t and
+		 results[t] receives the smoothed rates.  All arrays have length
+		 num_obs.  w is only used by the spatial smoothers.  Returns true
+		 if any result in any period is undefined. */
+		bool Smooth(RateSmoothingType type, int num_obs, const CsrWeight* w,
+					const std::vector<const double*>& P,
+					const std::vector<const double*>& E,
+					const std::vector<double*>& results);
+		
+		const boost::dynamic_bitset<>& GetUndefined(int t) const {
+			return undefined[t]; }
+		bool HasUndefined(int t) const { return undefined[t].any(); }
+		/** False if the smoother failed for period t.  Only
+		 eb_rate_standardized can fail, when all base values are zero. */
+		bool IsValid(int t) const { return valid[t]; }
+		
+		// called by the worker threads
+		void Load_range(int blk_start, int blk_end);
+		void Smooth_range(int blk_start, int blk_end);
+		
+	private:
+		void CalcGlobals();
+		
+		RateSmoothingType type;
+		int num_obs;
+		int num_times;
+		const CsrWeight* w;
+		const std::vector<const double*>* P_in;
+		const std::vector<const double*>* E_in;
+		const std::vector<double*>* results;
+		
+		// scratch, indexed [obs*num_times + t]
+		std::vector<double> P_blk;
+		std::vector<double> E_blk;
+		std::vector<double> pi_blk; // raw rate E/P
+		// per-period globals
+		std::vector<double> SP;
+		std::vector<double> SE;
+		std::vector<double> theta1; // also b_hat and lambda
+		std::vector<double> theta2; // also a_hat
+		std::vector<bool> valid;
+		std::vector<boost::dynamic_bitset<> > undefined;
+	};
 }
 
 #endif
@@ -31,8 +31,12 @@
 #include <boost/polygon/voronoi.hpp>
 #include <boost/polygon/voronoi_builder.hpp>
 #include <boost/polygon/voronoi_diagram.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
 #include <wx/stopwatch.h>
-#include "GalWeight.h"
+#include "CsrWeight.h"
+#include "../GdaParallel.h"
+#include "../GdaTrace.h"
 #include "../GenUtils.h"
 #include "../GenGeomAlgs.h"
 #include "../Generic/GdaShape.h"
@@ -89,98 +93,275 @@ namespace boost {
  Note: Input is double centroids, but we then scale up to large integers
  to create the Voronoi diagram.  The output of the Voronoi diagram
  is large doubles.
+ 
+ Points that scale to the same integer location are merged into a single
+ site before the diagram is built, so every Voronoi cell belongs to exactly
+ one site and cell.source_index() is the site id.  Once the diagram is
+ built, cells are clipped and their neighbors found in parallel: the
+ diagram is only read at that point.
  */
 
 namespace Gda {
 	namespace VoronoiUtils {
 		typedef voronoi_builder<int> VB;
 		typedef voronoi_diagram<double> VD;
+		typedef std::pair<int,int> int_pair;
 		
-		std::list<int>* getCellList(
-							const VD::cell_type& cell,
-							std::map<std::pair<int,int>,
-							std::list<int>* >& pt_to_id_list,
-							std::vector<std::pair<int,int> >& int_pts);
+		/** Input points scaled to integers and merged by location.  Sites
+		 are numbered in order of their first observation, and the
+		 observations at site s are obs[obs_start[s]] ...
+		 obs[obs_start[s+1]-1] in increasing order. */
+		struct Sites {
+			void Init(const std::vector<double>& x,
+					  const std::vector<double>& y);
+			int GetNumSites() const { return (int) pts.size(); }
+			int GetNumObsAt(int site) const {
+				return obs_start[site+1]-obs_start[site]; }
+			
+			double x_orig_min, y_orig_min;
+			double p; // scale from original to integer coordinates
+			// bounding box of the diagram in integer coordinates
+			double bb_xmin, bb_ymin, bb_xmax, bb_ymax;
+			std::vector<int_pair> pts; // integer location of each site
+			std::vector<int> site_of; // site of each observation
+			std::vector<int> obs_start; // size num sites + 1
+			std::vector<int> obs;
+		};
+		
+		struct SitesScaleTask {
+			SitesScaleTask(const std::vector<double>& x_s,
+						   const std::vector<double>& y_s,
+						   const Sites& sites_s,
+						   std::vector<int_pair>& int_pts_s)
+			: x(x_s), y(y_s), sites(sites_s), int_pts(int_pts_s) {}
+			void operator()(int start, int end, int) {
+				for (int i=start; i<end; i++) {
+					int_pts[i].first =
+						(int) ((x[i]-sites.x_orig_min)*sites.p);
+					int_pts[i].second =
+						(int) ((y[i]-sites.y_orig_min)*sites.p);
+				}
+			}
+			const std::vector<double>& x;
+			const std::vector<double>& y;
+			const Sites& sites;
+			std::vector<int_pair>& int_pts;
+		};
+		
+		void constructDiagram(const Sites& sites, VD& vd);
+		void cellPolygon(const VD::cell_type& cell, const Sites& sites,
+						 std::vector<wxRealPoint>& pts);
+		void cellNeighbors(const VD::cell_type& cell, const Sites& sites,
+						   bool queen, std::vector<int>& nbrs);
 		bool isVertexOutsideBB(const VD::vertex_type& vertex,
 							   const double& xmin, const double& ymin,
 							   const double& xmax, const double& ymax);
 		bool clipEdge(const VD::edge_type& edge,
-					  std::vector<std::pair<int,int> >& int_pts,
+					  const std::vector<int_pair>& int_pts,
 					  const double& xmin, const double& ymin,
 					  const double& xmax, const double& ymax,
 					  double& x0, double& y0, double& x1, double& y1);
 		bool clipInfiniteEdge(const VD::edge_type& edge,
-							  std::vector<std::pair<int,int> >& int_pts,
+							  const std::vector<int_pair>& int_pts,
 							  const double& xmin, const double& ymin,
 							  const double& xmax, const double& ymax,
 							  double& x0, double& y0, double& x1, double& y1);
 		bool clipFiniteEdge(const VD::edge_type& edge,
-							std::vector<std::pair<int,int> >& int_pts,
+							const std::vector<int_pair>& int_pts,
 							const double& xmin, const double& ymin,
 							const double& xmax, const double& ymax,
 							double& x0, double& y0, double& x1, double& y1);
+		
+		struct CellPolygonTask {
+			CellPolygonTask(const VD& vd_s, const Sites& sites_s,
+							std::vector<GdaShape*>& polys_s)
+			: vd(vd_s), sites(sites_s), polys(polys_s) {}
+			void operator()(int start, int end, int) {
+				std::vector<wxRealPoint> pts;
+				for (int c=start; c<end; c++) {
+					const VD::cell_type& cell = vd.cells()[c];
+					int site = cell.source_index();
+					cellPolygon(cell, sites, pts);
+					GdaPolygon* poly =
+						new GdaPolygon(pts.size(), pts.empty() ? 0 : &pts[0]);
+					// duplicate points get copies of the same polygon
+					int k = sites.obs_start[site];
+					polys[sites.obs[k]] = poly;
+					for (k++; k<sites.obs_start[site+1]; k++) {
+						polys[sites.obs[k]] = new GdaPolygon(*poly);
+					}
+				}
+			}
+			const VD& vd;
+			const Sites& sites;
+			std::vector<GdaShape*>& polys;
+		};
+		
+		/** Neighboring sites of every cell.  Each thread appends the
+		 sorted neighbor lists of its cells to its own buffer and records
+		 where they are, so no locking is needed except for progress,
+		 which counts cells on top of progress_base. */
+		struct CellNbrTask {
+			CellNbrTask(const VD& vd_s, const Sites& sites_s, bool queen_s,
+						int num_threads, const volatile bool* cancel_s,
+						volatile long* progress_s, long progress_base)
+			: vd(vd_s), sites(sites_s), queen(queen_s),
+			thread_nbrs(num_threads), site_thread(sites_s.GetNumSites()),
+			site_off(sites_s.GetNumSites()),
+			site_cnt(sites_s.GetNumSites(), 0), cancel(cancel_s),
+			progress(progress_s), done(progress_base) {}
+			void operator()(int start, int end, int thread_id) {
+				std::vector<int>& out = thread_nbrs[thread_id];
+				std::vector<int> nbrs;
+				for (int c=start; c<end; c++) {
+					if (cancel && *cancel) return;
+					const VD::cell_type& cell = vd.cells()[c];
+					int site = cell.source_index();
+					cellNeighbors(cell, sites, queen, nbrs);
+					site_thread[site] = thread_id;
+					site_off[site] = out.size();
+					site_cnt[site] = nbrs.size();
+					out.insert(out.end(), nbrs.begin(), nbrs.end());
+					if (progress && (c-start) % 1024 == 1023) {
+						boost::mutex::scoped_lock lock(mutex);
+						done += 1024;
+						*progress = done;
+					}
+				}
+			}
+			const int* SiteNbrs(int site) const {
+				return &thread_nbrs[site_thread[site]][0] + site_off[site]; }
+			
+			const VD& vd;
+			const Sites& sites;
+			bool queen;
+			std::vector<std::vector<int> > thread_nbrs;
+			std::vector<int> site_thread;
+			std::vector<long> site_off;
+			std::vector<int> site_cnt;
+			const volatile bool* cancel;
+			volatile long* progress;
+			boost::mutex mutex;
+			long done;
+		};
+		
+		/** Expands site neighbors to observation neighbors.  Every
+		 observation at a site is a neighbor of the others at that site and
+		 of every observation at a neighboring site. */
+		struct ObsNbrTask {
+			ObsNbrTask(const Sites& sites_s, const CellNbrTask& cn_s,
+					   CsrWeight& w_s)
+			: sites(sites_s), cn(cn_s), w(w_s) {}
+			void operator()(int start, int end, int) {
+				for (int i=start; i<end; i++) {
+					int site = sites.site_of[i];
+					int* row = &w.nbrs[0] + w.row_start[i];
+					int cnt = 0;
+					for (int k=sites.obs_start[site];
+						 k<sites.obs_start[site+1]; k++) {
+						if (sites.obs[k] != i) row[cnt++] = sites.obs[k];
+					}
+					const int* snb = cn.site_cnt[site] ? cn.SiteNbrs(site) : 0;
+					for (int j=0; j<cn.site_cnt[site]; j++) {
+						for (int k=sites.obs_start[snb[j]];
+							 k<sites.obs_start[snb[j]+1]; k++) {
+							row[cnt++] = sites.obs[k];
+						}
+					}
+					std::sort(row, row+cnt);
+				}
+			}
+			const Sites& sites;
+			const CellNbrTask& cn;
+			CsrWeight& w;
+		};
 	}
 }
 
-/** Input: double precision x/y coordinates, indexed by observation record id
- Output: list of list of duplicates
- */
-void Gda::VoronoiUtils::FindPointDuplicates(const std::vector<double>& x,
-											  const std::vector<double>& y,
-										std::list<std::list<int> >& duplicates)
+void Gda::VoronoiUtils::Sites::Init(const std::vector<double>& x,
+									const std::vector<double>& y)
 {
-	typedef std::pair<int,int> int_pair;
 	int num_obs = x.size();
-	double x_orig_min=0, x_orig_max=0;
-	double y_orig_min=0, y_orig_max=0;
+	double x_orig_max=0, y_orig_max=0;
+	x_orig_min = 0;
+	y_orig_min = 0;
 	SampleStatistics::CalcMinMax(x, x_orig_min, x_orig_max);
 	SampleStatistics::CalcMinMax(y, y_orig_min, y_orig_max);
 	double orig_scale = GenUtils::max<double>(x_orig_max-x_orig_min,
 											  y_orig_max-y_orig_min);
 	if (orig_scale == 0) orig_scale = 1;
 	double big_dbl = 1073741824; // 2^30
-	double p = (big_dbl/orig_scale);
-
-	std::map<int, std::list<int> > dups;
-	std::map<int, std::list<int> >::iterator dups_iter;
-	std::map<int_pair, int> pt_map;
-	std::map<int_pair, int>::iterator map_iter;
-	std::vector<int> x_int(num_obs);
-	std::vector<int> y_int(num_obs);
-	bool duplicates_exist = false;
+	p = (big_dbl/orig_scale);
+	
+	// Add 2% offset to the bounding rectangle
+	const double bb_pad = 0.02;
+	// note data has been translated to origin and scaled
+	bb_xmin = -bb_pad*big_dbl;
+	bb_xmax = (x_orig_max-x_orig_min)*p + bb_pad*big_dbl;
+	bb_ymin = -bb_pad*big_dbl;
+	bb_ymax = (y_orig_max-y_orig_min)*p + bb_pad*big_dbl;
+	
+	std::vector<int_pair> int_pts(num_obs);
+	SitesScaleTask task(x, y, *this, int_pts);
+	Gda::ParallelFor(num_obs, task, -1, 16384);
+	
+	// merge duplicate locations through a hash of the integer point
+	typedef boost::unordered_map<int_pair, int> site_map_type;
+	site_map_type site_map(num_obs);
+	pts.clear();
+	site_of.resize(num_obs);
 	for (int i=0; i<num_obs; i++) {
-		x_int[i] = (int) ((x[i]-x_orig_min)*p);
-		y_int[i] = (int) ((y[i]-y_orig_min)*p);
-		int_pair key(std::make_pair(x_int[i], y_int[i]));
-		map_iter = pt_map.find(key);
-		if (map_iter == pt_map.end()) {
-			pt_map[key] = i;
-		} else {
-			duplicates_exist = true;
-			int ind1 = map_iter->second;
-			int ind2 = i;
-			dups_iter = dups.find(ind1);
-			if (dups_iter == dups.end()) {
-				std::list<int> l;
-				l.push_back(ind1);
-				l.push_back(ind2);
-				dups[ind1] = l;
-			} else {
-				dups_iter->second.push_back(ind2);
-			}
-		}
+		std::pair<site_map_type::iterator, bool> r =
+			site_map.insert(std::make_pair(int_pts[i], (int) pts.size()));
+		if (r.second) pts.push_back(int_pts[i]);
+		site_of[i] = r.first->second;
+	}
+	int num_sites = pts.size();
+	obs_start.assign(num_sites+1, 0);
+	for (int i=0; i<num_obs; i++) obs_start[site_of[i]+1]++;
+	for (int s=0; s<num_sites; s++) obs_start[s+1] += obs_start[s];
+	obs.resize(num_obs);
+	std::vector<int> fill(obs_start.begin(), obs_start.end()-1);
+	for (int i=0; i<num_obs; i++) obs[fill[site_of[i]]++] = i;
+}
+
+void Gda::VoronoiUtils::constructDiagram(const Sites& sites, VD& vd)
+{
+	wxStopWatch sw_vd;
+	VB vb;
+	for (int s=0, num_sites=sites.GetNumSites(); s<num_sites; s++) {
+		vb.insert_point(sites.pts[s].first, sites.pts[s].second);
 	}
+	vb.construct(&vd);
+	LOG_MSG(wxString::Format("Voronoi diagram construction on %d points "
+							 "took %ld ms", sites.GetNumSites(),
+							 sw_vd.Time()));
+}
+
+/** Input: double precision x/y coordinates, indexed by observation record id
+ Output: list of list of duplicates
+ */
+void Gda::VoronoiUtils::FindPointDuplicates(const std::vector<double>& x,
+											  const std::vector<double>& y,
+										std::list<std::list<int> >& duplicates)
+{
 	duplicates.clear();
-	if (duplicates_exist) {
-		for (dups_iter = dups.begin(); dups_iter != dups.end(); dups_iter++) {
-			duplicates.push_back(dups_iter->second);
+	if (x.size() == 0) return;
+	Sites sites;
+	sites.Init(x, y);
+	for (int s=0, num_sites=sites.GetNumSites(); s<num_sites; s++) {
+		if (sites.GetNumObsAt(s) < 2) continue;
+		std::list<int> l;
+		for (int k=sites.obs_start[s]; k<sites.obs_start[s+1]; k++) {
+			l.push_back(sites.obs[k]);
 		}
+		duplicates.push_back(l);
 	}
 }
 
-/** If success, returns true. Else, if returns false, then duplicates or
-   near duplicates were found and duplicate_ind1 and duplicate_ind2 will
-   indicate which two points are near duplicates. */
+/** Fills polys with the Thiessen polygon of each point, clipped to the
+ bounding box of the points padded by 2%.  Duplicate points get copies of
+ the same polygon.  Returns false only if there are no points. */
 bool Gda::VoronoiUtils::MakePolygons(const std::vector<double>& x,
 									   const std::vector<double>& y,
 									   std::vector<GdaShape*>& polys,
@@ -190,276 +371,177 @@ bool Gda::VoronoiUtils::MakePolygons(const std::vector<double>& x,
 									   double& voronoi_bb_ymax)
 {
 	LOG_MSG("Entering Gda::VoronoiUtils::MakePolygons");
-	using namespace boost::polygon;
-	typedef std::pair<int,int> int_pair;
-	
+	GDA_TRACE_SCOPE("weights", "VoronoiUtils::MakePolygons");
 	int num_obs = x.size();
 	polys.clear();
+	if (num_obs == 0) return false;
 	polys.resize(num_obs);
-	double x_orig_min=0, x_orig_max=0;
-	double y_orig_min=0, y_orig_max=0;
-	SampleStatistics::CalcMinMax(x, x_orig_min, x_orig_max);
-	SampleStatistics::CalcMinMax(y, y_orig_min, y_orig_max);
-	double orig_scale = GenUtils::max<double>(x_orig_max-x_orig_min,
-											  y_orig_max-y_orig_min);
-	if (orig_scale == 0) orig_scale = 1;
-	double big_dbl = 1073741824; // 2^30
-	double p = (big_dbl/orig_scale);
 	
-	std::map<int, std::list<int> > dups;
-	std::map<int, std::list<int> >::iterator dups_iter;
-	std::map<int_pair, int> pt_map;
-	std::map<int_pair, int>::iterator map_iter;
-	std::vector<int> x_int(num_obs);
-	std::vector<int> y_int(num_obs);
-	bool duplicates_exist = false;
-	std::list<std::list<int> > duplicates;
-	for (int i=0; i<num_obs; i++) {
-		x_int[i] = (int) ((x[i]-x_orig_min)*p);
-		y_int[i] = (int) ((y[i]-y_orig_min)*p);
-		int_pair key(std::make_pair(x_int[i], y_int[i]));
-		map_iter = pt_map.find(key);
-		if (map_iter == pt_map.end()) {
-			pt_map[key] = i;
-		} else {
-			duplicates_exist = true;
-			int ind1 = map_iter->second;
-			int ind2 = i;
-			dups_iter = dups.find(ind1);
-			if (dups_iter == dups.end()) {
-				std::list<int> l;
-				l.push_back(ind1);
-				l.push_back(ind2);
-				dups[ind1] = l;
-			} else {
-				dups_iter->second.push_back(ind2);
-			}
-		}
-	}
-	if (duplicates_exist) {
-		for (dups_iter = dups.begin(); dups_iter != dups.end(); dups_iter++) {
-			duplicates.push_back(dups_iter->second);
-		}
-	}
+	Sites sites;
+	sites.Init(x, y);
+	voronoi_bb_xmin = (sites.bb_xmin / sites.p) + sites.x_orig_min;
+	voronoi_bb_xmax = (sites.bb_xmax / sites.p) + sites.x_orig_min;
+	voronoi_bb_ymin = (sites.bb_ymin / sites.p) + sites.y_orig_min;
+	voronoi_bb_ymax = (sites.bb_ymax / sites.p) + sites.y_orig_min;
 	
 	VD vd;
-	wxStopWatch sw_vd;
-	VB vb;
-	std::vector<int_pair> int_pts(num_obs);
-	for (int i=0; i<num_obs; i++) {
-		int_pts[i].first = x_int[i];
-		int_pts[i].second = y_int[i];
-	}
-	for (int i=0; i<num_obs; i++) {
-		int index = vb.insert_point(x_int[i], y_int[i]);
-	}
-	vb.construct(&vd);
-	LOG_MSG(wxString::Format("Voronoi diagram construction on %d points "
-							 "took %ld ms", num_obs, sw_vd.Time()));
+	constructDiagram(sites, vd);
 	
-	// Add 2% offset to the bounding rectangle
-	const double bb_pad = 0.02;
-	// note data has been translated to origin and scaled
-	double bbox_xmin = -bb_pad*big_dbl;
-	double bbox_xmax = (x_orig_max-x_orig_min)*p + bb_pad*big_dbl;
-	double bbox_ymin = -bb_pad*big_dbl;
-	double bbox_ymax = (y_orig_max-y_orig_min)*p + bb_pad*big_dbl;
+	wxStopWatch sw_vd_processing;
+	CellPolygonTask task(vd, sites, polys);
+	Gda::ParallelFor(vd.num_cells(), task, -1, 1024);
+	LOG_MSG(wxString::Format("Voronoi diagram processing on %d points "
+							 "took %ld ms", num_obs, sw_vd_processing.Time()));
 	
-	voronoi_bb_xmin = (bbox_xmin / p) + x_orig_min;
-	voronoi_bb_xmax = (bbox_xmax / p) + x_orig_min;
-	voronoi_bb_ymin = (bbox_ymin / p) + y_orig_min;
-	voronoi_bb_ymax = (bbox_ymax / p) + y_orig_min;
+	LOG_MSG("Exiting Gda::VoronoiUtils::MakePolygons");
+	return true;
+}
+
+/** Fills pts with the closed, clockwise ring of a cell.  Cells with a
+ vertex outside the bounding box or an infinite edge are clipped by taking
+ the convex hull of their clipped edges and their own point, which is
+ exact since Voronoi cells are convex. */
+void Gda::VoronoiUtils::cellPolygon(const VD::cell_type& cell,
+									const Sites& sites,
+									std::vector<wxRealPoint>& pts)
+{
+	pts.clear();
+	const double p = sites.p;
+	const double x_min = sites.x_orig_min;
+	const double y_min = sites.y_orig_min;
+	const VD::edge_type* edge = cell.incident_edge();
+	if (!edge) {
+		// a single site: its cell is the whole bounding box
+		pts.push_back(wxRealPoint(sites.bb_xmin/p + x_min,
+								  sites.bb_ymin/p + y_min));
+		pts.push_back(wxRealPoint(sites.bb_xmin/p + x_min,
+								  sites.bb_ymax/p + y_min));
+		pts.push_back(wxRealPoint(sites.bb_xmax/p + x_min,
+								  sites.bb_ymax/p + y_min));
+		pts.push_back(wxRealPoint(sites.bb_xmax/p + x_min,
+								  sites.bb_ymin/p + y_min));
+		pts.push_back(pts[0]);
+		return;
+	}
 	
-	wxStopWatch sw_vd_processing;
-	int cell_cnt = 0;
-	int max_pts = 1000;
-	wxRealPoint* pts = new wxRealPoint[max_pts];
-	for (VD::const_cell_iterator it = vd.cells().begin();
-		 it != vd.cells().end(); ++it) {
-		bool boundary_cell = false;
-		int edge_cnt = 0;
-		const VD::cell_type &cell = *it;
-		
-		int_pair key = std::make_pair(x_int[cell.source_index()],
-									  y_int[cell.source_index()]);
-		int ind = pt_map.find(key)->second;
-		
-		const VD::edge_type *edge = cell.incident_edge();
-		double x_init = 0;
-		double y_init = 0;
-		do {
-			if (!edge->is_finite() || !edge->is_primary()) {
-				//LOG_MSG("cell intersects boundary");
-				boundary_cell = true;
-				break;
-			}
-			// The following ensures that the same edge is always clipped.
-			// This ensurues that adjacent polygons have the exact same
-			// shared-edge descriptions.
-			double edge_x0, edge_y0, edge_x1, edge_y1;
-			bool intersects_e = false;
-			if (edge < edge->twin()) {
-				intersects_e = clipEdge(*edge, int_pts, bbox_xmin, bbox_ymin,
-										bbox_xmax, bbox_ymax,
-										edge_x0, edge_y0, edge_x1, edge_y1);
-			} else {
-				intersects_e = clipEdge(*edge->twin(), int_pts, bbox_xmin,
-										bbox_ymin, bbox_xmax, bbox_ymax,
-										edge_x0, edge_y0, edge_x1, edge_y1);
-			}
-			if (!intersects_e) {
-				boundary_cell = true;
-				break;
-			}
-			if (edge_cnt-1 > max_pts) {
-				delete [] pts;
-				max_pts = 2*edge_cnt;
-				pts = new wxRealPoint[max_pts];
-			}
-			double x0 = (edge_x0 / p) + x_orig_min;
-			double y0 = (edge_y0 / p) + y_orig_min;
-			double x1 = (edge_x1 / p) + x_orig_min;
-			double y1 = (edge_y1 / p) + y_orig_min;
-			if (edge_cnt == 0) {
-				x_init == x0;
-				y_init == y0;
-			}
-			//wxString msg;
-			//msg << "edge: (" << x0 << ", " << y0 << ") -> (";
-			//msg << x1 << ", " << y1 << ")";
-			//LOG_MSG(msg);
-			pts[edge_cnt].x = x0;
-			pts[edge_cnt].y = y0;
-			edge_cnt++;
-			edge = edge->next();
-			if (edge == cell.incident_edge()) {
-				if (x1 == x_init && y1 == y_init) {
-					pts[edge_cnt].x = x1;
-					pts[edge_cnt].y = y1;
-					edge_cnt++;
-				} else {
-					boundary_cell = true;
-					break;
-				}
-			}
-		} while (edge != cell.incident_edge());
-		
-		if (!boundary_cell) {
-			polys[ind] = new GdaPolygon(edge_cnt, pts);
-			//wxString msg;
-			//msg << "added non-boundary polygon with ";
-			//msg << edge_cnt-1 << " edges";
-			//LOG_MSG(msg);
-		} else {
-			// boundary cell, need to determine clipped polygon
-			edge = cell.incident_edge();
-			edge_cnt = 0;
-			
-			using boost::geometry::model::d2::point_xy;
-			using boost::geometry::append;
-			using boost::geometry::make;
-			boost::geometry::model::multi_point<point_xy<double> > h_pts;
-			typedef boost::geometry::model::polygon<point_xy<double> > my_polygon;
-			typedef boost::geometry::ring_type<my_polygon>::type ring_type;
-			my_polygon hull;
-			
-			do {
-				// The following ensures that the same edge is always clipped.
-				// This ensurues that adjacent polygons have the exact same
-				// shared-edge descriptions.
-				double edge_x0, edge_y0, edge_x1, edge_y1;
-				bool intersects_e = false;
-				if (edge < edge->twin()) {
-					intersects_e = clipEdge(*edge, int_pts,
-											bbox_xmin, bbox_ymin,
-											bbox_xmax, bbox_ymax,
-											edge_x0, edge_y0, edge_x1, edge_y1);
-				} else {
-					intersects_e = clipEdge(*edge->twin(), int_pts,
-											bbox_xmin, bbox_ymin,
-											bbox_xmax, bbox_ymax,
-											edge_x0, edge_y0, edge_x1, edge_y1);
-				}
-				if (intersects_e) {
-					double x0 = (edge_x0 / p) + x_orig_min;
-					double y0 = (edge_y0 / p) + y_orig_min;
-					append(h_pts, make<point_xy<double> >(x0, y0));
-					double x1 = (edge_x1 / p) + x_orig_min;
-					double y1 = (edge_y1 / p) + y_orig_min;
-					append(h_pts, make<point_xy<double> >(x1, y1));
-				}
-				edge_cnt++;
-				edge = edge->next();
-			} while (edge != cell.incident_edge());
-			
-			// make sure that the cell's internal point is also within the
-			// convex hull.
-			{
-				double x0 =
-					(((double) x_int[cell.source_index()]) / p) + x_orig_min;
-				double y0 =
-					(((double) y_int[cell.source_index()]) / p) + y_orig_min;
-				append(h_pts, make<point_xy<double> >(x0, y0));
-			}
-			
-			boost::geometry::convex_hull(h_pts, hull);
-			
-				ring_type outer_ring = hull.outer();
-			int pts_cnt = 0;
-			for (ring_type::iterator it=outer_ring.begin();
-				 it != outer_ring.end(); it++) {
-				double x = boost::geometry::get<0>(*it);
-				double y = boost::geometry::get<1>(*it);
-				pts[pts_cnt].x = x;
-				pts[pts_cnt].y = y;
-				pts_cnt++;
-			}
-			polys[ind] = new GdaPolygon(pts_cnt, pts);
+	bool boundary_cell = false;
+	do {
+		if (!edge->is_finite() || !edge->is_primary() ||
+			isVertexOutsideBB(*edge->vertex0(), sites.bb_xmin, sites.bb_ymin,
+							  sites.bb_xmax, sites.bb_ymax)) {
+			boundary_cell = true;
+			break;
 		}
+		pts.push_back(wxRealPoint((edge->vertex0()->x() / p) + x_min,
+								  (edge->vertex0()->y() / p) + y_min));
+		edge = edge->next();
+	} while (edge != cell.incident_edge());
+	
+	if (!boundary_cell) {
+		// edges run counter-clockwise around a cell, while shapefile outer
+		// rings are clockwise
+		std::reverse(pts.begin(), pts.end());
+		pts.push_back(pts[0]);
+		return;
 	}
 	
-	if (duplicates_exist) {
-		// Must fill in missing entries in poly vector with copies
-		// of duplicate shapes.
-		for (dups_iter = dups.begin(); 
-			 dups_iter != dups.end(); dups_iter++) {
-			int head_id = dups_iter->first;
-			for (std::list<int>::iterator iter=dups_iter->second.begin();
-				 iter != dups_iter->second.end(); iter++) {
-				if (*iter == head_id) continue;
-				polys[*iter] = new GdaPolygon(*(GdaPolygon*)polys[head_id]);
-			}			
+	// boundary cell, need to determine clipped polygon
+	pts.clear();
+	using boost::geometry::model::d2::point_xy;
+	using boost::geometry::append;
+	using boost::geometry::make;
+	boost::geometry::model::multi_point<point_xy<double> > h_pts;
+	typedef boost::geometry::model::polygon<point_xy<double> > my_polygon;
+	typedef boost::geometry::ring_type<my_polygon>::type ring_type;
+	my_polygon hull;
+	
+	edge = cell.incident_edge();
+	do {
+		// The following ensures that the same edge is always clipped.
+		// This ensurues that adjacent polygons have the exact same
+		// shared-edge descriptions.
+		double edge_x0, edge_y0, edge_x1, edge_y1;
+		bool intersects_e = false;
+		if (edge < edge->twin()) {
+			intersects_e = clipEdge(*edge, sites.pts,
+									sites.bb_xmin, sites.bb_ymin,
+									sites.bb_xmax, sites.bb_ymax,
+									edge_x0, edge_y0, edge_x1, edge_y1);
+		} else {
+			intersects_e = clipEdge(*edge->twin(), sites.pts,
+									sites.bb_xmin, sites.bb_ymin,
+									sites.bb_xmax, sites.bb_ymax,
+									edge_x0, edge_y0, edge_x1, edge_y1);
+		}
+		if (intersects_e) {
+			append(h_pts, make<point_xy<double> >((edge_x0 / p) + x_min,
+												  (edge_y0 / p) + y_min));
+			append(h_pts, make<point_xy<double> >((edge_x1 / p) + x_min,
+												  (edge_y1 / p) + y_min));
 		}
+		edge = edge->next();
+	} while (edge != cell.incident_edge());
+	
+	// make sure that the cell's internal point is also within the
+	// convex hull.
+	{
+		const int_pair& pt = sites.pts[cell.source_index()];
+		append(h_pts, make<point_xy<double> >((((double) pt.first) / p)
+											  + x_min,
+											  (((double) pt.second) / p)
+											  + y_min));
 	}
-			
-	if (pts) delete [] pts;
 	
-	//LOG_MSG(wxString::Format("Voronoi diagram processing on %d points "
-	//						 "took %ld ms", num_obs, sw_vd_processing.Time()));
-	//LOG_MSG(wxString::Format("#obs: %d, #voronoi cells: %d", num_obs,
-	//						 polys.size()));
+	boost::geometry::convex_hull(h_pts, hull);
 	
-	LOG_MSG("Exiting Gda::VoronoiUtils::MakePolygons");
-	return true;
+	const ring_type& outer_ring = hull.outer();
+	for (ring_type::const_iterator it=outer_ring.begin();
+		 it != outer_ring.end(); it++) {
+		pts.push_back(wxRealPoint(boost::geometry::get<0>(*it),
+								  boost::geometry::get<1>(*it)));
+	}
 }
 
-std::list<int>* Gda::VoronoiUtils::getCellList(
-				const VD::cell_type& cell,
-				std::map<std::pair<int,int>, std::list<int>* >& pt_to_id_list,
-				std::vector<std::pair<int,int> >& int_pts)
+/** Fills nbrs with the sorted ids of the sites whose cells share an edge
+ with cell inside the bounding box.  For queen contiguity, cells that only
+ share a vertex inside the bounding box are included as well. */
+void Gda::VoronoiUtils::cellNeighbors(const VD::cell_type& cell,
+									  const Sites& sites, bool queen,
+									  std::vector<int>& nbrs)
 {
-	std::map<std::pair<int,int>, std::list<int>* >::iterator iter;
-	//iter = pt_to_id_list.find(std::make_pair(cell.point0().x(),
-	//										 cell.point0().y()));
-	iter = pt_to_id_list.find(int_pts[cell.source_index()]);
-	if (iter == pt_to_id_list.end()) {
-		LOG_MSG(wxString::Format("cell id (%d,%d) point not found",
-								 //cell.point0().x(), cell.point0().x()));
-								 int_pts[cell.source_index()].first,
-								 int_pts[cell.source_index()].second));
-		return 0;
+	nbrs.clear();
+	const VD::edge_type* edge = cell.incident_edge();
+	if (!edge) return;
+	do {
+		double x0, y0, x1, y1;
+		if (clipEdge(*edge, sites.pts,
+					 sites.bb_xmin, sites.bb_ymin, sites.bb_xmax, sites.bb_ymax,
+					 x0, y0, x1, y1)) {
+			nbrs.push_back(edge->twin()->cell()->source_index());
+		}
+		if (queen) { // add all cells that share each edge vertex
+			const VD::vertex_type* v[2] = { edge->vertex0(), edge->vertex1() };
+			for (int k=0; k<2; k++) {
+				if (!v[k] || isVertexOutsideBB(*v[k], sites.bb_xmin,
+											   sites.bb_ymin, sites.bb_xmax,
+											   sites.bb_ymax)) continue;
+				const VD::edge_type* v_edge = v[k]->incident_edge();
+				do {
+					nbrs.push_back(v_edge->cell()->source_index());
+					v_edge = v_edge->rot_next();
+				} while (v_edge != v[k]->incident_edge());
+			}
+		}
+		edge = edge->next();
+	} while (edge != cell.incident_edge());
+	
+	std::sort(nbrs.begin(), nbrs.end());
+	nbrs.erase(std::unique(nbrs.begin(), nbrs.end()), nbrs.end());
+	std::vector<int>::iterator self =
+		std::lower_bound(nbrs.begin(), nbrs.end(), (int) cell.source_index());
+	if (self != nbrs.end() && *self == (int) cell.source_index()) {
+		nbrs.erase(self);
 	}
-	return iter->second;
 }
 
 bool Gda::VoronoiUtils::isVertexOutsideBB(const VD::vertex_type& vertex,
@@ -477,7 +559,7 @@ bool Gda::VoronoiUtils::isVertexOutsideBB(const VD::vertex_type& vertex,
  return true if intersection or if edge is contained within bounding box,
  otherwise return false */
 bool Gda::VoronoiUtils::clipEdge(const VD::edge_type& edge,
-								   std::vector<std::pair<int,int> >& int_pts,
+								   const std::vector<int_pair>& int_pts,
 								   const double& xmin, const double& ymin,
 								   const double& xmax, const double& ymax,
 								   double& x0, double& y0,
@@ -494,7 +576,7 @@ bool Gda::VoronoiUtils::clipEdge(const VD::edge_type& edge,
 
 /** Clip infinite edge to bounding rectangle */
 bool Gda::VoronoiUtils::clipInfiniteEdge(const VD::edge_type& edge,
-									std::vector<std::pair<int,int> >& int_pts,
+									const std::vector<int_pair>& int_pts,
 									const double& xmin, const double& ymin,
 									const double& xmax, const double& ymax,
 									double& x0, double& y0,
@@ -515,7 +597,6 @@ bool Gda::VoronoiUtils::clipInfiniteEdge(const VD::edge_type& edge,
 		direction_y = (p2_x - p1_x);
     } else {
 		// This case should never happen for point maps.
-		LOG_MSG("Warning! one clipInfiniteEdge cells contains a segment!");
 		return false;
     }
     double side = xmax - xmin;
@@ -540,7 +621,7 @@ bool Gda::VoronoiUtils::clipInfiniteEdge(const VD::edge_type& edge,
 
 /** Clip finite edge to bounding rectangle */
 bool Gda::VoronoiUtils::clipFiniteEdge(const VD::edge_type& edge,
-									std::vector<std::pair<int,int> >& int_pts,
+									const std::vector<int_pair>& int_pts,
 									const double& xmin, const double& ymin,
 									const double& xmax, const double& ymax,
 									double& x0, double& y0,
@@ -554,176 +635,98 @@ bool Gda::VoronoiUtils::clipFiniteEdge(const VD::edge_type& edge,
 	return GenGeomAlgs::ClipToBB(x0, y0, x1, y1, xmin, ymin, xmax, ymax);
 }
 
-/** If false returned, then an unexpected error.  Otherwise, neighbor map
- created successfully.  The presence of duplicates is indicated in
- duplicates_exists and the list of duplicates is filled in.
- */
+/** Rook or queen contiguity between the Thiessen polygons of the points,
+ written to w as binary weights with each neighbor list in increasing
+ order.  Duplicate points are neighbors of each other and share the
+ neighbors of their polygon.  Returns false if there are no points. */
 bool Gda::VoronoiUtils::PointsToContiguity(const std::vector<double>& x,
-									const std::vector<double>& y,
-									bool queen,
-									std::vector<std::set<int> >& nbr_map)
+										   const std::vector<double>& y,
+										   bool queen, CsrWeight& w)
 {
-	LOG_MSG("Entering Gda::VoronoiUtils::PointsToContiguity");
-	typedef std::pair<int,int> int_pair;
-	typedef std::list<int> id_list;
-	
-	int num_obs = x.size();
-	double x_orig_min=0, x_orig_max=0;
-	double y_orig_min=0, y_orig_max=0;
-	SampleStatistics::CalcMinMax(x, x_orig_min, x_orig_max);
-	SampleStatistics::CalcMinMax(y, y_orig_min, y_orig_max);
-	double orig_scale = GenUtils::max<double>(x_orig_max-x_orig_min,
-											  y_orig_max-y_orig_min);
-	if (orig_scale == 0) orig_scale = 1;
-	double big_dbl = 1073741824; // 2^30
-	double p = (big_dbl/orig_scale);
-	
-	// Add 2% offset to the bounding rectangle
-	const double bb_pad = 0.02;
-	// note data has been translated to origin and scaled
-	double bb_xmin = -bb_pad*big_dbl;
-	double bb_xmax = (x_orig_max-x_orig_min)*p + bb_pad*big_dbl;
-	double bb_ymin = -bb_pad*big_dbl;
-	double bb_ymax = (y_orig_max-y_orig_min)*p + bb_pad*big_dbl;
-		
-	std::map<int_pair, id_list* > pt_to_id_list;
-	// for each unique point, the list of cells at that point
-	std::map<int_pair, id_list* >::iterator pt_to_id_list_iter;
-	
-	std::map<int_pair, std::set<id_list* > > pt_to_nbr_sets;
-	// for each unique point, the set of lists of points that are neighbors
-	std::map<int_pair, std::set<id_list* > >::iterator pt_to_nbr_sets_iter;
-	
-	std::vector<int_pair> int_pts(num_obs);
-	for (int i=0; i<num_obs; i++) {
-		int_pts[i].first = (int) ((x[i]-x_orig_min)*p);
-		int_pts[i].second = (int) ((y[i]-y_orig_min)*p);
-	}		
-	
-	for (int i=0; i<num_obs; i++) {
-		pt_to_id_list_iter = pt_to_id_list.find(int_pts[i]);
-		if (pt_to_id_list_iter == pt_to_id_list.end()) {
-			pt_to_id_list[int_pts[i]] = new id_list;
-		}
-		pt_to_id_list[int_pts[i]]->push_back(i);
-	}
-		
-	nbr_map.clear();
-	nbr_map.resize(num_obs);
-	
-	VD vd;
-	wxStopWatch sw_vd;
-	VB vb;
-	for (int i=0; i<num_obs; i++) {
-		int index = vb.insert_point(int_pts[i].first, int_pts[i].second);
-	}
-	vb.construct(&vd);
-	LOG_MSG(wxString::Format("Voronoi diagram construction on %d points "
-							 "took %ld ms", num_obs, sw_vd.Time()));
-		
-	wxStopWatch sw_vd_processing;
-	for (VD::const_cell_iterator it = vd.cells().begin();
-		 it != vd.cells().end(); ++it) {
-		const VD::cell_type &cell = *it;
-		
-		int_pair key = int_pts[cell.source_index()];
-		
-		std::set<id_list* >& nbr_set = pt_to_nbr_sets[key];
-		
-		const VD::edge_type* edge = cell.incident_edge();
-		typedef std::list<const VD::vertex_type*> v_list;
-		v_list verts;
-		do {
-			id_list* nbr_list = getCellList(*(edge->twin()->cell()),
-											pt_to_id_list, int_pts);
-			if (!nbr_list) {
-				return false;
-			}
-			
-			double x0, y0, x1, y1;
-			if (clipEdge(*edge, int_pts,
-						 bb_xmin, bb_ymin, bb_xmax, bb_ymax,
-						 x0, y0, x1, y1)) {
-				nbr_set.insert(nbr_list);
-			}
+	return queen ? PointsToContiguity(x, y, &w, 0) :
+		PointsToContiguity(x, y, 0, &w);
+}
+
+namespace Gda {
+	namespace VoronoiUtils {
+		/** Contiguity of the observations from the cells of a diagram
+		 that has already been constructed.  Returns false if *cancel is
+		 set while the cells are visited. */
+		bool CellsToContiguity(const VD& vd, const Sites& sites, bool queen,
+							   int num_obs, CsrWeight& w,
+							   const volatile bool* cancel,
+							   volatile long* progress, long progress_base)
+		{
+			int num_cells = vd.num_cells();
+			int num_workers = GenUtils::min<int>(Gda::GetNumWorkers(),
+												 num_cells/1024 + 1);
+			CellNbrTask cn(vd, sites, queen, num_workers, cancel, progress,
+						   progress_base);
+			Gda::ParallelFor(num_cells, cn, num_workers, 1024);
+			if (cancel && *cancel) return false;
 			
-			if (queen) { // add all cells that share each edge vertex
-				if (edge->vertex0() &&
-					!isVertexOutsideBB(*edge->vertex0(), bb_xmin, bb_ymin,
-									   bb_xmax, bb_ymax)) {
-						verts.push_back(edge->vertex0());
+			w.num_obs = num_obs;
+			w.row_start.resize(num_obs+1);
+			w.row_start[0] = 0;
+			for (int i=0; i<num_obs; i++) {
+				int site = sites.site_of[i];
+				long cnt = sites.GetNumObsAt(site)-1;
+				if (cn.site_cnt[site] > 0) {
+					const int* snb = cn.SiteNbrs(site);
+					for (int j=0; j<cn.site_cnt[site]; j++) {
+						cnt += sites.GetNumObsAt(snb[j]);
 					}
-				if (edge->vertex1() &&
-					!isVertexOutsideBB(*edge->vertex1(), bb_xmin, bb_ymin,
-									   bb_xmax, bb_ymax)) {
-					verts.push_back(edge->vertex1());
 				}
+				w.row_start[i+1] = w.row_start[i] + cnt;
 			}
-			edge = edge->next();
-		} while (edge != cell.incident_edge());
-		
-		// add all neighboring cells.  List will be empty if !queen
-		for (v_list::iterator it = verts.begin(); it != verts.end(); it++) {
-			const VD::edge_type *edge =
-				(*it)->incident_edge();
-			do {
-				id_list* nbr_list = getCellList(*(edge->cell()),
-												 pt_to_id_list, int_pts);
-				if (!nbr_list) {
-					return false;
-				}
-				nbr_set.insert(nbr_list);
-				
-				edge = edge->rot_next();
-			} while (edge != (*it)->incident_edge());
-		}
-	}
-	
-	for (int i=0; i<num_obs; i++) {
-		std::set<id_list* >& nbr_set = pt_to_nbr_sets[int_pts[i]];
-		//LOG_MSG(wxString::Format("obs %d has %d neighbors",
-		//        i, nbr_set.size()));
-		
-		for (std::set<id_list* >::iterator set_iter = nbr_set.begin();
-			 set_iter != nbr_set.end(); set_iter++) {
-			for (id_list::iterator list_iter = (*set_iter)->begin();
-				 list_iter != (*set_iter)->end(); list_iter++) {
-				if (*list_iter != i) nbr_map[i].insert(*list_iter);
+			w.nbrs.resize(w.row_start[num_obs]);
+			if (w.nbrs.size() > 0) {
+				ObsNbrTask task(sites, cn, w);
+				Gda::ParallelFor(num_obs, task, -1, 4096);
 			}
-		}
-		// for each set of points, make every point a neighbor of the
-		// other points in the set, excluding self
-		id_list* pl = pt_to_id_list[int_pts[i]];
-		for (id_list::iterator it=pl->begin(); it!=pl->end(); it++) {
-			if (*it != i) nbr_map[i].insert(*it);
+			if (progress) *progress = progress_base + num_obs;
+			return true;
 		}
 	}
+}
+
+bool Gda::VoronoiUtils::PointsToContiguity(const std::vector<double>& x,
+										   const std::vector<double>& y,
+										   CsrWeight* queen_w,
+										   CsrWeight* rook_w,
+										   const volatile bool* cancel,
+										   volatile long* progress)
+{
+	LOG_MSG("Entering Gda::VoronoiUtils::PointsToContiguity");
+	GDA_TRACE_SCOPE("weights", "VoronoiUtils::PointsToContiguity");
+	int num_obs = x.size();
+	if (queen_w) queen_w->Clear();
+	if (rook_w) rook_w->Clear();
+	if (num_obs == 0) return false;
 	
-	for (pt_to_id_list_iter = pt_to_id_list.begin();
-		 pt_to_id_list_iter != pt_to_id_list.end();
-		 pt_to_id_list_iter++) {
-		delete pt_to_id_list_iter->second;
+	Sites sites;
+	sites.Init(x, y);
+	VD vd;
+	if (!(cancel && *cancel)) constructDiagram(sites, vd);
+	
+	wxStopWatch sw_vd_processing;
+	bool ok = !(cancel && *cancel);
+	if (queen_w && ok) {
+		ok = CellsToContiguity(vd, sites, true, num_obs, *queen_w,
+							   cancel, progress, 0);
+	}
+	if (rook_w && ok) {
+		ok = CellsToContiguity(vd, sites, false, num_obs, *rook_w,
+							   cancel, progress, queen_w ? num_obs : 0);
+	}
+	if (!ok) {
+		if (queen_w) queen_w->Clear();
+		if (rook_w) rook_w->Clear();
+		return false;
 	}
 	
 	LOG_MSG(wxString::Format("Voronoi diagram processing on %d points "
 							 "took %ld ms", num_obs, sw_vd_processing.Time()));
-	
 	LOG_MSG("Exiting Gda::VoronoiUtils::PointsToContiguity");
 	return true;
 }
-
-GalElement* Gda::VoronoiUtils::NeighborMapToGal(
-										std::vector<std::set<int> >& nbr_map)
-{
-	if (nbr_map.size() == 0) return 0;
-	GalElement* gal = new GalElement[nbr_map.size()];
-	if (!gal) return 0;
-	for (int i=0, iend=nbr_map.size(); i<iend; i++) {
-		gal[i].alloc(nbr_map[i].size());
-		for (std::set<int>::iterator it=nbr_map[i].begin();
-			 it != nbr_map[i].end(); it++) {
-			gal[i].Push(*it);
-		}
-	}
-	return gal;
-}
@@ -21,12 +21,11 @@
 #define __GEODA_CENTER_VORONOI_UTILS_H__
 
 #include <list>
-#include <set>
 #include <vector>
 
 class GdaPolygon;
 class GdaShape;
-class GalElement;
+class CsrWeight;
 
 namespace Gda {
 	namespace VoronoiUtils {
@@ -42,8 +41,16 @@ namespace Gda {
 		bool PointsToContiguity(const std::vector<double>& x,
 								const std::vector<double>& y,
 								bool queen, // if false, then rook only
-								std::vector<std::set<int> >& nbr_map);
-		GalElement* NeighborMapToGal(std::vector<std::set<int> >& nbr_map);
+								CsrWeight& w);
+		/** Queen and rook contiguity from one Voronoi diagram.  Either
+		 output may be null.  Returns false, with both outputs cleared,
+		 if *cancel is set before the neighbors are found.  *progress
+		 advances by the number of points for each output. */
+		bool PointsToContiguity(const std::vector<double>& x,
+								const std::vector<double>& y,
+								CsrWeight* queen_w, CsrWeight* rook_w,
+								const volatile bool* cancel = 0,
+								volatile long* progress = 0);
 	}
 }
 
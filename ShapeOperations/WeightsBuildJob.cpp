@@ -0,0 +1,405 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include "../GdaTrace.h"
+#include "AttributeKnn.h"
+#include "CsrWeight.h"
+#include "GalWeight.h"
+#include "GeomMeasures.h"
+#include "GwtWeight.h"
+#include "shp2cnt.h"
+#include "shp2gwt.h"
+#include "VoronoiUtils.h"
+#include "WeightsBuildJob.h"
+
+WeightsSpec::WeightsSpec(Type type_s)
+: type(type_s), order(1), include_lower(false), precision_threshold(0),
+k(4), threshold(0), method(1), with_coords(false)
+{
+}
+
+struct WeightsBuildTask {
+	WeightsBuildTask(WeightsBuildJob* job_s, int t_s) : job(job_s), t(t_s) {}
+	void operator()() { job->RunTask(t); }
+	WeightsBuildJob* job;
+	int t;
+};
+
+WeightsBuildJob::WeightsBuildJob()
+: main(0), has_cont(false), gm(0), num_running(0), cancel(false)
+{
+}
+
+WeightsBuildJob::~WeightsBuildJob()
+{
+	Cancel();
+	ClearResults();
+}
+
+void WeightsBuildJob::SetPolygons(Shapefile::Main* main_s)
+{
+	main = main_s;
+	has_cont = false;
+	pt_x.clear();
+	pt_y.clear();
+}
+
+void WeightsBuildJob::SetPoints(const std::vector<double>& x_s,
+								const std::vector<double>& y_s)
+{
+	main = 0;
+	has_cont = false;
+	pt_x = x_s;
+	pt_y = y_s;
+	cont_queen.Clear();
+	cont_rook.Clear();
+}
+
+void WeightsBuildJob::SetContiguity(const CsrWeight* queen,
+									const CsrWeight* rook)
+{
+	main = 0;
+	has_cont = true;
+	pt_x.clear();
+	pt_y.clear();
+	cont_queen.Clear();
+	cont_rook.Clear();
+	if (queen) cont_queen = *queen;
+	if (rook) cont_rook = *rook;
+}
+
+void WeightsBuildJob::SetCoordinates(const std::vector<double>& x_s,
+									 const std::vector<double>& y_s)
+{
+	x = x_s;
+	y = y_s;
+}
+
+void WeightsBuildJob::SetGeomMeasures(Gda::GeomMeasures* gm_s)
+{
+	gm = gm_s;
+}
+
+void WeightsBuildJob::SetAttributes(
+							const std::vector<std::vector<double> >& cols)
+{
+	attr_cols = cols;
+}
+
+bool WeightsBuildJob::Start(const std::vector<WeightsSpec>& specs_s)
+{
+	if (IsPending() || specs_s.empty()) return false;
+	ClearResults();
+	specs = specs_s;
+	
+	// group the specs that can share a sweep or a kd-tree
+	int cont_task = -1;
+	int bord_task = -1;
+	int knn_task_of_method[3] = { -1, -1, -1 };
+	bool need_queen = false;
+	bool need_rook = false;
+	for (int s=0, sz=specs.size(); s<sz; s++) {
+		const WeightsSpec& spec = specs[s];
+		int t = -1;
+		if (spec.type == WeightsSpec::queen_type ||
+			spec.type == WeightsSpec::rook_type) {
+			if (!main && !has_cont && pt_x.empty()) break;
+			if (cont_task < 0) {
+				cont_task = tasks.size();
+				tasks.push_back(Task());
+				tasks.back().kind = contiguity_task;
+			}
+			t = cont_task;
+			if (spec.type == WeightsSpec::queen_type) {
+				need_queen = true;
+			} else {
+				need_rook = true;
+			}
+		} else if (spec.type == WeightsSpec::border_type) {
+			if (!main || !gm || gm->GetNumObs() != (int) main->records.size()) {
+				break;
+			}
+			if (bord_task < 0) {
+				bord_task = tasks.size();
+				tasks.push_back(Task());
+				tasks.back().kind = border_task;
+			}
+			t = bord_task;
+		} else if (spec.type == WeightsSpec::knn_type) {
+			if (x.empty() || spec.method < 1 || spec.method > 2) break;
+			if (knn_task_of_method[spec.method] < 0) {
+				knn_task_of_method[spec.method] = tasks.size();
+				tasks.push_back(Task());
+				tasks.back().kind = knn_task;
+			}
+			t = knn_task_of_method[spec.method];
+		} else if (spec.type == WeightsSpec::attr_knn_type) {
+			if (attr_cols.empty() ||
+				(spec.with_coords && x.size() != attr_cols[0].size())) {
+				break;
+			}
+			t = tasks.size();
+			tasks.push_back(Task());
+			tasks.back().kind = attr_knn_task;
+		} else {
+			if (x.empty()) break;
+			t = tasks.size();
+			tasks.push_back(Task());
+			tasks.back().kind = threshold_task;
+		}
+		tasks[t].specs.push_back(s);
+	}
+	int n_specs = 0;
+	for (size_t t=0; t<tasks.size(); t++) n_specs += tasks[t].specs.size();
+	if (n_specs != (int) specs.size()) {
+		tasks.clear();
+		return false;
+	}
+	
+	int num_obs = main ? main->records.size() : !pt_x.empty() ?
+		pt_x.size() : std::max(cont_queen.GetNumObs(), cont_rook.GetNumObs());
+	for (size_t t=0; t<tasks.size(); t++) {
+		Task& task = tasks[t];
+		if (task.kind == contiguity_task) {
+			// one unit per polygon for the sweep, or per point and
+			// Voronoi contiguity type, then per higher order spec
+			task.progress_max = num_obs;
+			if (!pt_x.empty() && need_queen && need_rook) {
+				task.progress_max += num_obs;
+			}
+			for (size_t i=0; i<task.specs.size(); i++) {
+				if (specs[task.specs[i]].order > 1) {
+					task.progress_max += num_obs;
+				}
+			}
+		} else if (task.kind == border_task) {
+			task.progress_max = num_obs;
+		} else if (task.kind == attr_knn_task) {
+			task.progress_max = attr_cols[0].size();
+		} else {
+			task.progress_max = x.size();
+		}
+	}
+	
+	gals.resize(specs.size(), 0);
+	gwts.resize(specs.size(), 0);
+	progress.resize(tasks.size(), 0);
+	cancel = false;
+	num_running = tasks.size();
+	for (size_t t=0; t<tasks.size(); t++) {
+		threads.create_thread(WeightsBuildTask(this, t));
+	}
+	return true;
+}
+
+void WeightsBuildJob::RunTask(int t)
+{
+	const Task& task = tasks[t];
+	volatile long* prog = &progress[t];
+	if (task.kind == contiguity_task) {
+		RunContiguity(task, prog);
+	} else if (task.kind == knn_task) {
+		RunKnn(task, prog);
+	} else if (task.kind == border_task) {
+		RunBorders(task, prog);
+	} else if (task.kind == attr_knn_task) {
+		RunAttrKnn(task, prog);
+	} else {
+		RunThreshold(task, prog);
+	}
+	boost::mutex::scoped_lock lock(mutex);
+	num_running--;
+}
+
+void WeightsBuildJob::RunContiguity(const Task& task, volatile long* prog)
+{
+	GDA_TRACE_SCOPE("weights", "WeightsBuildJob::RunContiguity");
+	bool need_queen = false;
+	bool need_rook = false;
+	for (size_t i=0; i<task.specs.size(); i++) {
+		if (specs[task.specs[i]].type == WeightsSpec::queen_type) {
+			need_queen = true;
+		} else {
+			need_rook = true;
+		}
+	}
+	
+	// first order neighbors from a single sweep, one Voronoi diagram, or
+	// as given
+	int num_obs = 0;
+	GalElement* queen = 0;
+	GalElement* rook = 0;
+	if (main) {
+		num_obs = main->records.size();
+		double prec = specs[task.specs[0]].precision_threshold;
+		if (!shp2gal(*main, need_queen ? &queen : 0, need_rook ? &rook : 0,
+					 prec, &cancel, prog)) return;
+	} else {
+		if (!has_cont &&
+			!Gda::VoronoiUtils::PointsToContiguity(pt_x, pt_y,
+							need_queen ? &cont_queen : 0,
+							need_rook ? &cont_rook : 0, &cancel, prog)) {
+			return;
+		}
+		num_obs = std::max(cont_queen.GetNumObs(), cont_rook.GetNumObs());
+		if (need_queen && cont_queen.GetNumObs() > 0) {
+			queen = cont_queen.ToGal();
+		}
+		if (need_rook && cont_rook.GetNumObs() > 0) {
+			rook = cont_rook.ToGal();
+		}
+		if (has_cont) *prog = num_obs;
+	}
+	
+	long done = *prog;
+	for (size_t i=0; i<task.specs.size() && !cancel; i++) {
+		int s = task.specs[i];
+		const WeightsSpec& spec = specs[s];
+		GalElement* first = (spec.type == WeightsSpec::queen_type ?
+							 queen : rook);
+		if (!first) continue;
+		if (spec.order > 1) {
+			gals[s] = HOContiguity(spec.order, num_obs, first,
+								   spec.include_lower, &cancel);
+			done += num_obs;
+			*prog = done;
+		} else {
+			CsrWeight w(first, num_obs);
+			gals[s] = w.ToGal();
+		}
+	}
+	if (queen) delete [] queen;
+	if (rook) delete [] rook;
+}
+
+void WeightsBuildJob::RunKnn(const Task& task, volatile long* prog)
+{
+	GDA_TRACE_SCOPE("weights", "WeightsBuildJob::RunKnn");
+	std::vector<int> ks(task.specs.size());
+	for (size_t i=0; i<task.specs.size(); i++) {
+		ks[i] = specs[task.specs[i]].k;
+	}
+	std::vector<GwtElement*> knn;
+	int method = specs[task.specs[0]].method;
+	if (!DynKNN(x, y, ks, method, knn, &cancel, prog)) return;
+	for (size_t i=0; i<task.specs.size(); i++) {
+		gwts[task.specs[i]] = knn[i];
+	}
+}
+
+void WeightsBuildJob::RunBorders(const Task& task, volatile long* prog)
+{
+	GDA_TRACE_SCOPE("weights", "WeightsBuildJob::RunBorders");
+	if (!gm->HasSharedBorders() &&
+		!gm->ComputeSharedBorders(*main, &cancel, prog)) return;
+	CsrWeight w;
+	gm->GetSharedBorderWeights(w);
+	*prog = gm->GetNumObs();
+	if (w.GetNumNonZero() == 0) return;
+	for (size_t i=0; i<task.specs.size(); i++) {
+		gwts[task.specs[i]] = w.ToGwt();
+	}
+}
+
+void WeightsBuildJob::RunAttrKnn(const Task& task, volatile long* prog)
+{
+	GDA_TRACE_SCOPE("weights", "WeightsBuildJob::RunAttrKnn");
+	int s = task.specs[0];
+	std::vector<std::vector<double> > cols(attr_cols);
+	if (specs[s].with_coords) {
+		cols.push_back(x);
+		cols.push_back(y);
+	}
+	Gda::AttributeKnn::Standardize(cols);
+	CsrWeight w;
+	if (!Gda::AttributeKnn::Knn(cols, specs[s].k, 0, w, &cancel, prog)) {
+		return;
+	}
+	gwts[s] = w.ToGwt();
+}
+
+void WeightsBuildJob::RunThreshold(const Task& task, volatile long* prog)
+{
+	GDA_TRACE_SCOPE("weights", "WeightsBuildJob::RunThreshold");
+	int s = task.specs[0];
+	gwts[s] = shp2gwt(x.size(), x, y, specs[s].threshold, 1, specs[s].method,
+					  &cancel, prog);
+}
+
+bool WeightsBuildJob::IsDone()
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return num_running == 0;
+}
+
+void WeightsBuildJob::Wait()
+{
+	threads.join_all();
+	tasks.clear();
+	if (cancel) ClearResults();
+}
+
+void WeightsBuildJob::Cancel()
+{
+	if (!IsPending()) return;
+	cancel = true;
+	Wait();
+}
+
+long WeightsBuildJob::GetProgress()
+{
+	long p = 0;
+	for (size_t t=0; t<tasks.size(); t++) {
+		p += std::min(progress[t], tasks[t].progress_max);
+	}
+	return p;
+}
+
+long WeightsBuildJob::GetProgressMax()
+{
+	long p = 0;
+	for (size_t t=0; t<tasks.size(); t++) p += tasks[t].progress_max;
+	return p;
+}
+
+GalElement* WeightsBuildJob::TakeGal(int s)
+{
+	if (IsPending() || s < 0 || s >= (int) gals.size()) return 0;
+	GalElement* gal = gals[s];
+	gals[s] = 0;
+	return gal;
+}
+
+GwtElement* WeightsBuildJob::TakeGwt(int s)
+{
+	if (IsPending() || s < 0 || s >= (int) gwts.size()) return 0;
+	GwtElement* gwt = gwts[s];
+	gwts[s] = 0;
+	return gwt;
+}
+
+void WeightsBuildJob::ClearResults()
+{
+	for (size_t s=0; s<gals.size(); s++) if (gals[s]) delete [] gals[s];
+	for (size_t s=0; s<gwts.size(); s++) if (gwts[s]) delete [] gwts[s];
+	gals.clear();
+	gwts.clear();
+	progress.clear();
+}
@@ -0,0 +1,177 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2014 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_WEIGHTS_BUILD_JOB_H__
+#define __GEODA_CENTER_WEIGHTS_BUILD_JOB_H__
+
+#include <vector>
+#include <boost/thread.hpp>
+#include "CsrWeight.h"
+#include "ShpFile.h"
+
+class GalElement;
+class GwtElement;
+namespace Gda { class GeomMeasures; }
+
+/** One weights matrix to be built by a WeightsBuildJob.  border_type
+ gives the polygons that share a border as neighbors, with the lengths of
+ the shared borders as weights.  attr_knn_type gives the k nearest
+ neighbors in the space of the standardized variables of SetAttributes,
+ with distances in that space as weights. */
+struct WeightsSpec {
+	enum Type { queen_type, rook_type, knn_type, threshold_type,
+		border_type, attr_knn_type };
+	WeightsSpec(Type type = queen_type);
+	
+	Type type;
+	/** Contiguity order.  When include_lower is set, orders 1..order are
+	 all included. */
+	int order;
+	bool include_lower;
+	/** Vertex matching tolerance for polygon contiguity.  All contiguity
+	 specs of a job share the tolerance of the first one. */
+	double precision_threshold;
+	/** Number of nearest neighbors, not counting the point itself. */
+	int k;
+	/** Distance band, in the units of method. */
+	double threshold;
+	/** 1 == Euclidean Dist, 2 == Arc Dist */
+	int method;
+	/** For attr_knn_type: add the coordinates of SetCoordinates as two
+	 more variables, for neighbors in combined geographic and attribute
+	 space. */
+	bool with_coords;
+};
+
+/**
+ Builds one or more weights matrices on background threads.  Specs that
+ can share work are grouped into one task: every queen and rook spec comes
+ from a single contiguity sweep over the polygons (or from one Voronoi
+ diagram of the points, or from the first order neighbors given), every
+ kNN spec with the same distance metric comes from one kd-tree searched
+ once per point for the largest k, and every border spec from one pass
+ over the polygon edges.  Each distance band and attribute kNN spec is a
+ task of its own.
+ The tasks run concurrently.
+ 
+ Every task updates a progress counter and checks the cancellation flag
+ inside its neighbor search, so the caller can poll GetProgress from a
+ progress dialog and stop the build with Cancel.  All methods must be
+ called from the thread that called Start.
+ */
+class WeightsBuildJob {
+public:
+	WeightsBuildJob();
+	virtual ~WeightsBuildJob();
+	
+	/** Polygons used by contiguity and border specs.  main must not
+	 change until the job is done. */
+	void SetPolygons(Shapefile::Main* main);
+	/** Points whose Voronoi neighbors are used by contiguity specs.  The
+	 neighbors are found by the job; see GetContiguity. */
+	void SetPoints(const std::vector<double>& x,
+				   const std::vector<double>& y);
+	/** First order neighbors used by contiguity specs in place of
+	 polygons, such as the Voronoi neighbors a project keeps for points.
+	 Either may be null, in which case specs of that type have no
+	 neighbors. */
+	void SetContiguity(const CsrWeight* queen, const CsrWeight* rook);
+	/** Coordinates used by kNN and distance band specs. */
+	void SetCoordinates(const std::vector<double>& x,
+						const std::vector<double>& y);
+	/** Measures of the polygons of SetPolygons used by border specs.
+	 Missing shared borders are computed into gm, so gm must not be used
+	 elsewhere until the job is done. */
+	void SetGeomMeasures(Gda::GeomMeasures* gm);
+	/** Variables used by attribute kNN specs: cols[j][i] is the value of
+	 variable j for observation i.  See Gda::AttributeKnn. */
+	void SetAttributes(const std::vector<std::vector<double> >& cols);
+	
+	/** Begin building specs.  Returns false if a build is already pending
+	 or a spec has no polygons, points or coordinates to work on. */
+	bool Start(const std::vector<WeightsSpec>& specs);
+	/** True between a successful Start and the matching Wait or Cancel. */
+	bool IsPending() { return !tasks.empty(); }
+	/** True when every task has finished. */
+	bool IsDone();
+	/** Block until every task has finished. */
+	void Wait();
+	/** Stop every task and discard all results. */
+	void Cancel();
+	/** Units of work done so far, out of GetProgressMax. */
+	long GetProgress();
+	long GetProgressMax();
+	
+	/** Result of specs[s] after Wait.  Contiguity specs give a GalElement
+	 array and all other specs a GwtElement array with distances, or
+	 border lengths, as weights.  Null when the spec has no neighbors at
+	 all.  Ownership passes to the caller. */
+	GalElement* TakeGal(int s);
+	GwtElement* TakeGwt(int s);
+	/** First order neighbors used by the contiguity specs after Wait: as
+	 given to SetContiguity, or found from SetPoints so that the caller
+	 can keep them.  Empty if no spec needed them. */
+	const CsrWeight& GetContiguity(bool queen) const {
+		return queen ? cont_queen : cont_rook; }
+	
+private:
+	enum TaskKind { contiguity_task, knn_task, threshold_task,
+		border_task, attr_knn_task };
+	struct Task {
+		TaskKind kind;
+		/** Indices into specs. */
+		std::vector<int> specs;
+		long progress_max;
+	};
+	
+	void RunTask(int t);
+	void RunContiguity(const Task& task, volatile long* progress);
+	void RunKnn(const Task& task, volatile long* progress);
+	void RunThreshold(const Task& task, volatile long* progress);
+	void RunBorders(const Task& task, volatile long* progress);
+	void RunAttrKnn(const Task& task, volatile long* progress);
+	void ClearResults();
+	
+	Shapefile::Main* main;
+	bool has_cont;
+	CsrWeight cont_queen;
+	CsrWeight cont_rook;
+	std::vector<double> pt_x;
+	std::vector<double> pt_y;
+	std::vector<double> x;
+	std::vector<double> y;
+	Gda::GeomMeasures* gm;
+	std::vector<std::vector<double> > attr_cols;
+	
+	std::vector<WeightsSpec> specs;
+	std::vector<Task> tasks;
+	std::vector<GalElement*> gals;
+	std::vector<GwtElement*> gwts;
+	/** progress[t] is only written by the thread running tasks[t]. */
+	std::vector<long> progress;
+	
+	boost::thread_group threads;
+	boost::mutex mutex;
+	int num_running;
+	volatile bool cancel;
+	
+	friend struct WeightsBuildTask;
+};
+
+#endif
@@ -32,6 +32,9 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <boost/thread.hpp>
+#include "../GdaParallel.h"
+#include "../GdaTrace.h"
 #include "../GenUtils.h"
 #include "../logger.h"
 #include "ShapeFileHdr.h"
@@ -294,17 +297,24 @@ inline bool Intersect(const Box &a, const Box &b)
     return true;
 }
 
-GalElement* MakeContiguity(Shapefile::Main& main, const int crit,
-                           double precision_threshold=0.0)
+/** Sweeps the x partition once, testing every pair of polygons whose
+ boxes overlap.  queen and rook receive half matrices and either may be
+ null.  Rook neighbors are a subset of queen neighbors, so when both are
+ wanted the rook test is only run on queen neighbors.  Returns false when
+ cancelled. */
+static bool MakeContiguity(Shapefile::Main& main, GalElement* queen,
+						   GalElement* rook, double precision_threshold,
+						   const volatile bool* cancel,
+						   volatile long* progress)
 {
 	using namespace Shapefile;
+	GDA_TRACE_SCOPE("weights", "MakeContiguity");
 	int curr;
-	GalElement * gl= new GalElement [ gRecords ];
-	
-	if (!gl) return NULL;
-	GeoDaSet   Neighbors(gRecords), Related(gRecords);
+	long done = 0;
+	GeoDaSet   Neighbors(gRecords), Related(gRecords), RookRelated(gRecords);
 	//  cout << "total steps= " << gMinX.Cells() << endl;
 	for (int step= 0; step < gMinX.Cells(); ++step) {
+		if (cancel && *cancel) return false;
 		// include all elements from xmin[step]
 		for (curr= gMinX.first(step); curr != GdaConst::EMPTY;
 			 curr= gMinX.tail(curr)) gY->include(curr);
@@ -334,29 +344,36 @@ GalElement* MakeContiguity(Shapefile::Main& main, const int crit,
 				if (ply->intersect(nbr_ply)) {
 					
 					PolygonPartition nbrPoly(nbr_ply);
-					//shp.seekg(gOffset[nbr]+12, ios::beg);
-					//nbrPoly.ReadShape(shp);
-					
-					if (curr == 0 && nbr == 0) {
-						
-					}
 					
 					// run sweep with testPoly as a host and nbrPoly as a guest
-					int related = testPoly.sweep(nbrPoly, crit,
-                                                 precision_threshold);
-					if (related) Related.Push(nbr);
+					bool is_queen = true;
+					if (queen) {
+						is_queen = testPoly.sweep(nbrPoly, 0,
+												  precision_threshold);
+						if (is_queen) Related.Push(nbr);
+					}
+					if (rook && is_queen &&
+						testPoly.sweep(nbrPoly, 1, precision_threshold)) {
+						RookRelated.Push(nbr);
+					}
 				}
 			}
 			
-			if (Related.Size() && gl[curr].alloc(Related.Size())) {
-				while (Related.Size()) gl[curr].Push(Related.Pop());
+			if (queen && Related.Size() &&
+				queen[curr].alloc(Related.Size())) {
+				while (Related.Size()) queen[curr].Push(Related.Pop());
+			}
+			if (rook && RookRelated.Size() &&
+				rook[curr].alloc(RookRelated.Size())) {
+				while (RookRelated.Size()) rook[curr].Push(RookRelated.Pop());
 			}
 			
 			gY->remove(curr);       // remove from the partition
+			if (progress) *progress = ++done;
 		}
 	}
 	
-	return gl;
+	return true;
 }
 
 void ValueSort(const long * value, const int lower, const int upper)  
@@ -485,10 +502,29 @@ bool SaveGal(const GalElement *full,
 
 GalElement* shp2gal(Shapefile::Main& main, int criteria, bool save,
                     double precision_threshold)
+{
+	GalElement* full = 0;
+	if (criteria != 0) {
+		shp2gal(main, (GalElement**) 0, &full, precision_threshold);
+	} else {
+		shp2gal(main, &full, 0, precision_threshold);
+	}
+	return full;
+}
+
+// The partitions above are file globals, so one sweep runs at a time.
+static boost::mutex shp2gal_mutex;
+
+bool shp2gal(Shapefile::Main& main, GalElement** queen, GalElement** rook,
+			 double precision_threshold, const volatile bool* cancel,
+			 volatile long* progress)
 {
 	using namespace Shapefile;
+	if (queen) *queen = 0;
+	if (rook) *rook = 0;
+	if (!queen && !rook) return true;
 	
-	GalElement * full;
+	boost::mutex::scoped_lock lock(shp2gal_mutex);
 	//ReadOffsets(fname);
 	//ReadBoxes(fname);
 	gRecords = main.records.size();
@@ -531,82 +567,186 @@ GalElement* shp2gal(Shapefile::Main& main, int criteria, bool save,
 		}
 	} while ( total == 0);
 	
-	GalElement * gl= MakeContiguity(main, criteria, precision_threshold);
+	GalElement* q_half = queen ? new GalElement[gRecords] : 0;
+	GalElement* r_half = rook ? new GalElement[gRecords] : 0;
+	bool completed = MakeContiguity(main, q_half, r_half,
+									precision_threshold, cancel, progress);
     
 	if (gY) delete gY; gY = 0;
 	if (gOffset) delete [] gOffset; gOffset = 0;
 	if (gBox) delete [] gBox; gBox = 0;
 	
-	full = MakeFull(gl);
-	if (gl) delete [] gl; gl = 0;
-	return full;
+	if (completed && q_half) *queen = MakeFull(q_half);
+	if (completed && r_half) *rook = MakeFull(r_half);
+	if (q_half) delete [] q_half;
+	if (r_half) delete [] r_half;
+	return completed;
 }
 
 // Lag: True; otherwise Cumulative
-GalElement *HOContiguity(const int p, long obs, GalElement *W, bool Lag)
-{	
-	if (obs	< 1 || p <= 1 || p > obs-1) return NULL;
-	
-	int j, QueueCnt, c, irow, CurrIx, LastIx;
-	int* nLag				= new int [p];
-	GalElement *HO	= new GalElement[obs];
-	long *Queue			= new long [obs];
-	long *dt;
-	int *OC					= new int [obs];
-	
-	if (W == NULL || nLag == NULL || HO == NULL ||
-		Queue == NULL || OC == NULL) return NULL;
-	
-	for (j=0; j < obs; j++) OC[j] = 0;
-	for (irow = 0; irow < obs; irow++) {
-		OC[irow] = -1;
-		dt = W[irow].dt(); // neighbors of irow
-		QueueCnt = W[irow].Size();
-		for (j=0; j<QueueCnt; j++) {
-			Queue[j] = dt[j];
-			OC[Queue[j]] = 1;
-		}
-		CurrIx = 0; int k;
-		k= LastIx = QueueCnt;
-		for (c=2;c<=p; c++) {
-			nLag[c-2] = 0;
-			LastIx = k;
-			for (;CurrIx <LastIx; CurrIx++) {
-				dt = W[Queue[CurrIx]].dt();
-				int Nbrs = W[Queue[CurrIx]].Size();
-				for ( j=0; j< Nbrs; j++) {
-					if (OC[dt[j]] == 0) {
-						OC[dt[j]] = c;
-						Queue[k] = dt[j];
-						k++;
-						nLag[c-2]++;
+namespace {
+	/** Bounded breadth-first search from every observation in a range of
+	 parts.  Each worker thread keeps one visited array that is stamped
+	 with a per-source epoch instead of being cleared, and two frontier
+	 vectors that are reused for every source.  Neighbors of order
+	 lo..p are appended to the part's output in BFS order, together with
+	 a count per row and order.  cancel is checked before each source. */
+	struct HOContiguityTask {
+		HOContiguityTask(int p_s, int lo_s, long obs_s, const GalElement* W_s,
+						 const std::vector<int>& part_start_s,
+						 const volatile bool* cancel_s = 0)
+		: p(p_s), lo(lo_s), obs(obs_s), W(W_s), part_start(part_start_s),
+		cancel(cancel_s) {}
+		
+		void operator()(int part_b, int part_e, int)
+		{
+			const int num_kept = p-lo+1;
+			std::vector<unsigned int> stamp(obs, 0);
+			unsigned int epoch = 0;
+			std::vector<int> frontier;
+			std::vector<int> next;
+			for (int part=part_b; part<part_e; part++) {
+				std::vector<int>& out = part_nbrs[part];
+				std::vector<int>& cnt = part_cnt[part];
+				const int row_b = part_start[part];
+				const int row_e = part_start[part+1];
+				cnt.assign((size_t) (row_e-row_b) * num_kept, 0);
+				for (int i=row_b; i<row_e; i++) {
+					if (cancel && *cancel) return;
+					stamp[i] = ++epoch;
+					frontier.clear();
+					frontier.push_back(i);
+					int* row_cnt = &cnt[(size_t) (i-row_b) * num_kept];
+					for (int c=1; c<=p && !frontier.empty(); c++) {
+						next.clear();
+						for (size_t f=0, fsz=frontier.size(); f<fsz; f++) {
+							const GalElement& e = W[frontier[f]];
+							const long* dt = e.dt();
+							for (long j=0, sz=e.Size(); j<sz; j++) {
+								if (stamp[dt[j]] == epoch) continue;
+								stamp[dt[j]] = epoch;
+								next.push_back(dt[j]);
+							}
+						}
+						if (c >= lo) {
+							out.insert(out.end(), next.begin(), next.end());
+							row_cnt[c-lo] = next.size();
+						}
+						frontier.swap(next);
 					}
 				}
 			}
 		}
 		
-		LastIx = k;
-		if (!Lag) {
-			HO[irow].alloc(nLag[p-2]);
-			k = nLag[p-2];
+		int p;
+		int lo;
+		long obs;
+		const GalElement* W;
+		const std::vector<int>& part_start;
+		const volatile bool* cancel;
+		std::vector<std::vector<int> > part_nbrs;
+		std::vector<std::vector<int> > part_cnt;
+	};
+	
+	void RunHOContiguity(HOContiguityTask& task, long obs,
+						 std::vector<int>& part_start)
+	{
+		int num_parts = Gda::GetNumWorkers();
+		if (num_parts > obs) num_parts = obs;
+		Gda::PartitionRange(obs, num_parts, part_start);
+		task.part_nbrs.resize(part_start.size()-1);
+		task.part_cnt.resize(part_start.size()-1);
+		Gda::ParallelFor(part_start.size()-1, task);
+	}
+}
+
+bool HOContiguity(const int p, long obs, const GalElement *W, bool Lag,
+				  CsrWeight& HO, const volatile bool* cancel)
+{
+	HO.Clear();
+	if (obs < 1 || p < 1 || W == NULL) return false;
+	GDA_TRACE_SCOPE("weights", "HOContiguity");
+	
+	std::vector<int> part_start;
+	HOContiguityTask task(p, Lag ? 1 : p, obs, W, part_start, cancel);
+	RunHOContiguity(task, obs, part_start);
+	if (cancel && *cancel) return false;
+	
+	// Rows are in part order, and the kept orders of a row are
+	// contiguous, so only the row offsets need to be computed.
+	const int num_kept = task.p - task.lo + 1;
+	HO.num_obs = obs;
+	HO.row_start.resize(obs+1);
+	HO.row_start[0] = 0;
+	size_t nnz = 0;
+	for (size_t part=0; part<task.part_nbrs.size(); part++) {
+		nnz += task.part_nbrs[part].size();
+	}
+	HO.nbrs.reserve(nnz);
+	for (size_t part=0; part<task.part_nbrs.size(); part++) {
+		const std::vector<int>& cnt = task.part_cnt[part];
+		for (int i=part_start[part]; i<part_start[part+1]; i++) {
+			long row_sz = 0;
+			for (int k=0; k<num_kept; k++) {
+				row_sz += cnt[(size_t) (i-part_start[part])*num_kept + k];
+			}
+			HO.row_start[i+1] = HO.row_start[i] + row_sz;
 		}
-		else HO[irow].alloc(LastIx);
-		
-		for (j=0;j<LastIx;j++) {
-			if (Lag) {
-				HO[irow].Push(Queue[j]);
-			} else {
-				
-				if (OC[Queue[j]] == p) {
-					HO[irow].Push(Queue[j]);
-				}
-				
+		HO.nbrs.insert(HO.nbrs.end(), task.part_nbrs[part].begin(),
+					   task.part_nbrs[part].end());
+		std::vector<int>().swap(task.part_nbrs[part]);
+	}
+	return true;
+}
+
+bool HOContiguityOrders(const int p, long obs, const GalElement *W,
+						std::vector<CsrWeight>& orders)
+{
+	orders.clear();
+	if (obs < 1 || p < 1 || W == NULL) return false;
+	
+	std::vector<int> part_start;
+	HOContiguityTask task(p, 1, obs, W, part_start);
+	RunHOContiguity(task, obs, part_start);
+	
+	orders.resize(p);
+	std::vector<size_t> nnz(p, 0);
+	for (size_t part=0; part<task.part_cnt.size(); part++) {
+		const std::vector<int>& cnt = task.part_cnt[part];
+		for (size_t r=0; r<cnt.size(); r++) nnz[r % p] += cnt[r];
+	}
+	for (int k=0; k<p; k++) {
+		orders[k].num_obs = obs;
+		orders[k].row_start.resize(obs+1);
+		orders[k].row_start[0] = 0;
+		orders[k].nbrs.reserve(nnz[k]);
+	}
+	for (size_t part=0; part<task.part_nbrs.size(); part++) {
+		const std::vector<int>& cnt = task.part_cnt[part];
+		const int* nb = task.part_nbrs[part].empty() ? 0 :
+			&task.part_nbrs[part][0];
+		for (int i=part_start[part]; i<part_start[part+1]; i++) {
+			const int* row_cnt = &cnt[(size_t) (i-part_start[part])*p];
+			for (int k=0; k<p; k++) {
+				orders[k].nbrs.insert(orders[k].nbrs.end(), nb,
+									  nb + row_cnt[k]);
+				orders[k].row_start[i+1] = orders[k].nbrs.size();
+				nb += row_cnt[k];
 			}
-			OC[Queue[j]] = 0;
 		}
-		OC[irow] = 0;
+		std::vector<int>().swap(task.part_nbrs[part]);
 	}
-	return HO;
+	return true;
+}
+
+GalElement *HOContiguity(const int p, long obs, GalElement *W, bool Lag,
+						 const volatile bool* cancel)
+{	
+	if (obs	< 1 || p <= 1 || p > obs-1 || W == NULL) return NULL;
+	
+	CsrWeight HO;
+	if (!HOContiguity(p, obs, W, Lag, HO, cancel)) return NULL;
+	return HO.ToGal();
 }
 
 void DevFromMean(int nObs, double* RawData)
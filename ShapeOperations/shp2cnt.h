@@ -21,16 +21,37 @@
 #define __GEODA_CENTER_SHP_2_CNT_H__
 
 #include <wx/filename.h>
+#include "CsrWeight.h"
 #include "GalWeight.h"
 #include <vector>
 #include "ShpFile.h"
 
 bool IsLineShapeFile(const wxString& fname);
 #define geoda_sqr(x) ( (x) * (x) )
-GalElement* HOContiguity(const int p, long obs, GalElement *W, bool Lag);
+GalElement* HOContiguity(const int p, long obs, GalElement *W, bool Lag,
+						 const volatile bool* cancel = 0);
+/** Order-p contiguity, or cumulative orders 1..p when Lag is true, built
+ by a parallel bounded breadth-first search and written directly into
+ CSR form.  Unlike the GalElement version above, p may be 1.  Returns
+ false if *cancel is set before the search finishes. */
+bool HOContiguity(const int p, long obs, const GalElement *W, bool Lag,
+				  CsrWeight& HO, const volatile bool* cancel = 0);
+/** Builds orders 1..p in a single traversal.  On return orders[k-1]
+ holds the neighbors of exactly order k. */
+bool HOContiguityOrders(const int p, long obs, const GalElement *W,
+						std::vector<CsrWeight>& orders);
 //GalElement* shp2gal(const wxString& fname, int criteria, bool save= true);
 GalElement* shp2gal(Shapefile::Main& main, int criteria, bool save= true,
                     double precision_threshold=0.0);
+/** Queen and rook contiguity of a polygon layer from a single sweep over
+ one partition of the polygon bounding boxes.  Pass 0 for an output that
+ is not wanted; an output is left null when no polygon has a neighbor.
+ cancel is checked once per partition column and progress, if given, is
+ set to the number of polygons tested so far.  Returns false, with no
+ outputs allocated, when cancelled. */
+bool shp2gal(Shapefile::Main& main, GalElement** queen, GalElement** rook,
+			 double precision_threshold=0.0, const volatile bool* cancel=0,
+			 volatile long* progress=0);
 
 bool SaveGal(const GalElement *full, const wxString& layer_name, 
 			 const wxString& ifname, //<- no need to be file name 
@@ -35,6 +35,8 @@
 #include <wx/msgdlg.h>
 #include <wx/filename.h>
 #include <time.h>
+#include <boost/thread.hpp>
+#include "../GdaParallel.h"
 #include "../GenUtils.h"
 #include "../GdaConst.h"
 #include "../GenGeomAlgs.h"
@@ -675,7 +677,9 @@ GwtElement* shp2gwt(int Obs,
 					std::vector<double>& y,
 					const double threshold, 
 					const int degree,
-					int	method) // 0: Euclidean dist, 1:Arc
+					int	method, // 0: Euclidean dist, 1:Arc
+					const volatile bool* cancel,
+					volatile long* progress)
 {
 	long Records = Obs, cnt;
 	
@@ -704,10 +708,11 @@ GwtElement* shp2gwt(int Obs,
 	
 	GwtNeighbor * buffer	= new GwtNeighbor[ Records];
 	GwtElement * GwtHalf	= new GwtElement[ Records];
-	long BufferSize= 0, included;
+	long BufferSize= 0, included, done= 0;
 	
 	for (part= 0; part < gx; ++part)  
 	{      // processing all elements along (part, y)
+		if (cancel && *cancel) break;
 		included= 0;
 		for (curr= gX.first(part); curr != GdaConst::EMPTY;
 			 curr= gX.tail(curr), ++included)
@@ -733,6 +738,8 @@ GwtElement* shp2gwt(int Obs,
 			while (BufferSize)
 				GwtHalf[curr].Push(buffer[--BufferSize]);
 		};
+		done += included;
+		if (progress) *progress = done;
 		if (part > 0 && included > 0)  
 		{
 			if (4*included > gy) // it's less expensive to reset all cells in the partition
@@ -746,7 +753,9 @@ GwtElement* shp2gwt(int Obs,
 	};
 	delete  A;
 	delete  B;
-	GwtElement * GwtFull= MakeFullGwt(GwtHalf, Records, degree, false);
+	GwtElement * GwtFull= 0;
+	if (!(cancel && *cancel))
+		GwtFull= MakeFullGwt(GwtHalf, Records, degree, false);
 	delete [] GwtHalf;
 	GwtHalf = NULL;
 	delete [] buffer;
@@ -756,47 +765,115 @@ GwtElement* shp2gwt(int Obs,
 }
 
 #include "../kNN/ANN.h"			// ANN declarations
+
+namespace {
+	/** Searches the tree once per point for the k_max nearest neighbors
+	 and fills every specification from the result.  Each thread has its
+	 own result buffers; the tree is only read. */
+	struct DynKNNTask {
+		DynKNNTask(ANNkd_tree* tree_s, ANNpointArray pts_s, int k_s,
+				   int method_s, const std::vector<int>& ks_s,
+				   std::vector<GwtElement*>& knn_s,
+				   const volatile bool* cancel_s, volatile long* progress_s)
+		: tree(tree_s), pts(pts_s), k(k_s), method(method_s), ks(ks_s),
+		knn(knn_s), cancel(cancel_s), progress(progress_s), done(0) {}
+		
+		void operator()(int start, int end, int thread_id)
+		{
+			std::vector<ANNidx> nn_idx(k);
+			std::vector<ANNdist> dists(k);
+			for (int i=start; i<end; i++) {
+				if (cancel && *cancel) return;
+				tree->annkSearch(pts[i], k, &nn_idx[0], &dists[0], 0.0,
+								 method);
+				// neighbors come back nearest first, so the k nearest of
+				// each specification are a prefix of the k_max nearest
+				for (size_t s=0; s<ks.size(); s++) {
+					GwtElement& e = knn[s][i];
+					e.alloc(ks[s]);
+					for (int j=1; j<=ks[s]; j++) {
+						GwtNeighbor nb;
+						nb.nbx = nn_idx[j];
+						nb.weight = sqrt(dists[j]);  // annkSearch returns
+						// each distance squared, so take sqrt.
+						e.Push(nb);
+					}
+				}
+				if (progress && (i-start) % 1024 == 1023) {
+					boost::mutex::scoped_lock lock(mutex);
+					done += 1024;
+					*progress = done;
+				}
+			}
+		}
+		
+		ANNkd_tree* tree;
+		ANNpointArray pts;
+		int k;
+		int method;
+		const std::vector<int>& ks;
+		std::vector<GwtElement*>& knn;
+		const volatile bool* cancel;
+		volatile long* progress;
+		boost::mutex mutex;
+		long done;
+	};
+}
+
 GwtElement* DynKNN(const std::vector<double>& x, const std::vector<double>& y,
 				   int k, int method)
 {
 	int obs = x.size();
 	if (obs	< 3 || k < 1 || k > obs || x.size() != y.size()) return NULL;
 	
+	std::vector<int> ks(1, k-1);
+	std::vector<GwtElement*> knn;
+	if (!DynKNN(x, y, ks, method, knn)) return NULL;
+	return knn[0];
+}
+
+bool DynKNN(const std::vector<double>& x, const std::vector<double>& y,
+			const std::vector<int>& ks, int method,
+			std::vector<GwtElement*>& knn,
+			const volatile bool* cancel, volatile long* progress)
+{
+	knn.clear();
+	int obs = x.size();
+	if (obs	< 3 || ks.empty() || x.size() != y.size()) return false;
+	int k_max = 0;
+	for (size_t s=0; s<ks.size(); s++) {
+		if (ks[s] < 0 || ks[s] >= obs) return false;
+		if (ks[s] > k_max) k_max = ks[s];
+	}
+	// every point is its own nearest neighbor, so search for one more
+	int k = k_max+1;
+	
 	int		dim		= 2;		// dimension
 	ANNpointArray	data_pts;		// data points
-	ANNpoint			query_pt;		// query point
-	ANNidxArray		nn_idx;			// near neighbor indices
-	ANNdistArray	dists;			// near neighbor distances
 	ANNkd_tree		*the_tree;		// search structure
 	
-	GwtElement *gwt = new GwtElement[obs];
-	if (gwt == NULL)
-		return NULL;
-	
-	query_pt	= annAllocPt(dim);			// allocate query point
 	data_pts	= annAllocPts(obs, dim);	// allocate data points
-	nn_idx		= new ANNidx[k];			// allocate near neigh indices
-	dists		= new ANNdist[k];			// allocate near neighbor dists
-	int i = 0;
-	for (i=0;i<obs; i++) {
+	for (int i=0;i<obs; i++) {
 		data_pts[i][0] = x.at(i);
 		data_pts[i][1] = y.at(i);
 	}
 	
+	knn.resize(ks.size());
+	for (size_t s=0; s<ks.size(); s++) knn[s] = new GwtElement[obs];
+	
 	the_tree = new ANNkd_tree(data_pts,obs,dim);
+	DynKNNTask task(the_tree, data_pts, k, method, ks, knn, cancel, progress);
+	Gda::ParallelFor(obs, task, -1, 1024);
+	if (progress) *progress = obs;
+	bool completed = !(cancel && *cancel);
+	delete the_tree;
+	annDeallocPts(data_pts);
 	
-	for (i=0; i<obs; i++) {
-		the_tree->annkSearch(data_pts[i], k, nn_idx, dists,0.0, method);
-		gwt[i].alloc(k-1);
-		for (int j=1; j<k; j++) {
-			GwtNeighbor e;
-			e.nbx = nn_idx[j];
-			e.weight = sqrt(dists[j]);  // annkSearch returns each distance
-			// squared, so take sqrt.
-			gwt[i].Push(e);
-		}
+	if (!completed) {
+		for (size_t s=0; s<knn.size(); s++) delete [] knn[s];
+		knn.clear();
 	}
-	return gwt;
+	return completed;
 }
 
 
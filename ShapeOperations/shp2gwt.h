@@ -39,9 +39,26 @@ double ComputeMaxDistance(const std::vector<double>& x,
 GwtElement* DynKNN(const std::vector<double>& x, const std::vector<double>& y,
 				   int k, int method);
 
+/** k nearest neighbors for several values of k from one kd-tree and one
+ search per point with the largest k.  The searches run in parallel.
+ Unlike the version above, ks[s] does not count the point itself.  On
+ success knn[s] holds the ks[s] nearest neighbors of every point, nearest
+ first, with distances as weights.  cancel is checked before each search
+ and progress, if given, is set to the number of points searched so far.
+ Returns false, with knn empty, when cancelled or when any ks[s] is not in
+ [0, number of points). */
+bool DynKNN(const std::vector<double>& x, const std::vector<double>& y,
+			const std::vector<int>& ks, int method,
+			std::vector<GwtElement*>& knn,
+			const volatile bool* cancel = 0, volatile long* progress = 0);
+
+/** Distance band neighbors.  cancel is checked once per column of the
+ sweep and progress, if given, is set to the number of points processed so
+ far.  Returns NULL when cancelled. */
 GwtElement* shp2gwt(int Obs, std::vector<double>& x, std::vector<double>& y,
 					const double threshold, const int degree,
-					int method);
+					int method, const volatile bool* cancel = 0,
+					volatile long* progress = 0);
 
 bool WriteGwt(const GwtElement *g,
 			  const wxString& layer_name, const wxString& ofname, 
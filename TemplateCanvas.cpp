@@ -53,6 +53,7 @@
 #include "Project.h"
 #include "GdaConst.h"
 #include "GenUtils.h"
+#include "GdaTrace.h"
 #include "logger.h"
 #include "TemplateCanvas.h"
 #include "TemplateFrame.h"
@@ -72,6 +73,21 @@ BEGIN_EVENT_TABLE(TemplateCanvas, wxScrolledWindow)
 	EVT_SCROLLWIN(TemplateCanvas::OnScrollChanged)
 END_EVENT_TABLE()
 
+ScaleTransTimer::ScaleTransTimer(TemplateCanvas* canvas_s)
+: canvas(canvas_s)
+{
+}
+
+ScaleTransTimer::~ScaleTransTimer()
+{
+	canvas = 0;
+}
+
+void ScaleTransTimer::Notify()
+{
+	if (canvas) canvas->OnScaleTransTimer();
+}
+
 TemplateCanvas::TemplateCanvas(wxWindow *parent, const wxPoint& pos,
 							   const wxSize& size,
 							   bool fixed_aspect_ratio_mode_s,
@@ -103,6 +119,9 @@ TemplateCanvas::TemplateCanvas(wxWindow *parent, const wxPoint& pos,
 	draw_sel_shps_by_z_val(false),
 	layer0_bm(0), layer1_bm(0), layer2_bm(0),
 	layer0_valid(false), layer1_valid(false), layer2_valid(false),
+	frame_cache_enabled(false), frame_switch_pending(false), layer0_tm(-1),
+	point_render_mode(point_marks), scale_trans_gen(0), point_raster_gen(-1),
+	scale_trans_timer(0), resize_in_background(false),
 	total_hover_obs(0), max_hover_obs(11), hover_obs(11),
 	is_pan_zoom(false), is_scrolled(false), prev_scroll_pos_x(0),
 	prev_scroll_pos_y(0)
@@ -110,6 +129,7 @@ TemplateCanvas::TemplateCanvas(wxWindow *parent, const wxPoint& pos,
 	cat_data.CreateEmptyCategories(1, num_obs); // default is one time slice
 	SetMouseMode(mousemode); // will set the correct cursor for current mode
 	SetBackgroundStyle(wxBG_STYLE_ERASE);
+	scale_trans_timer = new ScaleTransTimer(this);
 	LOG_MSG("Entering TemplateCanvas::TemplateCanvas");
 	LOG_MSG("Exiting TemplateCanvas::TemplateCanvas");
 }
@@ -124,6 +144,9 @@ TemplateCanvas::TemplateCanvas(wxWindow *parent, const wxPoint& pos,
 TemplateCanvas::~TemplateCanvas()
 {
 	LOG_MSG("Entering TemplateCanvas::~TemplateCanvas()");
+	scale_trans_timer->Stop();
+	delete scale_trans_timer;
+	scale_trans_batch.Cancel();
 	BOOST_FOREACH( GdaShape* shp, background_shps ) delete shp;
 	BOOST_FOREACH( GdaShape* shp, selectable_shps ) delete shp;
 	BOOST_FOREACH( GdaShape* shp, foreground_shps ) delete shp;
@@ -140,6 +163,7 @@ TemplateCanvas::~TemplateCanvas()
 
 void TemplateCanvas::deleteLayerBms()
 {
+	ClearFrameCache();
 	if (layer0_bm) delete layer0_bm; layer0_bm = 0;
 	if (layer1_bm) delete layer1_bm; layer1_bm = 0;
 	if (layer2_bm) delete layer2_bm; layer2_bm = 0;
@@ -161,6 +185,7 @@ void TemplateCanvas::resizeLayerBms(int width, int height)
 
 void TemplateCanvas::invalidateBms()
 {
+	ClearFrameCache();
 	layer0_valid = false;
 	layer1_valid = false;
 	layer2_valid = false;	
@@ -269,7 +294,9 @@ void TemplateCanvas::OnScrollChanged(wxScrollWinEvent& event)
 			prev_scroll_pos_y = pos;
 		}
 		is_scrolled = true;
+		resize_in_background = true;
 		ResizeSelectableShps();
+		resize_in_background = false;
 	}
 	Refresh();
 }
@@ -323,7 +350,7 @@ void TemplateCanvas::ResizeSelectableShps(int virtual_scrn_w,
 	// NOTE: we do not support both fixed_aspect_ratio_mode
 	//    and fit_to_window_mode being false currently.
 	//LOG_MSG("Entering TemplateCanvas::ResizeSelectableShps");
-	wxStopWatch sw;
+	GDA_TRACE_SCOPE("render", "TemplateCanvas::ResizeSelectableShps");
 	int vs_w=virtual_scrn_w, vs_h=virtual_scrn_h;
 
 	double image_width, image_height;
@@ -381,12 +408,14 @@ void TemplateCanvas::ResizeSelectableShps(int virtual_scrn_w,
 		BOOST_FOREACH( GdaShape* ms, background_shps ) {
 			ms->applyScaleTrans(last_scale_trans);
 		}
-		BOOST_FOREACH( GdaShape* ms, selectable_shps ) {
-			ms->applyScaleTrans(last_scale_trans);
+		if (resize_in_background &&
+			scale_trans_batch.Start(selectable_shps, last_scale_trans)) {
+			// check back for the result once the resize events settle
+			scale_trans_timer->Start(20, wxTIMER_ONE_SHOT);
+		} else {
+			scale_trans_batch.Apply(selectable_shps, last_scale_trans);
 		}
 	}
-	LOG_MSG(wxString::Format("ResizeSelectableShps scale shapes: %ld ms",
-							 sw.Time()));
 	/*
 	//if (selectable_shps_type == polygons) {
 		//int proj_to_pnt_cnt = 0;
@@ -410,6 +439,8 @@ void TemplateCanvas::ResizeSelectableShps(int virtual_scrn_w,
 	BOOST_FOREACH( GdaShape* ms, foreground_shps ) {
 		ms->applyScaleTrans(last_scale_trans);
 	}
+	scale_trans_gen++;
+	ClearFrameCache();
 	layer0_valid = false;
 	if ( resize_xmax == shps_orig_xmax && resize_ymin == shps_orig_ymin){
 		wxRealPoint map_topleft, map_bottomright;
@@ -443,7 +474,6 @@ void TemplateCanvas::ResizeSelectableShps(int virtual_scrn_w,
 	}
 	is_scrolled = false;
 	Refresh();
-	LOG_MSG(wxString::Format("ResizeSelectableShps run time: %ld ms",sw.Time()));
 	//LOG_MSG("Exiting TemplateCanvas::ResizeSelectableShps");
 }
 
@@ -688,6 +718,7 @@ void TemplateCanvas::SetSelectableOutlineColor(wxColour color)
 {
 	LOG_MSG("Called TemplateCanvas::SetSelectableOutlineColor");
 	selectable_outline_color = color;
+	ClearFrameCache();
 	layer0_valid = false;
 	UpdateSelectableOutlineColors();
 	Refresh();
@@ -697,6 +728,7 @@ void TemplateCanvas::SetSelectableFillColor(wxColour color)
 {
 	selectable_fill_color = color;
 	UpdateSelectableOutlineColors();
+	ClearFrameCache();
 	layer0_valid = false;
 	Refresh();
 }
@@ -711,6 +743,7 @@ void TemplateCanvas::SetHighlightColor(wxColour color)
 void TemplateCanvas::SetCanvasBackgroundColor(wxColour color)
 {
 	canvas_background_color = color;
+	ClearFrameCache();
 	layer0_valid = false;
 	Refresh();
 }
@@ -732,6 +765,29 @@ void TemplateCanvas::UpdateSelectableOutlineColors()
 	}
 }
 
+void TemplateCanvas::OnScaleTransTimer()
+{
+	if (!scale_trans_batch.IsPending()) return;
+	if (!scale_trans_batch.IsDone()) {
+		scale_trans_timer->Start(20, wxTIMER_ONE_SHOT);
+		return;
+	}
+	FinishScaleTrans();
+	Refresh();
+}
+
+void TemplateCanvas::FinishScaleTrans()
+{
+	if (!scale_trans_batch.IsPending()) return;
+	scale_trans_timer->Stop();
+	if (!scale_trans_batch.Commit(selectable_shps)) {
+		// selectable_shps changed size without a Cancel
+		scale_trans_batch.Apply(selectable_shps, last_scale_trans);
+	}
+	scale_trans_gen++;
+	invalidateBms();
+}
+
 void TemplateCanvas::OnSize(wxSizeEvent& event)
 {
 	//LOG_MSG("Entering TemplateCanvas::OnSize");
@@ -767,7 +823,9 @@ void TemplateCanvas::OnSize(wxSizeEvent& event)
     //LOG(current_shps_height);
     resizeLayerBms(cs_w, cs_h);
     //SetVirtualSize(cs_w, cs_h);
+	resize_in_background = true;
     ResizeSelectableShps();
+	resize_in_background = false;
 
 	event.Skip();
 	//LOG_MSG("Exiting TemplateCanvas::OnSize");
@@ -781,7 +839,7 @@ void TemplateCanvas::update(HighlightState* o)
 {
 	LOG_MSG("Entering TemplateCanvas::update");
 
-	if (draw_sel_shps_by_z_val) {
+	if (draw_sel_shps_by_z_val || scale_trans_batch.IsPending()) {
 		// force a full redraw
 		layer0_valid = false;
 		Refresh();
@@ -794,7 +852,8 @@ void TemplateCanvas::update(HighlightState* o)
 	//std::vector<int>& nh = highlight_state->GetNewlyHighlighted();
 
 	HighlightState::EventType type = highlight_state->GetEventType();
-	if (type == HighlightState::delta) {
+	// erasing unhighlighted points would draw marks over the density cells
+	if (type == HighlightState::delta && !IsPointDensityShown()) {
 		LOG_MSG("processing HighlightState::delta");
 		wxMemoryDC dc(*layer1_bm);
 		if (!layer0_valid) {
@@ -862,6 +921,7 @@ void TemplateCanvas::OnPaint(wxPaintEvent& event)
 
 void TemplateCanvas::RenderToDC(wxDC &dc, bool disable_crosshatch_brush)
 {
+	FinishScaleTrans();
 	wxSize sz = GetVirtualSize();
 	dc.SetPen(canvas_background_color);
 	dc.SetBrush(canvas_background_color);
@@ -887,6 +947,15 @@ void TemplateCanvas::RenderToDC(wxDC &dc, bool disable_crosshatch_brush)
 
 void TemplateCanvas::DrawLayers()
 {
+	if (scale_trans_batch.IsPending()) {
+		// shapes are still being moved to the new size: paint only the
+		// background until OnScaleTransTimer commits them
+		wxMemoryDC dc(*layer2_bm);
+		dc.SetPen(canvas_background_color);
+		dc.SetBrush(canvas_background_color);
+		dc.DrawRectangle(wxPoint(0,0), GetVirtualSize());
+		return;
+	}
 	if (layer2_valid && layer1_valid && layer0_valid) return;
 	if (!layer0_valid) {
 		layer1_valid = false;
@@ -905,9 +974,45 @@ void TemplateCanvas::DrawLayers()
 void TemplateCanvas::DrawLayer0()
 {
 	//LOG_MSG("In TemplateCanvas::DrawLayer0");
+	GDA_TRACE_SCOPE("render", "TemplateCanvas::DrawLayer0");
 	wxSize sz = GetVirtualSize();
 	if (!layer0_bm) resizeLayerBms(sz.GetWidth(), sz.GetHeight());
-	wxMemoryDC dc(*layer0_bm);
+	int canvas_tm = cat_data.GetCurrentCanvasTmStep();
+	if (frame_cache_enabled && frame_switch_pending) {
+		// layer0_bm is still a valid frame for layer0_tm: keep it around
+		// and either swap in a prerendered frame or paint a fresh one.
+		frame_switch_pending = false;
+		wxBitmap* prev_bm = layer0_bm;
+		std::map<int, wxBitmap*>::iterator it = frame_cache.find(canvas_tm);
+		if (it != frame_cache.end()) {
+			layer0_bm = it->second;
+			frame_cache.erase(it);
+			frame_cache_lru.remove(canvas_tm);
+		} else {
+			layer0_bm = new wxBitmap(prev_bm->GetWidth(), prev_bm->GetHeight());
+			wxMemoryDC dc(*layer0_bm);
+			PaintLayer0(dc, sz);
+		}
+		if (layer0_tm != canvas_tm) {
+			CacheFrame(layer0_tm, prev_bm);
+		} else {
+			delete prev_bm;
+		}
+	} else {
+		// contents changed for reasons other than time step
+		ClearFrameCache();
+		wxMemoryDC dc(*layer0_bm);
+		PaintLayer0(dc, sz);
+	}
+	layer0_tm = canvas_tm;
+	
+	layer0_valid = true;
+	layer1_valid = false;
+	layer2_valid = false;
+}
+
+void TemplateCanvas::PaintLayer0(wxMemoryDC& dc, const wxSize& sz)
+{
 	dc.SetPen(canvas_background_color);
 	dc.SetBrush(canvas_background_color);
 	dc.DrawRectangle(wxPoint(0,0), sz);
@@ -920,12 +1025,208 @@ void TemplateCanvas::DrawLayer0()
 	} else {
 		DrawSelectableShapes(dc);
 	}
+}
+
+void TemplateCanvas::SetPointRenderMode(PointRenderMode mode)
+{
+	if (point_render_mode == mode) return;
+	point_render_mode = mode;
+	invalidateBms();
+	Refresh();
+}
+
+bool TemplateCanvas::IsPointDensityShown()
+{
+	return (point_render_mode != point_marks &&
+			selectable_shps_type == points && !draw_sel_shps_by_z_val);
+}
+
+/** Bin the selectable point centers into the w by h canvas, with enough
+ margin that marks centered just off the canvas are kept.  The bins are
+ reused until the canvas size or the shape positions change, so that
+ selection changes do not bin every point again. */
+void TemplateCanvas::BinSelectablePoints(int w, int h)
+{
+	if (point_raster_gen == scale_trans_gen &&
+		point_raster.GetWidth() == w && point_raster.GetHeight() == h &&
+		point_raster.GetNumPoints() == (int) selectable_shps.size()) return;
+	point_raster.Bin(selectable_shps, w, h,
+					 GdaConst::my_point_click_radius+1);
+	point_raster_gen = scale_trans_gen;
+}
+
+/** Draw point counts in small squares or hexagons, shaded on a log scale
+ with the sequential color scheme used by themed maps. */
+void TemplateCanvas::DrawPointDensity(wxDC& dc, int w, int h)
+{
+	GDA_TRACE_SCOPE("render", "TemplateCanvas::DrawPointDensity");
+	const int cell_size = 4;
+	const double hex_radius = 6;
+	const int num_colors = 9;
+	// the two palest colors are skipped so that cells holding a single
+	// point remain visible on a white background
+	const int first_color = 2;
 	
-	layer0_valid = true;
+	BinSelectablePoints(w, h);
+	int cols = 0, rows = 0;
+	std::vector<int> counts;
+	if (point_render_mode == point_hexbin) {
+		point_raster.HexCounts(hex_radius, cols, rows, counts);
+	} else {
+		point_raster.SquareCounts(cell_size, cols, rows, counts);
+	}
+	int max_count = 0;
+	for (int c=0, cend=counts.size(); c<cend; c++) {
+		if (counts[c] > max_count) max_count = counts[c];
+	}
+	if (max_count == 0) return;
+	
+	std::vector<wxColour> colors;
+	CatClassification::PickColorSet(colors,
+									CatClassification::sequential_color_scheme,
+									num_colors);
+	std::vector<wxBrush> brushes;
+	for (int i=first_color; i<num_colors; i++) {
+		brushes.push_back(wxBrush(colors[i]));
+	}
+	int num_levels = brushes.size();
+	double log_max = log((double) max_count + 1.0);
+	
+	// pointy-top hexagon corners relative to the center
+	wxPoint hex[6];
+	double hw = sqrt(3.0)/2.0*hex_radius;
+	hex[0] = wxPoint(0, (int) -hex_radius);
+	hex[1] = wxPoint((int) ceil(hw), (int) ceil(-hex_radius/2));
+	hex[2] = wxPoint((int) ceil(hw), (int) ceil(hex_radius/2));
+	hex[3] = wxPoint(0, (int) hex_radius);
+	hex[4] = wxPoint((int) floor(-hw), (int) ceil(hex_radius/2));
+	hex[5] = wxPoint((int) floor(-hw), (int) ceil(-hex_radius/2));
+	
+	dc.SetPen(*wxTRANSPARENT_PEN);
+	for (int r=0; r<rows; r++) {
+		for (int c=0; c<cols; c++) {
+			int n = counts[r*cols+c];
+			if (n == 0) continue;
+			int lvl = (int) (log((double) n + 1.0) / log_max * num_levels);
+			if (lvl >= num_levels) lvl = num_levels-1;
+			dc.SetBrush(brushes[lvl]);
+			if (point_render_mode == point_hexbin) {
+				wxPoint ctr = PointRaster::HexCenter(hex_radius, c, r);
+				dc.DrawPolygon(6, hex, ctr.x, ctr.y);
+			} else {
+				dc.DrawRectangle(c*cell_size, r*cell_size,
+								 cell_size, cell_size);
+			}
+		}
+	}
+	GDA_TRACE_COUNT("render", "density cells", (int64_t) rows*cols);
+}
+
+void TemplateCanvas::EnableFrameCache(bool enable)
+{
+	if (!enable) ClearFrameCache();
+	frame_cache_enabled = enable;
+}
+
+void TemplateCanvas::ClearFrameCache()
+{
+	std::map<int, wxBitmap*>::iterator it;
+	for (it = frame_cache.begin(); it != frame_cache.end(); it++) {
+		delete it->second;
+	}
+	frame_cache.clear();
+	frame_cache_lru.clear();
+	frame_switch_pending = false;
+}
+
+/** Keep bm as the frame for canvas_tm, evicting the least recently used
+ frames once the cache exceeds its frame count or memory budget. */
+void TemplateCanvas::CacheFrame(int canvas_tm, wxBitmap* bm)
+{
+	const int max_frames = 16;
+	const double max_bytes = 64.0*1024.0*1024.0;
+	if (!bm) return;
+	if (!frame_cache_enabled || canvas_tm < 0) {
+		delete bm;
+		return;
+	}
+	std::map<int, wxBitmap*>::iterator it = frame_cache.find(canvas_tm);
+	if (it != frame_cache.end()) {
+		delete it->second;
+		frame_cache_lru.remove(canvas_tm);
+	}
+	frame_cache[canvas_tm] = bm;
+	frame_cache_lru.push_front(canvas_tm);
+	
+	double frame_bytes = 4.0 * bm->GetWidth() * bm->GetHeight();
+	int limit = (int) (max_bytes / (frame_bytes > 1 ? frame_bytes : 1));
+	if (limit > max_frames) limit = max_frames;
+	if (limit < 1) limit = 1;
+	while ((int) frame_cache_lru.size() > limit) {
+		int tm = frame_cache_lru.back();
+		frame_cache_lru.pop_back();
+		it = frame_cache.find(tm);
+		if (it != frame_cache.end()) {
+			delete it->second;
+			frame_cache.erase(it);
+		}
+	}
+}
+
+/** Called by a subclass in place of invalidateBms when only the current
+ canvas time step has changed.  The caller must have already updated
+ cat_data to the new time step and left the selectable shapes as is. */
+void TemplateCanvas::SwitchFrame(int canvas_tm)
+{
+	if (!frame_cache_enabled) {
+		invalidateBms();
+		return;
+	}
+	if (!layer0_valid && !frame_switch_pending) {
+		// layer0 went stale for some other reason: cached frames are too
+		ClearFrameCache();
+	} else if (layer0_valid) {
+		frame_switch_pending = true;
+	}
+	layer0_valid = false;
 	layer1_valid = false;
 	layer2_valid = false;
 }
 
+/** Render the layer0 frame for canvas_tm into the frame cache while
+ leaving the current frame untouched.  Returns false if the canvas is not
+ in a state where frames can be reused. */
+bool TemplateCanvas::PrerenderFrame(int canvas_tm)
+{
+	if (!frame_cache_enabled || !layer0_bm) return false;
+	// settle a pending switch first so that the current frame is kept
+	if (frame_switch_pending) DrawLayer0();
+	if (!layer0_valid) return false;
+	if (canvas_tm < 0 || canvas_tm >= cat_data.GetCanvasTmSteps()) {
+		return false;
+	}
+	if (canvas_tm == layer0_tm || frame_cache.find(canvas_tm) !=
+		frame_cache.end()) return true;
+	
+	GDA_TRACE_SCOPE("render", "TemplateCanvas::PrerenderFrame");
+	wxSize sz = GetVirtualSize();
+	wxBitmap* cur_bm = layer0_bm;
+	int cur_tm = cat_data.GetCurrentCanvasTmStep();
+	wxBitmap* bm = new wxBitmap(cur_bm->GetWidth(), cur_bm->GetHeight());
+	// The DrawSelectableShapes methods read the current time step and the
+	// dimensions of layer0_bm, so point both at the frame being rendered.
+	layer0_bm = bm;
+	cat_data.SetCurrentCanvasTmStep(canvas_tm);
+	{
+		wxMemoryDC dc(*bm);
+		PaintLayer0(dc, sz);
+	}
+	cat_data.SetCurrentCanvasTmStep(cur_tm);
+	layer0_bm = cur_bm;
+	CacheFrame(canvas_tm, bm);
+	return true;
+}
+
 // Copy in layer0_bm and draw highlighted shapes.
 void TemplateCanvas::DrawLayer1()
 {
@@ -999,8 +1300,10 @@ void TemplateCanvas::DrawSelectableShapesByZVal(wxDC &dc,
 void TemplateCanvas::DrawSelectableShapes(wxMemoryDC &dc)
 {
 	//LOG_MSG("In TemplateCanvas::DrawSelectableShapes");
-	wxStopWatch sw;
-	if (use_category_brushes) {
+	GDA_TRACE_SCOPE("render", "TemplateCanvas::DrawSelectableShapes");
+	if (use_category_brushes && IsPointDensityShown()) {
+		DrawPointDensity(dc, layer0_bm->GetWidth(), layer0_bm->GetHeight());
+	} else if (use_category_brushes) {
 #ifdef __WXMAC__
 		DrawSelectableShapes_gc(dc);
 #else
@@ -1011,8 +1314,8 @@ void TemplateCanvas::DrawSelectableShapes(wxMemoryDC &dc)
 			selectable_shps[i]->paintSelf(dc);
 		}
 	}
-	LOG_MSG(wxString::Format("DrawSelectableShapes render time: "
-							 "%ld ms", sw.Time()));
+	GDA_TRACE_COUNT("render", "selectable shapes drawn",
+					(int64_t) selectable_shps.size());
 }
 
 // draw unhighlighted selectable shapes with wxGraphicsContext
@@ -1027,29 +1330,21 @@ void TemplateCanvas::DrawSelectableShapes_gc(wxMemoryDC &dc)
 	int w = layer0_bm->GetWidth();
 	int h = layer0_bm->GetHeight();
 	if (selectable_shps_type == points) {
-		std::vector<bool> dirty(w*h, false);
-		int dirty_cnt = 0;
+		BinSelectablePoints(w, h);
+		std::vector<int> kept;
 		gc->SetAntialiasMode(wxANTIALIAS_NONE);
 		wxDouble r = GdaConst::my_point_click_radius;
-		wxGraphicsPath path = gc->CreatePath();
 		GdaPoint* p;
 		for (int cat=0; cat<num_cats; cat++) {
 			gc->SetPen(cat_data.GetCategoryColor(cc_ts, cat));
-			//gc->SetBrush(cat_data.GetCategoryBrush(cc_ts, cat));
-			std::vector<int>& ids = cat_data.GetIdsRef(cc_ts, cat);
+			kept.clear();
+			point_raster.Decimate(cat_data.GetIdsRef(cc_ts, cat), kept);
 			
 			wxGraphicsPath path = gc->CreatePath();
-			for (int i=0, iend=ids.size(); i<iend; i++) {
-				p = (GdaPoint*) selectable_shps[ids[i]];
-				if (p->isNull()) continue;
+			for (int i=0, iend=kept.size(); i<iend; i++) {
+				p = (GdaPoint*) selectable_shps[kept[i]];
 				path.AddCircle(p->center.x, p->center.y, r);
-				//if (!dirty[p->center.x + p->center.y*w]) {
-					//path.AddCircle(p->center.x, p->center.y, r);
-					//dirty[p->center.x + p->center.y*w] = true;
-				//}
 			}
-			//gc->FillPath(path, wxWINDING_RULE);
-			//if (selectable_outline_visible)	gc->StrokePath(path);
 			gc->StrokePath(path);
 		}
 	} else if (selectable_shps_type == polygons) {
@@ -1174,53 +1469,25 @@ void TemplateCanvas::DrawSelectableShapes_gen_dc(wxDC &dc)
 	int num_cats=cat_data.GetNumCategories(cc_ts);
 	int w = layer0_bm->GetWidth();
 	int h = layer0_bm->GetHeight();
-	if (selectable_shps_type == points) {
-		std::vector<bool> dirty(w*h, false);
-		int dirty_cnt = 0;
+	if (selectable_shps_type == points && IsPointDensityShown()) {
+		DrawPointDensity(dc, w, h);
+	} else if (selectable_shps_type == points) {
+		// Categories are drawn in order, so a second mark of the same
+		// category at the same pixel would only repaint the same pixels.
+		BinSelectablePoints(w, h);
 		dc.SetBrush(*wxTRANSPARENT_BRUSH);
-		wxDouble r = GdaConst::my_point_click_radius;
-		GdaPoint* p;
 		for (int cat=0; cat<num_cats; cat++) {
 			dc.SetPen(cat_data.GetCategoryColor(cc_ts, cat));
-			//dc.SetBrush(cat_data.GetCategoryBrush(cc_ts, cat));
-			std::vector<int>& ids =	cat_data.GetIdsRef(cc_ts, cat);
-			for (int i=0, iend=ids.size(); i<iend; i++) {
-				p = (GdaPoint*) selectable_shps[ids[i]];
-				if (p->isNull()) continue;
-				dc.DrawCircle(p->center.x, p->center.y, r);
-				//if (!dirty[p->center.x + p->center.y*w]) {
-					//dc.DrawCircle(p->center.x, p->center.y, r);
-					//dirty[p->center.x + p->center.y*w] = true;
-				//}
-			}
+			DrawPointMarks(dc, selectable_shps, cat_data.GetIdsRef(cc_ts, cat),
+						   point_raster);
 		}
 	} else if (selectable_shps_type == polygons) {
-		std::vector<bool> dirty(w*h, false);
-		GdaPolygon* p;
 		for (int cat=0; cat<num_cats; cat++) {
 			if (selectable_outline_visible) {
 				dc.SetPen(cat_data.GetCategoryPen(cc_ts, cat));
 			}
 			dc.SetBrush(cat_data.GetCategoryBrush(cc_ts, cat));
-			std::vector<int>& ids =	cat_data.GetIdsRef(cc_ts, cat);
-			for (int i=0, iend=ids.size(); i<iend; i++) {
-				p = (GdaPolygon*) selectable_shps[ids[i]];
-				if (p->isNull()) continue;
-				if (p->all_points_same) {
-					dc.DrawPoint(p->center.x, p->center.y);
-					//if (!dirty[p->center.x + p->center.y*w]) {
-						//dc.DrawPoint(p->center.x, p->center.y);
-						//dirty[p->center.x + p->center.y*w] = true;
-					//}
-				} else {
-					//dirty[p->points[0].x + p->points[0].y*w] = true;
-					if (p->n_count > 1) {
-						dc.DrawPolyPolygon(p->n_count, p->count, p->points);
-					} else {
-						dc.DrawPolygon(p->n, p->points);
-					}
-				}
-			}
+			DrawPolygons(dc, selectable_shps, cat_data.GetIdsRef(cc_ts, cat));
 		}
 	} else if (selectable_shps_type == circles) {
 		// Only Bubble Chart uses circles currently, but Bubble Chart uses
@@ -1260,6 +1527,39 @@ void TemplateCanvas::DrawSelectableShapes_gen_dc(wxDC &dc)
 	}
 }
 
+void TemplateCanvas::DrawPointMarks(wxDC& dc,
+									const std::vector<GdaShape*>& shps,
+									const std::vector<int>& ids,
+									PointRaster& raster)
+{
+	std::vector<int> kept;
+	raster.Decimate(ids, kept);
+	wxDouble r = GdaConst::my_point_click_radius;
+	GdaPoint* p;
+	for (int i=0, iend=kept.size(); i<iend; i++) {
+		p = (GdaPoint*) shps[kept[i]];
+		dc.DrawCircle(p->center.x, p->center.y, r);
+	}
+}
+
+void TemplateCanvas::DrawPolygons(wxDC& dc,
+								  const std::vector<GdaShape*>& shps,
+								  const std::vector<int>& ids)
+{
+	GdaPolygon* p;
+	for (int i=0, iend=ids.size(); i<iend; i++) {
+		p = (GdaPolygon*) shps[ids[i]];
+		if (p->isNull()) continue;
+		if (p->all_points_same) {
+			dc.DrawPoint(p->center.x, p->center.y);
+		} else if (p->n_count > 1) {
+			dc.DrawPolyPolygon(p->n_count, p->count, p->points);
+		} else {
+			dc.DrawPolygon(p->n, p->points);
+		}
+	}
+}
+
 // draw highlighted selectable shapes
 void TemplateCanvas::DrawHighlightedShapes(wxMemoryDC &dc)
 {
@@ -1297,22 +1597,17 @@ void TemplateCanvas::DrawHighlightedShapes_gc(wxMemoryDC &dc)
 	int h = layer0_bm->GetHeight();
 	
 	if (selectable_shps_type == points) {
-		//std::vector<bool> dirty(w*h, false);
+		BinSelectablePoints(w, h);
+		std::vector<int> kept;
+		point_raster.DecimateHighlighted(hs, kept);
 		GdaPoint* p;
 		gc->SetAntialiasMode(wxANTIALIAS_NONE);
 		gc->SetPen(wxPen(highlight_color));
 		wxGraphicsPath path = gc->CreatePath();
 		wxDouble r = GdaConst::my_point_click_radius;
-		for (int i=0, iend=selectable_shps.size(); i<iend; i++) {
-			if (hs[i]) {
-				p = (GdaPoint*) selectable_shps[i];
-				if (p->isNull()) continue;
-				path.AddCircle(p->center.x, p->center.y, r);
-				//if (!dirty[p->center.x + p->center.y*w]) {
-					//path.AddCircle(p->center.x, p->center.y, r);
-					//dirty[p->center.x + p->center.y*w] = true;
-				//}
-			}
+		for (int i=0, iend=kept.size(); i<iend; i++) {
+			p = (GdaPoint*) selectable_shps[kept[i]];
+			path.AddCircle(p->center.x, p->center.y, r);
 		}
 		gc->StrokePath(path);
 	} else if (selectable_shps_type == polygons) {
@@ -1438,21 +1733,16 @@ void TemplateCanvas::DrawHighlightedShapes_gen_dc(wxDC &dc,
 	int h = layer0_bm->GetHeight();
 	
 	if (selectable_shps_type == points) {
-		std::vector<bool> dirty(w*h, false);
+		BinSelectablePoints(w, h);
+		std::vector<int> kept;
+		point_raster.DecimateHighlighted(hs, kept);
 		GdaPoint* p;
 		dc.SetPen(hc_pen);
 		dc.SetBrush(*wxTRANSPARENT_BRUSH);
 		wxDouble r = GdaConst::my_point_click_radius;
-		for (int i=0, iend=selectable_shps.size(); i<iend; i++) {
-			if (hs[i]) {
-				p = (GdaPoint*) selectable_shps[i];
-				if (p->isNull()) continue;
-				dc.DrawCircle(p->center.x, p->center.y, r);
-				//if (!dirty[p->center.x + p->center.y*w]) {
-					//dc.DrawCircle(p->center.x, p->center.y, r);
-					//dirty[p->center.x + p->center.y*w] = true;
-				//}
-			}
+		for (int i=0, iend=kept.size(); i<iend; i++) {
+			p = (GdaPoint*) selectable_shps[kept[i]];
+			dc.DrawCircle(p->center.x, p->center.y, r);
 		}
 	} else if (selectable_shps_type == polygons) {
 		//std::vector<bool> dirty(w*h, false);
@@ -1543,20 +1833,17 @@ void TemplateCanvas::DrawNewSelShapes_gc(wxMemoryDC &dc)
 	std::vector<int>& nh = highlight_state->GetNewlyHighlighted();
 	
 	if (selectable_shps_type == points) {
-		std::vector<bool> dirty(w*h, false);
+		BinSelectablePoints(w, h);
+		std::vector<int> kept;
+		if (total > 0) point_raster.Decimate(&nh[0], total, kept);
 		GdaPoint* p;
 		gc->SetAntialiasMode(wxANTIALIAS_NONE);
 		gc->SetPen(hc_pen);
 		wxGraphicsPath path = gc->CreatePath();
 		wxDouble r = GdaConst::my_point_click_radius;
-		for (int i=0; i<total; i++) {
-			p = (GdaPoint*) selectable_shps[nh[i]];
-			if (p->isNull()) continue;
+		for (int i=0, iend=kept.size(); i<iend; i++) {
+			p = (GdaPoint*) selectable_shps[kept[i]];
 			path.AddCircle(p->center.x, p->center.y, r);
-			//if (!dirty[p->center.x + p->center.y*w]) {
-				//path.AddCircle(p->center.x, p->center.y, r);
-				//dirty[p->center.x + p->center.y*w] = true;
-			//}
 		}
 		gc->StrokePath(path);
 	} else if (selectable_shps_type == polygons) {
@@ -1651,19 +1938,16 @@ void TemplateCanvas::DrawNewSelShapes_dc(wxMemoryDC &dc)
 	std::vector<int>& nh = highlight_state->GetNewlyHighlighted();
 	
 	if (selectable_shps_type == points) {
-		std::vector<bool> dirty(w*h, false);
+		BinSelectablePoints(w, h);
+		std::vector<int> kept;
+		if (total > 0) point_raster.Decimate(&nh[0], total, kept);
 		dc.SetPen(hc_pen);
 		dc.SetBrush(*wxTRANSPARENT_BRUSH);
 		GdaPoint* p;
 		wxDouble r = GdaConst::my_point_click_radius;
-		for (int i=0; i<total; i++) {
-			p = (GdaPoint*) selectable_shps[nh[i]];
-			if (p->isNull()) continue;
+		for (int i=0, iend=kept.size(); i<iend; i++) {
+			p = (GdaPoint*) selectable_shps[kept[i]];
 			dc.DrawCircle(p->center.x, p->center.y, r);
-			//if (!dirty[p->center.x + p->center.y*w]) {
-				//dc.DrawCircle(p->center.x, p->center.y, r);
-				//dirty[p->center.x + p->center.y*w] = true;
-			//}
 		}
 	} else if (selectable_shps_type == polygons) {
 		GdaPolygon* p;
@@ -1747,25 +2031,22 @@ void TemplateCanvas::EraseNewUnSelShapes_gc(wxMemoryDC &dc)
 	int h = layer0_bm->GetHeight();
 	
 	if (selectable_shps_type == points) {
-		//std::vector<bool> dirty(w*h, false);
+		BinSelectablePoints(w, h);
+		std::vector<int> kept;
 		GdaPoint* p;
 		gc->SetAntialiasMode(wxANTIALIAS_NONE);
 		wxDouble r = GdaConst::my_point_click_radius;
 		for (int cat=0; cat<num_cats; cat++) {
 			gc->SetPen(cat_data.GetCategoryColor(cc_ts, cat));
-			//wxColour c(cat_data.GetCategoryColor(cc_ts, cat));
-			//LOG_MSG(wxString::Format("GetCategoryColor(%d, %d): %d,%d,%d",
-			//						 cc_ts, cat, (int) c.Red(),
-			//						 (int) c.Green(), (int) c.Blue()));
+			kept.clear();
+			if (total_in_cat[cat] > 0) {
+				point_raster.Decimate(&scratch[cat][0], total_in_cat[cat],
+									  kept);
+			}
 			wxGraphicsPath path = gc->CreatePath();
-			for (int i=0, iend=total_in_cat[cat]; i<iend; i++) {
-				p = (GdaPoint*) selectable_shps[scratch[cat][i]];
-				if (p->isNull()) continue;
+			for (int i=0, iend=kept.size(); i<iend; i++) {
+				p = (GdaPoint*) selectable_shps[kept[i]];
 				path.AddCircle(p->center.x, p->center.y, r);
-				//if (!dirty[p->center.x + p->center.y*w]) {
-					//path.AddCircle(p->center.x, p->center.y, r);
-					//dirty[p->center.x + p->center.y*w] = true;
-				//}
 			}
 			gc->StrokePath(path);
 		}
@@ -1859,20 +2140,21 @@ void TemplateCanvas::EraseNewUnSelShapes_dc(wxMemoryDC &dc)
 	int h = layer0_bm->GetHeight();
 	
 	if (selectable_shps_type == points) {
+		BinSelectablePoints(w, h);
+		std::vector<int> kept;
 		dc.SetBrush(*wxTRANSPARENT_BRUSH);
-		//std::vector<bool> dirty(w*h, false);
 		GdaPoint* p;
 		wxDouble r = GdaConst::my_point_click_radius;
 		for (int cat=0; cat<num_cats; cat++) {
 			dc.SetPen(cat_data.GetCategoryColor(cc_ts, cat));
-			for (int i=0, iend=total_in_cat[cat]; i<iend; i++) {
-				p = (GdaPoint*) selectable_shps[scratch[cat][i]];
-				if (p->isNull()) continue;
+			kept.clear();
+			if (total_in_cat[cat] > 0) {
+				point_raster.Decimate(&scratch[cat][0], total_in_cat[cat],
+									  kept);
+			}
+			for (int i=0, iend=kept.size(); i<iend; i++) {
+				p = (GdaPoint*) selectable_shps[kept[i]];
 				dc.DrawCircle(p->center.x, p->center.y, r);
-				//if (!dirty[p->center.x + p->center.y*w]) {
-					//dc.DrawCircle(p->center.x, p->center.y, r);
-					//dirty[p->center.x + p->center.y*w] = true;
-				//}
 			}
 		}
 	} else if (selectable_shps_type == polygons) {
@@ -1950,6 +2232,9 @@ void TemplateCanvas::OnEraseBackground(wxEraseEvent& event)
 
 void TemplateCanvas::OnMouseEvent(wxMouseEvent& event)
 {
+	// selection needs the shapes at their current screen positions
+	FinishScaleTrans();
+	
 	// Capture the mouse when left mouse button is down.
 	if (event.LeftIsDown() && !HasCapture()) CaptureMouse();
 	if (event.LeftUp() && HasCapture()) ReleaseMouse();
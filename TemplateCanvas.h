@@ -21,6 +21,7 @@
 #define __GEODA_CENTER_TEMPLATE_CANVAS_H__
 
 #include <list>
+#include <map>
 #include <set> // for std::multiset template
 #include <vector>
 #include <boost/multi_array.hpp>
@@ -29,9 +30,12 @@
 #include <wx/overlay.h>
 #include <wx/scrolwin.h>
 #include <wx/string.h>
+#include <wx/timer.h>
 #include "Explore/CatClassification.h"
 #include "Generic/HighlightStateObserver.h"
 #include "Generic/GdaShape.h"
+#include "Generic/PointRaster.h"
+#include "Generic/ScaleTransBatch.h"
 //#include "ShapeOperations/QuadTree.h"
 
 typedef boost::multi_array<GdaShape*, 2> shp_array_type;
@@ -40,6 +44,17 @@ typedef boost::multi_array<int, 2> i_array_type;
 class CatClassifManager;
 class Project;
 class TemplateFrame;
+class TemplateCanvas;
+
+class ScaleTransTimer : public wxTimer
+{
+public:
+	ScaleTransTimer(TemplateCanvas* canvas);
+	virtual ~ScaleTransTimer();
+	
+	TemplateCanvas* canvas;
+	virtual void Notify();
+};
 
 /** TemplateCanvas is a base class that implements most of the
  functionality associated with selecting polygons.  It is the base
@@ -74,6 +89,12 @@ public:
 	
 	enum SelectableShpType { mixed, circles, points, rectangles, polygons,
 		polylines };
+	
+	/** Unhighlighted points can be drawn as marks, one per occupied pixel
+	 and category, or summarized as point counts in small squares or
+	 hexagons colored with a sequential ramp.  Highlighted points are always
+	 drawn as marks. */
+	enum PointRenderMode { point_marks, point_density, point_hexbin };
 
 public:
 	/** Colors */
@@ -191,6 +212,16 @@ public:
 	
 	static void AppendCustomCategories(wxMenu* menu, CatClassifManager* ccm);
 	
+	/** Draw the GdaPoints shps[ids[i]] with the current pen and brush, one
+	 mark per pixel of raster occupied by them.  raster must be binned from
+	 shps. */
+	static void DrawPointMarks(wxDC& dc, const std::vector<GdaShape*>& shps,
+							   const std::vector<int>& ids,
+							   PointRaster& raster);
+	/** Draw the GdaPolygons shps[ids[i]] with the current pen and brush. */
+	static void DrawPolygons(wxDC& dc, const std::vector<GdaShape*>& shps,
+							 const std::vector<int>& ids);
+	
 	virtual void DrawGdaSelShape(int i, wxDC& dc);
 		
 	virtual void UpdateSelection(bool shiftdown = false,
@@ -349,7 +380,59 @@ protected:
 	bool layer1_valid; // if false, then needs to be redrawn
 	bool layer2_valid; // if flase, then needs to be redrawn
 	
+	/** Bounded cache of layer0 frames keyed by canvas time step.  When
+	 enabled, stepping through time periods reuses frames rendered ahead of
+	 time by PrerenderFrame rather than repainting every shape.  The cache
+	 is cleared whenever anything other than the time step changes. */
+	std::map<int, wxBitmap*> frame_cache;
+	std::list<int> frame_cache_lru; // most recently used time step first
+	bool frame_cache_enabled;
+	bool frame_switch_pending; // layer0_bm still holds frame for layer0_tm
+	int layer0_tm; // canvas time step rendered in layer0_bm
+	void CacheFrame(int canvas_tm, wxBitmap* bm);
+	void PaintLayer0(wxMemoryDC& dc, const wxSize& sz);
+	
+	PointRenderMode point_render_mode;
+	PointRaster point_raster;
+	/** Incremented whenever the selectable shapes are moved to new screen
+	 coordinates.  point_raster is only binned again when this or the
+	 canvas size has changed since it was last binned. */
+	int scale_trans_gen;
+	int point_raster_gen;
+	void BinSelectablePoints(int w, int h);
+	void DrawPointDensity(wxDC& dc, int w, int h);
+	
+	/** Selectable shapes are transformed in one parallel batch.  When the
+	 canvas is resized by the user, large layers are transformed on a
+	 background thread and the result is committed by scale_trans_timer.
+	 Until then only the canvas background is painted, and each further
+	 resize supersedes the transform in progress.  Cancel it before
+	 selectable_shps is cleared or rebuilt. */
+	ScaleTransBatch scale_trans_batch;
+	ScaleTransTimer* scale_trans_timer;
+	bool resize_in_background;
+	
+public:
+	/** Called by scale_trans_timer while a background transform is
+	 pending. */
+	void OnScaleTransTimer();
+	/** Wait for a pending background transform and commit it. */
+	void FinishScaleTrans();
+	
 public:
+	void EnableFrameCache(bool enable);
+	void ClearFrameCache();
+	void SwitchFrame(int canvas_tm);
+	bool PrerenderFrame(int canvas_tm);
+	/** Render the frame for the given global time period ahead of time
+	 so that the next TimeChange is cheap.  Default does nothing. */
+	virtual void PrerenderTime(int time) {}
+
+	void SetPointRenderMode(PointRenderMode mode);
+	PointRenderMode GetPointRenderMode() { return point_render_mode; }
+	bool HasSelectablePoints() { return selectable_shps_type == points; }
+	bool IsPointDensityShown();
+
 	void RenderToDC(wxDC &dc, bool disable_crosshatch_brush = true);
 	const wxBitmap* GetLayer1() { return layer1_bm; }
 	const wxBitmap* GetLayer2() { return layer2_bm; }
@@ -110,6 +110,27 @@ void TemplateFrame::OnSelectionMode(wxCommandEvent& event)
 	UpdateOptionMenuItems();
 }
 
+void TemplateFrame::OnPointRenderMarks(wxCommandEvent& event)
+{
+	if (!template_canvas) return;
+	template_canvas->SetPointRenderMode(TemplateCanvas::point_marks);
+	UpdateOptionMenuItems();
+}
+
+void TemplateFrame::OnPointRenderDensity(wxCommandEvent& event)
+{
+	if (!template_canvas) return;
+	template_canvas->SetPointRenderMode(TemplateCanvas::point_density);
+	UpdateOptionMenuItems();
+}
+
+void TemplateFrame::OnPointRenderHexbin(wxCommandEvent& event)
+{
+	if (!template_canvas) return;
+	template_canvas->SetPointRenderMode(TemplateCanvas::point_hexbin);
+	UpdateOptionMenuItems();
+}
+
 void TemplateFrame::OnResetMap(wxCommandEvent& event)
 {
 	LOG_MSG("Called TemplateFrame::OnResetMap");
@@ -195,6 +216,22 @@ void TemplateFrame::UpdateOptionMenuItems()
 	GeneralWxUtils::CheckMenuItem(mb, XRCID("ID_SELECTABLE_OUTLINE_VISIBLE"),
 								  template_canvas->
 									IsSelectableOutlineVisible());
+	GeneralWxUtils::CheckMenuItem(mb, XRCID("ID_POINT_RENDER_MARKS"),
+								  template_canvas->GetPointRenderMode() ==
+								  TemplateCanvas::point_marks);
+	GeneralWxUtils::CheckMenuItem(mb, XRCID("ID_POINT_RENDER_DENSITY"),
+								  template_canvas->GetPointRenderMode() ==
+								  TemplateCanvas::point_density);
+	GeneralWxUtils::CheckMenuItem(mb, XRCID("ID_POINT_RENDER_HEXBIN"),
+								  template_canvas->GetPointRenderMode() ==
+								  TemplateCanvas::point_hexbin);
+	bool has_points = template_canvas->HasSelectablePoints();
+	GeneralWxUtils::EnableMenuItem(mb, XRCID("ID_POINT_RENDER_MARKS"),
+								   has_points);
+	GeneralWxUtils::EnableMenuItem(mb, XRCID("ID_POINT_RENDER_DENSITY"),
+								   has_points);
+	GeneralWxUtils::EnableMenuItem(mb, XRCID("ID_POINT_RENDER_HEXBIN"),
+								   has_points);
 	GeneralWxUtils::CheckMenuItem(mb, XRCID("ID_DISPLAY_STATUS_BAR"),
 								  IsStatusBarVisible());
 }
@@ -231,6 +268,22 @@ void TemplateFrame::UpdateContextMenuItems(wxMenu* menu)
 	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_SELECTABLE_OUTLINE_VISIBLE"),
 								  template_canvas->
 									IsSelectableOutlineVisible());
+	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_POINT_RENDER_MARKS"),
+								  template_canvas->GetPointRenderMode() ==
+								  TemplateCanvas::point_marks);
+	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_POINT_RENDER_DENSITY"),
+								  template_canvas->GetPointRenderMode() ==
+								  TemplateCanvas::point_density);
+	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_POINT_RENDER_HEXBIN"),
+								  template_canvas->GetPointRenderMode() ==
+								  TemplateCanvas::point_hexbin);
+	bool has_points = template_canvas->HasSelectablePoints();
+	GeneralWxUtils::EnableMenuItem(menu, XRCID("ID_POINT_RENDER_MARKS"),
+								   has_points);
+	GeneralWxUtils::EnableMenuItem(menu, XRCID("ID_POINT_RENDER_DENSITY"),
+								   has_points);
+	GeneralWxUtils::EnableMenuItem(menu, XRCID("ID_POINT_RENDER_HEXBIN"),
+								   has_points);
 	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_DISPLAY_STATUS_BAR"),
 								  IsStatusBarVisible());
 }
@@ -689,6 +742,11 @@ void TemplateFrame::update(TimeState* o)
 {
 }
 
+void TemplateFrame::PrepareTime(int next_time)
+{
+	if (template_canvas) template_canvas->PrerenderTime(next_time);
+}
+
 bool TemplateFrame::AllowTimelineChanges()
 {
 	if (supports_timeline_changes) return true;
@@ -76,6 +76,9 @@ public:
 	virtual void OnFixedAspectRatioMode(wxCommandEvent& event);
 	virtual void OnZoomMode(wxCommandEvent& event);
 	virtual void OnPanMode(wxCommandEvent& event);
+	virtual void OnPointRenderMarks(wxCommandEvent& event);
+	virtual void OnPointRenderDensity(wxCommandEvent& event);
+	virtual void OnPointRenderHexbin(wxCommandEvent& event);
 	virtual void OnPrintCanvasState(wxCommandEvent& event);
 	virtual void UpdateOptionMenuItems();
 	virtual void UpdateContextMenuItems(wxMenu* menu);
@@ -99,6 +102,9 @@ public:
 	virtual void update(TableState* o);
 	/** Default Implementation of TimeStateObserver interface */
 	virtual void update(TimeState* o);
+	/** Default Implementation of TimeStateObserver interface.  Asks
+	 template_canvas to render the frame for next_time ahead of time. */
+	virtual void PrepareTime(int next_time);
 	/** Default Implementation of TableStateObserver interface.  Indicates if
 	 frame currently handle changes to time-line.  This is a function
 	 of private boolean variables depends_on_non_simple_groups 
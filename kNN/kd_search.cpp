@@ -73,17 +73,10 @@
 //----------------------------------------------------------------------
 
 //----------------------------------------------------------------------
-//	To keep argument lists short, a number of global variables
-//	are maintained which are common to all the recursive calls.
-//	These are given below.
+//	The values common to all the recursive calls are kept in an
+//	ANNkdSearch on the stack of annkSearch (see kd_search.h).
 //----------------------------------------------------------------------
 
-int						ANNkdDim;				// dimension of space
-ANNpoint			ANNkdQ;					// query point
-double				ANNkdMaxErr;		// max tolerable squared error
-ANNpointArray	ANNkdPts;				// the points
-ANNmin_k		 *ANNkdPointMK;		// set of k closest points
-
 //----------------------------------------------------------------------
 //  annkSearch - search for the k nearest neighbors
 //----------------------------------------------------------------------
@@ -98,49 +91,50 @@ void ANNkd_tree::annkSearch(
 
 {
 
-	ANNkdDim = dim;			// copy arguments to static equivs
-	ANNkdQ	 = q;
-	ANNkdPts = pts;
-	ANNptsVisited = 0;			// initialize count of points visited
+	ANNkdSearch s;			// copy arguments to search state
+	s.dim = dim;
+	s.q	 = q;
+	s.pts = pts;
+	s.pts_visited = 0;			// initialize count of points visited
 
 	if (k > n_pts) 
 	{			// too many near neighbors?
 		annError("Requesting more near neighbors than data points", ANNabort);
 	}
 
-	ANNkdMaxErr = ANN_POW(1.0 + eps);
+	s.max_err = ANN_POW(1.0 + eps);
 	FLOP(2)				// increment floating op count
 
-	ANNkdPointMK = new ANNmin_k(k);	// create set for closest k points
+	ANNmin_k point_mk(k);		// create set for closest k points
+	s.point_mk = &point_mk;
 	// search starting at the root
-	root->ann_search(annBoxDistance(q, bnd_box_lo, bnd_box_hi, dim), method);
+	root->ann_search(annBoxDistance(q, bnd_box_lo, bnd_box_hi, dim), method,
+					 s);
 
 	for (int i = 0; i < k; i++) 
 	{	// extract the k-th closest points
-		dd[i] = ANNkdPointMK->ith_smallest_key(i);
-		nn_idx[i] = ANNkdPointMK->ith_smallest_info(i);
+		dd[i] = point_mk.ith_smallest_key(i);
+		nn_idx[i] = point_mk.ith_smallest_info(i);
 	}
-	delete ANNkdPointMK;		// deallocate closest point set
-	ANNkdPointMK = NULL;
 }
 
 //----------------------------------------------------------------------
 //  kd_split::ann_search - search a splitting node
 //----------------------------------------------------------------------
 
-void ANNkd_split::ann_search(ANNdist box_dist, int method)
+void ANNkd_split::ann_search(ANNdist box_dist, int method, ANNkdSearch& s)
 {
 	// check dist calc termination condition
-	if (ANNmaxPtsVisited && ANNptsVisited > ANNmaxPtsVisited) return;
+	if (ANNmaxPtsVisited && s.pts_visited > ANNmaxPtsVisited) return;
 
 	// distance to cutting plane
-	ANNcoord cut_diff = ANNkdQ[cut_dim] - cut_val;
+	ANNcoord cut_diff = s.q[cut_dim] - cut_val;
 
 	if (cut_diff < 0) 
 	{			// left of cutting plane
-		child[LO]->ann_search(box_dist, method);// visit closer child first
+		child[LO]->ann_search(box_dist, method, s);// visit closer child first
 
-		ANNcoord box_diff = cd_bnds[LO] - ANNkdQ[cut_dim];
+		ANNcoord box_diff = cd_bnds[LO] - s.q[cut_dim];
 		if (box_diff < 0)		// within bounds - ignore
 		box_diff = 0;
 		// distance to further box
@@ -148,15 +142,15 @@ void ANNkd_split::ann_search(ANNdist box_dist, int method)
 		            ANN_DIFF(ANN_POW(box_diff), ANN_POW(cut_diff)));
 
 		// visit further child if close enough
-		if (box_dist * ANNkdMaxErr < ANNkdPointMK->max_key())
-			child[HI]->ann_search(box_dist, method);
+		if (box_dist * s.max_err < s.point_mk->max_key())
+			child[HI]->ann_search(box_dist, method, s);
 
 	}
 	else 
 	{				// right of cutting plane
-		child[HI]->ann_search(box_dist, method);// visit closer child first
+		child[HI]->ann_search(box_dist, method, s);// visit closer child first
 
-		ANNcoord box_diff = ANNkdQ[cut_dim] - cd_bnds[HI];
+		ANNcoord box_diff = s.q[cut_dim] - cd_bnds[HI];
 		if (box_diff < 0)		// within bounds - ignore
 		box_diff = 0;
 		// distance to further box
@@ -164,8 +158,8 @@ void ANNkd_split::ann_search(ANNdist box_dist, int method)
 		            ANN_DIFF(ANN_POW(box_diff), ANN_POW(cut_diff)));
 
 		// visit further child if close enough
-		if (box_dist * ANNkdMaxErr < ANNkdPointMK->max_key())
-			child[LO]->ann_search(box_dist, method);
+		if (box_dist * s.max_err < s.point_mk->max_key())
+			child[LO]->ann_search(box_dist, method, s);
 	}
 	FLOP(10)				// increment floating ops
 	SPL(1)				// one more splitting node visited
@@ -180,7 +174,7 @@ void ANNkd_split::ann_search(ANNdist box_dist, int method)
 
 // adding ArcDist computation
 
-void ANNkd_leaf::ann_search(ANNdist box_dist, int method)
+void ANNkd_leaf::ann_search(ANNdist box_dist, int method, ANNkdSearch& s)
 {
 	register ANNdist dist;		// distance to data point
 	register ANNcoord* pp;		// data coordinate pointer
@@ -189,7 +183,7 @@ void ANNkd_leaf::ann_search(ANNdist box_dist, int method)
 	register ANNcoord t;
 	register int d;
 
-	min_dist = ANNkdPointMK->max_key();	// k-th smallest distance so far
+	min_dist = s.point_mk->max_key();	// k-th smallest distance so far
   int i = 0;
 	switch (method)
 	{
@@ -197,11 +191,11 @@ void ANNkd_leaf::ann_search(ANNdist box_dist, int method)
 			for (i = 0; i < n_pts; i++) 
 			{	// check points in bucket
 
-				pp = ANNkdPts[bkt[i]];		// first coord of next data point
-				qq = ANNkdQ; 	    		// first coord of query point
+				pp = s.pts[bkt[i]];		// first coord of next data point
+				qq = s.q; 	    		// first coord of query point
 				dist = 0;
 
-				for(d = 0; d < ANNkdDim; d++) 
+				for(d = 0; d < s.dim; d++) 
 				{
 					COORD(1)			// one more coordinate hit
 					FLOP(4)			// increment floating ops
@@ -214,12 +208,12 @@ void ANNkd_leaf::ann_search(ANNdist box_dist, int method)
 					}
 				}
 
-				if (d >= ANNkdDim &&			// among the k best?
+				if (d >= s.dim &&			// among the k best?
 				(ANN_ALLOW_SELF_MATCH || dist!=0)) 
 				{	// and no self-match problem
 					// add it to the list
-					ANNkdPointMK->insert(dist, bkt[i]);
-					min_dist = ANNkdPointMK->max_key();
+					s.point_mk->insert(dist, bkt[i]);
+					min_dist = s.point_mk->max_key();
 				}
 			}
 			break;
@@ -227,12 +221,12 @@ void ANNkd_leaf::ann_search(ANNdist box_dist, int method)
 			for (i = 0; i < n_pts; i++) 
 			{	// check points in bucket
 
-				pp = ANNkdPts[bkt[i]];		// first coord of next data point
-				qq = ANNkdQ; 	    		// first coord of query point
+				pp = s.pts[bkt[i]];		// first coord of next data point
+				qq = s.q; 	    		// first coord of query point
 				dist = 0;
 				double x[4];
 
-				for(d = 0; d < ANNkdDim; d++) 
+				for(d = 0; d < s.dim; d++) 
 				{
 					COORD(1)			// one more coordinate hit
 					FLOP(4)			// increment floating ops
@@ -250,8 +244,8 @@ void ANNkd_leaf::ann_search(ANNdist box_dist, int method)
 				if (ANN_ALLOW_SELF_MATCH || dist!=0) 
 				{	// and no self-match problem
 					// add it to the list
-					ANNkdPointMK->insert(dist, bkt[i]);
-					min_dist = ANNkdPointMK->max_key();
+					s.point_mk->insert(dist, bkt[i]);
+					min_dist = s.point_mk->max_key();
 				}
 			}
 			
@@ -262,9 +256,6 @@ void ANNkd_leaf::ann_search(ANNdist box_dist, int method)
 
 	LEAF(1)				// one more leaf node visited
 	PTS(n_pts)				// increment points visited
-	ANNptsVisited += n_pts;		// increment number of points visited
-
-	char buf[333];
-	sprintf(buf,"Visited: %d, %f\n",n_pts,min_dist);
+	s.pts_visited += n_pts;		// increment number of points visited
 }
 
@@ -30,18 +30,20 @@
 #include "ANNperf.h"		// performance evaluation
 
 //----------------------------------------------------------------------
-//  More global variables
-//	These are active for the life of each call to Appx_Near_Neigh()
-//	or Appx_k_Near_Neigh().  They are set to save the number of
-//	variables that need to be passed among the various search
-//	procedures.
+//  Search state
+//	These are active for the life of each call to annkSearch().
+//	They used to be global variables; they are passed down the
+//	recursive search instead, so that several threads can search
+//	the same tree at once.
 //----------------------------------------------------------------------
 
-extern int		ANNkdDim;	// dimension of space (static copy)
-extern ANNpoint		ANNkdQ;		// query point (static copy)
-extern double		ANNkdMaxErr;	// max tolerable squared error
-extern ANNpointArray	ANNkdPts;	// the points (static copy)
-extern ANNmin_k		*ANNkdPointMK;	// set of k closest points
-extern int		ANNptsVisited;	// number of points visited
+struct ANNkdSearch {
+    int			dim;		// dimension of space
+    ANNpoint		q;		// query point
+    double		max_err;	// max tolerable squared error
+    ANNpointArray	pts;		// the points
+    ANNmin_k		*point_mk;	// set of k closest points
+    int			pts_visited;	// number of points visited
+};
 
 #endif
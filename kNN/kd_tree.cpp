@@ -37,12 +37,12 @@
 //  contains no points.  For messy coding reasons it is convenient
 //  to have it reference a trivial point index.
 //
-//  KD_TRIVIAL is allocated when the first kd-tree is created.  It
-//  must *never* deallocated (since it may be shared by more than
-//  one tree).
+//  KD_TRIVIAL is allocated during static initialization, so that
+//  trees may be created from several threads at once.  It must
+//  *never* deallocated (since it may be shared by more than one tree).
 //----------------------------------------------------------------------
 static int  		IDX_TRIVIAL[] = {0};	// trivial point index
-ANNkd_leaf		*KD_TRIVIAL = NULL;	// trivial leaf node
+ANNkd_leaf		*KD_TRIVIAL = new ANNkd_leaf(0, IDX_TRIVIAL); // trivial leaf
 
 //----------------------------------------------------------------------
 //  Printing the kd-tree 
@@ -2,11 +2,13 @@
 #ifndef ANN_kd_tree_H
 #define ANN_kd_tree_H
 
+struct ANNkdSearch;			// state of one standard search
+
 class ANNkd_node{			// generic kd-tree node (empty shell)
 public:
     virtual ~ANNkd_node() {}			// virtual distroyer
 
-    virtual void ann_search(ANNdist, int) = 0;	// tree search
+    virtual void ann_search(ANNdist, int, ANNkdSearch&) = 0; // tree search
     virtual void ann_pri_search(ANNdist) = 0;	// priority search
 
 
@@ -39,7 +41,7 @@ public:
   ~ANNkd_leaf() { }			// destructor (none)
 //	ANNkd_leaf::CalcLatLongDist(double lat1, double long1, double lat2, double long2) ;
 
-  virtual void ann_search(ANNdist, int);		// standard search routine
+  virtual void ann_search(ANNdist, int, ANNkdSearch&); // standard search
   virtual void ann_pri_search(ANNdist);	// priority search routine
 };
 
@@ -97,7 +99,7 @@ public:
 		child[HI] = NULL;
 	}
 
-    virtual void ann_search(ANNdist, int);		// standard search routine
+    virtual void ann_search(ANNdist, int, ANNkdSearch&); // standard search
     virtual void ann_pri_search(ANNdist);	// priority search routine
 };
 